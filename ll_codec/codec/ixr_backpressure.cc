@@ -0,0 +1,399 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Backpressure between the capture thread and an encoder
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_backpressure.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "ll_codec/codec/ixr_capture.h"
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+// offers before the divisor of IXR_OVERLOAD_REDUCE_FPS is doubled again in
+// an overload, or halved once it's calm, about a second of 30 fps
+constexpr uint64_t kSettleFrames = 30;
+constexpr uint32_t kDefaultMaxDivisor = 8;
+
+int64_t SteadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Forward to the encoder, and drop or hold frames by the controller.
+ */
+class BackpressuredEncoder : public Encoder {
+ public:
+  BackpressuredEncoder(std::unique_ptr<Encoder> impl,
+                       std::shared_ptr<BackpressureController> controller)
+      : impl_(std::move(impl)),
+        controller_(std::move(controller)),
+        inner_(nullptr),
+        writing_(IXR_FRAME_STALL),
+        captured_(0),
+        held_(false),
+        heldTime_(0),
+        codec_(IXR_CODEC_AVC),
+        rate_(0),
+        outputs_(0),
+        fps_(0),
+        throughput_(0),
+        divisor_(1) {}
+
+  void Allocate(const CodecConfig &config) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    impl_->Allocate(config);
+    // frames encoded in place can't be copied
+    const uint32_t size = config.memoryType == IXR_MEM_INTERNAL_CPU
+                              ? CaptureFrameSize(config)
+                              : 0;
+    hold_.assign(size, 0);
+    scratch_.assign(size, 0);
+    inner_ = nullptr;
+    writing_ = IXR_FRAME_STALL;
+    held_ = false;
+    codec_ = config.codec;
+    rate_ = config.fps;
+    outputs_ = 0;
+    impl_->GetFlowControlParam(&fps_, &throughput_);
+    divisor_ = 1;
+    const size_t depth = std::max<size_t>(std::max(config.asyncDepth, 1),
+                                          config.sharedMemoryId.size());
+    controller_->Reset(static_cast<uint32_t>(depth), size != 0);
+  }
+
+  void Deallocate() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    impl_->Deallocate();
+    inner_ = nullptr;
+    held_ = false;
+  }
+
+  CodecStat GetEncodeStatus() override { return impl_->GetEncodeStatus(); }
+
+  void *DequeueInputBuffer() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // a buffer of the encoder is kept until it's queued
+    if (!inner_) inner_ = impl_->DequeueInputBuffer();
+    captured_ = SteadyMicros();
+    writing_ = controller_->Offer(captured_, !inner_, held_);
+    applyDivisor();
+    switch (writing_) {
+      case IXR_FRAME_QUEUE:
+        return inner_;
+      case IXR_FRAME_HOLD:
+        held_ = false;
+        return hold_.data();
+      case IXR_FRAME_DROP:
+        return scratch_.empty() ? inner_ : scratch_.data();
+      default:
+        return nullptr;
+    }
+  }
+
+  int QueueInputBuffer(void *ptr) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const FrameAction action = writing_;
+    writing_ = IXR_FRAME_STALL;
+    if (action == IXR_FRAME_HOLD) {
+      held_ = true;
+      heldTime_ = captured_;
+      flush();
+      return 0;
+    }
+    if (action == IXR_FRAME_DROP) return 1;
+    if (action != IXR_FRAME_QUEUE) {
+      // external buffers are queued without DequeueInputBuffer
+      if (!ptr) return -1;
+      captured_ = SteadyMicros();
+      const FrameAction a = controller_->Offer(captured_, false, false);
+      applyDivisor();
+      if (a != IXR_FRAME_QUEUE) return 1;
+    }
+    return queue(ptr, captured_);
+  }
+
+  int GetDirtyRects(DirtyRect *rects, uint32_t *count) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->GetDirtyRects(rects, count);
+  }
+
+  int QueueUserData(void *data, uint32_t size) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->QueueUserData(data, size);
+  }
+
+  int DequeueUserData(void *data, uint32_t *size) override {
+    return impl_->DequeueUserData(data, size);
+  }
+
+  int QueueSeiPayload(uint32_t type, const void *data,
+                      uint32_t size) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->QueueSeiPayload(type, data, size);
+  }
+
+  int QueueTimeCode(const TimeCode &timecode) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->QueueTimeCode(timecode);
+  }
+
+  int QueueRegionOfInterest(const RegionOfInterest *regions,
+                            uint32_t count) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->QueueRegionOfInterest(regions, count);
+  }
+
+  int DequeueOutputBuffer(void **ptr, uint32_t *size) override {
+    const int ret = impl_->DequeueOutputBuffer(ptr, size);
+    if (ret == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      outputs_++;
+      controller_->Completed(SteadyMicros());
+      applyDivisor();
+      flush();
+    }
+    return ret;
+  }
+
+  int GetSliceOffsets(uint32_t *offsets, uint32_t *count) override {
+    return impl_->GetSliceOffsets(offsets, count);
+  }
+
+  int DequeueOutputSegments(OutputDescriptor *desc) override {
+    // parts are dequeued by DequeueOutputBuffer above, so frames are counted
+    const int ret = Encoder::DequeueOutputSegments(desc);
+    const uint32_t order = ret == 0 ? outputs_ - 1 : outputs_;
+    if (ret >= 0) DescribeOutput(codec_, rate_, order, desc);
+    return ret;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    impl_->ReleaseOutputBuffer(ptr);
+  }
+
+  int RequestIntraRefresh() override { return impl_->RequestIntraRefresh(); }
+
+  int MarkLongTermReference() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return impl_->MarkLongTermReference();
+  }
+
+  int InvalidateReferences(uint32_t first, uint32_t last) override {
+    return impl_->InvalidateReferences(first, last);
+  }
+
+  //! The parameters set by the user, @see BackpressureStat::divisor
+  void GetFlowControlParam(float *fps, uint32_t *throughput) const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *fps = fps_;
+    *throughput = throughput_;
+  }
+
+  void SetFlowControlParam(const float fps,
+                           const uint32_t throughput) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fps_ = fps;
+    throughput_ = throughput;
+    impl_->SetFlowControlParam(fps / divisor_, throughput);
+  }
+
+  int JoinSession(Encoder *parent) override {
+    auto p = dynamic_cast<BackpressuredEncoder *>(parent);
+    return impl_->JoinSession(p ? p->impl_.get() : parent);
+  }
+
+ private:
+  int queue(void *ptr, int64_t captured) {
+    const int ret = impl_->QueueInputBuffer(ptr);
+    // a failed buffer is still dequeued
+    if (ret >= 0) inner_ = nullptr;
+    if (ret == 0) controller_->Queued(captured);
+    return ret;
+  }
+
+  //! Queue the held frame once the overload ends
+  void flush() {
+    if (!held_ || writing_ == IXR_FRAME_QUEUE || controller_->Overloaded()) {
+      return;
+    }
+    if (!inner_) inner_ = impl_->DequeueInputBuffer();
+    if (!inner_) return;
+    std::memcpy(inner_, hold_.data(), hold_.size());
+    held_ = false;
+    queue(inner_, heldTime_);
+  }
+
+  //! Tell the rate control the frame rate of IXR_OVERLOAD_REDUCE_FPS
+  void applyDivisor() {
+    const uint32_t divisor = controller_->Divisor();
+    if (divisor == divisor_ || fps_ <= 0) return;
+    divisor_ = divisor;
+    impl_->SetFlowControlParam(fps_ / divisor_, throughput_);
+  }
+
+  std::unique_ptr<Encoder> impl_;
+  std::shared_ptr<BackpressureController> controller_;
+  void *inner_;           // the buffer of the encoder dequeued and not queued
+  FrameAction writing_;   // the frame the capture thread is writing
+  int64_t captured_;      // when the frame is offered
+  std::vector<uint8_t> hold_;
+  std::vector<uint8_t> scratch_;
+  bool held_;
+  int64_t heldTime_;
+  CodecFourcc codec_;
+  int32_t rate_;
+  uint32_t outputs_;  // frames dequeued
+  float fps_;         // of the user, before the divisor
+  uint32_t throughput_;
+  uint32_t divisor_;
+  mutable std::mutex mutex_;
+};
+}  // namespace
+
+BackpressureController::BackpressureController(
+    const BackpressureConfig &config)
+    : config_(config) {
+  if (!config_.maxDivisor) config_.maxDivisor = kDefaultMaxDivisor;
+  Reset(1, true);
+}
+
+void BackpressureController::Reset(uint32_t capacity, bool canHold) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  high_ = config_.highDepth ? config_.highDepth : std::max(capacity, 1u);
+  low_ = config_.lowDepth ? std::min(config_.lowDepth, high_ - 1)
+                          : high_ / 2;
+  canHold_ = canHold;
+  overloaded_ = false;
+  divisor_ = 1;
+  phase_ = 0;
+  times_.clear();
+  stat_ = BackpressureStat();
+  stat_.divisor = 1;
+}
+
+FrameAction BackpressureController::Offer(int64_t now, bool full,
+                                          bool held) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stat_.offered++;
+  update(now, full, true);
+  FrameAction action = IXR_FRAME_QUEUE;
+  bool throttled = false;
+  if (config_.strategy == IXR_OVERLOAD_REDUCE_FPS) {
+    // the reduced rate lasts till it's calm, not only in the overload
+    throttled = (phase_ - 1) % divisor_ != 0;
+    action = throttled || full ? IXR_FRAME_DROP : IXR_FRAME_QUEUE;
+  } else if (overloaded_) {
+    switch (config_.strategy) {
+      case IXR_OVERLOAD_DROP_NEWEST:
+        action = IXR_FRAME_DROP;
+        break;
+      case IXR_OVERLOAD_DROP_OLDEST:
+        action = IXR_FRAME_HOLD;
+        break;
+      default:
+        action = full ? IXR_FRAME_STALL : IXR_FRAME_QUEUE;
+        break;
+    }
+  }
+  if (!canHold_ && action == IXR_FRAME_HOLD) action = IXR_FRAME_DROP;
+  // without a copy, frames are dropped into a free buffer of the encoder
+  if (!canHold_ && full && action == IXR_FRAME_DROP) action = IXR_FRAME_STALL;
+  switch (action) {
+    case IXR_FRAME_HOLD:
+      stat_.droppedOldest += held;
+      break;
+    case IXR_FRAME_DROP:
+      (throttled ? stat_.throttled : stat_.droppedNewest)++;
+      break;
+    case IXR_FRAME_STALL:
+      stat_.stalled++;
+      break;
+    default:
+      break;
+  }
+  return action;
+}
+
+void BackpressureController::Queued(int64_t time) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  times_.push_back(time);
+  stat_.queued++;
+  stat_.maxDepth =
+      std::max(stat_.maxDepth, static_cast<uint32_t>(times_.size()));
+}
+
+void BackpressureController::Completed(int64_t now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (times_.empty()) return;
+  stat_.latency = now - times_.front();
+  stat_.maxLatency = std::max(stat_.maxLatency, stat_.latency);
+  stat_.encoded++;
+  times_.pop_front();
+  update(now, false, false);
+}
+
+bool BackpressureController::Overloaded() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return overloaded_;
+}
+
+uint32_t BackpressureController::Divisor() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return divisor_;
+}
+
+BackpressureStat BackpressureController::GetStat() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  BackpressureStat stat = stat_;
+  stat.depth = static_cast<uint32_t>(times_.size());
+  stat.divisor = divisor_;
+  stat.overloaded = overloaded_;
+  return stat;
+}
+
+void BackpressureController::update(int64_t now, bool full, bool offered) {
+  const size_t depth = times_.size();
+  const int64_t age = times_.empty() ? 0 : now - times_.front();
+  const bool latency = config_.highLatency > 0;
+  const bool enter = full || depth >= high_ ||
+                     (latency && age >= config_.highLatency);
+  const bool leave =
+      !full && depth <= low_ && (!latency || age <= config_.lowLatency);
+  const bool reduce = config_.strategy == IXR_OVERLOAD_REDUCE_FPS;
+  if (!overloaded_ && enter) {
+    overloaded_ = true;
+    stat_.overloads++;
+    if (reduce) setDivisor(divisor_ * 2);
+  } else if (overloaded_ && leave) {
+    overloaded_ = false;
+    phase_ = 0;
+  } else if (reduce && phase_ >= kSettleFrames * divisor_) {
+    // still overloaded at the reduced rate, or calm long enough
+    setDivisor(overloaded_ ? divisor_ * 2 : divisor_ / 2);
+  }
+  phase_ += offered;
+}
+
+void BackpressureController::setDivisor(uint32_t divisor) {
+  divisor = std::min(std::max(divisor, 1u), config_.maxDivisor);
+  if (divisor != divisor_) phase_ = 0;
+  divisor_ = divisor;
+}
+
+std::unique_ptr<Encoder> BackpressureEncoder(
+    std::unique_ptr<Encoder> encoder,
+    std::shared_ptr<BackpressureController> controller) {
+  if (!encoder || !controller) return nullptr;
+  return std::unique_ptr<Encoder>(
+      new BackpressuredEncoder(std::move(encoder), std::move(controller)));
+}
+}  // namespace ixr
@@ -0,0 +1,148 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Backpressure between the capture thread and an encoder
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_BACKPRESSURE_H_
+#define LL_CODEC_CODEC_IXR_BACKPRESSURE_H_
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+enum OverloadStrategy {
+  /** DequeueInputBuffer returns null while the encoder is full, as an
+      encoder without backpressure */
+  IXR_OVERLOAD_STALL = 0,
+  /** Drop the frames offered while overloaded, so that the queue drains */
+  IXR_OVERLOAD_DROP_NEWEST = 1,
+  /** Hold the latest frame offered while overloaded in place of the one
+      held before, and queue it once the overload ends */
+  IXR_OVERLOAD_DROP_OLDEST = 2,
+  /** Queue 1 of N frames, N doubles as an overload starts or lasts and
+      halves once it's calm, the rate control is told fps / N */
+  IXR_OVERLOAD_REDUCE_FPS = 3,
+};
+
+//! What to do with a frame offered by the capture thread
+enum FrameAction {
+  IXR_FRAME_QUEUE = 0,  //!< write it into the encoder
+  IXR_FRAME_HOLD = 1,   //!< write it into the held frame
+  IXR_FRAME_DROP = 2,   //!< write it into a scratch buffer and drop it
+  IXR_FRAME_STALL = 3,  //!< no buffer, the capture thread retries
+};
+
+struct BackpressureConfig {
+  OverloadStrategy strategy;
+  uint32_t highDepth;   //!< frames in the encoder to start an overload, 0
+                        //!< of CodecConfig::asyncDepth
+  uint32_t lowDepth;    //!< frames in the encoder to end it, 0 of half the
+                        //!< high watermark
+  int64_t highLatency;  //!< us a frame has waited in the encoder to start
+                        //!< an overload, 0 to ignore the latency
+  int64_t lowLatency;   //!< us of the oldest frame to end it
+  uint32_t maxDivisor;  //!< IXR_OVERLOAD_REDUCE_FPS only, at most 1 of N
+                        //!< frames is dropped, 0 of 8
+};
+
+struct BackpressureStat {
+  uint64_t offered;        //!< frames offered by the capture thread
+  uint64_t queued;         //!< frames queued into the encoder
+  uint64_t encoded;        //!< frames dequeued from the encoder
+  uint64_t droppedNewest;  //!< frames dropped as they were offered
+  uint64_t droppedOldest;  //!< held frames replaced by a newer one
+  uint64_t throttled;      //!< frames dropped by IXR_OVERLOAD_REDUCE_FPS
+  uint64_t stalled;        //!< offers without a buffer
+  uint64_t overloads;      //!< overloads started
+  uint32_t depth;          //!< frames in the encoder
+  uint32_t maxDepth;
+  int64_t latency;  //!< us from capture to output of the last frame
+  int64_t maxLatency;
+  uint32_t divisor;  //!< N of IXR_OVERLOAD_REDUCE_FPS, 1 otherwise
+  bool overloaded;
+};
+
+/**
+ * @brief Track the frames in an encoder and decide the frames to drop.
+ *
+ * An overload starts once the encoder is full, or its depth or the wait of
+ * its oldest frame reaches the high watermark, and ends once both are at or
+ * below the low watermarks. Times are in us of any monotonic clock.
+ *
+ * All methods are thread-safe, the counters can be read from any thread.
+ */
+class BackpressureController {
+ public:
+  explicit BackpressureController(const BackpressureConfig &config);
+
+  /**
+   * @brief Restart the counters for an encoder.
+   *
+   * @param capacity input buffers of the encoder
+   * @param canHold frames are in CPU memory and can be held or dropped into
+   *        a copy, otherwise they are only dropped into free buffers of the
+   *        encoder.
+   */
+  void Reset(uint32_t capacity, bool canHold);
+
+  /**
+   * @param full the encoder has no free input buffer
+   * @param held a frame is held already, which is replaced if the action is
+   *        IXR_FRAME_HOLD
+   */
+  FrameAction Offer(int64_t now, bool full, bool held);
+
+  //! A frame captured at time is queued into the encoder
+  void Queued(int64_t time);
+
+  //! The oldest frame in the encoder is dequeued
+  void Completed(int64_t now);
+
+  bool Overloaded() const;
+
+  uint32_t Divisor() const;
+
+  BackpressureStat GetStat() const;
+
+ private:
+  void update(int64_t now, bool full, bool offered);
+  void setDivisor(uint32_t divisor);
+
+  BackpressureConfig config_;
+  uint32_t high_;
+  uint32_t low_;
+  bool canHold_;
+  bool overloaded_;
+  uint32_t divisor_;
+  uint64_t phase_;  //!< offers since the divisor changed
+  std::deque<int64_t> times_;  //!< of the frames in the encoder
+  BackpressureStat stat_;
+  mutable std::mutex mutex_;
+};
+
+/**
+ * @brief Apply backpressure to an encoder, which isn't allocated yet and is
+ * allocated through the returned one.
+ *
+ * The capture thread is never blocked: DequeueInputBuffer returns a buffer
+ * of the encoder, the held frame or a scratch buffer by the action of the
+ * controller, and QueueInputBuffer returns 1 if the frame is dropped. User
+ * data and SEI of a dropped frame move to the next frame, as
+ * IXR_STATIC_DROP. Only the latest frame is held, and it's queued once the
+ * overload ends. Frames in GPU memory, or encoded in place of
+ * IXR_MEM_EXTERNAL_*, can't be copied, they are dropped into free buffers
+ * of the encoder or stalled.
+ *
+ * Calls of the input side are serialized, the output side is called by
+ * another thread as without backpressure.
+ */
+std::unique_ptr<Encoder> BackpressureEncoder(
+    std::unique_ptr<Encoder> encoder,
+    std::shared_ptr<BackpressureController> controller);
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_BACKPRESSURE_H_
@@ -0,0 +1,80 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Convert frames between 8-bit and 10-bit in CPU memory
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_bit_depth.h"
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IXR_BIT_DEPTH_SSE2
+#endif
+
+namespace ixr {
+void Widen8To10(const uint8_t *src, uint16_t *dst, size_t count) {
+  size_t i = 0;
+#ifdef IXR_BIT_DEPTH_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= count; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    // the sample as the high byte of a word is shifted by 8
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_unpacklo_epi8(zero, v));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8),
+                     _mm_unpackhi_epi8(zero, v));
+  }
+#endif
+  for (; i < count; i++) dst[i] = static_cast<uint16_t>(src[i] << 8);
+}
+
+void Narrow10To8(const uint16_t *src, uint8_t *dst, size_t count) {
+  size_t i = 0;
+#ifdef IXR_BIT_DEPTH_SSE2
+  const __m128i half = _mm_set1_epi16(0x80);
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+    // saturated, so that the top values round to 255
+    a = _mm_srli_epi16(_mm_adds_epu16(a, half), 8);
+    b = _mm_srli_epi16(_mm_adds_epu16(b, half), 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi16(a, b));
+  }
+#endif
+  for (; i < count; i++) {
+    dst[i] = static_cast<uint8_t>(std::min((src[i] + 0x80u) >> 8, 255u));
+  }
+}
+
+int ConvertBitDepth(const void *src, ColorFourcc srcFormat, uint32_t srcPitch,
+                    void *dst, ColorFourcc dstFormat, uint32_t dstPitch,
+                    uint32_t width, uint32_t height) {
+  const bool widen =
+      srcFormat == IXR_COLOR_NV12 && dstFormat == IXR_COLOR_P010;
+  const bool narrow =
+      srcFormat == IXR_COLOR_P010 && dstFormat == IXR_COLOR_NV12;
+  if ((!widen && !narrow) || !src || !dst) return -1;
+  if (!srcPitch) srcPitch = widen ? width : width * 2;
+  if (!dstPitch) dstPitch = widen ? width * 2 : width;
+  auto s = static_cast<const uint8_t *>(src);
+  auto d = static_cast<uint8_t *>(dst);
+  // interleaved chroma is as wide as luma and half the height
+  const uint32_t rows = height + height / 2;
+  for (uint32_t y = 0; y < rows; y++) {
+    const uint8_t *from = s + size_t(y) * srcPitch;
+    uint8_t *to = d + size_t(y) * dstPitch;
+    if (widen) {
+      Widen8To10(from, reinterpret_cast<uint16_t *>(to), width);
+    } else {
+      Narrow10To8(reinterpret_cast<const uint16_t *>(from), to, width);
+    }
+  }
+  return 0;
+}
+}  // namespace ixr
@@ -0,0 +1,40 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Convert frames between 8-bit and 10-bit in CPU memory
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_BIT_DEPTH_H_
+#define LL_CODEC_CODEC_IXR_BIT_DEPTH_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+/**
+ * @brief Widen 8-bit samples into the layout of P010, i.e. shifted into the
+ * MSBs of 16-bit words. A video range of 16-235 becomes 64-940 exactly.
+ */
+void Widen8To10(const uint8_t *src, uint16_t *dst, size_t count);
+
+//! Round samples in the layout of P010 to 8 bits, the inverse of widening
+void Narrow10To8(const uint16_t *src, uint8_t *dst, size_t count);
+
+/**
+ * @brief Convert a NV12 frame into P010, or a P010 frame into NV12.
+ *
+ * Frames are in the layout of Encoder::DequeueInputBuffer in CPU memory,
+ * chroma follows luma at pitch * height. Width and height are even. Both
+ * kernels use SSE2 if the target has it, so that 8-bit content is widened
+ * once at the edge of a 10-bit pipeline instead of each stage.
+ *
+ * @param srcPitch, dstPitch bytes of a row, 0 of packed rows
+ * @return 0 if succeed, -1 if the formats aren't NV12 and P010
+ */
+int ConvertBitDepth(const void *src, ColorFourcc srcFormat, uint32_t srcPitch,
+                    void *dst, ColorFourcc dstFormat, uint32_t dstPitch,
+                    uint32_t width, uint32_t height);
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_BIT_DEPTH_H_
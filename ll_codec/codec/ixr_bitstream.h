@@ -0,0 +1,176 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : RBSP and Exp-Golomb bit readers and writers
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_BITSTREAM_H_
+#define LL_CODEC_CODEC_IXR_BITSTREAM_H_
+#include <stdint.h>
+#include <vector>
+
+namespace ixr {
+/**
+ * @brief Remove emulation prevention bytes (00 00 03) of a NAL unit.
+ */
+inline void UnescapeRbsp(const uint8_t *nal, uint32_t size,
+                         std::vector<uint8_t> *rbsp) {
+  rbsp->clear();
+  rbsp->reserve(size);
+  uint32_t zeros = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (zeros >= 2 && nal[i] == 3) {
+      zeros = 0;
+      continue;
+    }
+    zeros = nal[i] == 0 ? zeros + 1 : 0;
+    rbsp->push_back(nal[i]);
+  }
+}
+
+/**
+ * @brief Append a RBSP to a NAL unit, with emulation prevention bytes
+ * inserted.
+ */
+inline void EscapeRbsp(const uint8_t *rbsp, uint32_t size,
+                       std::vector<uint8_t> *nal) {
+  uint32_t zeros = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (zeros >= 2 && rbsp[i] <= 3) {
+      nal->push_back(3);
+      zeros = 0;
+    }
+    zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    nal->push_back(rbsp[i]);
+  }
+}
+
+//! Read bits of a RBSP in big endian, reads past the end return 0
+class BitReader {
+ public:
+  BitReader(const uint8_t *data, uint32_t size)
+      : data_(data), size_(size), pos_(0) {}
+
+  uint32_t U(uint32_t bits) {
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < bits; i++) v = (v << 1) | Bit();
+    return v;
+  }
+
+  uint32_t Bit() {
+    uint32_t byte = static_cast<uint32_t>(pos_ >> 3);
+    uint32_t b = byte < size_ ? (data_[byte] >> (7 - (pos_ & 7))) & 1 : 0;
+    pos_++;
+    return b;
+  }
+
+  //! ue(v)
+  uint32_t Ue() {
+    uint32_t zeros = 0;
+    while (!Bit() && zeros < 32) zeros++;
+    if (zeros >= 32) {
+      overrun_ = true;
+      return 0;
+    }
+    return (1u << zeros) - 1 + U(zeros);
+  }
+
+  //! se(v)
+  int32_t Se() {
+    uint32_t k = Ue();
+    return k & 1 ? static_cast<int32_t>((k + 1) / 2)
+                 : -static_cast<int32_t>(k / 2);
+  }
+
+  //! position in bits
+  uint64_t Pos() const { return pos_; }
+
+  //! false if read past the end or a code is invalid
+  bool Good() const { return !overrun_ && pos_ <= uint64_t(size_) * 8; }
+
+ private:
+  const uint8_t *data_;
+  uint32_t size_;
+  uint64_t pos_;
+  bool overrun_ = false;
+};
+
+//! Write bits of a RBSP in big endian
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t> *out) : out_(out), bits_(0) {}
+
+  void U(uint32_t value, uint32_t bits) {
+    while (bits--) Bit((value >> bits) & 1);
+  }
+
+  void Bit(uint32_t b) {
+    if ((bits_ & 7) == 0) out_->push_back(0);
+    if (b) out_->back() |= 0x80 >> (bits_ & 7);
+    bits_++;
+  }
+
+  //! ue(v)
+  void Ue(uint32_t value) {
+    uint64_t v = uint64_t(value) + 1;
+    uint32_t len = 0;
+    while ((v >> len) > 1) len++;
+    U(0, len);
+    U(static_cast<uint32_t>(v), len + 1);
+  }
+
+  //! se(v)
+  void Se(int32_t value) {
+    Ue(value > 0 ? 2 * uint32_t(value) - 1 : 2 * uint32_t(-value));
+  }
+
+  //! Copy bits [from, to) of a RBSP
+  void Copy(const uint8_t *data, uint64_t from, uint64_t to) {
+    for (; from < to && (from & 7); from++) {
+      Bit((data[from >> 3] >> (7 - (from & 7))) & 1);
+    }
+    // the source is aligned, merge whole bytes into the output
+    const uint32_t shift = static_cast<uint32_t>(bits_ & 7);
+    for (; from + 8 <= to; from += 8) {
+      const uint8_t byte = data[from >> 3];
+      if (shift) {
+        out_->back() |= byte >> shift;
+        out_->push_back(static_cast<uint8_t>(byte << (8 - shift)));
+      } else {
+        out_->push_back(byte);
+      }
+      bits_ += 8;
+    }
+    for (; from < to; from++) Bit((data[from >> 3] >> (7 - (from & 7))) & 1);
+  }
+
+  //! rbsp_trailing_bits
+  void Trailing() {
+    Bit(1);
+    while (bits_ & 7) Bit(0);
+  }
+
+  bool Aligned() const { return (bits_ & 7) == 0; }
+
+ private:
+  std::vector<uint8_t> *out_;
+  uint64_t bits_;
+};
+
+/**
+ * @brief Find the rbsp_stop_one_bit of a RBSP
+ *
+ * @return position of the stop bit, or 0 if not found
+ */
+inline uint64_t FindRbspStopBit(const uint8_t *rbsp, uint32_t size) {
+  while (size > 0 && rbsp[size - 1] == 0) size--;
+  if (size == 0) return 0;
+  uint8_t last = rbsp[size - 1];
+  uint32_t shift = 0;
+  while (!((last >> shift) & 1)) shift++;
+  return uint64_t(size) * 8 - 1 - shift;
+}
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_BITSTREAM_H_
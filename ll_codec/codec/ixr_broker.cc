@@ -0,0 +1,824 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Place codec sessions on backends by their load
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_broker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+// weight of a new sample of the measured capacity
+constexpr double kAlpha = 0.1;
+// a session isn't moved again until its new backend is measured
+constexpr double kSettleSeconds = 1.0;
+// a backend failed to create a session is retried after a while
+constexpr double kRetrySeconds = 10.0;
+constexpr int32_t kDefaultFps = 30;
+
+double Demand(const CodecConfig &config) {
+  const double fps = config.fps > 0 ? config.fps : kDefaultFps;
+  return double(std::max(config.width, 0)) * std::max(config.height, 0) *
+         fps;
+}
+
+double Pixels(const CodecConfig &config) {
+  return double(std::max(config.width, 0)) * std::max(config.height, 0);
+}
+
+// the vendor specific configurations are meaningless to other vendors
+CodecConfig Retarget(const CodecConfig &config, AdapterVendor vid,
+                     bool software) {
+  CodecConfig c = config;
+  if (c.adapter != vid) {
+    constexpr size_t kSize = std::max(
+        {sizeof(ConfigGPUSpecificIntel), sizeof(ConfigGPUSpecificNvidia),
+         sizeof(ConfigGPUSpecificAmd)});
+    std::memset(&c.intel, 0, kSize);
+    c.adapter = vid;
+  }
+  if (software) c.intel.useSoftware = 1;
+  return c;
+}
+
+// a decoder can start from this packet
+bool IsKeyFrame(CodecFourcc codec, const void *data, uint32_t size) {
+  if (codec == IXR_CODEC_JPEG) return true;
+  bool key = false;
+  ForEachNalu(static_cast<const uint8_t *>(data), size,
+              [&](const uint8_t *nal, uint32_t) {
+                const uint8_t type = NaluType(codec, nal[0]);
+                // AVC IDR, HEVC IDR/CRA/BLA
+                key |= codec == IXR_CODEC_HEVC ? type >= 16 && type <= 21
+                                               : type == 5;
+              });
+  return key;
+}
+}  // namespace
+
+/**
+ * @brief Forward to the encoder of the current backend, and move it to the
+ * backend chosen by the broker when no frame is in flight.
+ *
+ * The output side may run on another thread. The input side swaps the
+ * encoder under the lock, and the output side calls a reference of it, so
+ * the old encoder is destroyed after its last call returns.
+ */
+class BrokeredEncoder : public Encoder {
+ public:
+  BrokeredEncoder(CodecBroker *broker, int id, const CodecConfig &config,
+                  std::unique_ptr<Encoder> impl)
+      : broker_(broker),
+        id_(id),
+        config_(config),
+        impl_(std::move(impl)),
+        input_(nullptr),
+        inflight_(0),
+        held_(0),
+        outputs_(0),
+        busy_(0),
+        fps_(0),
+        throughput_(0) {}
+
+  ~BrokeredEncoder() override {
+    impl_.reset();
+    broker_->removeSession(id_);
+  }
+
+  void Allocate(const CodecConfig &config) override {
+    config_ = config;
+    swap(nullptr);
+    swap(broker_->createEncoder(broker_->GetBackend(this), config));
+    broker_->setDemand(id_, Demand(config));
+    input_ = nullptr;
+    inflight_ = held_ = outputs_ = 0;
+  }
+
+  void Deallocate() override {
+    if (impl_) impl_->Deallocate();
+  }
+
+  CodecStat GetEncodeStatus() override { return current()->GetEncodeStatus(); }
+
+  void *DequeueInputBuffer() override {
+    migrate();
+    input_ = impl_->DequeueInputBuffer();
+    return input_;
+  }
+
+  int QueueInputBuffer(void *ptr) override {
+    // external memory can go to any backend, it's a safe point as well
+    if (ptr != input_) migrate();
+    input_ = nullptr;
+    // counted before the output side can see the frame
+    inflight_++;
+    auto ticket = broker_->enter(id_);
+    int ret = impl_->QueueInputBuffer(ptr);
+    addBusy(broker_->leave(ticket));
+    if (ret != 0) inflight_--;
+    return ret;
+  }
+
+  int GetDirtyRects(DirtyRect *rects, uint32_t *count) override {
+    return impl_->GetDirtyRects(rects, count);
+  }
+
+  int QueueUserData(void *data, uint32_t size) override {
+    return impl_->QueueUserData(data, size);
+  }
+
+  int DequeueUserData(void *data, uint32_t *size) override {
+    return current()->DequeueUserData(data, size);
+  }
+
+  int QueueSeiPayload(uint32_t type, const void *data,
+                      uint32_t size) override {
+    return impl_->QueueSeiPayload(type, data, size);
+  }
+
+  int QueueTimeCode(const TimeCode &timecode) override {
+    return impl_->QueueTimeCode(timecode);
+  }
+
+  int QueueRegionOfInterest(const RegionOfInterest *regions,
+                            uint32_t count) override {
+    return impl_->QueueRegionOfInterest(regions, count);
+  }
+
+  int DequeueOutputBuffer(void **ptr, uint32_t *size) override {
+    auto impl = current();
+    auto ticket = broker_->enter(id_);
+    int ret = impl->DequeueOutputBuffer(ptr, size);
+    const double seconds = broker_->leave(ticket);
+    // every part is held until released, not only the last one
+    if (ret >= 0) held_++;
+    if (ret == 0) outputs_++;
+    if (ret == 0 && inflight_) {
+      inflight_--;
+      broker_->report(id_, Pixels(config_), takeBusy(seconds));
+    } else {
+      addBusy(seconds);
+    }
+    return ret;
+  }
+
+  int GetSliceOffsets(uint32_t *offsets, uint32_t *count) override {
+    return current()->GetSliceOffsets(offsets, count);
+  }
+
+  int DequeueOutputSegments(OutputDescriptor *desc) override {
+    // parts are dequeued above to be accounted, the order survives moves
+    const int ret = Encoder::DequeueOutputSegments(desc);
+    const uint32_t outputs = outputs_;
+    const uint32_t order = ret == 0 ? outputs - 1 : outputs;
+    if (ret >= 0) DescribeOutput(config_.codec, config_.fps, order, desc);
+    return ret;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    // not moved while outputs are held, so it's of the current encoder
+    current()->ReleaseOutputBuffer(ptr);
+    if (held_) held_--;
+  }
+
+  int RequestIntraRefresh() override { return impl_->RequestIntraRefresh(); }
+
+  int MarkLongTermReference() override {
+    return impl_->MarkLongTermReference();
+  }
+
+  int InvalidateReferences(uint32_t first, uint32_t last) override {
+    return impl_->InvalidateReferences(first, last);
+  }
+
+  void GetFlowControlParam(float *fps, uint32_t *throughput) const override {
+    current()->GetFlowControlParam(fps, throughput);
+  }
+
+  void SetFlowControlParam(const float fps,
+                           const uint32_t throughput) override {
+    fps_ = fps;
+    throughput_ = throughput;
+    impl_->SetFlowControlParam(fps, throughput);
+  }
+
+  int SetJpegQuality(int32_t quality) override {
+    const int ret = impl_->SetJpegQuality(quality);
+    // kept by the encoder of the next move
+    if (ret == 0) config_.advanced.jpegQuality = quality;
+    return ret;
+  }
+
+  int JoinSession(Encoder *parent) override {
+    auto p = dynamic_cast<BrokeredEncoder *>(parent);
+    return impl_->JoinSession(p ? p->current().get() : parent);
+  }
+
+  int id() const { return id_; }
+  const CodecBroker *broker() const { return broker_; }
+
+ private:
+  std::shared_ptr<Encoder> current() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return impl_;
+  }
+
+  // called by the input side only, which reads impl_ without the lock
+  void swap(std::unique_ptr<Encoder> next) {
+    std::shared_ptr<Encoder> old;
+    std::lock_guard<std::mutex> lock(lock_);
+    old = std::move(impl_);
+    impl_ = std::move(next);
+    busy_ = 0;
+  }
+
+  void addBusy(double seconds) {
+    std::lock_guard<std::mutex> lock(lock_);
+    busy_ += seconds;
+  }
+
+  double takeBusy(double seconds) {
+    std::lock_guard<std::mutex> lock(lock_);
+    const double busy = busy_ + seconds;
+    busy_ = 0;
+    return busy;
+  }
+
+  void migrate() {
+    if (inflight_ || held_) return;
+    const int target = broker_->target(id_);
+    if (target < 0) return;
+    std::unique_ptr<Encoder> next;
+    try {
+      next = broker_->createEncoder(target, config_);
+    } catch (...) {
+      next.reset();
+    }
+    if (!next) {
+      broker_->commit(id_, false);
+      return;
+    }
+    if (fps_ > 0) next->SetFlowControlParam(fps_, throughput_);
+    swap(std::move(next));
+    broker_->commit(id_, true);
+  }
+
+  CodecBroker *broker_;
+  int id_;
+  CodecConfig config_;
+  std::shared_ptr<Encoder> impl_;
+  mutable std::mutex lock_;         // impl_ and busy_
+  void *input_;                     // the last DequeueInputBuffer
+  std::atomic<uint32_t> inflight_;  // frames queued but not output
+  std::atomic<uint32_t> held_;      // outputs and parts not released
+  std::atomic<uint32_t> outputs_;   // frames dequeued
+  double busy_;
+  float fps_;
+  uint32_t throughput_;
+};
+
+/**
+ * @brief Forward to the decoder of the current backend, and move it to the
+ * backend chosen by the broker at the next key frame. Frames of the old
+ * decoder are drained before the new one.
+ *
+ * Decoders are swapped and released in the manner of BrokeredEncoder.
+ */
+class BrokeredDecoder : public Decoder {
+ public:
+  BrokeredDecoder(CodecBroker *broker, int id, const CodecConfig &config,
+                  std::unique_ptr<Decoder> impl)
+      : broker_(broker),
+        id_(id),
+        config_(config),
+        impl_(std::move(impl)),
+        drained_(true),
+        flushed_(false),
+        busy_(0) {}
+
+  ~BrokeredDecoder() override {
+    old_.reset();
+    impl_.reset();
+    broker_->removeSession(id_);
+  }
+
+  void Allocate(CodecConfig &config, void *nalu, uint32_t size) override {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      old_.reset();
+      oldHeld_.clear();
+      impl_.reset();
+    }
+    auto next =
+        broker_->createDecoder(broker_->GetBackend(this), config, nalu, size);
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      impl_ = std::move(next);
+      drained_ = true;
+    }
+    config_ = config;
+    broker_->setDemand(id_, Demand(config));
+  }
+
+  void Deallocate() override {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      old_.reset();
+      oldHeld_.clear();
+      drained_ = true;
+    }
+    if (impl_) impl_->Deallocate();
+  }
+
+  CodecStat GetDecodeStatus() override { return current()->GetDecodeStatus(); }
+
+  int QueueInputBuffer(void *ptr, uint32_t size) override {
+    return QueueInputBuffer(ptr, size, kPtsUnknown);
+  }
+
+  int QueueInputBuffer(void *ptr, uint32_t size, int64_t pts) override {
+    if (ptr && size) migrate(ptr, size);
+    auto ticket = broker_->enter(id_);
+    int ret = impl_->QueueInputBuffer(ptr, size, pts);
+    addBusy(broker_->leave(ticket));
+    return ret;
+  }
+
+  int DequeueOutputBuffer(void **ptr) override {
+    return DequeueOutputBuffer(ptr, nullptr);
+  }
+
+  int DequeueOutputBuffer(void **ptr, int64_t *pts) override {
+    std::shared_ptr<Decoder> old, impl;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (!drained_) old = old_;
+      impl = impl_;
+    }
+    if (old) {
+      const int ret = drain(old.get(), ptr, pts);
+      if (ret <= 0) return ret;
+    }
+    auto ticket = broker_->enter(id_);
+    int ret = impl->DequeueOutputBuffer(ptr, pts);
+    const double seconds = broker_->leave(ticket);
+    if (ret == 0) {
+      broker_->report(id_, Pixels(config_), takeBusy(seconds));
+    } else {
+      addBusy(seconds);
+    }
+    return ret;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    std::shared_ptr<Decoder> owner;
+    bool old = false;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto it = std::find(oldHeld_.begin(), oldHeld_.end(), ptr);
+      old = it != oldHeld_.end();
+      if (old) oldHeld_.erase(it);
+      owner = old ? old_ : impl_;
+    }
+    owner->ReleaseOutputBuffer(ptr);
+    if (old) {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (drained_ && oldHeld_.empty()) old_.reset();
+    }
+  }
+
+  void GetPrivateData(void *data) const override {
+    current()->GetPrivateData(data);
+  }
+
+  void SetPrivateData(void *data) override { impl_->SetPrivateData(data); }
+
+  int id() const { return id_; }
+  const CodecBroker *broker() const { return broker_; }
+
+ private:
+  std::shared_ptr<Decoder> current() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return impl_;
+  }
+
+  void addBusy(double seconds) {
+    std::lock_guard<std::mutex> lock(lock_);
+    busy_ += seconds;
+  }
+
+  double takeBusy(double seconds) {
+    std::lock_guard<std::mutex> lock(lock_);
+    const double busy = busy_ + seconds;
+    busy_ = 0;
+    return busy;
+  }
+
+  /**
+   * A flush outputs at most one frame, so it's repeated until one outputs
+   * nothing.
+   *
+   * @return 0 if a frame of the old decoder is dequeued, -1 if the flush
+   * waits for outputs to be released, 1 if it's drained.
+   */
+  int drain(Decoder *old, void **ptr, int64_t *pts) {
+    for (;;) {
+      if (old->DequeueOutputBuffer(ptr, pts) == 0) {
+        std::lock_guard<std::mutex> lock(lock_);
+        oldHeld_.push_back(*ptr);
+        flushed_ = false;
+        return 0;
+      }
+      if (flushed_) break;
+      int ret;
+      try {
+        ret = old->QueueInputBuffer(nullptr, 0, kPtsUnknown);
+      } catch (...) {
+        break;
+      }
+      // no free surface until outputs of the old decoder are released
+      if (ret != 0) return -1;
+      flushed_ = true;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    drained_ = true;
+    if (oldHeld_.empty()) old_.reset();
+    return 1;
+  }
+
+  void migrate(void *ptr, uint32_t size) {
+    {
+      // the last move is still draining
+      std::lock_guard<std::mutex> lock(lock_);
+      if (old_) return;
+    }
+    const int target = broker_->target(id_);
+    if (target < 0 || !IsKeyFrame(config_.codec, ptr, size)) return;
+    std::unique_ptr<Decoder> next;
+    CodecConfig config = config_;
+    try {
+      next = broker_->createDecoder(target, config, ptr, size);
+    } catch (...) {
+      next.reset();
+    }
+    if (!next) {
+      broker_->commit(id_, false);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      old_ = std::move(impl_);
+      impl_ = std::move(next);
+      drained_ = false;
+      flushed_ = false;
+      busy_ = 0;
+    }
+    broker_->commit(id_, true);
+  }
+
+  CodecBroker *broker_;
+  int id_;
+  CodecConfig config_;
+  std::shared_ptr<Decoder> impl_;
+  std::shared_ptr<Decoder> old_;  // the decoder before the last move
+  mutable std::mutex lock_;       // all but flushed_ of the output side
+  std::vector<void *> oldHeld_;   // outputs of the old decoder
+  bool drained_;
+  bool flushed_;  // the last flush output nothing yet
+  double busy_;
+};
+
+CodecBroker::CodecBroker(double threshold, Clock clock)
+    : threshold_(threshold), clock_(std::move(clock)) {
+  if (!clock_) {
+    clock_ = []() {
+      return std::chrono::duration<double>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+    };
+  }
+}
+
+CodecBroker::~CodecBroker() {}
+
+int CodecBroker::AddBackend(const BackendInfo &info) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Backend b{};
+  b.info = info;
+  backends_.push_back(std::move(b));
+  return static_cast<int>(backends_.size() - 1);
+}
+
+void CodecBroker::AddDefaultBackends() {
+  struct Vendor {
+    const char *name;
+    AdapterVendor vid;
+    bool software;
+  };
+  const Vendor vendors[] = {
+      {"intel", IXR_CODEC_VID_INTEL, false},
+      {"nvidia", IXR_CODEC_VID_NVIDIA, false},
+      {"intel-software", IXR_CODEC_VID_INTEL, true},
+  };
+  for (auto &v : vendors) {
+    BackendInfo info{};
+    info.name = v.name;
+    info.software = v.software;
+    const AdapterVendor vid = v.vid;
+    const bool software = v.software;
+    info.encoder = [vid, software](const CodecConfig &config) {
+      auto e = Encoder::Create(vid);
+      if (e) e->Allocate(Retarget(config, vid, software));
+      return e;
+    };
+    info.decoder = [vid, software](CodecConfig &config, void *nalu,
+                                   uint32_t size) {
+      auto d = Decoder::Create(vid);
+      if (d) {
+        CodecConfig c = Retarget(config, vid, software);
+        d->Allocate(c, nalu, size);
+        config.width = c.width;
+        config.height = c.height;
+      }
+      return d;
+    };
+    AddBackend(info);
+  }
+}
+
+std::unique_ptr<Encoder> CodecBroker::CreateEncoder(
+    const CodecConfig &config) {
+  const double demand = Demand(config);
+  std::vector<bool> skip;
+  for (;;) {
+    int backend, id;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      skip.resize(backends_.size());
+      backend = pick(true, demand, skip, false);
+      if (backend < 0) return nullptr;
+      id = addSession(true, backend, demand);
+    }
+    std::unique_ptr<Encoder> impl;
+    try {
+      impl = createEncoder(backend, config);
+    } catch (...) {
+      impl.reset();
+    }
+    if (impl) {
+      return std::make_unique<BrokeredEncoder>(this, id, config,
+                                               std::move(impl));
+    }
+    // try the next one, i.e. the adapter is absent
+    removeSession(id);
+    fail(backend);
+    skip[backend] = true;
+  }
+}
+
+std::unique_ptr<Decoder> CodecBroker::CreateDecoder(CodecConfig &config,
+                                                    void *nalu,
+                                                    uint32_t size) {
+  std::vector<bool> skip;
+  for (;;) {
+    int backend, id;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      skip.resize(backends_.size());
+      backend = pick(false, Demand(config), skip, false);
+      if (backend < 0) return nullptr;
+      id = addSession(false, backend, Demand(config));
+    }
+    std::unique_ptr<Decoder> impl;
+    try {
+      impl = createDecoder(backend, config, nalu, size);
+    } catch (...) {
+      impl.reset();
+    }
+    if (impl) {
+      // the size of pictures is known after the header is parsed
+      setDemand(id, Demand(config));
+      return std::make_unique<BrokeredDecoder>(this, id, config,
+                                               std::move(impl));
+    }
+    removeSession(id);
+    fail(backend);
+    skip[backend] = true;
+  }
+}
+
+BackendStat CodecBroker::GetBackendStat(int backend) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  BackendStat stat{};
+  if (backend < 0 || backend >= static_cast<int>(backends_.size())) {
+    return stat;
+  }
+  const Backend &b = backends_[backend];
+  stat.sessions = b.sessions;
+  stat.demand = b.demand;
+  stat.pixelRate = b.secondsPerPixel > 0 ? 1 / b.secondsPerPixel : 0;
+  stat.load = stat.pixelRate > 0 ? b.demand / stat.pixelRate : 0;
+  stat.placed = b.placed;
+  stat.migrated = b.migrated;
+  return stat;
+}
+
+int CodecBroker::GetBackend(const Encoder *encoder) {
+  auto e = dynamic_cast<const BrokeredEncoder *>(encoder);
+  if (!e || e->broker() != this) return -1;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_[e->id()].backend;
+}
+
+int CodecBroker::GetBackend(const Decoder *decoder) {
+  auto d = dynamic_cast<const BrokeredDecoder *>(decoder);
+  if (!d || d->broker() != this) return -1;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_[d->id()].backend;
+}
+
+int CodecBroker::pick(bool encoder, double demand,
+                      const std::vector<bool> &skip, bool fit) const {
+  int best = -1;
+  int bestRank = 0;
+  double bestLoad = 0;
+  const double now = clock_();
+  for (size_t i = 0; i < backends_.size(); i++) {
+    const Backend &b = backends_[i];
+    if (skip[i] || now < b.downUntil ||
+        !(encoder ? bool(b.info.encoder) : bool(b.info.decoder))) {
+      continue;
+    }
+    if (b.info.maxSessions &&
+        b.sessions + b.reserved >= b.info.maxSessions) {
+      continue;
+    }
+    const double after = load(b, demand);
+    const bool fits = after <= threshold_;
+    if (fit && !fits) continue;
+    // hardware with room, software with room, then the least loaded
+    const int rank = (fits ? 0 : 2) + (b.info.software ? 1 : 0);
+    if (best < 0 || rank < bestRank ||
+        (rank == bestRank &&
+         (after < bestLoad ||
+          (after == bestLoad &&
+           b.sessions < backends_[best].sessions)))) {
+      best = static_cast<int>(i);
+      bestRank = rank;
+      bestLoad = after;
+    }
+  }
+  return best;
+}
+
+double CodecBroker::load(const Backend &b, double extra) const {
+  double rate = b.secondsPerPixel > 0 ? 1 / b.secondsPerPixel
+                                      : b.info.pixelRate;
+  // unknown until measured, the backend looks idle
+  if (rate <= 0) return 0;
+  return (b.demand - b.leaving + b.incoming + extra) / rate;
+}
+
+int CodecBroker::addSession(bool encoder, int backend, double demand) {
+  Session s{true, encoder, backend, -1, demand, clock_()};
+  Backend &b = backends_[backend];
+  b.sessions++;
+  b.demand += demand;
+  b.placed++;
+  for (size_t i = 0; i < sessions_.size(); i++) {
+    if (!sessions_[i].used) {
+      sessions_[i] = s;
+      return static_cast<int>(i);
+    }
+  }
+  sessions_.push_back(s);
+  return static_cast<int>(sessions_.size() - 1);
+}
+
+void CodecBroker::fail(int backend) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  backends_[backend].downUntil = clock_() + kRetrySeconds;
+}
+
+std::unique_ptr<Encoder> CodecBroker::createEncoder(
+    int backend, const CodecConfig &config) {
+  std::function<std::unique_ptr<Encoder>(const CodecConfig &)> create;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (backend < 0) return nullptr;
+    create = backends_[backend].info.encoder;
+  }
+  // backends may take long to allocate, out of the lock
+  return create ? create(config) : nullptr;
+}
+
+std::unique_ptr<Decoder> CodecBroker::createDecoder(int backend,
+                                                    CodecConfig &config,
+                                                    void *nalu,
+                                                    uint32_t size) {
+  std::function<std::unique_ptr<Decoder>(CodecConfig &, void *, uint32_t)>
+      create;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (backend < 0) return nullptr;
+    create = backends_[backend].info.decoder;
+  }
+  return create ? create(config, nalu, size) : nullptr;
+}
+
+void CodecBroker::removeSession(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Session &s = sessions_[id];
+  Backend &b = backends_[s.backend];
+  if (s.target >= 0) {
+    Backend &t = backends_[s.target];
+    t.incoming -= s.demand;
+    t.reserved--;
+    b.leaving -= s.demand;
+  }
+  b.sessions--;
+  b.demand -= s.demand;
+  s.used = false;
+}
+
+void CodecBroker::setDemand(int id, double demand) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Session &s = sessions_[id];
+  const double delta = demand - s.demand;
+  backends_[s.backend].demand += delta;
+  if (s.target >= 0) {
+    backends_[s.target].incoming += delta;
+    backends_[s.backend].leaving += delta;
+  }
+  s.demand = demand;
+}
+
+CodecBroker::Ticket CodecBroker::enter(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int backend = sessions_[id].backend;
+  const uint32_t share = ++backends_[backend].inflight;
+  return Ticket{backend, share, clock_()};
+}
+
+double CodecBroker::leave(const Ticket &ticket) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  backends_[ticket.backend].inflight--;
+  return std::max(clock_() - ticket.start, 0.0) / ticket.share;
+}
+
+void CodecBroker::report(int id, double pixels, double seconds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Session &s = sessions_[id];
+  if (pixels <= 0) return;
+  Backend &b = backends_[s.backend];
+  const double spp = seconds / pixels;
+  double &measured = b.secondsPerPixel;
+  measured = measured > 0 ? measured + kAlpha * (spp - measured) : spp;
+  if (s.target >= 0 || load(b, 0) <= threshold_) return;
+  if (clock_() - s.since < kSettleSeconds) return;
+  // move this session out if another backend has room for it
+  std::vector<bool> skip(backends_.size());
+  skip[s.backend] = true;
+  const int target = pick(s.encoder, s.demand, skip, true);
+  if (target < 0) return;
+  s.target = target;
+  backends_[target].incoming += s.demand;
+  backends_[target].reserved++;
+  b.leaving += s.demand;
+}
+
+int CodecBroker::target(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_[id].target;
+}
+
+void CodecBroker::commit(int id, bool moved) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Session &s = sessions_[id];
+  if (s.target < 0) return;
+  Backend &b = backends_[s.backend];
+  Backend &t = backends_[s.target];
+  t.incoming -= s.demand;
+  t.reserved--;
+  b.leaving -= s.demand;
+  if (!moved) t.downUntil = clock_() + kRetrySeconds;
+  if (moved) {
+    b.sessions--;
+    b.demand -= s.demand;
+    b.migrated++;
+    t.sessions++;
+    t.demand += s.demand;
+    t.placed++;
+    s.backend = s.target;
+  }
+  s.target = -1;
+  s.since = clock_();
+}
+}  // namespace ixr
@@ -0,0 +1,178 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Place codec sessions on backends by their load
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_BROKER_H_
+#define LL_CODEC_CODEC_IXR_BROKER_H_
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+/**
+ * @brief A backend to run codec sessions, i.e. an adapter of a vendor or
+ * the software implementation.
+ */
+struct BackendInfo {
+  std::string name;
+  uint32_t maxSessions;  //!< 0 for no limit
+  double pixelRate;      //!< estimated pixels per second, 0 if unknown. It's
+                         //!< replaced by the measured one at runtime.
+  bool software;         //!< used only if no hardware backend has room
+  //! Create and allocate an encoder, null if encode isn't supported
+  std::function<std::unique_ptr<Encoder>(const CodecConfig &)> encoder;
+  //! Create and allocate a decoder, null if decode isn't supported
+  std::function<std::unique_ptr<Decoder>(CodecConfig &, void *, uint32_t)>
+      decoder;
+};
+
+struct BackendStat {
+  uint32_t sessions;   //!< sessions running on the backend
+  double demand;       //!< pixels per second of all sessions
+  double pixelRate;    //!< measured pixels per second, 0 if unknown
+  double load;         //!< demand over pixelRate, 0 if unknown
+  uint64_t placed;     //!< sessions placed, including migrated in
+  uint64_t migrated;   //!< sessions migrated out
+};
+
+class BrokeredEncoder;
+class BrokeredDecoder;
+
+/**
+ * @brief Place encoder and decoder sessions on backends by their load.
+ *
+ * The demand of a session is its pixels per second. The capacity of a
+ * backend is measured from the time its sessions spend in QueueInputBuffer
+ * and DequeueOutputBuffer, shared by the frames in flight on the backend.
+ * A new session goes to the hardware backend of the lowest load which
+ * still has room, then to a software backend, then to the least loaded
+ * one. A backend that fails to create a session is skipped for a while.
+ *
+ * Sessions are returned as ordinary Encoder and Decoder objects. When the
+ * load of a backend goes above the threshold, its sessions are moved to a
+ * backend with room at their next safe point: an encoder when no frame is
+ * in flight, and its next frame is an IDR; a decoder at the next IDR, while
+ * frames of the old decoder are drained first. Long-term references and
+ * frame numbers of InvalidateReferences restart after a move.
+ *
+ * The broker must outlive its sessions. All methods are thread-safe. The
+ * input and output sides of a session may run on two threads.
+ */
+class CodecBroker {
+ public:
+  //! Time source in seconds
+  using Clock = std::function<double()>;
+
+  /**
+   * @param threshold a backend is overloaded if its load is above it.
+   * @param clock time source, the steady clock if null.
+   */
+  explicit CodecBroker(double threshold = 0.9, Clock clock = nullptr);
+
+  ~CodecBroker();
+
+  //! @return id of the backend
+  int AddBackend(const BackendInfo &info);
+
+  /**
+   * @brief Add the hardware backends of Intel and NVIDIA, and the software
+   * implementation of Intel Media SDK as the fallback.
+   */
+  void AddDefaultBackends();
+
+  /**
+   * @brief Place and allocate an encoder.
+   *
+   * @param config codec configurations, the vendor specific configurations
+   *        are cleared if it's placed on another vendor.
+   * @return the encoder, null if no backend can create it.
+   */
+  std::unique_ptr<Encoder> CreateEncoder(const CodecConfig &config);
+
+  /**
+   * @brief Place and allocate a decoder, @see Decoder::Allocate
+   *
+   * @return the decoder, null if no backend can create it.
+   */
+  std::unique_ptr<Decoder> CreateDecoder(CodecConfig &config, void *nalu,
+                                         uint32_t size);
+
+  BackendStat GetBackendStat(int backend);
+
+  /**
+   * @brief Get the backend of a session created by this broker.
+   *
+   * @return id of the backend, -1 if it's not a brokered session.
+   */
+  int GetBackend(const Encoder *encoder);
+  int GetBackend(const Decoder *decoder);
+
+ private:
+  friend class BrokeredEncoder;
+  friend class BrokeredDecoder;
+
+  struct Backend {
+    BackendInfo info;
+    double secondsPerPixel;  //!< measured, 0 if unknown
+    double demand;
+    double incoming;  //!< demand of sessions moving in
+    double leaving;   //!< demand of sessions moving out
+    uint32_t sessions;
+    uint32_t reserved;  //!< sessions moving in
+    uint32_t inflight;  //!< calls in QueueInputBuffer/DequeueOutputBuffer
+    double downUntil;   //!< skipped until then as it failed to create one
+    uint64_t placed;
+    uint64_t migrated;
+  };
+
+  struct Session {
+    bool used;
+    bool encoder;
+    int backend;
+    int target;  //!< backend to move to, -1 if none
+    double demand;
+    double since;  //!< when it's placed
+  };
+
+  //! A call into the backend, the time is shared by calls in flight
+  struct Ticket {
+    int backend;
+    uint32_t share;
+    double start;
+  };
+
+  int pick(bool encoder, double demand, const std::vector<bool> &skip,
+           bool fit) const;
+  double load(const Backend &b, double extra) const;
+  int addSession(bool encoder, int backend, double demand);
+  void fail(int backend);
+
+  // called by the sessions
+  std::unique_ptr<Encoder> createEncoder(int backend,
+                                         const CodecConfig &config);
+  std::unique_ptr<Decoder> createDecoder(int backend, CodecConfig &config,
+                                         void *nalu, uint32_t size);
+  void removeSession(int id);
+  void setDemand(int id, double demand);
+  Ticket enter(int id);
+  double leave(const Ticket &ticket);
+  void report(int id, double pixels, double seconds);
+  int target(int id);
+  void commit(int id, bool moved);
+
+  double threshold_;
+  Clock clock_;
+  std::vector<Backend> backends_;
+  std::vector<Session> sessions_;
+  std::mutex mutex_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_BROKER_H_
@@ -0,0 +1,566 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Record the calls of a codec session into a chunked file
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+// equal bytes shorter than this are kept in a literal run
+constexpr size_t kMinZeroRun = 8;
+// a chunk larger than this is taken as a broken capture
+constexpr uint32_t kMaxChunkSize = 1u << 30;
+constexpr uint32_t kConfigFields = 19;
+constexpr size_t kVendorSize =
+    std::max({sizeof(ConfigGPUSpecificIntel), sizeof(ConfigGPUSpecificNvidia),
+              sizeof(ConfigGPUSpecificAmd)});
+
+int64_t SteadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void PutVarint(size_t v, std::vector<uint8_t> *out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(v));
+}
+
+bool GetVarint(const uint8_t **p, const uint8_t *end, size_t *v) {
+  *v = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    const uint8_t b = *(*p)++;
+    *v |= size_t(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+uint64_t Load64(const uint8_t *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+// Code cur against prev as runs of (equal bytes, XOR-ed bytes), so that
+// static regions of screen content cost a few bytes.
+void Pack(const uint8_t *prev, const uint8_t *cur, size_t n,
+          std::vector<uint8_t> *out) {
+  out->clear();
+  size_t i = 0;
+  while (i < n) {
+    size_t same = i;
+    while (same + 8 <= n && Load64(prev + same) == Load64(cur + same)) {
+      same += 8;
+    }
+    while (same < n && prev[same] == cur[same]) same++;
+    size_t end = same, run = 0;
+    while (end < n && run < kMinZeroRun) {
+      run = prev[end] == cur[end] ? run + 1 : 0;
+      end++;
+    }
+    end -= run;
+    PutVarint(same - i, out);
+    PutVarint(end - same, out);
+    for (size_t k = same; k < end; k++) out->push_back(prev[k] ^ cur[k]);
+    i = end;
+  }
+}
+
+bool Unpack(const uint8_t *p, size_t size, uint8_t *frame, size_t n) {
+  const uint8_t *end = p + size;
+  size_t i = 0;
+  while (p < end) {
+    size_t same, diff;
+    if (!GetVarint(&p, end, &same) || !GetVarint(&p, end, &diff)) {
+      return false;
+    }
+    if (same > n - i || diff > n - i - same ||
+        diff > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    i += same;
+    for (size_t k = 0; k < diff; k++) frame[i + k] ^= p[k];
+    i += diff;
+    p += diff;
+  }
+  return true;
+}
+
+template <typename T>
+IoVec Of(const T &v) {
+  return IoVec{&v, sizeof v};
+}
+
+/**
+ * @brief Forward to the encoder and record the calls.
+ */
+class RecordingEncoder : public Encoder {
+ public:
+  RecordingEncoder(std::unique_ptr<Encoder> impl,
+                   std::shared_ptr<CaptureWriter> writer)
+      : impl_(std::move(impl)),
+        writer_(std::move(writer)),
+        frameSize_(0),
+        input_(nullptr),
+        codec_(IXR_CODEC_AVC),
+        fps_(0),
+        outputs_(0) {}
+
+  void Allocate(const CodecConfig &config) override {
+    frameSize_ = CaptureFrameSize(config);
+    input_ = nullptr;
+    codec_ = config.codec;
+    fps_ = config.fps;
+    outputs_ = 0;
+    PutCodecConfig(config, &blob_);
+    const IoVec iov{blob_.data(), blob_.size()};
+    writer_->Write(IXR_CAPTURE_ENCODER, writer_->Now(), 0, &iov, 1);
+    impl_->Allocate(config);
+  }
+
+  void Deallocate() override { impl_->Deallocate(); }
+
+  CodecStat GetEncodeStatus() override { return impl_->GetEncodeStatus(); }
+
+  void *DequeueInputBuffer() override {
+    input_ = impl_->DequeueInputBuffer();
+    return input_;
+  }
+
+  int QueueInputBuffer(void *ptr) override {
+    const int64_t t = writer_->Now();
+    const int ret = impl_->QueueInputBuffer(ptr);
+    const int64_t duration = writer_->Now() - t;
+    // the frame isn't written until its bitstream is dequeued
+    const void *frame = frameSize_ ? (ptr ? ptr : input_) : nullptr;
+    writer_->WriteFrame(t, duration, ret, frame, frameSize_);
+    return ret;
+  }
+
+  int GetDirtyRects(DirtyRect *rects, uint32_t *count) override {
+    return impl_->GetDirtyRects(rects, count);
+  }
+
+  int QueueUserData(void *data, uint32_t size) override {
+    const IoVec iov{data, size};
+    writer_->Write(IXR_CAPTURE_USER_DATA, writer_->Now(), 0, &iov, 1);
+    return impl_->QueueUserData(data, size);
+  }
+
+  int DequeueUserData(void *data, uint32_t *size) override {
+    return impl_->DequeueUserData(data, size);
+  }
+
+  int QueueSeiPayload(uint32_t type, const void *data,
+                      uint32_t size) override {
+    const IoVec iov[]{Of(type), {data, size}};
+    writer_->Write(IXR_CAPTURE_SEI, writer_->Now(), 0, iov, 2);
+    return impl_->QueueSeiPayload(type, data, size);
+  }
+
+  int QueueTimeCode(const TimeCode &timecode) override {
+    const IoVec iov = Of(timecode);
+    writer_->Write(IXR_CAPTURE_TIME_CODE, writer_->Now(), 0, &iov, 1);
+    return impl_->QueueTimeCode(timecode);
+  }
+
+  int QueueRegionOfInterest(const RegionOfInterest *regions,
+                            uint32_t count) override {
+    const IoVec iov{regions, sizeof(RegionOfInterest) * (regions ? count : 0)};
+    writer_->Write(IXR_CAPTURE_ROI, writer_->Now(), 0, &iov, 1);
+    return impl_->QueueRegionOfInterest(regions, count);
+  }
+
+  int DequeueOutputBuffer(void **ptr, uint32_t *size) override {
+    const int64_t t = writer_->Now();
+    const int32_t ret = impl_->DequeueOutputBuffer(ptr, size);
+    const uint32_t bytes = ret >= 0 ? *size : 0;
+    const IoVec iov[]{Of(ret), Of(bytes)};
+    writer_->Write(IXR_CAPTURE_OUTPUT, t, writer_->Now() - t, iov, 2);
+    outputs_ += ret == 0;
+    return ret;
+  }
+
+  int GetSliceOffsets(uint32_t *offsets, uint32_t *count) override {
+    return impl_->GetSliceOffsets(offsets, count);
+  }
+
+  int DequeueOutputSegments(OutputDescriptor *desc) override {
+    // each part is recorded by DequeueOutputBuffer above
+    const int ret = Encoder::DequeueOutputSegments(desc);
+    const uint32_t order = ret == 0 ? outputs_ - 1 : outputs_;
+    if (ret >= 0) DescribeOutput(codec_, fps_, order, desc);
+    return ret;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    impl_->ReleaseOutputBuffer(ptr);
+  }
+
+  int RequestIntraRefresh() override {
+    writer_->Write(IXR_CAPTURE_INTRA_REFRESH, writer_->Now(), 0, nullptr, 0);
+    return impl_->RequestIntraRefresh();
+  }
+
+  int MarkLongTermReference() override {
+    writer_->Write(IXR_CAPTURE_LONG_TERM, writer_->Now(), 0, nullptr, 0);
+    return impl_->MarkLongTermReference();
+  }
+
+  int InvalidateReferences(uint32_t first, uint32_t last) override {
+    const IoVec iov[]{Of(first), Of(last)};
+    writer_->Write(IXR_CAPTURE_INVALIDATE, writer_->Now(), 0, iov, 2);
+    return impl_->InvalidateReferences(first, last);
+  }
+
+  void GetFlowControlParam(float *fps, uint32_t *throughput) const override {
+    impl_->GetFlowControlParam(fps, throughput);
+  }
+
+  void SetFlowControlParam(const float fps,
+                           const uint32_t throughput) override {
+    const IoVec iov[]{Of(fps), Of(throughput)};
+    writer_->Write(IXR_CAPTURE_FLOW_CONTROL, writer_->Now(), 0, iov, 2);
+    impl_->SetFlowControlParam(fps, throughput);
+  }
+
+  int JoinSession(Encoder *parent) override {
+    auto p = dynamic_cast<RecordingEncoder *>(parent);
+    return impl_->JoinSession(p ? p->impl_.get() : parent);
+  }
+
+ private:
+  std::unique_ptr<Encoder> impl_;
+  std::shared_ptr<CaptureWriter> writer_;
+  uint32_t frameSize_;
+  void *input_;  // the buffer of the last DequeueInputBuffer
+  CodecFourcc codec_;
+  int32_t fps_;
+  uint32_t outputs_;  // frames dequeued
+  std::vector<uint8_t> blob_;
+};
+
+/**
+ * @brief Forward to the decoder and record the calls.
+ */
+class RecordingDecoder : public Decoder {
+ public:
+  RecordingDecoder(std::unique_ptr<Decoder> impl,
+                   std::shared_ptr<CaptureWriter> writer)
+      : impl_(std::move(impl)), writer_(std::move(writer)) {}
+
+  void Allocate(CodecConfig &config, void *nalu, uint32_t size) override {
+    PutCodecConfig(config, &blob_);
+    const uint32_t bytes = static_cast<uint32_t>(blob_.size());
+    const IoVec iov[]{Of(bytes), {blob_.data(), blob_.size()}, {nalu, size}};
+    writer_->Write(IXR_CAPTURE_DECODER, writer_->Now(), 0, iov, 3);
+    impl_->Allocate(config, nalu, size);
+  }
+
+  void Deallocate() override { impl_->Deallocate(); }
+
+  CodecStat GetDecodeStatus() override { return impl_->GetDecodeStatus(); }
+
+  int QueueInputBuffer(void *ptr, uint32_t size) override {
+    return QueueInputBuffer(ptr, size, kPtsUnknown);
+  }
+
+  int QueueInputBuffer(void *ptr, uint32_t size, int64_t pts) override {
+    const int64_t t = writer_->Now();
+    const int32_t ret = impl_->QueueInputBuffer(ptr, size, pts);
+    const IoVec iov[]{Of(ret), Of(pts), {ptr, ptr ? size : 0}};
+    writer_->Write(IXR_CAPTURE_BITSTREAM, t, writer_->Now() - t, iov, 3);
+    return ret;
+  }
+
+  int DequeueOutputBuffer(void **ptr) override {
+    return DequeueOutputBuffer(ptr, nullptr);
+  }
+
+  int DequeueOutputBuffer(void **ptr, int64_t *pts) override {
+    const int64_t t = writer_->Now();
+    int64_t stamp = kPtsUnknown;
+    const int32_t ret = impl_->DequeueOutputBuffer(ptr, &stamp);
+    // polls without a frame are not recorded
+    if (ret == 0) {
+      const IoVec iov[]{Of(ret), Of(stamp)};
+      writer_->Write(IXR_CAPTURE_OUTPUT, t, writer_->Now() - t, iov, 2);
+    }
+    if (pts) *pts = stamp;
+    return ret;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    impl_->ReleaseOutputBuffer(ptr);
+  }
+
+  void GetPrivateData(void *data) const override {
+    impl_->GetPrivateData(data);
+  }
+
+  void SetPrivateData(void *data) override { impl_->SetPrivateData(data); }
+
+ private:
+  std::unique_ptr<Decoder> impl_;
+  std::shared_ptr<CaptureWriter> writer_;
+  std::vector<uint8_t> blob_;
+};
+}  // namespace
+
+CaptureWriter::CaptureWriter(Sink sink, bool compress)
+    : sink_(std::move(sink)),
+      compress_(compress),
+      good_(static_cast<bool>(sink_)),
+      bytes_(0),
+      start_(SteadyNow()) {
+  const IoVec iov = Of(kCaptureVersion);
+  Write(IXR_CAPTURE_MAGIC, 0, 0, &iov, 1);
+}
+
+CaptureWriter::Sink CaptureWriter::FileSink(const char *path) {
+  std::shared_ptr<FILE> fp(std::fopen(path, "wb"), [](FILE *f) {
+    if (f) std::fclose(f);
+  });
+  if (!fp) return nullptr;
+  return [fp](const IoVec *iov, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      if (iov[i].size &&
+          std::fwrite(iov[i].base, 1, iov[i].size, fp.get()) != iov[i].size) {
+        return false;
+      }
+    }
+    return true;
+  };
+}
+
+int64_t CaptureWriter::Now() const { return SteadyNow() - start_; }
+
+void CaptureWriter::Write(uint32_t tag, int64_t time, int64_t duration,
+                          const IoVec *iov, uint32_t count) {
+  CaptureChunk chunk{tag, 0, time, duration};
+  for (uint32_t i = 0; i < count; i++) {
+    chunk.size += static_cast<uint32_t>(iov[i].size);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!good_) return;
+  // the header and payload are written in one call
+  list_.assign(1, Of(chunk));
+  list_.insert(list_.end(), iov, iov + count);
+  good_ = sink_(list_.data(), count + 1);
+  bytes_ += sizeof chunk + chunk.size;
+}
+
+void CaptureWriter::WriteFrame(int64_t time, int64_t duration,
+                               int32_t result, const void *frame,
+                               uint32_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!good_) return;
+  uint32_t flags = 0;
+  IoVec pixels{nullptr, 0};
+  if (!frame) {
+    size = 0;
+  } else if (compress_) {
+    if (last_.size() != size) last_.assign(size, 0);
+    auto cur = static_cast<const uint8_t *>(frame);
+    Pack(last_.data(), cur, size, &packed_);
+    std::memcpy(last_.data(), cur, size);
+    flags = kCaptureCompressed;
+    pixels = IoVec{packed_.data(), packed_.size()};
+  } else {
+    pixels = IoVec{frame, size};
+  }
+  CaptureChunk chunk{IXR_CAPTURE_FRAME, 0, time, duration};
+  chunk.size = static_cast<uint32_t>(sizeof result + sizeof flags +
+                                     sizeof size + pixels.size);
+  const IoVec list[]{Of(chunk), Of(result), Of(flags), Of(size), pixels};
+  good_ = sink_(list, 5);
+  bytes_ += sizeof chunk + chunk.size;
+}
+
+CaptureReader::CaptureReader(Source source)
+    : source_(std::move(source)), started_(false) {}
+
+CaptureReader::Source CaptureReader::FileSource(const char *path) {
+  std::shared_ptr<FILE> fp(std::fopen(path, "rb"), [](FILE *f) {
+    if (f) std::fclose(f);
+  });
+  if (!fp) return nullptr;
+  return [fp](void *dst, size_t size) {
+    return std::fread(dst, 1, size, fp.get());
+  };
+}
+
+bool CaptureReader::read(void *dst, size_t size) {
+  auto p = static_cast<uint8_t *>(dst);
+  while (size) {
+    const size_t n = source_(p, size);
+    if (!n) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool CaptureReader::Next(CaptureChunk *chunk, const uint8_t **payload) {
+  if (!source_) return false;
+  if (!started_) {
+    uint32_t version = 0;
+    if (!read(chunk, sizeof *chunk) || chunk->tag != IXR_CAPTURE_MAGIC ||
+        chunk->size != sizeof version || !read(&version, sizeof version) ||
+        version != kCaptureVersion) {
+      return fail();
+    }
+    started_ = true;
+  }
+  if (!read(chunk, sizeof *chunk) || chunk->size > kMaxChunkSize) {
+    return fail();
+  }
+  payload_.resize(chunk->size);
+  if (!read(payload_.data(), payload_.size())) return fail();
+  *payload = payload_.data();
+  if (chunk->tag != IXR_CAPTURE_FRAME) return true;
+  // result, flags, size and pixels
+  uint32_t flags, size;
+  if (chunk->size < 12) return fail();
+  std::memcpy(&flags, payload_.data() + 4, 4);
+  std::memcpy(&size, payload_.data() + 8, 4);
+  const uint8_t *pixels = payload_.data() + 12;
+  const size_t n = chunk->size - 12;
+  if (!size) {
+    frame_.clear();
+  } else if (flags & kCaptureCompressed) {
+    if (frame_.size() != size) frame_.assign(size, 0);
+    if (!Unpack(pixels, n, frame_.data(), size)) return fail();
+  } else if (n == size) {
+    frame_.assign(pixels, pixels + n);
+  } else {
+    return fail();
+  }
+  return true;
+}
+
+bool CaptureReader::fail() {
+  source_ = nullptr;
+  return false;
+}
+
+void PutCodecConfig(const CodecConfig &config, std::vector<uint8_t> *out) {
+  const int32_t fields[kConfigFields]{
+      config.codec,
+      config.width,
+      config.height,
+      config.bitrate,
+      config.constQP[0],
+      config.constQP[1],
+      config.constQP[2],
+      config.fps,
+      config.gop,
+      config.asyncDepth,
+      config.outputSizeMax,
+      config.userDataSizeMax,
+      config.seiSizeMax,
+      config.rcMode,
+      config.inputFormat,
+      config.outputFormat,
+      config.memoryType,
+      static_cast<int32_t>(config.sharedMemoryId.size()),
+      config.adapter};
+  // sizes of the blocks to detect a capture of another build
+  const uint32_t sizes[]{kConfigFields, kVendorSize, sizeof config.advanced,
+                         sizeof config.vpp};
+  auto put = [out](const void *p, size_t n) {
+    auto b = static_cast<const uint8_t *>(p);
+    out->insert(out->end(), b, b + n);
+  };
+  out->clear();
+  put(sizes, sizeof sizes);
+  put(fields, sizeof fields);
+  put(&config.intel, kVendorSize);
+  put(&config.advanced, sizeof config.advanced);
+  put(&config.vpp, sizeof config.vpp);
+}
+
+bool GetCodecConfig(const uint8_t *data, size_t size, CodecConfig *config) {
+  uint32_t sizes[4];
+  int32_t f[kConfigFields];
+  const size_t total = sizeof sizes + sizeof f + kVendorSize +
+                       sizeof config->advanced + sizeof config->vpp;
+  if (size != total) return false;
+  std::memcpy(sizes, data, sizeof sizes);
+  if (sizes[0] != kConfigFields || sizes[1] != kVendorSize ||
+      sizes[2] != sizeof config->advanced || sizes[3] != sizeof config->vpp) {
+    return false;
+  }
+  data += sizeof sizes;
+  std::memcpy(f, data, sizeof f);
+  data += sizeof f;
+  *config = CodecConfig{};
+  config->codec = static_cast<CodecFourcc>(f[0]);
+  config->width = f[1];
+  config->height = f[2];
+  config->bitrate = f[3];
+  std::copy(f + 4, f + 7, config->constQP);
+  config->fps = f[7];
+  config->gop = f[8];
+  config->asyncDepth = f[9];
+  config->outputSizeMax = f[10];
+  config->userDataSizeMax = f[11];
+  config->seiSizeMax = f[12];
+  config->rcMode = static_cast<RateControlMode>(f[13]);
+  config->inputFormat = static_cast<ColorFourcc>(f[14]);
+  config->outputFormat = static_cast<ColorFourcc>(f[15]);
+  config->memoryType = static_cast<MemoryType>(f[16]);
+  config->sharedMemoryId.assign(std::max(f[17], 0), nullptr);
+  config->adapter = static_cast<AdapterVendor>(f[18]);
+  std::memcpy(&config->intel, data, kVendorSize);
+  data += kVendorSize;
+  std::memcpy(&config->advanced, data, sizeof config->advanced);
+  data += sizeof config->advanced;
+  std::memcpy(&config->vpp, data, sizeof config->vpp);
+  return true;
+}
+
+uint32_t CaptureFrameSize(const CodecConfig &config) {
+  if (config.memoryType != IXR_MEM_INTERNAL_CPU &&
+      config.memoryType != IXR_MEM_EXTERNAL_CPU) {
+    return 0;
+  }
+  const uint32_t pixels = static_cast<uint32_t>(std::max(config.width, 0)) *
+                          static_cast<uint32_t>(std::max(config.height, 0));
+  switch (config.inputFormat) {
+    case IXR_COLOR_NV12:
+      return pixels * 3 / 2;
+    case IXR_COLOR_P010:
+      return pixels * 3;
+    default:
+      return pixels * 4;
+  }
+}
+
+std::unique_ptr<Encoder> CaptureEncoder(
+    std::unique_ptr<Encoder> encoder, std::shared_ptr<CaptureWriter> writer) {
+  if (!encoder || !writer) return nullptr;
+  return std::unique_ptr<Encoder>(
+      new RecordingEncoder(std::move(encoder), std::move(writer)));
+}
+
+std::unique_ptr<Decoder> CaptureDecoder(
+    std::unique_ptr<Decoder> decoder, std::shared_ptr<CaptureWriter> writer) {
+  if (!decoder || !writer) return nullptr;
+  return std::unique_ptr<Decoder>(
+      new RecordingDecoder(std::move(decoder), std::move(writer)));
+}
+}  // namespace ixr
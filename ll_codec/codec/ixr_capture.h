@@ -0,0 +1,188 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Record the calls of a codec session into a chunked file
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_CAPTURE_H_
+#define LL_CODEC_CODEC_IXR_CAPTURE_H_
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+//! Tags of capture chunks, the layout of each payload follows the tag
+enum CaptureTag {
+  //! uint32 version, the first chunk of a capture
+  IXR_CAPTURE_MAGIC = MAKE_FOURCC('I', 'X', 'R', 'C'),
+  //! serialized CodecConfig of Encoder::Allocate
+  IXR_CAPTURE_ENCODER = MAKE_FOURCC('E', 'N', 'C', 'A'),
+  //! uint32 size of config, serialized CodecConfig, the header of
+  //! Decoder::Allocate
+  IXR_CAPTURE_DECODER = MAKE_FOURCC('D', 'E', 'C', 'A'),
+  //! int32 result, uint32 flags, uint32 frame size, the frame, which is
+  //! compressed if flags has kCaptureCompressed
+  IXR_CAPTURE_FRAME = MAKE_FOURCC('F', 'R', 'A', 'M'),
+  //! int32 result, int64 pts, bytes of Decoder::QueueInputBuffer
+  IXR_CAPTURE_BITSTREAM = MAKE_FOURCC('B', 'I', 'T', 'S'),
+  //! int32 result, then uint32 size of the bitstream of an encoder, or
+  //! int64 pts of the frame of a decoder
+  IXR_CAPTURE_OUTPUT = MAKE_FOURCC('O', 'U', 'T', 'P'),
+  //! bytes of Encoder::QueueUserData
+  IXR_CAPTURE_USER_DATA = MAKE_FOURCC('U', 'S', 'E', 'R'),
+  //! uint32 type, payload of Encoder::QueueSeiPayload
+  IXR_CAPTURE_SEI = MAKE_FOURCC('S', 'E', 'I', ' '),
+  //! TimeCode
+  IXR_CAPTURE_TIME_CODE = MAKE_FOURCC('T', 'I', 'M', 'E'),
+  //! RegionOfInterest array
+  IXR_CAPTURE_ROI = MAKE_FOURCC('R', 'O', 'I', ' '),
+  //! empty, Encoder::RequestIntraRefresh
+  IXR_CAPTURE_INTRA_REFRESH = MAKE_FOURCC('I', 'R', 'E', 'F'),
+  //! empty, Encoder::MarkLongTermReference
+  IXR_CAPTURE_LONG_TERM = MAKE_FOURCC('L', 'T', 'R', ' '),
+  //! uint32 first, uint32 last of Encoder::InvalidateReferences
+  IXR_CAPTURE_INVALIDATE = MAKE_FOURCC('I', 'N', 'V', 'R'),
+  //! float fps, uint32 throughput of Encoder::SetFlowControlParam
+  IXR_CAPTURE_FLOW_CONTROL = MAKE_FOURCC('F', 'L', 'O', 'W'),
+};
+
+constexpr uint32_t kCaptureVersion = 1;
+//! Flag of IXR_CAPTURE_FRAME, the frame is XOR-ed with the previous one of
+//! the capture and its zero runs are removed.
+constexpr uint32_t kCaptureCompressed = 1;
+
+/**
+ * @brief Header of a chunk, followed by the payload. All fields are in the
+ * byte order of the host.
+ */
+struct CaptureChunk {
+  uint32_t tag;       //!< CaptureTag
+  uint32_t size;      //!< size of the payload
+  int64_t time;       //!< ns since the capture starts, when the call is made
+  int64_t duration;   //!< ns spent in the codec
+};
+
+/**
+ * @brief Write a capture into a sink.
+ *
+ * Frames of a capture are compressed against each other, so a writer
+ * records only one session. All methods are thread-safe, a failed sink
+ * stops the capture silently, check Good() at the end.
+ */
+class CaptureWriter {
+ public:
+  //! Write the IoVec list in order, return false on error
+  using Sink = std::function<bool(const IoVec *iov, uint32_t count)>;
+
+  /**
+   * @param sink receives the chunks, @see FileSink
+   * @param compress set to compress frames, it's lossless
+   */
+  CaptureWriter(Sink sink, bool compress);
+
+  //! A sink of a new file, null if it can't be created
+  static Sink FileSink(const char *path);
+
+  //! ns since the capture starts
+  int64_t Now() const;
+
+  //! Write a chunk of the payload list
+  void Write(uint32_t tag, int64_t time, int64_t duration, const IoVec *iov,
+             uint32_t count);
+
+  /**
+   * @brief Write a IXR_CAPTURE_FRAME chunk
+   *
+   * @param frame pixels of the frame, null if it's not in CPU memory
+   * @param size size of the frame
+   */
+  void WriteFrame(int64_t time, int64_t duration, int32_t result,
+                  const void *frame, uint32_t size);
+
+  bool Good() const { return good_; }
+
+  //! Bytes written, including the headers
+  uint64_t Bytes() const { return bytes_; }
+
+ private:
+  Sink sink_;
+  bool compress_;
+  bool good_;
+  uint64_t bytes_;
+  int64_t start_;
+  std::vector<uint8_t> last_;    //!< the previous frame
+  std::vector<uint8_t> packed_;  //!< the compressed frame
+  std::vector<IoVec> list_;      //!< the header and payload of a chunk
+  std::mutex mutex_;
+};
+
+/**
+ * @brief Read chunks of a capture in order.
+ */
+class CaptureReader {
+ public:
+  //! Read up to size bytes into dst, return the bytes read, 0 at the end
+  using Source = std::function<size_t(void *dst, size_t size)>;
+
+  explicit CaptureReader(Source source);
+
+  //! A source of a file, null if it can't be opened
+  static Source FileSource(const char *path);
+
+  /**
+   * @brief Read the next chunk
+   *
+   * @param [out] chunk header of the chunk
+   * @param [out] payload the payload, valid until the next call
+   * @return false at the end of capture, or if the capture is broken
+   */
+  bool Next(CaptureChunk *chunk, const uint8_t **payload);
+
+  /**
+   * @brief Pixels of the last IXR_CAPTURE_FRAME chunk, decompressed. Empty
+   * if the frame isn't in CPU memory.
+   */
+  const std::vector<uint8_t> &Frame() const { return frame_; }
+
+ private:
+  bool read(void *dst, size_t size);
+  //! stop reading a broken capture
+  bool fail();
+
+  Source source_;
+  bool started_;
+  std::vector<uint8_t> payload_;
+  std::vector<uint8_t> frame_;
+};
+
+//! Serialize the configurations. Device handles are not kept, and external
+//! memories are kept as null slots.
+void PutCodecConfig(const CodecConfig &config, std::vector<uint8_t> *out);
+
+//! @return false if the serialized configurations are broken
+bool GetCodecConfig(const uint8_t *data, size_t size, CodecConfig *config);
+
+//! Bytes of a frame in CPU memory, 0 if the input isn't in CPU memory
+uint32_t CaptureFrameSize(const CodecConfig &config);
+
+/**
+ * @brief Record an encoder into a capture. The encoder isn't allocated yet,
+ * and is allocated through the recorder, i.e. by Encoder::Create(vid).
+ *
+ * The configurations, input frames, user data, SEI and other per-frame
+ * calls are recorded, with the time of each call and the time spent in
+ * the encoder. Frames in GPU memory are recorded without pixels.
+ */
+std::unique_ptr<Encoder> CaptureEncoder(
+    std::unique_ptr<Encoder> encoder, std::shared_ptr<CaptureWriter> writer);
+
+//! Record a decoder into a capture, @see CaptureEncoder
+std::unique_ptr<Decoder> CaptureDecoder(
+    std::unique_ptr<Decoder> decoder, std::shared_ptr<CaptureWriter> writer);
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_CAPTURE_H_
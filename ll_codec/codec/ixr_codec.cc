@@ -112,19 +112,68 @@ void Encoder::Deallocate() {}
 CodecStat Encoder::GetEncodeStatus() { return CodecStat(); }
 void* Encoder::DequeueInputBuffer() { return nullptr; }
 int Encoder::QueueInputBuffer(void*) { return -1; }
+int Encoder::GetDirtyRects(DirtyRect*, uint32_t*) { return -1; }
 int Encoder::QueueUserData(void*, uint32_t) { return -1; }
 int Encoder::DequeueUserData(void*, uint32_t*) { return -1; }
+int Encoder::QueueSeiPayload(uint32_t, const void*, uint32_t) { return -1; }
+int Encoder::QueueTimeCode(const TimeCode&) { return -1; }
+int Encoder::QueueRegionOfInterest(const RegionOfInterest*, uint32_t) {
+  return -1;
+}
 int Encoder::DequeueOutputBuffer(void**, uint32_t*) { return -1; }
+int Encoder::GetSliceOffsets(uint32_t*, uint32_t*) { return -1; }
+int Encoder::RequestIntraRefresh() { return -1; }
+int Encoder::MarkLongTermReference() { return -1; }
+int Encoder::InvalidateReferences(uint32_t, uint32_t) { return -1; }
 void Encoder::ReleaseOutputBuffer(void*) {}
 void Encoder::GetFlowControlParam(float*, uint32_t*) const {}
 void Encoder::SetFlowControlParam(const float, const uint32_t) {}
+int Encoder::SetJpegQuality(int32_t) { return -1; }
+int Encoder::JoinSession(Encoder*) { return -1; }
+
+// segments are gathered by DequeueOutputBuffer of the implementation
+int Encoder::DequeueOutputSegments(OutputDescriptor* desc) {
+  if (!desc) return -1;
+  *desc = OutputDescriptor();
+  desc->pts = kPtsUnknown;
+  int ret = 1;
+  while (ret == 1 && desc->numBuffers < kMaxOutputSegments) {
+    void* ptr = nullptr;
+    uint32_t size = 0;
+    ret = DequeueOutputBuffer(&ptr, &size);
+    if (ret < 0) break;
+    desc->buffers[desc->numBuffers++] = ptr;
+    desc->size += size;
+    IoVec* last = desc->count ? &desc->segments[desc->count - 1] : nullptr;
+    if (last && static_cast<const uint8_t*>(last->base) + last->size == ptr) {
+      // parts written back to back in one buffer
+      last->size += size;
+    } else {
+      desc->segments[desc->count++] = IoVec{ptr, size};
+    }
+  }
+  if (ret < 0 && desc->numBuffers) {
+    // the rest of the frame is lost
+    ReleaseOutputSegments(*desc);
+    *desc = OutputDescriptor();
+  }
+  return ret;
+}
+
+void Encoder::ReleaseOutputSegments(const OutputDescriptor& desc) {
+  for (uint32_t i = 0; i < desc.numBuffers && i < kMaxOutputSegments; i++) {
+    ReleaseOutputBuffer(desc.buffers[i]);
+  }
+}
 
 Decoder::~Decoder() {}
 void Decoder::Allocate(CodecConfig&, void*, uint32_t) {}
 void Decoder::Deallocate() {}
 CodecStat Decoder::GetDecodeStatus() { return CodecStat(); }
 int Decoder::QueueInputBuffer(void*, uint32_t) { return -1; }
+int Decoder::QueueInputBuffer(void*, uint32_t, int64_t) { return -1; }
 int Decoder::DequeueOutputBuffer(void**) { return -1; }
+int Decoder::DequeueOutputBuffer(void**, int64_t*) { return -1; }
 void Decoder::ReleaseOutputBuffer(void*) {}
 void Decoder::GetPrivateData(void*) const {}
 void Decoder::SetPrivateData(void*) {}
@@ -59,31 +59,97 @@ class IXR_CODEC_API Encoder {
    * You should call QueueInputBuffer right after DequeueInputBuffer,
    * otherwise the buffer could be overwritten.
    *
+   * If IXR_MEM_EXTERNAL_* is specified, ptr can be any of
+   * CodecConfig::sharedMemoryId and is encoded in place. Don't write it
+   * until its bitstream is dequeued.
+   *
+   * If CodecConfig::advanced.staticFrameMode is IXR_STATIC_DROP, a frame
+   * identical to the last one is dropped and 1 is returned. User data and
+   * SEI queued for it move to the next frame.
+   *
    * @param ptr the memory handle which is acquired by DequeueInputBuffer()
-   * @return 0 if succeed, -1 otherwise.
+   * @return 0 if succeed, 1 if the frame is dropped, -1 otherwise.
    */
   virtual int QueueInputBuffer(void *ptr);
 
   /**
-   * @brief Queue in a user defined structure as a FIFO.
-   * Data is copied into internal FIFO.
+   * @brief Get the changed regions of the last queued frame compared with
+   * its previous one. Requires CodecConfig::advanced.staticFrameMode.
+   *
+   * @param rects [out] can be null to query the count
+   * @param count [in] capacity of rects, [out] number of regions, 0 if the
+   *        frame is static
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int GetDirtyRects(DirtyRect *rects, uint32_t *count);
+
+  /**
+   * @brief Attach a user defined structure to the next queued input frame.
+   * Data is copied into a pre-allocated slot of that frame, and is written
+   * as SEI user_data_unregistered if CodecConfig::advanced.enableUserDataSei
+   * is set (@see kUserDataUuid).
+   *
+   * Call it before QueueInputBuffer, at most once per frame.
    *
    * @param data structure header
-   * @param size structure size
+   * @param size structure size, no more than CodecConfig::userDataSizeMax
    * @return 0 if succeed, -1 otherwise.
    */
   virtual int QueueUserData(void *data, uint32_t size);
 
   /**
-   * @brief Dequeue out user defined structure as a FIFO.
-   * Data is copied from internal FIFO
+   * @brief Get the user defined structure of the frame which is dequeued by
+   * the last DequeueOutputBuffer.
    *
-   * @param data pointer to an allocated memory
-   * @param size structure size
+   * @param data pointer to an allocated memory, or null to query the size
+   * @param size [in] size of data, [out] size of the structure, 0 if the
+   *             frame has no user data
    * @return 0 if succeed, -1 otherwise.
    */
   virtual int DequeueUserData(void *data, uint32_t *size);
 
+  /**
+   * @brief Insert a SEI message into the next queued input frame.
+   * The payload is copied into a pre-allocated slot of that frame and is
+   * written by the encoder in place, no re-muxing is needed.
+   *
+   * Call it before QueueInputBuffer, can be called several times per frame
+   * as long as CodecConfig::seiSizeMax is not exceeded.
+   *
+   * @param type SEI payload type, i.e. 5 for user_data_unregistered
+   * @param data payload body, without payload type and size
+   * @param size payload size
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int QueueSeiPayload(uint32_t type, const void *data, uint32_t size);
+
+  /**
+   * @brief Attach a time code to the next queued input frame.
+   * Requires CodecConfig::advanced.enableTimeCode. The time code is written
+   * in pic_timing SEI for H.264, and in time_code SEI for HEVC.
+   *
+   * Call it before QueueInputBuffer, at most once per frame.
+   *
+   * @param timecode time code of the frame
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int QueueTimeCode(const TimeCode &timecode);
+
+  /**
+   * @brief Set regions of interest of the next queued input frame, i.e.
+   * around the gaze point. Works with all rate control modes, the bitrate
+   * is redistributed among regions. Where regions overlap, the former one in
+   * the list takes effect. Requires CodecConfig::advanced.enableDynamicRoi.
+   *
+   * Call it before QueueInputBuffer, at most once per frame.
+   *
+   * @param regions QP offsets of regions, see ixr_region.h
+   * @param count number of regions, at most kMaxRegions, 0 to clear
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int QueueRegionOfInterest(const RegionOfInterest *regions,
+                                    uint32_t count);
+
   /**
    * @brief Synchronize the encoding operation and dequeue the output bitstream
    *
@@ -91,12 +157,47 @@ class IXR_CODEC_API Encoder {
    * locked afterward. This function is thread-safe with
    * DequeueInputBuffer/QueueInputBuffer.
    *
+   * If CodecConfig::advanced.enableSlice is set, slices are dequeued as soon
+   * as they are encoded, and 1 is returned until the last part of the frame.
+   * Every part must be released by ReleaseOutputBuffer.
+   *
    * @param ptr pointer to the bitstream memory
    * @param size length of the bitstream
-   * @return 0 if succeed, -1 otherwise.
+   * @return 0 if succeed, 1 if a part of the frame is dequeued, -1 otherwise.
    */
   virtual int DequeueOutputBuffer(void **ptr, uint32_t *size);
 
+  /**
+   * @brief Get the slice boundaries of the bitstream dequeued by the last
+   * DequeueOutputBuffer. Call it before the bitstream is released.
+   *
+   * @param offsets [out] byte offset of the start code of each slice, can be
+   *        null to query the count
+   * @param count [in] capacity of offsets, [out] number of slices
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int GetSliceOffsets(uint32_t *offsets, uint32_t *count);
+
+  /**
+   * @brief Dequeue the output bitstream of a frame as a list of segments,
+   * instead of concatenating its parts.
+   *
+   * Parts of a frame, @see DequeueOutputBuffer, are gathered into one
+   * descriptor, adjacent parts are merged. If a frame has more parts than
+   * kMaxOutputSegments, 1 is returned and the rest of the frame is
+   * dequeued by the next call. The frame type and layer are parsed from the
+   * bitstream, or IXR_FRAME_UNKNOWN if the encoder doesn't know its codec.
+   *
+   * @param desc [out] segments and metadata of the frame
+   * @return 0 if succeed, 1 if a part of the frame is dequeued, -1 otherwise.
+   */
+  virtual int DequeueOutputSegments(OutputDescriptor *desc);
+
+  /**
+   * @brief Release every buffer of a descriptor by ReleaseOutputBuffer.
+   */
+  virtual void ReleaseOutputSegments(const OutputDescriptor &desc);
+
   /**
    * @brief Unlock the internal bitstream.
    *
@@ -106,6 +207,41 @@ class IXR_CODEC_API Encoder {
    */
   virtual void ReleaseOutputBuffer(void *ptr);
 
+  /**
+   * @brief Start a new intra refresh cycle from the next queued frame, i.e.
+   * when the receiver reports a packet loss. If
+   * CodecConfig::advanced.enableIntraRefresh isn't set, the next frame is
+   * encoded as IDR instead. This function is thread-safe.
+   *
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int RequestIntraRefresh();
+
+  /**
+   * @brief Mark the next queued frame as a long-term reference (LTR).
+   * Requires CodecConfig::advanced.numLongTermRefs. When all slots are
+   * taken, the oldest LTR is replaced. LTRs are dropped at IDR, of gop
+   * or requested.
+   * This function is thread-safe.
+   *
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int MarkLongTermReference();
+
+  /**
+   * @brief Invalidate frames the receiver failed to decode, so that the next
+   * queued frame references the latest valid LTR instead, or is encoded as
+   * IDR if there's none. This function is thread-safe.
+   *
+   * Frames are numbered by the order of QueueInputBuffer from 0, which is
+   * also the order of DequeueOutputBuffer.
+   *
+   * @param first the first lost frame
+   * @param last the last lost frame, UINT32_MAX for all frames since first
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int InvalidateReferences(uint32_t first, uint32_t last);
+
   /**
    * @brief Get the Flow Control Parameters
    *
@@ -123,6 +259,26 @@ class IXR_CODEC_API Encoder {
    */
   virtual void SetFlowControlParam(const float fps, const uint32_t throughput);
 
+  /**
+   * @brief Change the quality of a JPEG encoder in place of allocating
+   * another one. Call it when no frame is in flight.
+   *
+   * @param quality 1-100, @see CodecConfig::advanced.jpegQuality
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int SetJpegQuality(int32_t quality);
+
+  /**
+   * @brief Join the session of another encoder of the same adapter, so that
+   * both encoders share one scheduler and run in parallel. Call it after
+   * both encoders are allocated, the joined encoder must be deallocated
+   * before the parent one.
+   *
+   * @param parent an allocated encoder
+   * @return 0 if succeed, -1 otherwise.
+   */
+  virtual int JoinSession(Encoder *parent);
+
   struct ConfigInfo {
     AdapterVendor vid;
     CodecConfig *config;
@@ -188,6 +344,15 @@ class IXR_CODEC_API Decoder {
    */
   virtual int QueueInputBuffer(void *ptr, uint32_t size);
 
+  /**
+   * @brief Queue bytes of a frame with its presentation time stamp.
+   *
+   * @param pts the time stamp in 90kHz, carried to the decoded frame
+   *
+   * @see QueueInputBuffer(void *, uint32_t)
+   */
+  virtual int QueueInputBuffer(void *ptr, uint32_t size, int64_t pts);
+
   /**
    * @brief Dequeue an output buffer handle if outputs available.
    *
@@ -200,6 +365,18 @@ class IXR_CODEC_API Decoder {
    */
   virtual int DequeueOutputBuffer(void **ptr);
 
+  /**
+   * @brief Dequeue an output buffer handle and its presentation time stamp.
+   *
+   * Frames are in the decoder's output order, use DisplayQueue to reorder
+   * and pace them by time stamps.
+   *
+   * @param pts the time stamp given to QueueInputBuffer, or kPtsUnknown
+   *
+   * @see DequeueOutputBuffer(void **)
+   */
+  virtual int DequeueOutputBuffer(void **ptr, int64_t *pts);
+
   /**
    * @brief Unlock the output surface.
    *
@@ -8,6 +8,7 @@ changelog
 ********************************************************************/
 #ifndef LL_CODEC_CODEC_IXR_CODEC_DEF_H_
 #define LL_CODEC_CODEC_IXR_CODEC_DEF_H_
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
@@ -42,6 +43,11 @@ enum CodecFourcc {
 enum ColorFourcc {
   IXR_COLOR_NV12 = MAKE_FOURCC('N', 'V', '1', '2'),
   IXR_COLOR_ARGB = MAKE_FOURCC('A', 'R', 'G', 'B'),
+  /** 10-bit NV12, samples are 16-bit with the 10 bits in the MSBs */
+  IXR_COLOR_P010 = MAKE_FOURCC('P', '0', '1', '0'),
+  /** 10-bit packed 4:4:4, a 32-bit word of U, Y, V from the LSB and 2-bit
+      alpha */
+  IXR_COLOR_Y410 = MAKE_FOURCC('Y', '4', '1', '0'),
 };
 
 //! GPU vendor ID
@@ -71,7 +77,9 @@ enum MemoryType {
   /** Use external cpu memories as input surfaces.
       The codec doesn't own these resources, those who
       create them should be responsible to release them.
-      Users should register those resources when allocate encoder. */
+      Users should register those resources when allocate encoder.
+      Each buffer holds a tightly packed frame of inputFormat, and is
+      passed to Encoder::QueueInputBuffer without copy. */
   IXR_MEM_EXTERNAL_CPU,
   /** Use internal gpu textures as input surfaces.
       The codec owns the resources, and users should call
@@ -95,8 +103,18 @@ enum RateControlMode {
   IXR_RC_MODE_VBR,
 };
 
-//! slice mode
-enum SliceMode { MB_BASED, BYTE_BASED, TILE_BASED, BLOCK_BASED };
+//! slice mode, tells the meaning of CodecConfig::advanced.sliceData
+enum SliceMode {
+  //! Number of MBs in each slice.
+  MB_BASED,
+  //! Maximum size in bytes of each slice.
+  BYTE_BASED,
+  //! Number of slices (tiles for HEVC) in a frame.
+  TILE_BASED,
+  /** Intel only, size in bytes of each partial output regardless of slices.
+      Treated as TILE_BASED by NVENC. */
+  BLOCK_BASED
+};
 
 //! Intel Media SDK specific config
 struct ConfigGPUSpecificIntel {
@@ -105,9 +123,12 @@ struct ConfigGPUSpecificIntel {
   /** Set this to 1 to enable encode for region of interest.
       Different regions can encode with different quality. */
   int32_t enableRegionOfInterest : 1;
+  /** Set this to 1 to use the software implementation of Media SDK, i.e.
+      as the fallback of overloaded GPUs. */
+  int32_t useSoftware : 1;
   //! The number of regions (Maximum 8 regions)
   int32_t numRegions;
-  //! Qualities of each region (Maximum 8 regions)
+  //! QP delta of each region from inner to outer (Maximum 8 regions)
   int32_t regionQP[8];
 };
 
@@ -134,10 +155,90 @@ struct ConfigGPUSpecificAmd {
   int32_t reserved[12];
 };
 
+//! Time code of a frame, written into the bitstream as SEI
+struct TimeCode {
+  uint16_t hours;      //!< 0-23
+  uint16_t minutes;    //!< 0-59
+  uint16_t seconds;    //!< 0-59
+  uint16_t frames;     //!< frame counter within the second
+  uint16_t dropFrame;  //!< Set to 1 for NTSC drop-frame counting
+};
+
+//! A rectangle of a frame encoded with a QP offset, in pixels
+struct RegionOfInterest {
+  uint32_t left;
+  uint32_t top;
+  uint32_t right;   //!< exclusive
+  uint32_t bottom;  //!< exclusive
+  int32_t deltaQP;  //!< -51 to 51, negative for better quality
+};
+
+//! Presentation time stamp of a frame without one, time stamps are 90kHz
+constexpr int64_t kPtsUnknown = -1;
+
+//! A piece of memory to write, in the same layout as POSIX struct iovec
+struct IoVec {
+  const void *base;
+  size_t size;
+};
+
+//! Picture type of an encoded frame
+enum FrameType {
+  IXR_FRAME_UNKNOWN,
+  IXR_FRAME_IDR,
+  IXR_FRAME_I,
+  IXR_FRAME_P,
+  IXR_FRAME_B,
+};
+
+//! Capacity of an OutputDescriptor
+constexpr uint32_t kMaxOutputSegments = 16;
+
+/**
+ * @brief An encoded frame as a list of segments, dequeued by
+ * Encoder::DequeueOutputSegments. Segments are in the layout of POSIX struct
+ * iovec and can be passed to writev/sendmsg as they are.
+ */
+struct OutputDescriptor {
+  IoVec segments[kMaxOutputSegments];
+  uint32_t count;  //!< number of segments
+  uint32_t size;   //!< bytes of all segments
+  //! outputs of DequeueOutputBuffer held by the descriptor
+  void *buffers[kMaxOutputSegments];
+  uint32_t numBuffers;
+  FrameType type;
+  int64_t pts;          //!< of the output order at CodecConfig::fps
+  uint32_t frameOrder;  //!< output order from 0
+  uint32_t layer;       //!< nuh_layer_id of HEVC, or view_id of MVC
+  uint32_t temporalId;  //!< temporal layer
+};
+
+//! A changed rectangle of a frame, in pixels
+struct DirtyRect {
+  uint32_t left;
+  uint32_t top;
+  uint32_t right;   //!< exclusive
+  uint32_t bottom;  //!< exclusive
+};
+
+//! Handling of an input frame identical to the last one
+enum StaticFrameMode {
+  //! Encode it as usual, frames are not compared.
+  IXR_STATIC_ENCODE,
+  //! Drop it, QueueInputBuffer returns 1 and no bitstream is output.
+  IXR_STATIC_DROP,
+  //! Encode it as a skipped frame of a few bytes.
+  IXR_STATIC_SKIP,
+};
+
 struct CodecStat {
-  int32_t numFrames;    //!< current encoded frame index
-  int32_t qp;           //!< current encoded quality
-  int32_t reserved[8];  //!< reserved bits.
+  int32_t numFrames;      //!< current encoded frame index
+  int32_t qp;             //!< current encoded quality
+  int32_t inputFull;      //!< Intel only, DequeueInputBuffer calls failed as
+                          //!< all input buffers are queued
+  int32_t outputStarved;  //!< Intel only, frames not started as all output
+                          //!< buffers are held
+  int32_t reserved[6];    //!< reserved bits.
 };
 
 struct CodecConfig {
@@ -152,6 +253,11 @@ struct CodecConfig {
   int32_t asyncDepth;  //!< Specifies depth of output buffer (a ring buffer).
   int32_t outputSizeMax;     //!< The size in byte pre-allocated for each output
                              //!< buffer.
+  int32_t userDataSizeMax;   //!< The size in byte pre-allocated for user data
+                             //!< of each frame. Default 256 if 0.
+  int32_t seiSizeMax;        //!< The size in byte pre-allocated for SEI
+                             //!< messages queued by Encoder::QueueSeiPayload
+                             //!< of each frame.
   RateControlMode rcMode;    //!< Specifies rate control mode.
   ColorFourcc inputFormat;   //!< Specifies input color format.
   ColorFourcc outputFormat;  //!< Specifies output color format.
@@ -169,6 +275,16 @@ struct CodecConfig {
     int32_t enableSlice : 1;         //!< Set this to 1 to enable slice encode.
     int32_t enableIntraRefresh : 1;  //!< Set this to 1 to enable intra refresh.
     int32_t enableMvc : 1;       //!< Set this to 1 to enable multi-view encode
+    int32_t enableUserDataSei : 1;  //!< Set this to 1 to write user data as
+                                    //!< SEI user_data_unregistered.
+    int32_t enableTimeCode : 1;  //!< Set this to 1 to write time code SEI.
+    int32_t enableDynamicRoi : 1;  //!< Set this to 1 to set regions of
+                                   //!< interest per frame. Turns off AQ of
+                                   //!< NVENC.
+    int32_t enableStitching : 1;  //!< Intel AVC only, set this to 1 to keep
+                                  //!< motion vectors and deblocking inside
+                                  //!< the picture, so that pictures of
+                                  //!< several encoders can be stitched.
     SliceMode sliceMode;         //!< Specifies slice mode.
     int32_t sliceData;           //!< Specifies a slice data of that mode.
     int32_t intraRefreshPeriod;  //!< Specifies the interval between successive
@@ -177,6 +293,15 @@ struct CodecConfig {
                                    //!< number of frames for periodic intra
                                    //!< refresh. This value should be smaller
                                    //!< than intraRefreshPeriod
+    int32_t intraRefreshQpDelta;  //!< Intel only, QP delta of the refreshed
+                                  //!< region, from -51 to 51.
+    int32_t numLongTermRefs;  //!< Number of long-term reference slots for
+                              //!< loss recovery, 0 to disable. At most 4.
+                              //!< No periodic IDR unless gop is set.
+    StaticFrameMode staticFrameMode;  //!< Intel only, handling of static
+                                      //!< frames in CPU memory.
+    int32_t jpegQuality;  //!< Intel JPEG only, quality from 1 to 100. The
+                          //!< bitrate is taken as the quality if 0.
   } advanced;
   struct VppConfig {
     int32_t inCrop[4];
@@ -14,6 +14,11 @@ changelog
 #include <mutex>
 #include "ll_codec/codec/ixr_codec.h"
 #include "ll_codec/codec/ixr_codec_config.h"
+#include "ll_codec/codec/ixr_frame_diff.h"
+#include "ll_codec/codec/ixr_nalu.h"
+#include "ll_codec/codec/ixr_reference.h"
+#include "ll_codec/codec/ixr_region.h"
+#include "ll_codec/codec/ixr_user_data.h"
 #include "ll_codec/impl/thread_safe_stl/queue/thread_safe_queue.h"
 
 namespace ixr {
@@ -27,25 +32,57 @@ class EncoderImplIntel : public Encoder {
   virtual CodecStat GetEncodeStatus() override;
   virtual void* DequeueInputBuffer() override;
   virtual int QueueInputBuffer(void* ptr) override;
+  virtual int GetDirtyRects(DirtyRect* rects, uint32_t* count) override;
   virtual int QueueUserData(void* data, uint32_t size) override;
   virtual int DequeueUserData(void* data, uint32_t* size) override;
+  virtual int QueueSeiPayload(uint32_t type, const void* data,
+                              uint32_t size) override;
+  virtual int QueueTimeCode(const TimeCode& timecode) override;
+  virtual int QueueRegionOfInterest(const RegionOfInterest* regions,
+                                    uint32_t count) override;
   virtual int DequeueOutputBuffer(void** ptr, uint32_t* size) override;
+  virtual int GetSliceOffsets(uint32_t* offsets, uint32_t* count) override;
+  virtual int DequeueOutputSegments(OutputDescriptor* desc) override;
   virtual void ReleaseOutputBuffer(void* ptr) override;
+  virtual int RequestIntraRefresh() override;
+  virtual int MarkLongTermReference() override;
+  virtual int InvalidateReferences(uint32_t first, uint32_t last) override;
   virtual void GetFlowControlParam(float* fps,
                                    uint32_t* throughput) const override;
   virtual void SetFlowControlParam(const float fps,
                                    const uint32_t throughput) override;
+  virtual int SetJpegQuality(int32_t quality) override;
+  virtual int JoinSession(Encoder* parent) override;
 
  protected:
   uint32_t formatConvert(ColorFourcc f);
   uint32_t rcConvert(RateControlMode rc);
   int32_t sliceModeConvert(SliceMode sm);
+  void attachReferenceList(const ReferenceControl& ref);
+  void attachDirtyRects();
+  void refreshReferences(const uint8_t* data, uint32_t size);
 
  private:
   std::unique_ptr<mfxvr::enc::CVRmfxFramework> m_Object;
-  std::deque<std::vector<char>> m_UserData;
-  std::mutex m_UserMutex;
+  FrameUserData m_UserData;
   bool m_bRunning;
+  bool m_bJoined;
+  bool m_bExternalMemory;
+  bool m_bUserDataSei;
+  bool m_bTimeCode;
+  bool m_bPartial;
+  CodecFourcc m_Codec;
+  int32_t m_Fps;
+  uint32_t m_OutputOrder;  //!< frames dequeued
+  bool m_bDynamicRoi;
+  const uint8_t* m_LastOutput;
+  uint32_t m_LastOutputSize;
+  LongTermReferences m_References;
+  std::mutex m_RefLock;
+  uint32_t m_FrameOrder;
+  FrameDiff m_FrameDiff;
+  StaticFrameMode m_StaticMode;
+  void* m_LastInput;
 #endif  // LL_CODEC_MFXVR_ENCODER_DETAIL_MFX_FRAMEWORK_ENC_H
 };
 
@@ -59,7 +96,10 @@ class DecoderImplIntel : public Decoder {
   virtual void Deallocate() override;
   virtual CodecStat GetDecodeStatus() override;
   virtual int QueueInputBuffer(void* ptr, uint32_t size) override;
+  virtual int QueueInputBuffer(void* ptr, uint32_t size,
+                               int64_t pts) override;
   virtual int DequeueOutputBuffer(void** ptr) override;
+  virtual int DequeueOutputBuffer(void** ptr, int64_t* pts) override;
   virtual void ReleaseOutputBuffer(void* ptr) override;
   virtual void GetPrivateData(void* data) const override;
   virtual void SetPrivateData(void* data) override;
@@ -100,8 +140,7 @@ class VppImplIntel :
   std::vector<mfxFrameSurface1> m_InputSurfaces;
   SafeQueue<mfxFrameSurface1*> m_SurfaceFree;
   std::deque<mfxFrameSurface1*> m_SurfaceInUse;
-  std::map<mfxHDL, mfxFrameSurface1*> m_TextureSurfaces;
-  std::mutex m_MapMutex;
+  mfxvr::HandleTable<mfxFrameSurface1> m_TextureSurfaces;
   struct SyncSurface {
     mfxFrameSurface1* surf;
     mfxSyncPoint sync;
@@ -122,8 +161,18 @@ class EncoderImplNvidia : public Encoder {
   virtual int QueueInputBuffer(void* ptr) override;
   virtual int QueueUserData(void* data, uint32_t size) override;
   virtual int DequeueUserData(void* data, uint32_t* size) override;
+  virtual int QueueSeiPayload(uint32_t type, const void* data,
+                              uint32_t size) override;
+  virtual int QueueTimeCode(const TimeCode& timecode) override;
+  virtual int QueueRegionOfInterest(const RegionOfInterest* regions,
+                                    uint32_t count) override;
   virtual int DequeueOutputBuffer(void** ptr, uint32_t* size) override;
+  virtual int GetSliceOffsets(uint32_t* offsets, uint32_t* count) override;
+  virtual int DequeueOutputSegments(OutputDescriptor* desc) override;
   virtual void ReleaseOutputBuffer(void* ptr) override;
+  virtual int RequestIntraRefresh() override;
+  virtual int MarkLongTermReference() override;
+  virtual int InvalidateReferences(uint32_t first, uint32_t last) override;
   virtual void GetFlowControlParam(float* fps,
                                    uint32_t* throughput) const override;
   virtual void SetFlowControlParam(const float fps,
@@ -134,15 +183,26 @@ class EncoderImplNvidia : public Encoder {
   NV_ENC_PARAMS_RC_MODE rcConvert(RateControlMode rc);
   uint32_t sliceModeConvert(SliceMode sm);
   std::vector<void*>& allocateInternal(const CodecConfig& config);
+  void refreshReferences(const uint8_t* data, uint32_t size);
 
  private:
   std::unique_ptr<nvenc::CVRNvFramework> m_Object;
   std::vector<void*> m_MemInternal;
   std::vector<void*>::iterator m_MemIterator;
   std::atomic<size_t> m_InternelMemSize;
-  std::deque<std::vector<char>> m_UserData;
-  std::mutex m_UserMutex;
+  FrameUserData m_UserData;
   bool m_InternalAllocated;
+  bool m_bUserDataSei;
+  bool m_bTimeCode;
+  CodecFourcc m_Codec;
+  int32_t m_Fps;
+  uint32_t m_OutputOrder;  //!< frames dequeued
+  bool m_bDynamicRoi;
+  const uint8_t* m_LastOutput;
+  uint32_t m_LastOutputSize;
+  LongTermReferences m_References;
+  std::mutex m_RefLock;
+  uint32_t m_FrameOrder;
 #endif  // LL_CODEC_NVENC_NV_FRAMEWORK_H
 };
 
@@ -0,0 +1,201 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Decode many streams on a fixed pool of worker threads
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_decode_service.h"
+#include <cstring>
+
+namespace ixr {
+namespace {
+constexpr uint32_t kQueueDepth = 16;
+constexpr uint32_t kDeadlineMs = 100;
+// Retry a parked stream in case no output is released, i.e. the decoder
+// is waiting for more bytes to output a frame.
+constexpr std::chrono::milliseconds kRetryInterval(2);
+}  // namespace
+
+DecodeService::DecodeService(uint32_t workers) : exit_(false) {
+  if (workers == 0) workers = std::thread::hardware_concurrency();
+  if (workers == 0) workers = 1;
+  for (uint32_t i = 0; i < workers; i++) {
+    workers_.emplace_back(&DecodeService::work, this);
+  }
+}
+
+DecodeService::~DecodeService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  cond_.notify_all();
+  for (auto &t : workers_) t.join();
+  streams_.clear();
+}
+
+int DecodeService::AddStream(CodecConfig &config, void *nalu, uint32_t size,
+                             const StreamConfig &stream) {
+  auto s = std::make_shared<Stream>();
+  s->decoder = Decoder::Create(config.adapter);
+  if (!s->decoder) return -1;
+  s->decoder->Allocate(config, nalu, size);
+  s->config = stream;
+  if (s->config.queueDepth == 0) s->config.queueDepth = kQueueDepth;
+  if (s->config.deadline == 0) s->config.deadline = kDeadlineMs;
+  s->busy = false;
+  s->removed = false;
+  s->stat = StreamStat();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < streams_.size(); i++) {
+    if (!streams_[i]) {
+      streams_[i] = std::move(s);
+      return static_cast<int>(i);
+    }
+  }
+  streams_.push_back(std::move(s));
+  return static_cast<int>(streams_.size() - 1);
+}
+
+void DecodeService::RemoveStream(int id) {
+  std::shared_ptr<Stream> s;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Stream *p = stream(id);
+    if (!p) return;
+    p->removed = true;
+    cond_.wait(lock, [p]() { return !p->busy; });
+    s = std::move(streams_[id]);
+  }
+  // the decoder is deallocated out of the lock, by the last one that holds
+  // the stream
+  s.reset();
+}
+
+int DecodeService::QueuePacket(int id, const void *data, uint32_t size,
+                               int64_t pts) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stream *s = stream(id);
+  if (!s || s->stat.error) return -1;
+  if (s->packets.size() >= s->config.queueDepth) {
+    s->stat.rejected++;
+    return -1;
+  }
+  Packet p;
+  if (!s->spare.empty()) {
+    p.data = std::move(s->spare.back());
+    s->spare.pop_back();
+  }
+  p.eos = !data && size == 0;
+  p.data.resize(size);
+  if (size) std::memcpy(p.data.data(), data, size);
+  p.pts = pts;
+  p.deadline = Clock::now() + std::chrono::milliseconds(s->config.deadline);
+  s->packets.push_back(std::move(p));
+  s->stat.packets++;
+  cond_.notify_one();
+  return 0;
+}
+
+int DecodeService::DequeueOutputBuffer(int id, void **ptr, int64_t *pts) {
+  // the decoder lives till return, even if the stream is removed meanwhile
+  std::shared_ptr<Stream> s = hold(id);
+  if (!s) return -1;
+  return s->decoder->DequeueOutputBuffer(ptr, pts);
+}
+
+void DecodeService::ReleaseOutputBuffer(int id, void *ptr) {
+  std::shared_ptr<Stream> s = hold(id);
+  if (!s) return;
+  s->decoder->ReleaseOutputBuffer(ptr);
+  std::lock_guard<std::mutex> lock(mutex_);
+  // a surface is freed, wake the parked stream up
+  s->retryAt = Clock::time_point();
+  if (!s->packets.empty()) cond_.notify_one();
+}
+
+StreamStat DecodeService::GetStreamStat(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stream *s = stream(id);
+  return s ? s->stat : StreamStat();
+}
+
+void DecodeService::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!exit_) {
+    Clock::time_point wake = Clock::time_point::max();
+    Stream *s = pick(Clock::now(), &wake);
+    if (!s) {
+      if (wake == Clock::time_point::max()) {
+        cond_.wait(lock);
+      } else {
+        cond_.wait_until(lock, wake);
+      }
+      continue;
+    }
+    s->busy = true;
+    // references to deque elements survive push_back of other threads
+    Packet &p = s->packets.front();
+    lock.unlock();
+    int ret = -1;
+    bool failed = false;
+    try {
+      if (p.eos) {
+        ret = s->decoder->QueueInputBuffer(nullptr, 0);
+      } else {
+        ret = s->decoder->QueueInputBuffer(
+            p.data.data(), static_cast<uint32_t>(p.data.size()), p.pts);
+      }
+    } catch (...) {
+      failed = true;
+    }
+    Clock::time_point now = Clock::now();
+    lock.lock();
+    s->busy = false;
+    if (failed) {
+      s->stat.error = -1;
+      s->packets.clear();
+    } else if (ret == 0) {
+      s->stat.decoded++;
+      if (now > p.deadline) s->stat.missed++;
+      s->spare.push_back(std::move(p.data));
+      s->packets.pop_front();
+    } else {
+      // out of surfaces, the rest bytes will be queued again
+      s->retryAt = now + kRetryInterval;
+    }
+    // wakes up RemoveStream, or another worker for the rest packets
+    cond_.notify_all();
+  }
+}
+
+DecodeService::Stream *DecodeService::pick(Clock::time_point now,
+                                           Clock::time_point *wake) {
+  Stream *next = nullptr;
+  for (auto &s : streams_) {
+    if (!s || s->busy || s->removed || s->packets.empty()) continue;
+    if (s->retryAt > now) {
+      if (s->retryAt < *wake) *wake = s->retryAt;
+      continue;
+    }
+    if (!next ||
+        s->packets.front().deadline < next->packets.front().deadline) {
+      next = s.get();
+    }
+  }
+  return next;
+}
+
+DecodeService::Stream *DecodeService::stream(int id) {
+  if (id < 0 || id >= static_cast<int>(streams_.size())) return nullptr;
+  return streams_[id].get();
+}
+
+std::shared_ptr<DecodeService::Stream> DecodeService::hold(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!stream(id)) return nullptr;
+  return streams_[id];
+}
+}  // namespace ixr
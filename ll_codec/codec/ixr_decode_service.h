@@ -0,0 +1,132 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Decode many streams on a fixed pool of worker threads
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_DECODE_SERVICE_H_
+#define LL_CODEC_CODEC_IXR_DECODE_SERVICE_H_
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+struct StreamConfig {
+  uint32_t queueDepth;  //!< packets held for the stream, 16 if 0
+  uint32_t deadline;    //!< ms from QueuePacket to decode, 100 if 0
+};
+
+struct StreamStat {
+  uint64_t packets;   //!< packets accepted by QueuePacket
+  uint64_t rejected;  //!< packets rejected as the queue is full
+  uint64_t decoded;   //!< packets consumed by the decoder
+  uint64_t missed;    //!< packets decoded after their deadlines
+  int32_t error;      //!< -1 if the decoder failed, the stream is stopped
+};
+
+/**
+ * @brief Multiplex decoders of many streams onto a fixed pool of worker
+ * threads.
+ *
+ * Packets are copied into a bounded queue of each stream. Workers pick the
+ * stream whose first packet has the earliest deadline, so that streams of
+ * the same latency budget are served first come first served, and a burst
+ * of one stream doesn't starve the others. A stream is decoded by at most
+ * one worker at a time.
+ *
+ * If a decoder is out of free surfaces, its packet stays in the queue and
+ * the stream is parked until an output of it is released, so workers never
+ * block on a single stream. Outputs are dequeued and released by the
+ * caller from any thread other than the workers.
+ */
+class DecodeService {
+ public:
+  /**
+   * @param workers number of worker threads, the number of hardware
+   *        threads if 0.
+   */
+  explicit DecodeService(uint32_t workers);
+
+  //! Stop the workers and deallocate the decoders of all streams
+  ~DecodeService();
+
+  /**
+   * @brief Create a decoder for a stream.
+   *
+   * @param config codec configurations, @see Decoder::Allocate
+   * @param nalu a complete IDR frame or JPEG header
+   * @param size size of the NALU
+   * @param stream queue configurations of the stream
+   * @return id of the stream, -1 if failed
+   */
+  int AddStream(CodecConfig &config, void *nalu, uint32_t size,
+                const StreamConfig &stream);
+
+  /**
+   * @brief Drop queued packets and deallocate the decoder of a stream. All
+   * outputs of the stream must have been released. A call on the outputs
+   * that is running keeps the decoder till it returns.
+   */
+  void RemoveStream(int id);
+
+  /**
+   * @brief Copy a packet into the queue of a stream.
+   *
+   * @param data bytes of the packet, or null to signal the end of stream
+   * @param size size of the packet, 0 at the end of stream
+   * @param pts presentation time stamp in 90kHz
+   * @return 0 if succeed, -1 if the queue is full or the stream is stopped
+   */
+  int QueuePacket(int id, const void *data, uint32_t size, int64_t pts);
+
+  //! @see Decoder::DequeueOutputBuffer
+  int DequeueOutputBuffer(int id, void **ptr, int64_t *pts);
+
+  //! @see Decoder::ReleaseOutputBuffer
+  void ReleaseOutputBuffer(int id, void *ptr);
+
+  StreamStat GetStreamStat(int id);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Packet {
+    std::vector<uint8_t> data;
+    int64_t pts;
+    bool eos;
+    Clock::time_point deadline;
+  };
+
+  struct Stream {
+    std::unique_ptr<Decoder> decoder;
+    StreamConfig config;
+    std::deque<Packet> packets;
+    std::vector<std::vector<uint8_t>> spare;  //!< buffers to reuse
+    Clock::time_point retryAt;
+    bool busy;
+    bool removed;
+    StreamStat stat;
+  };
+
+  void work();
+  Stream *pick(Clock::time_point now, Clock::time_point *wake);
+  Stream *stream(int id);
+  //! @return a reference of the stream to use out of the lock
+  std::shared_ptr<Stream> hold(int id);
+
+  std::vector<std::shared_ptr<Stream>> streams_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool exit_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_DECODE_SERVICE_H_
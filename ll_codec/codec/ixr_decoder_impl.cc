@@ -16,7 +16,8 @@ DecoderImplIntel::~DecoderImplIntel() { Deallocate(); }
 
 void DecoderImplIntel::Allocate(CodecConfig &config, void *nalu,
                                 uint32_t size) {
-  m_Object = std::make_unique<mfxvr::dec::CVRDecBase>();
+  m_Object = std::make_unique<mfxvr::dec::CVRDecBase>(
+      config.intel.useSoftware != 0);
   mfxvr::vrpar::config par{};
   par.codec = config.codec;
   par.multiViewCodec = config.advanced.enableMvc;
@@ -27,10 +28,12 @@ void DecoderImplIntel::Allocate(CodecConfig &config, void *nalu,
       par.renderer = config.device;
       break;
     case IXR_MEM_INTERNAL_CPU:
+    case IXR_MEM_EXTERNAL_CPU:
+      // decoder outputs are always owned by the decoder, the CPU surfaces
+      // are returned without copy.
       par.renderer = nullptr;
       break;
     case IXR_MEM_EXTERNAL_GPU:
-    case IXR_MEM_EXTERNAL_CPU:
       // @Todo: TBD...
       break;
   }
@@ -51,14 +54,25 @@ void DecoderImplIntel::Deallocate() {
 CodecStat DecoderImplIntel::GetDecodeStatus() { return CodecStat(); }
 
 int DecoderImplIntel::QueueInputBuffer(void *ptr, uint32_t size) {
+  return QueueInputBuffer(ptr, size, kPtsUnknown);
+}
+
+int DecoderImplIntel::QueueInputBuffer(void *ptr, uint32_t size,
+                                       int64_t pts) {
   if (!m_Object) return -1;
-  return m_Object->QueueInput(ptr, size) ? 0 : -1;
+  return m_Object->QueueInput(ptr, size, static_cast<mfxU64>(pts)) ? 0 : -1;
 }
 
 int DecoderImplIntel::DequeueOutputBuffer(void **ptr) {
+  return DequeueOutputBuffer(ptr, nullptr);
+}
+
+int DecoderImplIntel::DequeueOutputBuffer(void **ptr, int64_t *pts) {
   void *avoid_stack_error[2]{};
-  if (m_Object) m_Object->DequeueOutputSurface(avoid_stack_error);
+  mfxU64 timestamp = MFX_TIMESTAMP_UNKNOWN;
+  if (m_Object) m_Object->DequeueOutputSurface(avoid_stack_error, &timestamp);
   *ptr = avoid_stack_error[0];
+  if (pts) *pts = static_cast<int64_t>(timestamp);
   return *ptr ? 0 : -1;
 }
 
@@ -76,6 +90,10 @@ uint32_t ixr::DecoderImplIntel::formatConvert(ColorFourcc f) {
       return MFX_FOURCC_NV12;
     case IXR_COLOR_ARGB:
       return MFX_FOURCC_RGB4;
+    case IXR_COLOR_P010:
+      return MFX_FOURCC_P010;
+    case IXR_COLOR_Y410:
+      return MFX_FOURCC_Y410;
     default:
       break;
   }
@@ -0,0 +1,110 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Reorder decoded frames by time stamps and pace them to vsync
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_display_queue.h"
+#include <algorithm>
+
+namespace ixr {
+namespace {
+// min-heap on time stamps
+template <class T>
+bool Later(const T &a, const T &b) {
+  return a.pts > b.pts;
+}
+}  // namespace
+
+DisplayQueue::DisplayQueue(Decoder *decoder, const DisplayConfig &config)
+    : decoder_(decoder),
+      config_(config),
+      draining_(false),
+      started_(false),
+      offset_(0),
+      lastPts_(kPtsUnknown),
+      shownPts_(kPtsUnknown),
+      dropped_(0) {
+  heap_.reserve(config_.jitterFrames + 1);
+}
+
+int DisplayQueue::Poll(int64_t now, void **frame, int64_t *pts) {
+  fetch();
+  if (heap_.empty()) return -1;
+  if (!draining_ && heap_.size() <= config_.jitterFrames) {
+    // fill the jitter buffer before the first release, frames are only
+    // released in order when there's no clock.
+    if (!started_ || config_.vsyncPeriod <= 0) return -1;
+  }
+  if (!started_) {
+    offset_ = now - heap_.front().pts;
+    started_ = true;
+  }
+  Frame f;
+  if (config_.vsyncPeriod <= 0) {
+    f = pop();
+  } else {
+    // a frame is due if its time is before the middle of this vsync
+    const int64_t deadline = now + config_.vsyncPeriod / 2 - offset_;
+    if (heap_.front().pts > deadline) return -1;
+    f = pop();
+    while (config_.dropLate && !heap_.empty() &&
+           heap_.front().pts <= deadline) {
+      drop(f);
+      f = pop();
+    }
+    // The decoder fell behind for more than a vsync, catch up with the
+    // clock, or the following frames will be dropped in a row.
+    if (f.pts + offset_ < now - config_.vsyncPeriod) offset_ = now - f.pts;
+  }
+  shownPts_ = f.pts;
+  *frame = f.ptr;
+  if (pts) *pts = f.pts;
+  return 0;
+}
+
+void DisplayQueue::Clear() {
+  fetch();
+  for (auto &f : heap_) decoder_->ReleaseOutputBuffer(f.ptr);
+  heap_.clear();
+  draining_ = false;
+  started_ = false;
+  lastPts_ = kPtsUnknown;
+  shownPts_ = kPtsUnknown;
+}
+
+void DisplayQueue::fetch() {
+  Frame f{};
+  while (decoder_->DequeueOutputBuffer(&f.ptr, &f.pts) == 0) {
+    if (f.pts == kPtsUnknown) {
+      f.pts = lastPts_ == kPtsUnknown ? 0 : lastPts_ + config_.frameDuration;
+    }
+    lastPts_ = std::max(lastPts_, f.pts);
+    if (config_.dropLate && shownPts_ != kPtsUnknown && f.pts <= shownPts_) {
+      // too late to be reordered
+      drop(f);
+    } else {
+      push(f);
+    }
+  }
+}
+
+void DisplayQueue::push(const Frame &f) {
+  heap_.push_back(f);
+  std::push_heap(heap_.begin(), heap_.end(), Later<Frame>);
+}
+
+DisplayQueue::Frame DisplayQueue::pop() {
+  std::pop_heap(heap_.begin(), heap_.end(), Later<Frame>);
+  Frame f = heap_.back();
+  heap_.pop_back();
+  return f;
+}
+
+void DisplayQueue::drop(const Frame &f) {
+  decoder_->ReleaseOutputBuffer(f.ptr);
+  dropped_++;
+}
+}  // namespace ixr
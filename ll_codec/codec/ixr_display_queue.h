@@ -0,0 +1,94 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Reorder decoded frames by time stamps and pace them to vsync
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_DISPLAY_QUEUE_H_
+#define LL_CODEC_CODEC_IXR_DISPLAY_QUEUE_H_
+#include <stdint.h>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+struct DisplayConfig {
+  uint32_t jitterFrames;  //!< frames buffered before the first release
+  int64_t vsyncPeriod;    //!< 90kHz, 0 to release frames once in order
+  int64_t frameDuration;  //!< 90kHz, to stamp frames without time stamps
+  int32_t dropLate : 1;   //!< Set this to 1 to drop frames behind the clock
+};
+
+/**
+ * @brief Display queue of a decoder.
+ *
+ * Decoded frames are held in a min-heap of presentation time stamps, so
+ * that they are released in display order whatever order the decoder
+ * outputs. The first jitterFrames frames are buffered to absorb the jitter
+ * of arrival.
+ *
+ * If vsyncPeriod is 0, a frame is released once more than jitterFrames
+ * frames are held. Otherwise frames are paced to the display clock: the
+ * first frame is shown at the vsync it's released, and the following ones
+ * at their time stamps relative to it. If several frames are due at a
+ * vsync, all but the last are late, they are dropped if dropLate is set,
+ * or else shown at the following vsyncs. Dropped frames are returned to
+ * the decoder.
+ *
+ * Every frame released by Poll must be returned to the decoder by
+ * Decoder::ReleaseOutputBuffer.
+ */
+class DisplayQueue {
+ public:
+  DisplayQueue(Decoder *decoder, const DisplayConfig &config);
+
+  /**
+   * @brief Fetch decoded frames and release the one to show.
+   *
+   * @param now the display clock in 90kHz, i.e. time of the next vsync.
+   *        Ignored if vsyncPeriod is 0.
+   * @param [out] frame the frame to show
+   * @param [out] pts the time stamp of the frame
+   * @return 0 if a frame is released, -1 if none is due, in that case the
+   *         last frame should be repeated.
+   */
+  int Poll(int64_t now, void **frame, int64_t *pts);
+
+  /**
+   * @brief Release the buffered frames without waiting for the jitter
+   * buffer to be filled, i.e. at the end of stream. Poll until it fails.
+   */
+  void Flush() { draining_ = true; }
+
+  //! Return all held frames to the decoder and restart buffering
+  void Clear();
+
+  uint32_t Size() const { return static_cast<uint32_t>(heap_.size()); }
+
+  //! Number of frames dropped as late
+  uint64_t Dropped() const { return dropped_; }
+
+ private:
+  struct Frame {
+    int64_t pts;
+    void *ptr;
+  };
+
+  void fetch();
+  void push(const Frame &f);
+  Frame pop();
+  void drop(const Frame &f);
+
+  Decoder *decoder_;
+  DisplayConfig config_;
+  std::vector<Frame> heap_;
+  bool draining_;
+  bool started_;
+  int64_t offset_;    //!< display clock minus time stamp
+  int64_t lastPts_;   //!< time stamp of the last frame fetched
+  int64_t shownPts_;  //!< time stamp of the last frame released
+  uint64_t dropped_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_DISPLAY_QUEUE_H_
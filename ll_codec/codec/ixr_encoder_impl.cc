@@ -7,6 +7,7 @@ Created     : Nov. 14th, 2017
 changelog
 ********************************************************************/
 #include "ll_codec/codec/ixr_codec_impl.h"
+#include <algorithm>
 
 namespace ixr {
 EncoderImplIntel::EncoderImplIntel() {}
@@ -14,18 +15,34 @@ EncoderImplIntel::EncoderImplIntel() {}
 EncoderImplIntel::~EncoderImplIntel() { Deallocate(); }
 
 void EncoderImplIntel::Allocate(const CodecConfig &config) {
-  m_Object = std::make_unique<mfxvr::enc::CVRmfxFramework>(true);
+  m_Object = std::make_unique<mfxvr::enc::CVRmfxFramework>(
+      true, config.intel.useSoftware != 0);
   m_bRunning = false;
+  m_bJoined = false;
+  m_bPartial = false;
+  m_LastOutput = nullptr;
+  m_LastOutputSize = 0;
   mfxvr::vrpar::config par{};
   par.in.cropW = par.in.width = static_cast<uint16_t>(config.width);
   par.in.cropH = par.in.height = static_cast<uint16_t>(config.height);
   par.in.color_format = formatConvert(config.inputFormat);
   par.out = par.in;
-  par.out.color_format = MFX_FOURCC_NV12;
+  // HEVC codes 10-bit inputs as they are, Main10 of P010 and RExt of Y410,
+  // others are converted to 8-bit NV12 by VPP
+  par.out.color_format = config.codec == IXR_CODEC_HEVC &&
+                                 (config.inputFormat == IXR_COLOR_P010 ||
+                                  config.inputFormat == IXR_COLOR_Y410)
+                             ? par.in.color_format
+                             : static_cast<mfxU32>(MFX_FOURCC_NV12);
   par.targetKbps = config.bitrate;  // the target bitrate has an offset
   par.gop = static_cast<mfxU16>(config.gop);
   par.fps = static_cast<float>(config.fps);
   par.codec = config.codec;
+  if (config.codec == IXR_CODEC_JPEG && config.advanced.jpegQuality > 0) {
+    // shares the field with the bitrate
+    par.jpegQuality =
+        static_cast<uint32_t>(std::min(config.advanced.jpegQuality, 100));
+  }
   par.enableQSVFF = config.intel.enableQsvff;
   par.numRoi = static_cast<mfxU16>(config.intel.numRegions);
   for (int i = 0; i < par.numRoi; i++) {
@@ -39,10 +56,37 @@ void EncoderImplIntel::Allocate(const CodecConfig &config) {
   par.asyncDepth = config.asyncDepth;
   par.outputSizeMax = config.outputSizeMax;
   par.intraRefresh = config.advanced.enableIntraRefresh;
+  // refresh the whole picture in 10 frames by default
+  par.intraRefreshCycle = static_cast<mfxU16>(
+      config.advanced.intraRefreshDuration > 0
+          ? config.advanced.intraRefreshDuration
+          : 10);
+  par.intraRefreshDist = static_cast<mfxU16>(
+      std::max(config.advanced.intraRefreshPeriod, 0));
+  par.intraRefreshQpDelta = static_cast<mfxI16>(
+      std::min(std::max(config.advanced.intraRefreshQpDelta, -51), 51));
   par.multiViewCodec = config.advanced.enableMvc;
+  par.timeCode = config.advanced.enableTimeCode &&
+                 config.codec == IXR_CODEC_AVC;
   par.rateControl = static_cast<uint16_t>(rcConvert(config.rcMode));
-  par.slice = static_cast<uint16_t>(config.advanced.sliceData);
+  par.slice = static_cast<uint16_t>(config.advanced.enableSlice);
+  par.stitchable = config.advanced.enableStitching &&
+                   config.codec == IXR_CODEC_AVC;
+  // frames are compared on CPU only
+  m_StaticMode = config.codec != IXR_CODEC_JPEG &&
+                         (config.memoryType == IXR_MEM_INTERNAL_CPU ||
+                          config.memoryType == IXR_MEM_EXTERNAL_CPU)
+                     ? config.advanced.staticFrameMode
+                     : IXR_STATIC_ENCODE;
+  par.skipFrame = m_StaticMode == IXR_STATIC_SKIP;
+  m_LastInput = nullptr;
+  par.numLtr = static_cast<mfxU16>(
+      std::min<uint32_t>(std::max(config.advanced.numLongTermRefs, 0),
+                         kMaxLongTermRefs));
+  m_References.Allocate(par.numLtr);
+  m_FrameOrder = 0;
   mfxFrameAllocResponse resp{};
+  m_bExternalMemory = false;
   switch (config.memoryType) {
     case IXR_MEM_INTERNAL_GPU:
       par.renderer = config.device;
@@ -50,48 +94,192 @@ void EncoderImplIntel::Allocate(const CodecConfig &config) {
     case IXR_MEM_INTERNAL_CPU:
       par.renderer = nullptr;
       break;
-    case IXR_MEM_EXTERNAL_GPU:
     case IXR_MEM_EXTERNAL_CPU:
+      par.renderer = nullptr;
+      m_bExternalMemory = true;
+      break;
+    case IXR_MEM_EXTERNAL_GPU:
       // @Todo: TBD...
       break;
   }
-  m_Object->Allocate(par, resp);
+  const uint32_t user_size = config.userDataSizeMax > 0
+                                 ? config.userDataSizeMax
+                                 : kUserDataSizeDefault;
+  m_Codec = config.codec;
+  m_Fps = config.fps;
+  m_OutputOrder = 0;
+  m_bUserDataSei = config.advanced.enableUserDataSei &&
+                   config.codec != IXR_CODEC_JPEG;
+  m_bTimeCode = config.advanced.enableTimeCode &&
+                config.codec != IXR_CODEC_JPEG;
+  m_bDynamicRoi = config.advanced.enableDynamicRoi &&
+                  config.codec != IXR_CODEC_JPEG;
+  if (m_bUserDataSei) {
+    // uuid, plus payload type and size coded as 0xFF...xx
+    par.payloadSizeMax =
+        sizeof(kUserDataUuid) + user_size + user_size / 255 + 4;
+  }
+  if (config.codec != IXR_CODEC_JPEG && config.seiSizeMax > 0) {
+    // several messages may share the space, leave room for their headers
+    par.payloadSizeMax += config.seiSizeMax + config.seiSizeMax / 255 + 16;
+  }
+  if (m_bTimeCode && config.codec == IXR_CODEC_HEVC) {
+    par.payloadSizeMax += kTimeCodeSeiSize + 2;
+  }
+  if (m_bExternalMemory) {
+    m_Object->Allocate(par, config.sharedMemoryId);
+  } else {
+    m_Object->Allocate(par, resp);
+  }
+  const size_t depth = std::max<size_t>(config.asyncDepth,
+                                        config.sharedMemoryId.size());
+  m_UserData.Allocate(static_cast<uint32_t>(depth + 2), user_size);
+  if (m_StaticMode != IXR_STATIC_ENCODE) {
+    m_FrameDiff.Allocate(config.width, config.height, config.inputFormat);
+  }
 }
 
 void EncoderImplIntel::Deallocate() {
+  if (m_Object && m_bJoined) m_Object->DisJoinMe();
+  m_bJoined = false;
   m_Object.reset();
-  m_UserData.~deque();
+  m_UserData.Deallocate();
+  m_FrameDiff.Deallocate();
 }
 
 CodecStat EncoderImplIntel::GetEncodeStatus() {
-  CodecStat stat;
+  CodecStat stat{};
   auto istat = m_Object->GetEncodeStatus();
   stat.numFrames = istat.NumFrame;
   stat.qp = istat.reserved[0];
+  stat.inputFull = static_cast<int32_t>(m_Object->InputFullCount());
+  stat.outputStarved = static_cast<int32_t>(m_Object->OutputStarvedCount());
   return stat;
 }
 
 void *EncoderImplIntel::DequeueInputBuffer() {
-  return m_Object->DequeueInputBuffer(mfxHDL(0));
+  m_LastInput = m_Object->DequeueInputBuffer(mfxHDL(0));
+  return m_LastInput;
 }
 
 int EncoderImplIntel::QueueInputBuffer(void *ptr) {
-  return m_Object->QueueInputBuffer() ? 0 : -1;
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  auto frame = static_cast<const uint8_t *>(ptr ? ptr : m_LastInput);
+  if (m_StaticMode != IXR_STATIC_ENCODE && frame) {
+    if (m_FrameDiff.Update(frame) > 0) {
+      attachDirtyRects();
+    } else if (m_StaticMode == IXR_STATIC_DROP) {
+      m_Object->DiscardInputBuffer();
+      return 1;
+    } else {
+      m_Object->SkipFrame();
+    }
+  }
+  ReferenceControl ref;
+  const bool control = m_References.Resolve(m_FrameOrder, &ref);
+  if (control) attachReferenceList(ref);
+  bool queued = m_bExternalMemory
+                    ? m_Object->QueueInputBuffer(static_cast<mfxHDL>(ptr))
+                    : m_Object->QueueInputBuffer();
+  if (!queued) {
+    // the reference has taken the frame, compare the retry with nothing.
+    // The skip flag stays with the pending slot till it's output, so it's
+    // cleared, or a changed retry would be coded as skipped.
+    m_FrameDiff.Reset();
+    m_Object->SkipFrame(false);
+    return -1;
+  }
+  if (control) m_References.Commit(ref);
+  m_FrameOrder++;
+  m_UserData.Commit();
+  return 0;
+}
+
+int EncoderImplIntel::GetDirtyRects(DirtyRect *rects, uint32_t *count) {
+  if (m_StaticMode == IXR_STATIC_ENCODE || !count) return -1;
+  const auto &dirty = m_FrameDiff.Rects();
+  if (rects) {
+    std::copy_n(dirty.begin(), std::min<size_t>(*count, dirty.size()), rects);
+  }
+  *count = static_cast<uint32_t>(dirty.size());
+  return 0;
+}
+
+void EncoderImplIntel::attachDirtyRects() {
+  mfxExtDirtyRect *ext = m_Object->AttachDirtyRects();
+  if (!ext) return;
+  const auto &dirty = m_FrameDiff.Rects();
+  ext->NumRect = static_cast<mfxU16>(dirty.size());
+  for (size_t i = 0; i < dirty.size(); ++i) {
+    ext->Rect[i].Left = dirty[i].left;
+    ext->Rect[i].Top = dirty[i].top;
+    ext->Rect[i].Right = dirty[i].right;
+    ext->Rect[i].Bottom = dirty[i].bottom;
+  }
 }
 
 int EncoderImplIntel::QueueUserData(void *data, uint32_t size) {
-  std::lock_guard<std::mutex> locker(m_UserMutex);
-  m_UserData.emplace_back();
-  m_UserData.back().resize(size);
-  memcpy(m_UserData.back().data(), data, size);
+  if (!m_UserData.Write(data, size)) return -1;
+  if (m_bUserDataSei) {
+    mfxU8 *sei = m_Object->AttachPayload(kSeiUserDataUnregistered,
+                                         sizeof(kUserDataUuid) + size);
+    if (!sei) {
+      // leave the slot free for a retry
+      m_UserData.Discard();
+      return -1;
+    }
+    memcpy(sei, kUserDataUuid, sizeof(kUserDataUuid));
+    memcpy(sei + sizeof(kUserDataUuid), data, size);
+  }
   return 0;
 }
 
 int EncoderImplIntel::DequeueUserData(void *data, uint32_t *size) {
-  std::lock_guard<std::mutex> locker(m_UserMutex);
-  memcpy(data, m_UserData.front().data(), m_UserData.front().size());
-  m_UserData.pop_front();
-  return static_cast<int>(m_UserData.size());
+  return m_UserData.Read(data, size) ? 0 : -1;
+}
+
+int EncoderImplIntel::QueueSeiPayload(uint32_t type, const void *data,
+                                      uint32_t size) {
+  if (!data || type > 0xFFFF) return -1;
+  mfxU8 *sei = m_Object->AttachPayload(static_cast<mfxU16>(type), size);
+  if (!sei) return -1;
+  memcpy(sei, data, size);
+  return 0;
+}
+
+int EncoderImplIntel::QueueTimeCode(const TimeCode &timecode) {
+  if (!m_bTimeCode) return -1;
+  if (m_Codec == IXR_CODEC_HEVC) {
+    uint8_t sei[kTimeCodeSeiSize];
+    return QueueSeiPayload(kSeiTimeCode, sei, WriteTimeCodeSei(timecode, sei));
+  }
+  mfxExtTimeCode tc{};
+  tc.DropFrameFlag = timecode.dropFrame;
+  tc.TimeCodeHours = timecode.hours;
+  tc.TimeCodeMinutes = timecode.minutes;
+  tc.TimeCodeSeconds = timecode.seconds;
+  tc.TimeCodePictures = timecode.frames;
+  return m_Object->AttachTimeCode(tc) ? 0 : -1;
+}
+
+int EncoderImplIntel::QueueRegionOfInterest(const RegionOfInterest *regions,
+                                            uint32_t count) {
+  if (!m_bDynamicRoi || count > kMaxRegions || (count && !regions)) {
+    return -1;
+  }
+  mfxExtEncoderROI *roi = m_Object->AttachRegions();
+  if (!roi) return -1;
+  roi->NumROI = static_cast<mfxU16>(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    // align to MB outwards
+    roi->ROI[i].Left = regions[i].left & ~15u;
+    roi->ROI[i].Top = regions[i].top & ~15u;
+    roi->ROI[i].Right = (regions[i].right + 15) & ~15u;
+    roi->ROI[i].Bottom = (regions[i].bottom + 15) & ~15u;
+    roi->ROI[i].DeltaQP =
+        static_cast<mfxI16>(std::min(std::max(regions[i].deltaQP, -51), 51));
+  }
+  return 0;
 }
 
 int EncoderImplIntel::DequeueOutputBuffer(void **ptr, uint32_t *size) {
@@ -101,8 +289,99 @@ int EncoderImplIntel::DequeueOutputBuffer(void **ptr, uint32_t *size) {
   int ret = -1;
   if (m_bRunning) {
     ret = m_Object->DequeueOutputBuffer(reinterpret_cast<mfxU8 **>(ptr), size);
+    if (ret == MFX_ERR_NONE || ret == MFX_PARTIAL_OUTPUT) {
+      // user data belongs to the first part of a frame
+      if (!m_bPartial) {
+        m_UserData.Advance();
+        refreshReferences(static_cast<const uint8_t *>(*ptr), *size);
+      }
+      m_bPartial = ret == MFX_PARTIAL_OUTPUT;
+      m_LastOutput = static_cast<const uint8_t *>(*ptr);
+      m_LastOutputSize = *size;
+      if (ret == MFX_ERR_NONE) m_OutputOrder++;
+    }
   }
-  if (ret == 0 || ret != 12) m_bRunning = false;
+  if (ret != MFX_PARTIAL_OUTPUT) m_bRunning = false;
+  if (ret == MFX_PARTIAL_OUTPUT) return 1;
+  return ret;
+}
+
+int EncoderImplIntel::RequestIntraRefresh() {
+  return m_Object->RequestIntraRefresh() ? 0 : -1;
+}
+
+int EncoderImplIntel::MarkLongTermReference() {
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  return m_References.Mark() ? 0 : -1;
+}
+
+int EncoderImplIntel::InvalidateReferences(uint32_t first, uint32_t last) {
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  return m_References.Invalidate(first, last) ? 0 : -1;
+}
+
+void EncoderImplIntel::refreshReferences(const uint8_t *data, uint32_t size) {
+  // an IDR of gop or RequestIntraRefresh flushes the long-term references
+  if (!m_References.Slots() ||
+      AccessUnitType(m_Codec, data, size) != IXR_FRAME_IDR) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  m_References.Refresh(m_OutputOrder);
+}
+
+void EncoderImplIntel::attachReferenceList(const ReferenceControl &ref) {
+  mfxExtAVCRefListCtrl list{};
+  const mfxU32 unknown = static_cast<mfxU32>(MFX_FRAMEORDER_UNKNOWN);
+  for (auto &r : list.PreferredRefList) r.FrameOrder = unknown;
+  for (auto &r : list.RejectedRefList) r.FrameOrder = unknown;
+  for (auto &r : list.LongTermRefList) r.FrameOrder = unknown;
+  int n = 0;
+  for (uint32_t i = 0; i < m_References.Slots(); ++i) {
+    if (ref.use & (1u << i)) {
+      list.PreferredRefList[n].FrameOrder =
+          static_cast<mfxU32>(m_References.Frame(i));
+      list.PreferredRefList[n++].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+    }
+  }
+  n = 0;
+  if (ref.replaced >= 0) {
+    list.RejectedRefList[n].FrameOrder = static_cast<mfxU32>(ref.replaced);
+    list.RejectedRefList[n++].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+  }
+  // the DPB holds 16 frames at most, reject the latest ones
+  for (uint32_t f = ref.rejectLast; ref.rejectFirst <= ref.rejectLast &&
+                                    f >= ref.rejectFirst && n < 16;
+       --f) {
+    list.RejectedRefList[n].FrameOrder = f;
+    list.RejectedRefList[n++].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+    if (f == 0) break;
+  }
+  if (ref.mark >= 0) {
+    list.LongTermRefList[0].FrameOrder = ref.frame;
+    list.LongTermRefList[0].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+    list.LongTermRefList[0].LongTermIdx = static_cast<mfxU16>(ref.mark);
+  }
+  list.NumRefIdxL0Active = static_cast<mfxU16>(
+      std::max<uint32_t>(m_References.Slots(), 1));
+  m_Object->AttachReferenceList(
+      list, ref.idr ? mfxU16(MFX_FRAMETYPE_I | MFX_FRAMETYPE_REF |
+                             MFX_FRAMETYPE_IDR)
+                    : mfxU16(MFX_FRAMETYPE_UNKNOWN));
+}
+
+int EncoderImplIntel::GetSliceOffsets(uint32_t *offsets, uint32_t *count) {
+  if (!count || !m_LastOutput || m_Codec == IXR_CODEC_JPEG) return -1;
+  *count = FindSlices(m_Codec, m_LastOutput, m_LastOutputSize, offsets,
+                      offsets ? *count : 0);
+  return 0;
+}
+
+int EncoderImplIntel::DequeueOutputSegments(OutputDescriptor *desc) {
+  const int ret = Encoder::DequeueOutputSegments(desc);
+  // the order is advanced as the last part is dequeued
+  const uint32_t order = ret == 0 ? m_OutputOrder - 1 : m_OutputOrder;
+  if (ret >= 0) DescribeOutput(m_Codec, m_Fps, order, desc);
   return ret;
 }
 
@@ -122,12 +401,29 @@ void EncoderImplIntel::SetFlowControlParam(const float fps,
   m_Object->SetFlowControlParam(fps, throughput);
 }
 
+int EncoderImplIntel::SetJpegQuality(int32_t quality) {
+  if (!m_Object || quality < 1 || quality > 100) return -1;
+  return m_Object->SetJpegQuality(static_cast<mfxU16>(quality)) ? 0 : -1;
+}
+
+int EncoderImplIntel::JoinSession(Encoder *parent) {
+  auto p = dynamic_cast<EncoderImplIntel *>(parent);
+  if (!p || p == this || !p->m_Object || !m_Object || m_bJoined) return -1;
+  if (m_Object->Join(p->m_Object->GetSession()) != MFX_ERR_NONE) return -1;
+  m_bJoined = true;
+  return 0;
+}
+
 uint32_t EncoderImplIntel::formatConvert(ColorFourcc f) {
   switch (f) {
     case IXR_COLOR_NV12:
       return MFX_FOURCC_NV12;
     case IXR_COLOR_ARGB:
       return MFX_FOURCC_RGB4;
+    case IXR_COLOR_P010:
+      return MFX_FOURCC_P010;
+    case IXR_COLOR_Y410:
+      return MFX_FOURCC_Y410;
     default:
       break;
   }
@@ -150,14 +446,18 @@ uint32_t EncoderImplIntel::rcConvert(RateControlMode rc) {
 
 int32_t EncoderImplIntel::sliceModeConvert(SliceMode sm) {
   switch (sm) {
+    case ixr::MB_BASED:
+      return mfxvr::vrpar::SLICE_MB;
+    case ixr::BYTE_BASED:
+      return mfxvr::vrpar::SLICE_BYTE;
     case ixr::TILE_BASED:
-      return 1;
+      return mfxvr::vrpar::SLICE_TILE;
     case ixr::BLOCK_BASED:
-      return 2;
+      return mfxvr::vrpar::SLICE_BLOCK;
     default:
       break;
   }
-  return 3;
+  return mfxvr::vrpar::SLICE_TILE;
 }
 #endif  // LL_CODEC_MFXVR_ENCODER_DETAIL_MFX_FRAMEWORK_ENC_H_
 
@@ -169,6 +469,11 @@ EncoderImplNvidia::~EncoderImplNvidia() { Deallocate(); }
 void EncoderImplNvidia::Allocate(const CodecConfig &config) {
   m_Object = std::make_unique<nvenc::CVRNvFramework>();
   m_InternalAllocated = false;
+  m_Codec = config.codec;
+  m_Fps = config.fps;
+  m_OutputOrder = 0;
+  m_LastOutput = nullptr;
+  m_LastOutputSize = 0;
   nvenc::EncodeConfig par{};
   par.width = config.width;
   par.height = config.height;
@@ -190,10 +495,27 @@ void EncoderImplNvidia::Allocate(const CodecConfig &config) {
   par.enableTemporalAQ = config.nv.enableTemporalAQ;
   par.intraRefreshDuration = config.advanced.intraRefreshDuration;
   par.intraRefreshPeriod = config.advanced.intraRefreshPeriod;
-  // par.sliceMode =
+  par.sliceMode = sliceModeConvert(config.advanced.sliceMode);
   par.sliceData = config.advanced.sliceData;
   par.vbvSize = config.nv.vbvSize;
   par.vbvMaxBitrate = config.nv.maxBitrate;
+  par.numLongTermRefs = static_cast<int>(
+      std::min<uint32_t>(std::max(config.advanced.numLongTermRefs, 0),
+                         kMaxLongTermRefs));
+  m_References.Allocate(static_cast<uint32_t>(par.numLongTermRefs));
+  m_FrameOrder = 0;
+  const uint32_t user_size = config.userDataSizeMax > 0
+                                 ? config.userDataSizeMax
+                                 : kUserDataSizeDefault;
+  m_bUserDataSei = config.advanced.enableUserDataSei;
+  // NVENC only writes time code in time_code SEI of HEVC
+  m_bTimeCode = config.advanced.enableTimeCode &&
+                config.codec == IXR_CODEC_HEVC;
+  m_bDynamicRoi = config.advanced.enableDynamicRoi;
+  par.enableQpDeltaMap = m_bDynamicRoi;
+  par.seiSizeMax = config.seiSizeMax > 0 ? config.seiSizeMax : 0;
+  if (m_bUserDataSei) par.seiSizeMax += sizeof(kUserDataUuid) + user_size;
+  if (m_bTimeCode) par.seiSizeMax += kTimeCodeSeiSize;
   switch (config.memoryType) {
     case IXR_MEM_INTERNAL_GPU:
       allocateInternal(config);
@@ -210,6 +532,8 @@ void EncoderImplNvidia::Allocate(const CodecConfig &config) {
     par.sharedTextures.push_back(mid);
   }
   m_Object->Allocate(par);
+  m_UserData.Allocate(static_cast<uint32_t>(config.asyncDepth + 2),
+                      user_size);
 }
 
 void EncoderImplNvidia::Deallocate() {
@@ -222,7 +546,7 @@ void EncoderImplNvidia::Deallocate() {
   }
   m_Object.reset();
   m_MemInternal.~vector();
-  m_UserData.~deque();
+  m_UserData.Deallocate();
 }
 
 CodecStat EncoderImplNvidia::GetEncodeStatus() {
@@ -243,32 +567,122 @@ void *EncoderImplNvidia::DequeueInputBuffer() {
 }
 
 int EncoderImplNvidia::QueueInputBuffer(void *ptr) {
-  return m_Object->QueueInputBuffer(ptr) ? 0 : -1;
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  ReferenceControl ref;
+  const bool control = m_References.Resolve(m_FrameOrder, &ref);
+  if (control) {
+    nvenc::ReferenceControl ctrl{ref.mark, ref.use, ref.idr, ref.rejectFirst,
+                                 ref.rejectLast};
+    // the replaced frame is dropped by marking the slot over it
+    m_Object->SetReferenceControl(ctrl);
+  }
+  if (!m_Object->QueueInputBuffer(ptr)) return -1;
+  if (control) m_References.Commit(ref);
+  m_FrameOrder++;
+  m_UserData.Commit();
+  return 0;
 }
 
 int EncoderImplNvidia::QueueUserData(void *data, uint32_t size) {
-  std::lock_guard<std::mutex> locker(m_UserMutex);
-  m_UserData.emplace_back();
-  m_UserData.back().resize(size);
-  memcpy(m_UserData.back().data(), data, size);
+  if (!m_UserData.Write(data, size)) return -1;
+  if (m_bUserDataSei) {
+    uint8_t *sei = m_Object->AttachPayload(kSeiUserDataUnregistered,
+                                           sizeof(kUserDataUuid) + size);
+    if (!sei) {
+      // leave the slot free for a retry
+      m_UserData.Discard();
+      return -1;
+    }
+    memcpy(sei, kUserDataUuid, sizeof(kUserDataUuid));
+    memcpy(sei + sizeof(kUserDataUuid), data, size);
+  }
   return 0;
 }
 
 int EncoderImplNvidia::DequeueUserData(void *data, uint32_t *size) {
-  std::lock_guard<std::mutex> locker(m_UserMutex);
-  memcpy(data, m_UserData.front().data(), m_UserData.front().size());
-  m_UserData.pop_front();
+  return m_UserData.Read(data, size) ? 0 : -1;
+}
+
+int EncoderImplNvidia::QueueSeiPayload(uint32_t type, const void *data,
+                                       uint32_t size) {
+  if (!data) return -1;
+  uint8_t *sei = m_Object->AttachPayload(type, size);
+  if (!sei) return -1;
+  memcpy(sei, data, size);
+  return 0;
+}
+
+int EncoderImplNvidia::QueueTimeCode(const TimeCode &timecode) {
+  if (!m_bTimeCode) return -1;
+  uint8_t sei[kTimeCodeSeiSize];
+  return QueueSeiPayload(kSeiTimeCode, sei, WriteTimeCodeSei(timecode, sei));
+}
+
+int EncoderImplNvidia::QueueRegionOfInterest(const RegionOfInterest *regions,
+                                             uint32_t count) {
+  if (!m_bDynamicRoi || count > kMaxRegions || (count && !regions)) {
+    return -1;
+  }
+  uint32_t block = 0, blocks_w = 0, blocks_h = 0;
+  int8_t *map = m_Object->AttachQpDeltaMap(&block, &blocks_w, &blocks_h);
+  if (!map) return -1;
+  FillQpDeltaMap(regions, count, block, blocks_w, blocks_h, map);
   return 0;
 }
 
 int EncoderImplNvidia::DequeueOutputBuffer(void **ptr, uint32_t *size) {
   if (m_Object->DequeueOutputBuffer(ptr, size)) {
     m_InternelMemSize++;
+    m_UserData.Advance();
+    m_LastOutput = static_cast<const uint8_t *>(*ptr);
+    m_LastOutputSize = *size;
+    refreshReferences(m_LastOutput, m_LastOutputSize);
+    m_OutputOrder++;
     return 0;
   }
   return -1;
 }
 
+int EncoderImplNvidia::RequestIntraRefresh() {
+  m_Object->RequestIntraRefresh();
+  return 0;
+}
+
+int EncoderImplNvidia::MarkLongTermReference() {
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  return m_References.Mark() ? 0 : -1;
+}
+
+int EncoderImplNvidia::InvalidateReferences(uint32_t first, uint32_t last) {
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  return m_References.Invalidate(first, last) ? 0 : -1;
+}
+
+void EncoderImplNvidia::refreshReferences(const uint8_t *data, uint32_t size) {
+  // an IDR of gop or RequestIntraRefresh flushes the long-term references
+  if (!m_References.Slots() ||
+      AccessUnitType(m_Codec, data, size) != IXR_FRAME_IDR) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_RefLock);
+  m_References.Refresh(m_OutputOrder);
+}
+
+int EncoderImplNvidia::GetSliceOffsets(uint32_t *offsets, uint32_t *count) {
+  if (!count || !m_LastOutput) return -1;
+  *count = FindSlices(m_Codec, m_LastOutput, m_LastOutputSize, offsets,
+                      offsets ? *count : 0);
+  return 0;
+}
+
+int EncoderImplNvidia::DequeueOutputSegments(OutputDescriptor *desc) {
+  const int ret = Encoder::DequeueOutputSegments(desc);
+  // the order is advanced as the last part is dequeued
+  const uint32_t order = ret == 0 ? m_OutputOrder - 1 : m_OutputOrder;
+  if (ret >= 0) DescribeOutput(m_Codec, m_Fps, order, desc);
+  return ret;
+}
+
 void EncoderImplNvidia::ReleaseOutputBuffer(void *ptr) {
   m_Object->ReleaseOutputBuffer(ptr);
 }
@@ -289,6 +703,8 @@ NV_ENC_BUFFER_FORMAT EncoderImplNvidia::formatConvert(ColorFourcc f) {
       return NV_ENC_BUFFER_FORMAT_NV12;
     case IXR_COLOR_ARGB:
       return NV_ENC_BUFFER_FORMAT_ARGB;
+    case IXR_COLOR_P010:
+      return NV_ENC_BUFFER_FORMAT_YUV420_10BIT;
     default:
       break;
   }
@@ -0,0 +1,331 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : A work-stealing thread pool shared by codec instances
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_executor.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ixr {
+namespace {
+struct WorkerSlot {
+  const Executor *owner;
+  size_t index;
+};
+thread_local WorkerSlot tls_worker = {nullptr, 0};
+
+std::mutex g_shared_mutex;
+ExecutorConfig g_shared_config = {0, IXR_AFFINITY_NONE, -1};
+bool g_shared_created = false;
+
+using CpuSet = std::vector<uint32_t>;
+
+// logical cores the process may run on
+CpuSet AllowedCpus() {
+  CpuSet cpus;
+#if defined(_WIN32)
+  DWORD_PTR process = 0, system = 0;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system)) {
+    for (uint32_t i = 0; i < sizeof(process) * 8; i++) {
+      if (process & (DWORD_PTR(1) << i)) cpus.push_back(i);
+    }
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (uint32_t i = 0; i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i, &set)) cpus.push_back(i);
+    }
+  }
+#endif
+  return cpus;
+}
+
+#if defined(__linux__)
+// a list of sysfs, i.e. "0-3,8-11"
+CpuSet ParseCpuList(const char *list) {
+  CpuSet cpus;
+  while (*list) {
+    char *end = nullptr;
+    const unsigned long first = std::strtoul(list, &end, 10);
+    if (end == list) break;
+    unsigned long last = first;
+    list = end;
+    if (*list == '-') {
+      last = std::strtoul(list + 1, &end, 10);
+      list = end;
+    }
+    for (unsigned long i = first; i <= last && i < CPU_SETSIZE; i++) {
+      cpus.push_back(static_cast<uint32_t>(i));
+    }
+    if (*list != ',') break;
+    list++;
+  }
+  return cpus;
+}
+#endif
+
+// allowed cores of each NUMA node, one node of all cores if unknown
+std::vector<CpuSet> NumaNodes(const CpuSet &allowed) {
+  std::vector<CpuSet> nodes;
+#if defined(_WIN32)
+  ULONG highest = 0;
+  if (GetNumaHighestNodeNumber(&highest)) {
+    for (ULONG n = 0; n <= highest; n++) {
+      ULONGLONG mask = 0;
+      CpuSet cpus;
+      if (GetNumaNodeProcessorMask(static_cast<UCHAR>(n), &mask)) {
+        for (uint32_t cpu : allowed) {
+          if (cpu < 64 && (mask & (ULONGLONG(1) << cpu))) cpus.push_back(cpu);
+        }
+      }
+      nodes.push_back(cpus);
+    }
+  }
+#elif defined(__linux__)
+  for (int n = 0;; n++) {
+    char path[64];
+    std::snprintf(path, sizeof(path),
+                  "/sys/devices/system/node/node%d/cpulist", n);
+    FILE *file = std::fopen(path, "r");
+    if (!file) break;
+    char list[1024] = {};
+    const bool read = std::fgets(list, sizeof(list), file) != nullptr;
+    std::fclose(file);
+    CpuSet cpus;
+    for (uint32_t cpu : read ? ParseCpuList(list) : CpuSet()) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    nodes.push_back(cpus);
+  }
+#endif
+  // nodes keep their numbers, those without allowed cores stay empty
+  if (std::all_of(nodes.begin(), nodes.end(),
+                  [](const CpuSet &c) { return c.empty(); })) {
+    nodes.assign(1, allowed);
+  }
+  return nodes;
+}
+
+bool PinThread(std::thread *thread, const CpuSet &cpus) {
+  if (cpus.empty()) return false;
+#if defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (uint32_t cpu : cpus) {
+    if (cpu < sizeof(mask) * 8) mask |= DWORD_PTR(1) << cpu;
+  }
+  return mask && SetThreadAffinityMask(thread->native_handle(), mask) != 0;
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (uint32_t cpu : cpus) CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(thread->native_handle(), sizeof(set),
+                                &set) == 0;
+#else
+  return false;
+#endif
+}
+}  // namespace
+
+Executor::Executor(const ExecutorConfig &config)
+    : queued_(0), executed_(0), stolen_(0), pinned_(0), exit_(false) {
+  const CpuSet allowed = AllowedCpus();
+  std::vector<CpuSet> nodes;
+  if (config.affinity == IXR_AFFINITY_NUMA) {
+    nodes = NumaNodes(allowed);
+    if (config.numaNode >= 0 && size_t(config.numaNode) < nodes.size() &&
+        !nodes[config.numaNode].empty()) {
+      nodes = {nodes[config.numaNode]};
+    }
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                               [](const CpuSet &c) { return c.empty(); }),
+                nodes.end());
+  }
+  uint32_t threads = config.threads;
+  if (!threads) {
+    threads = nodes.size() == 1 ? static_cast<uint32_t>(nodes[0].size())
+                                : static_cast<uint32_t>(allowed.size());
+  }
+  if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (uint32_t i = 0; i <= threads; i++) {
+    queues_.emplace_back(new Queue);
+  }
+  for (uint32_t i = 0; i < threads; i++) {
+    threads_.emplace_back(&Executor::work, this, i);
+    bool pinned = false;
+    if (config.affinity == IXR_AFFINITY_CORE && !allowed.empty()) {
+      pinned = PinThread(&threads_.back(), {allowed[i % allowed.size()]});
+    } else if (config.affinity == IXR_AFFINITY_NUMA && !nodes.empty()) {
+      pinned = PinThread(&threads_.back(), nodes[i % nodes.size()]);
+    }
+    pinned_ += pinned;
+  }
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  wake_.notify_all();
+  for (auto &t : threads_) t.join();
+}
+
+Executor &Executor::Shared() {
+  static Executor *shared = []() {
+    std::lock_guard<std::mutex> lock(g_shared_mutex);
+    g_shared_created = true;
+    // never destroyed, tasks may be queued by static objects at exit
+    return new Executor(g_shared_config);
+  }();
+  return *shared;
+}
+
+bool Executor::ConfigureShared(const ExecutorConfig &config) {
+  std::lock_guard<std::mutex> lock(g_shared_mutex);
+  if (g_shared_created) return false;
+  g_shared_config = config;
+  return true;
+}
+
+void Executor::Submit(Task task, TaskPriority priority) {
+  const size_t index =
+      tls_worker.owner == this ? tls_worker.index : threads_.size();
+  Queue &q = *queues_[index];
+  // counted first, so a take racing the push never counts below zero
+  queued_++;
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks[priority == IXR_TASK_BATCH].push_back(std::move(task));
+  }
+  // a worker checks queued_ under the lock before it sleeps
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  wake_.notify_one();
+}
+
+bool Executor::RunOne(TaskPriority lowest) {
+  Task task;
+  const size_t self =
+      tls_worker.owner == this ? tls_worker.index : threads_.size();
+  if (!take(self, &task, lowest)) return false;
+  run(&task);
+  return true;
+}
+
+ExecutorStat Executor::GetStat() const {
+  return ExecutorStat{executed_.load(), stolen_.load(), pinned_};
+}
+
+void Executor::work(size_t index) {
+  tls_worker = WorkerSlot{this, index};
+  for (;;) {
+    Task task;
+    if (take(index, &task)) {
+      run(&task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // queued tasks are run before the exit
+    if (exit_ && queued_ == 0) return;
+    wake_.wait(lock, [this]() { return exit_ || queued_ > 0; });
+  }
+}
+
+bool Executor::take(size_t self, Task *task, TaskPriority lowest) {
+  if (queued_ == 0) return false;
+  const size_t workers = threads_.size();
+  auto pop = [&](size_t index, size_t p, bool newest) {
+    Queue &q = *queues_[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks[p].empty()) return false;
+    if (newest) {
+      *task = std::move(q.tasks[p].back());
+      q.tasks[p].pop_back();
+    } else {
+      *task = std::move(q.tasks[p].front());
+      q.tasks[p].pop_front();
+    }
+    queued_--;
+    return true;
+  };
+  const size_t priorities = lowest == IXR_TASK_BATCH ? kPriorities : 1;
+  for (size_t p = 0; p < priorities; p++) {
+    // the newest task of its own queue is still in cache
+    if (self < workers && pop(self, p, true)) return true;
+    if (pop(workers, p, false)) return true;
+    for (size_t k = 1; k <= workers; k++) {
+      const size_t victim = (self + k) % (workers + 1);
+      if (victim == workers || victim == self) continue;
+      if (pop(victim, p, false)) {
+        stolen_++;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Executor::run(Task *task) {
+  try {
+    (*task)();
+  } catch (...) {
+  }
+  executed_++;
+}
+
+TaskGroup::TaskGroup(TaskPriority priority, Executor *executor)
+    : executor_(executor ? executor : &Executor::Shared()),
+      priority_(priority),
+      pending_(0) {}
+
+TaskGroup::~TaskGroup() { Wait(); }
+
+void TaskGroup::Run(Executor::Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_++;
+  }
+  executor_->Submit(
+      [this, task]() {
+        try {
+          task();
+        } catch (...) {
+        }
+        finish();
+      },
+      priority_);
+}
+
+void TaskGroup::Wait() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_ == 0) return;
+    }
+    if (!executor_->RunOne(priority_)) break;
+  }
+  // the rest are running on other threads
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void TaskGroup::finish() {
+  // notified under the lock, the group may be destroyed once it's released
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--pending_ == 0) done_.notify_all();
+}
+}  // namespace ixr
@@ -0,0 +1,158 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : A work-stealing thread pool shared by codec instances
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_EXECUTOR_H_
+#define LL_CODEC_CODEC_IXR_EXECUTOR_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ixr {
+enum TaskPriority {
+  /** Frames on the path to a viewer, always taken first */
+  IXR_TASK_INTERACTIVE = 0,
+  /** Throughput work, i.e. batches of thumbnails or quality metrics */
+  IXR_TASK_BATCH = 1,
+};
+
+enum AffinityPolicy {
+  /** Threads are scheduled by the OS */
+  IXR_AFFINITY_NONE = 0,
+  /** Each thread is pinned to one logical core, round robin */
+  IXR_AFFINITY_CORE = 1,
+  /** Each thread is pinned to the cores of one NUMA node, round robin over
+      the nodes, or all to ExecutorConfig::numaNode */
+  IXR_AFFINITY_NUMA = 2,
+};
+
+struct ExecutorConfig {
+  uint32_t threads;         //!< 0 for the cores allowed by the policy
+  AffinityPolicy affinity;  //!< cores are those the process may run on
+  int32_t numaNode;         //!< the only node of IXR_AFFINITY_NUMA, or -1
+};
+
+struct ExecutorStat {
+  uint64_t executed;  //!< tasks run, by workers or waiting callers
+  uint64_t stolen;    //!< tasks taken from the queue of another worker
+  uint32_t pinned;    //!< threads whose affinity was applied
+};
+
+/**
+ * @brief A pool of threads running short tasks of all codec instances, in
+ * place of threads spawned by each call.
+ *
+ * Each worker has its own queue, a task submitted by a worker is pushed to
+ * its queue and popped last in first out, while idle workers steal the
+ * oldest tasks of the others. Tasks of other threads go to a shared queue.
+ * Interactive tasks of any queue are taken before batch ones. Idle workers
+ * block on a condition variable, none of them spins.
+ *
+ * Tasks must not throw, exceptions are dropped.
+ */
+class Executor {
+ public:
+  using Task = std::function<void()>;
+
+  explicit Executor(const ExecutorConfig &config);
+
+  //! Run the queued tasks and join the threads
+  ~Executor();
+
+  /**
+   * @brief The executor of ll_codec, created at the first use with the
+   * configurations of ConfigureShared, or one thread a core.
+   */
+  static Executor &Shared();
+
+  /**
+   * @brief Configure the shared executor before its first use.
+   *
+   * @return false if it has been created
+   */
+  static bool ConfigureShared(const ExecutorConfig &config);
+
+  void Submit(Task task, TaskPriority priority = IXR_TASK_INTERACTIVE);
+
+  /**
+   * @brief Run one queued task on the calling thread, so that a thread
+   * waiting for tasks helps instead of blocking.
+   *
+   * @param lowest tasks of a lower priority are left to the workers
+   * @return false if no task is queued
+   */
+  bool RunOne(TaskPriority lowest = IXR_TASK_BATCH);
+
+  uint32_t Threads() const { return static_cast<uint32_t>(threads_.size()); }
+
+  ExecutorStat GetStat() const;
+
+ private:
+  static constexpr size_t kPriorities = 2;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks[kPriorities];
+  };
+
+  void work(size_t index);
+  //! @param self index of the calling worker, threads_.size() if none
+  bool take(size_t self, Task *task, TaskPriority lowest = IXR_TASK_BATCH);
+  void run(Task *task);
+
+  //! of each worker, then the shared one
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> queued_;
+  std::atomic<uint64_t> executed_;
+  std::atomic<uint64_t> stolen_;
+  uint32_t pinned_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool exit_;
+};
+
+/**
+ * @brief Tasks of one call, i.e. the stripes of a picture, which are waited
+ * for together.
+ */
+class TaskGroup {
+ public:
+  //! @param executor the shared one if null
+  explicit TaskGroup(TaskPriority priority = IXR_TASK_INTERACTIVE,
+                     Executor *executor = nullptr);
+
+  //! Wait for the tasks still running
+  ~TaskGroup();
+
+  void Run(Executor::Task task);
+
+  /**
+   * @brief Run queued tasks on this thread while the group isn't done, then
+   * block until its last task completes. Tasks of a lower priority than the
+   * group aren't taken, an interactive wait isn't held by a batch.
+   */
+  void Wait();
+
+ private:
+  void finish();
+
+  Executor *executor_;
+  TaskPriority priority_;
+  size_t pending_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_EXECUTOR_H_
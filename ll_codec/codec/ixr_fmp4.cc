@@ -0,0 +1,457 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Streaming fragmented MP4 (CMAF) writer of AVC and HEVC
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_fmp4.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "ll_codec/codec/ixr_bitstream.h"
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+// sample_flags of trun
+constexpr uint32_t kSyncSample = 0x02000000;
+constexpr uint32_t kNonSyncSample = 0x01010000;
+
+// Append big-endian fields and ISO BMFF boxes to a buffer
+class BoxWriter {
+ public:
+  explicit BoxWriter(std::vector<uint8_t> *buf) : buf_(buf) {}
+
+  size_t Begin(const char *type) {
+    const size_t at = buf_->size();
+    U32(0);
+    Bytes(type, 4);
+    return at;
+  }
+
+  size_t BeginFull(const char *type, uint8_t version, uint32_t flags) {
+    const size_t at = Begin(type);
+    U32((uint32_t(version) << 24) | flags);
+    return at;
+  }
+
+  void End(size_t at) {
+    WriteU32(&(*buf_)[at], static_cast<uint32_t>(buf_->size() - at));
+  }
+
+  void U8(uint32_t v) { buf_->push_back(static_cast<uint8_t>(v)); }
+  void U16(uint32_t v) {
+    U8(v >> 8);
+    U8(v);
+  }
+  void U32(uint32_t v) {
+    U16(v >> 16);
+    U16(v);
+  }
+  void U64(uint64_t v) {
+    U32(static_cast<uint32_t>(v >> 32));
+    U32(static_cast<uint32_t>(v));
+  }
+  void Bytes(const void *p, size_t n) {
+    auto b = static_cast<const uint8_t *>(p);
+    buf_->insert(buf_->end(), b, b + n);
+  }
+  void Zeros(size_t n) { buf_->insert(buf_->end(), n, 0); }
+  static void WriteU32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (24 - 8 * i));
+  }
+  void Matrix() {
+    const uint32_t m[9]{0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000};
+    for (auto v : m) U32(v);
+  }
+
+ private:
+  std::vector<uint8_t> *buf_;
+};
+
+enum ParamSet { kVps, kSps, kPps, kNumParamSets };
+
+// @return kind of parameter set, or -1
+int ParamSetOf(CodecFourcc codec, uint8_t type) {
+  if (codec == IXR_CODEC_HEVC) {
+    return type >= 32 && type <= 34 ? type - 32 : -1;
+  }
+  return type == 7 ? kSps : type == 8 ? kPps : -1;
+}
+
+// chroma_format_idc and bit depths of the samples, minus 8
+struct SampleFormat {
+  uint32_t chroma;
+  uint32_t lumaDepth;
+  uint32_t chromaDepth;
+};
+
+// AVC profiles without the fields are 8-bit 4:2:0
+bool ReadSampleFormat(CodecFourcc codec, const std::vector<uint8_t> &sps,
+                      SampleFormat *format) {
+  static const uint32_t kHighProfiles[] = {100, 110, 122, 244, 44,  83, 86,
+                                           118, 128, 138, 139, 134, 135};
+  const uint32_t header = codec == IXR_CODEC_HEVC ? 2 : 1;
+  std::vector<uint8_t> rbsp;
+  UnescapeRbsp(sps.data() + header, static_cast<uint32_t>(sps.size()) - header,
+               &rbsp);
+  BitReader br(rbsp.data(), static_cast<uint32_t>(rbsp.size()));
+  *format = SampleFormat{1, 0, 0};
+  if (codec == IXR_CODEC_HEVC) {
+    br.U(4);
+    const uint32_t subLayers = br.U(3);
+    br.Bit();
+    // general profile, tier and level
+    br.U(32);
+    br.U(32);
+    br.U(32);
+    uint32_t present[8] = {};
+    for (uint32_t i = 0; i < subLayers; i++) present[i] = br.U(2);
+    if (subLayers) br.U(2 * (8 - subLayers));
+    for (uint32_t i = 0; i < subLayers; i++) {
+      if (present[i] & 2) {
+        br.U(32);
+        br.U(32);
+        br.U(24);
+      }
+      if (present[i] & 1) br.U(8);
+    }
+    br.Ue();  // sps_seq_parameter_set_id
+    format->chroma = br.Ue();
+    if (format->chroma == 3) br.Bit();
+    br.Ue();  // pic_width_in_luma_samples
+    br.Ue();
+    if (br.Bit()) {
+      for (int i = 0; i < 4; i++) br.Ue();  // conformance window
+    }
+  } else {
+    const uint32_t profile = br.U(8);
+    if (std::find(std::begin(kHighProfiles), std::end(kHighProfiles),
+                  profile) == std::end(kHighProfiles)) {
+      return br.Good();
+    }
+    br.U(16);  // constraint flags and level_idc
+    br.Ue();
+    format->chroma = br.Ue();
+    if (format->chroma == 3) br.Bit();
+  }
+  format->lumaDepth = br.Ue();
+  format->chromaDepth = br.Ue();
+  return br.Good() && format->chroma <= 3 && format->lumaDepth <= 8 &&
+         format->chromaDepth <= 8;
+}
+
+bool IsKeyFrame(CodecFourcc codec, uint8_t type) {
+  // HEVC: BLA, IDR and CRA pictures
+  return codec == IXR_CODEC_HEVC ? type >= 16 && type <= 21 : type == 5;
+}
+
+bool IsAccessUnitDelimiter(CodecFourcc codec, uint8_t type) {
+  return codec == IXR_CODEC_HEVC ? type == 35 : type == 9;
+}
+}  // namespace
+
+Fmp4Writer::Fmp4Writer(const Fmp4Config &config, Sink sink)
+    : config_(config),
+      sink_(std::move(sink)),
+      started_(false),
+      sequence_(0),
+      firstPts_(0),
+      lastPts_(0) {
+  if (!config_.timescale) config_.timescale = 90000;
+  if (!config_.fps) config_.fps = 30;
+  if (!config_.fragmentFrames) config_.fragmentFrames = 1;
+  if (!config_.fragmentSizeMax) config_.fragmentSizeMax = 4 << 20;
+  lastDuration_ = config_.timescale / config_.fps;
+  params_.resize(kNumParamSets);
+  samples_.reserve(config_.fragmentFrames);
+  mdat_.reserve(config_.fragmentFrames > 1 ? config_.fragmentSizeMax : 0);
+  header_.reserve(128 + 12 * config_.fragmentFrames);
+  lengths_.reserve(4 * 32);
+  nals_.reserve(32);
+  iov_.reserve(2 * 32 + 1);
+}
+
+bool Fmp4Writer::AddSample(const uint8_t *data, uint32_t size, uint64_t pts) {
+  bool key = false;
+  if (!parse(data, size, &key)) return false;
+  if (!started_) {
+    if (!key || !writeInit()) return false;
+    started_ = true;
+    firstPts_ = lastPts_ = pts;
+  }
+  if (nals_.empty()) return true;
+  if (pts > lastPts_) lastDuration_ = pts - lastPts_;
+  lastPts_ = pts;
+  uint32_t sample = 0;
+  for (auto &n : nals_) sample += 4 + static_cast<uint32_t>(n.size);
+  // close the buffered fragment before a key frame or if it's full
+  if (!samples_.empty() &&
+      (key || mdat_.size() + sample > config_.fragmentSizeMax)) {
+    if (!Flush()) return false;
+  }
+  if (config_.fragmentFrames == 1 || sample > config_.fragmentSizeMax) {
+    // write in place, the length fields are the only copy
+    lengths_.resize(4 * nals_.size());
+    iov_.assign(1, IoVec{nullptr, 0});
+    for (size_t i = 0; i < nals_.size(); ++i) {
+      BoxWriter::WriteU32(&lengths_[4 * i],
+                          static_cast<uint32_t>(nals_[i].size));
+      iov_.push_back(IoVec{&lengths_[4 * i], 4});
+      iov_.push_back(nals_[i]);
+    }
+    samples_.assign(1, Sample{pts, sample, key});
+    return writeFragment(sample);
+  }
+  for (auto &n : nals_) {
+    BoxWriter w(&mdat_);
+    w.U32(static_cast<uint32_t>(n.size));
+    w.Bytes(n.base, n.size);
+  }
+  samples_.push_back(Sample{pts, sample, key});
+  if (samples_.size() >= config_.fragmentFrames) return Flush();
+  return true;
+}
+
+bool Fmp4Writer::Flush() {
+  if (samples_.empty()) return true;
+  iov_.assign(1, IoVec{nullptr, 0});
+  iov_.push_back(IoVec{mdat_.data(), mdat_.size()});
+  const bool ok = writeFragment(static_cast<uint32_t>(mdat_.size()));
+  mdat_.clear();
+  return ok;
+}
+
+bool Fmp4Writer::parse(const uint8_t *data, uint32_t size, bool *key) {
+  const CodecFourcc codec = config_.codec;
+  if (codec != IXR_CODEC_AVC && codec != IXR_CODEC_HEVC) return false;
+  nals_.clear();
+  ForEachNalu(data, size, [&](const uint8_t *nal, uint32_t len) {
+    const uint8_t type = NaluType(codec, nal[0]);
+    const int param = ParamSetOf(codec, type);
+    if (param >= 0) {
+      // parameter sets are carried by the sample entry
+      if (!started_ && params_[param].empty()) {
+        params_[param].assign(nal, nal + len);
+      }
+      return;
+    }
+    if (IsAccessUnitDelimiter(codec, type)) return;
+    if (IsKeyFrame(codec, type)) *key = true;
+    nals_.push_back(IoVec{nal, len});
+  });
+  return true;
+}
+
+bool Fmp4Writer::writeInit() {
+  const bool hevc = config_.codec == IXR_CODEC_HEVC;
+  if (params_[kSps].size() < 4 || params_[kPps].empty()) return false;
+  if (hevc && (params_[kVps].empty() || params_[kSps].size() < 15)) {
+    return false;
+  }
+  SampleFormat format;
+  if (!ReadSampleFormat(config_.codec, params_[kSps], &format)) return false;
+  std::vector<uint8_t> init;
+  init.reserve(1024);
+  BoxWriter w(&init);
+  size_t ftyp = w.Begin("ftyp");
+  w.Bytes("iso6", 4);
+  w.U32(0);
+  w.Bytes("iso6cmfcmp41", 12);
+  w.End(ftyp);
+  size_t moov = w.Begin("moov");
+  size_t mvhd = w.BeginFull("mvhd", 0, 0);
+  w.U32(0);  // creation_time
+  w.U32(0);  // modification_time
+  w.U32(config_.timescale);
+  w.U32(0);           // duration, unknown
+  w.U32(0x00010000);  // rate
+  w.U16(0x0100);      // volume
+  w.Zeros(10);
+  w.Matrix();
+  w.Zeros(24);  // pre_defined
+  w.U32(2);     // next_track_ID
+  w.End(mvhd);
+  size_t trak = w.Begin("trak");
+  size_t tkhd = w.BeginFull("tkhd", 0, 3);  // enabled, in movie
+  w.U32(0);
+  w.U32(0);
+  w.U32(1);  // track_ID
+  w.U32(0);
+  w.U32(0);  // duration
+  w.Zeros(8);
+  w.U16(0);  // layer
+  w.U16(0);  // alternate_group
+  w.U16(0);  // volume
+  w.U16(0);
+  w.Matrix();
+  w.U32(config_.width << 16);
+  w.U32(config_.height << 16);
+  w.End(tkhd);
+  size_t mdia = w.Begin("mdia");
+  size_t mdhd = w.BeginFull("mdhd", 0, 0);
+  w.U32(0);
+  w.U32(0);
+  w.U32(config_.timescale);
+  w.U32(0);
+  w.U16(0x55C4);  // 'und'
+  w.U16(0);
+  w.End(mdhd);
+  size_t hdlr = w.BeginFull("hdlr", 0, 0);
+  w.U32(0);
+  w.Bytes("vide", 4);
+  w.Zeros(12);
+  w.Bytes("VideoHandler", 13);
+  w.End(hdlr);
+  size_t minf = w.Begin("minf");
+  size_t vmhd = w.BeginFull("vmhd", 0, 1);
+  w.Zeros(8);
+  w.End(vmhd);
+  size_t dinf = w.Begin("dinf");
+  size_t dref = w.BeginFull("dref", 0, 0);
+  w.U32(1);
+  size_t url = w.BeginFull("url ", 0, 1);  // media in the same file
+  w.End(url);
+  w.End(dref);
+  w.End(dinf);
+  size_t stbl = w.Begin("stbl");
+  size_t stsd = w.BeginFull("stsd", 0, 0);
+  w.U32(1);
+  size_t entry = w.Begin(hevc ? "hvc1" : "avc1");
+  w.Zeros(6);
+  w.U16(1);  // data_reference_index
+  w.Zeros(16);
+  w.U16(config_.width);
+  w.U16(config_.height);
+  w.U32(0x00480000);  // 72 dpi
+  w.U32(0x00480000);
+  w.U32(0);
+  w.U16(1);  // frame_count
+  w.Zeros(32);  // compressorname
+  w.U16(0x0018);
+  w.U16(0xFFFF);
+  if (hevc) {
+    // general profile, tier and level are copied from SPS
+    std::vector<uint8_t> sps;
+    UnescapeRbsp(params_[kSps].data(),
+                 static_cast<uint32_t>(params_[kSps].size()), &sps);
+    // a truncated SPS reads as zeros
+    if (sps.size() < 15) sps.resize(15);
+    const uint8_t sub_layers = ((sps[2] >> 1) & 7) + 1;
+    size_t hvcc = w.Begin("hvcC");
+    w.U8(1);
+    w.Bytes(sps.data() + 3, 12);
+    w.U16(0xF000);  // min_spatial_segmentation_idc
+    w.U8(0xFC);     // parallelismType
+    w.U8(0xFC | format.chroma);       // chroma_format_idc
+    w.U8(0xF8 | format.lumaDepth);    // bit_depth_luma_minus8
+    w.U8(0xF8 | format.chromaDepth);  // bit_depth_chroma_minus8
+    w.U16(0);       // avgFrameRate
+    w.U8((sub_layers << 3) | ((sps[2] & 1) << 2) | 3);
+    w.U8(3);  // numOfArrays
+    for (int i = kVps; i < kNumParamSets; ++i) {
+      w.U8(0x80 | (32 + i));  // array_completeness and NAL_unit_type
+      w.U16(1);
+      w.U16(static_cast<uint32_t>(params_[i].size()));
+      w.Bytes(params_[i].data(), params_[i].size());
+    }
+    w.End(hvcc);
+  } else {
+    const auto &sps = params_[kSps];
+    size_t avcc = w.Begin("avcC");
+    w.U8(1);
+    w.U8(sps[1]);  // profile_idc
+    w.U8(sps[2]);  // constraint flags
+    w.U8(sps[3]);  // level_idc
+    w.U8(0xFF);    // lengthSizeMinusOne = 3
+    w.U8(0xE1);    // one SPS
+    w.U16(static_cast<uint32_t>(sps.size()));
+    w.Bytes(sps.data(), sps.size());
+    w.U8(1);
+    w.U16(static_cast<uint32_t>(params_[kPps].size()));
+    w.Bytes(params_[kPps].data(), params_[kPps].size());
+    if (sps[1] == 100 || sps[1] == 110 || sps[1] == 122 || sps[1] == 244) {
+      w.U8(0xFC | format.chroma);       // chroma_format
+      w.U8(0xF8 | format.lumaDepth);    // bit_depth_luma_minus8
+      w.U8(0xF8 | format.chromaDepth);  // bit_depth_chroma_minus8
+      w.U8(0);     // numOfSequenceParameterSetExt
+    }
+    w.End(avcc);
+  }
+  w.End(entry);
+  w.End(stsd);
+  // sample tables are empty, samples are in fragments
+  for (const char *box : {"stts", "stsc", "stco"}) {
+    size_t b = w.BeginFull(box, 0, 0);
+    w.U32(0);
+    w.End(b);
+  }
+  size_t stsz = w.BeginFull("stsz", 0, 0);
+  w.U32(0);
+  w.U32(0);
+  w.End(stsz);
+  w.End(stbl);
+  w.End(minf);
+  w.End(mdia);
+  w.End(trak);
+  size_t mvex = w.Begin("mvex");
+  size_t trex = w.BeginFull("trex", 0, 0);
+  w.U32(1);  // track_ID
+  w.U32(1);  // default_sample_description_index
+  w.U32(0);
+  w.U32(0);
+  w.U32(0);
+  w.End(trex);
+  w.End(mvex);
+  w.End(moov);
+  IoVec iov{init.data(), init.size()};
+  return sink_(&iov, 1);
+}
+
+void Fmp4Writer::buildMoof(uint32_t payloadSize) {
+  header_.clear();
+  BoxWriter w(&header_);
+  size_t moof = w.Begin("moof");
+  size_t mfhd = w.BeginFull("mfhd", 0, 0);
+  w.U32(sequence_ + 1);
+  w.End(mfhd);
+  size_t traf = w.Begin("traf");
+  size_t tfhd = w.BeginFull("tfhd", 0, 0x020000);  // default-base-is-moof
+  w.U32(1);
+  w.End(tfhd);
+  size_t tfdt = w.BeginFull("tfdt", 1, 0);
+  w.U64(samples_[0].pts - firstPts_);
+  w.End(tfdt);
+  // data-offset, sample-duration, sample-size and sample-flags present
+  size_t trun = w.BeginFull("trun", 0, 0x000701);
+  w.U32(static_cast<uint32_t>(samples_.size()));
+  const size_t offset = header_.size();
+  w.U32(0);
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const uint64_t duration = i + 1 < samples_.size()
+                                  ? samples_[i + 1].pts - samples_[i].pts
+                                  : lastDuration_;
+    w.U32(static_cast<uint32_t>(duration));
+    w.U32(samples_[i].size);
+    w.U32(samples_[i].key ? kSyncSample : kNonSyncSample);
+  }
+  w.End(trun);
+  w.End(traf);
+  w.End(moof);
+  // samples start right after the mdat header
+  BoxWriter::WriteU32(&header_[offset],
+                      static_cast<uint32_t>(header_.size() - moof + 8));
+  w.U32(8 + payloadSize);
+  w.Bytes("mdat", 4);
+}
+
+bool Fmp4Writer::writeFragment(uint32_t payloadSize) {
+  buildMoof(payloadSize);
+  iov_[0] = IoVec{header_.data(), header_.size()};
+  sequence_++;
+  samples_.clear();
+  return sink_(iov_.data(), static_cast<uint32_t>(iov_.size()));
+}
+}  // namespace ixr
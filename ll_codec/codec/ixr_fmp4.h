@@ -0,0 +1,92 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Streaming fragmented MP4 (CMAF) writer of AVC and HEVC
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_FMP4_H_
+#define LL_CODEC_CODEC_IXR_FMP4_H_
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+struct Fmp4Config {
+  CodecFourcc codec;          //!< AVC or HEVC
+  uint32_t width;
+  uint32_t height;
+  uint32_t timescale;         //!< ticks per second, 90000 if 0
+  uint32_t fps;               //!< duration of a sample if unknown, 30 if 0
+  uint32_t fragmentFrames;    //!< samples of a fragment, 1 if 0
+  uint32_t fragmentSizeMax;   //!< bytes buffered for a fragment, 4MB if 0
+};
+
+/**
+ * @brief Write Annex-B access units into a single-track fragmented MP4.
+ *
+ * The init segment (ftyp, moov) is written with the first key frame, which
+ * carries the parameter sets. Then samples are packed into moof/mdat
+ * fragments, closed every Fmp4Config::fragmentFrames samples or before a
+ * key frame. Each fragment is handed to the sink as one IoVec list, ready
+ * for writev.
+ *
+ * A fragment of one sample is written straight from the bitstream without
+ * copying, so it is sent within AddSample. Longer fragments are copied into
+ * a buffer of Fmp4Config::fragmentSizeMax, so that the encoder bitstream
+ * can be released at once. Nothing is allocated after the first fragment.
+ */
+class Fmp4Writer {
+ public:
+  //! Write the IoVec list in order, return false on error
+  using Sink = std::function<bool(const IoVec *iov, uint32_t count)>;
+
+  Fmp4Writer(const Fmp4Config &config, Sink sink);
+
+  /**
+   * @brief Add an access unit
+   *
+   * @param data Annex-B bitstream of a frame
+   * @param size size of the bitstream
+   * @param pts presentation time in Fmp4Config::timescale, no B frames
+   * @return false if no key frame is written yet, or the sink fails
+   */
+  bool AddSample(const uint8_t *data, uint32_t size, uint64_t pts);
+
+  //! Write the pending fragment, call it at the end of stream
+  bool Flush();
+
+  //! Number of fragments written
+  uint32_t Fragments() const { return sequence_; }
+
+ private:
+  struct Sample {
+    uint64_t pts;
+    uint32_t size;
+    bool key;
+  };
+
+  bool writeInit();
+  bool writeFragment(uint32_t payloadSize);
+  void buildMoof(uint32_t payloadSize);
+  bool parse(const uint8_t *data, uint32_t size, bool *key);
+
+  Fmp4Config config_;
+  Sink sink_;
+  bool started_;
+  uint32_t sequence_;
+  uint64_t firstPts_;
+  uint64_t lastPts_;
+  uint64_t lastDuration_;
+  std::vector<std::vector<uint8_t>> params_;  //!< VPS, SPS, PPS
+  std::vector<Sample> samples_;
+  std::vector<uint8_t> mdat_;     //!< payload of the buffered fragment
+  std::vector<uint8_t> header_;   //!< moof and mdat header
+  std::vector<uint8_t> lengths_;  //!< NAL length fields of a direct sample
+  std::vector<IoVec> nals_;       //!< NAL units of the current sample
+  std::vector<IoVec> iov_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_FMP4_H_
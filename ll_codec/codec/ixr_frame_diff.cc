@@ -0,0 +1,145 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Detect static frames and dirty regions of CPU surfaces
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_frame_diff.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IXR_FRAME_DIFF_SSE2
+#endif
+
+namespace ixr {
+void FrameDiff::Allocate(uint32_t width, uint32_t height,
+                         ColorFourcc format) {
+  width_ = width;
+  height_ = height;
+  format_ = format;
+  blocksW_ = (width + kBlockSize - 1) / kBlockSize;
+  blocksH_ = (height + kBlockSize - 1) / kBlockSize;
+  const size_t pixels = size_t(width) * height;
+  const size_t size = packed() ? pixels * 4 : pixels * 3 / 2 * sample();
+  ref_.assign(size, 0);
+  dirty_.assign(size_t(blocksW_) * blocksH_, 0);
+  rects_.clear();
+  rects_.reserve(kMaxDirtyRects);
+  valid_ = false;
+}
+
+void FrameDiff::Deallocate() {
+  ref_.clear();
+  dirty_.clear();
+  rects_.clear();
+  valid_ = false;
+}
+
+uint32_t FrameDiff::Update(const uint8_t *frame) {
+  rects_.clear();
+  if (ref_.empty() || !frame) return 0;
+  if (!valid_) {
+    std::memcpy(ref_.data(), frame, ref_.size());
+    valid_ = true;
+    rects_.push_back(DirtyRect{0, 0, width_, height_});
+    return 1;
+  }
+  std::fill(dirty_.begin(), dirty_.end(), 0);
+  if (packed()) {
+    diffPlane(frame, ref_.data(), width_ * 4, height_, kBlockSize * 4,
+              kBlockSize);
+  } else {
+    const uint32_t pitch = width_ * sample();
+    const size_t luma = size_t(pitch) * height_;
+    diffPlane(frame, ref_.data(), pitch, height_, kBlockSize * sample(),
+              kBlockSize);
+    // interleaved UV of a block is as wide as luma and half the height
+    diffPlane(frame + luma, ref_.data() + luma, pitch, height_ / 2,
+              kBlockSize * sample(), kBlockSize / 2);
+  }
+  mergeBlocks();
+  return static_cast<uint32_t>(rects_.size());
+}
+
+void FrameDiff::diffPlane(const uint8_t *src, uint8_t *ref, uint32_t pitch,
+                          uint32_t rows, uint32_t blockBytes,
+                          uint32_t blockRows) {
+  for (uint32_t y = 0; y < rows; ++y) {
+    const uint8_t *s = src + size_t(y) * pitch;
+    uint8_t *r = ref + size_t(y) * pitch;
+    uint8_t *dirty = &dirty_[size_t(y / blockRows) * blocksW_];
+    uint32_t x = 0;
+#ifdef IXR_FRAME_DIFF_SSE2
+    // blockBytes is a multiple of 16, a vector never spans two blocks
+    for (; x + 16 <= pitch; x += 16) {
+      auto ps = reinterpret_cast<const __m128i *>(s + x);
+      auto pr = reinterpret_cast<__m128i *>(r + x);
+      const __m128i a = _mm_loadu_si128(ps);
+      const __m128i b = _mm_loadu_si128(pr);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF) {
+        _mm_storeu_si128(pr, a);
+        dirty[x / blockBytes] = 1;
+      }
+    }
+#endif
+    for (; x < pitch; ++x) {
+      if (s[x] != r[x]) {
+        r[x] = s[x];
+        dirty[x / blockBytes] = 1;
+      }
+    }
+  }
+}
+
+void FrameDiff::mergeBlocks() {
+  // runs of dirty blocks in a row, extended downwards while the run above
+  // has the same span
+  size_t open = 0;  // rects of the previous block row start here
+  for (uint32_t by = 0; by < blocksH_; ++by) {
+    const uint8_t *dirty = &dirty_[size_t(by) * blocksW_];
+    const size_t row = rects_.size();
+    const uint32_t top = by * kBlockSize;
+    const uint32_t bottom = std::min(top + kBlockSize, height_);
+    for (uint32_t bx = 0; bx < blocksW_;) {
+      if (!dirty[bx]) {
+        ++bx;
+        continue;
+      }
+      uint32_t end = bx;
+      while (end < blocksW_ && dirty[end]) ++end;
+      const uint32_t left = bx * kBlockSize;
+      const uint32_t right = std::min(end * kBlockSize, width_);
+      bool merged = false;
+      for (size_t i = open; i < row; ++i) {
+        DirtyRect &r = rects_[i];
+        if (r.left == left && r.right == right && r.bottom == top) {
+          r.bottom = bottom;
+          merged = true;
+          break;
+        }
+      }
+      if (!merged) rects_.push_back(DirtyRect{left, top, right, bottom});
+      bx = end;
+    }
+    // rects not extended by this row are closed
+    open = row;
+    for (size_t i = row; i-- > 0;) {
+      if (rects_[i].bottom == bottom) open = i;
+    }
+  }
+  if (rects_.size() > kMaxDirtyRects) {
+    DirtyRect box = rects_[0];
+    for (auto &r : rects_) {
+      box.left = std::min(box.left, r.left);
+      box.top = std::min(box.top, r.top);
+      box.right = std::max(box.right, r.right);
+      box.bottom = std::max(box.bottom, r.bottom);
+    }
+    rects_.assign(1, box);
+  }
+}
+}  // namespace ixr
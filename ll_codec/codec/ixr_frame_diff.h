@@ -0,0 +1,75 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Detect static frames and dirty regions of CPU surfaces
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_FRAME_DIFF_H_
+#define LL_CODEC_CODEC_IXR_FRAME_DIFF_H_
+#include <stdint.h>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+//! Maximum dirty rectangles of a frame, more are merged into one
+constexpr uint32_t kMaxDirtyRects = 256;
+
+/**
+ * @brief Compare each frame with the last one in blocks of 16x16 pixels,
+ * and merge changed blocks into rectangles.
+ *
+ * Frames are packed NV12, P010, ARGB or Y410 in CPU memory, whose pitch is
+ * the width in samples (4 bytes of a pixel of ARGB and Y410). Only changed
+ * bytes are copied into the reference, so a static frame costs a read of
+ * two frames.
+ */
+class FrameDiff {
+ public:
+  //! Size in pixels of a block
+  static constexpr uint32_t kBlockSize = 16;
+
+  FrameDiff() : width_(0), height_(0), format_(IXR_COLOR_NV12) {}
+
+  void Allocate(uint32_t width, uint32_t height, ColorFourcc format);
+
+  void Deallocate();
+
+  /**
+   * @brief Compare frame with the last one and keep it as the reference.
+   *
+   * @param frame the frame, the first one is always dirty
+   * @return number of dirty rectangles, 0 if the frame is static
+   */
+  uint32_t Update(const uint8_t *frame);
+
+  /** Forget the reference, so that the next frame is dirty */
+  void Reset() { valid_ = false; }
+
+  //! Dirty rectangles found by the last Update
+  const std::vector<DirtyRect> &Rects() const { return rects_; }
+
+ private:
+  void diffPlane(const uint8_t *src, uint8_t *ref, uint32_t pitch,
+                 uint32_t rows, uint32_t blockBytes, uint32_t blockRows);
+  void mergeBlocks();
+  //! 4 bytes a pixel in one plane
+  bool packed() const {
+    return format_ == IXR_COLOR_ARGB || format_ == IXR_COLOR_Y410;
+  }
+  //! bytes of a sample of planar formats
+  uint32_t sample() const { return format_ == IXR_COLOR_P010 ? 2 : 1; }
+
+  uint32_t width_;
+  uint32_t height_;
+  ColorFourcc format_;
+  bool valid_ = false;
+  uint32_t blocksW_ = 0;
+  uint32_t blocksH_ = 0;
+  std::vector<uint8_t> ref_;
+  std::vector<uint8_t> dirty_;
+  std::vector<DirtyRect> rects_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_FRAME_DIFF_H_
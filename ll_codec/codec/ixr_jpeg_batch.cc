@@ -0,0 +1,242 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Encode batches of small JPEG images in parallel
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_jpeg_batch.h"
+#include <algorithm>
+#include <cstring>
+#include "ll_codec/codec/ixr_capture.h"
+#include "ll_codec/codec/ixr_executor.h"
+
+namespace ixr {
+namespace {
+constexpr uint32_t kHardwareThreads = 2;
+constexpr int32_t kMinQuality = 1;
+constexpr int32_t kMaxQuality = 100;
+// runs of images handed out per thread, so that a run of one size stays on
+// one thread while the load is still balanced
+constexpr size_t kRunsPerThread = 4;
+}  // namespace
+
+JpegBatchEncoder::JpegBatchEncoder(const CodecConfig &base, uint32_t threads,
+                                   Factory factory)
+    : base_(base),
+      factory_(std::move(factory)),
+      next_(0),
+      run_(1),
+      allocations_(0) {
+  if (threads == 0) {
+    threads = base.adapter == IXR_CODEC_VID_INTEL && base.intel.useSoftware
+                  ? Executor::Shared().Threads()
+                  : kHardwareThreads;
+  }
+  workers_.resize(threads);
+  for (auto &w : workers_) {
+    w.clock = 0;
+    w.hint = Hint{};
+  }
+  if (!factory_) {
+    factory_ = [](const CodecConfig &config) {
+      auto codec = Encoder::Create(config.adapter);
+      if (codec) codec->Allocate(config);
+      return codec;
+    };
+  }
+}
+
+JpegBatchEncoder::~JpegBatchEncoder() {}
+
+size_t JpegBatchEncoder::Encode(const JpegImage *images, size_t count,
+                                JpegResult *results) {
+  arena_.clear();
+  order_.resize(count);
+  for (size_t i = 0; i < count; i++) order_[i] = i;
+  // neighbours share sessions
+  std::stable_sort(order_.begin(), order_.end(), [&](size_t a, size_t b) {
+    const JpegImage &x = images[a], &y = images[b];
+    if (x.width != y.width) return x.width < y.width;
+    if (x.height != y.height) return x.height < y.height;
+    if (x.format != y.format) return x.format < y.format;
+    if (x.quality != y.quality) return x.quality < y.quality;
+    return x.targetSize < y.targetSize;
+  });
+  next_ = 0;
+  const size_t threads = std::min(workers_.size(), count);
+  run_ = threads ? std::max<size_t>(count / (threads * kRunsPerThread), 1) : 1;
+  // a worker of the batch is a session, which runs on any thread of the
+  // executor after the frames of viewers
+  TaskGroup group(IXR_TASK_BATCH);
+  for (size_t t = 1; t < threads; t++) {
+    Worker *worker = &workers_[t];
+    group.Run([this, worker, images, results]() {
+      work(worker, images, results);
+    });
+  }
+  if (threads) work(&workers_[0], images, results);
+  group.Wait();
+  size_t failed = 0;
+  for (size_t i = 0; i < count; i++) failed += results[i].status < 0;
+  return failed;
+}
+
+void JpegBatchEncoder::work(Worker *worker, const JpegImage *images,
+                            JpegResult *results) {
+  for (;;) {
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (next_ == order_.size()) return;
+      begin = next_;
+      end = next_ = std::min(next_ + run_, order_.size());
+    }
+    for (size_t i = begin; i < end; i++) {
+      encodeImage(worker, images[order_[i]], &results[order_[i]]);
+    }
+  }
+}
+
+void JpegBatchEncoder::encodeImage(Worker *worker, const JpegImage &image,
+                                   JpegResult *result) {
+  *result = JpegResult{0, 0, 0, -1};
+  const int32_t top = std::min(
+      image.quality > 0 ? image.quality : kMaxQuality, kMaxQuality);
+  if (!image.targetSize) {
+    if (!encode(worker, image, top)) return;
+    result->quality = top;
+    result->status = 0;
+    append(worker->output, result);
+    return;
+  }
+  // the highest quality which fits, or the lowest one
+  Hint &hint = worker->hint;
+  const bool similar = hint.width == image.width &&
+                       hint.height == image.height &&
+                       hint.format == image.format && hint.top == top &&
+                       hint.targetSize == image.targetSize;
+  // the hinted quality, then the one above it, are tried before bisecting
+  int32_t probe = similar ? hint.quality : 0;
+  bool stepped = false;
+  int32_t lo = kMinQuality, hi = top, best = 0;
+  uint32_t smallest = UINT32_MAX;
+  while (lo <= hi) {
+    const int32_t q = probe >= lo && probe <= hi ? probe : lo + (hi - lo) / 2;
+    if (!encode(worker, image, q)) return;
+    const uint32_t size = static_cast<uint32_t>(worker->output.size());
+    if (size <= image.targetSize) {
+      best = q;
+      worker->best.swap(worker->output);
+      lo = q + 1;
+      probe = q == probe && !stepped ? q + 1 : 0;
+      stepped = true;
+    } else {
+      if (!best && size < smallest) {
+        smallest = size;
+        result->quality = q;
+        worker->best.swap(worker->output);
+      }
+      hi = q - 1;
+      probe = 0;
+    }
+  }
+  if (best) result->quality = best;
+  result->status = best ? 0 : 1;
+  hint = Hint{image.width, image.height, image.format, top, image.targetSize,
+              result->quality};
+  append(worker->best, result);
+}
+
+bool JpegBatchEncoder::encode(Worker *worker, const JpegImage &image,
+                              int32_t quality) {
+  worker->output.clear();
+  try {
+    Encoder *codec = session(worker, image, quality);
+    if (!codec) return false;
+    void *dst = codec->DequeueInputBuffer();
+    if (!dst) return false;
+    CodecConfig c{};
+    c.width = image.width;
+    c.height = image.height;
+    c.inputFormat = image.format;
+    c.memoryType = IXR_MEM_INTERNAL_CPU;
+    std::memcpy(dst, image.data, CaptureFrameSize(c));
+    if (codec->QueueInputBuffer(dst) != 0) return false;
+    int ret;
+    do {
+      void *buf = nullptr;
+      uint32_t size = 0;
+      ret = codec->DequeueOutputBuffer(&buf, &size);
+      if (ret < 0) return false;
+      auto p = static_cast<const uint8_t *>(buf);
+      worker->output.insert(worker->output.end(), p, p + size);
+      codec->ReleaseOutputBuffer(buf);
+    } while (ret > 0);
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+Encoder *JpegBatchEncoder::session(Worker *worker, const JpegImage &image,
+                                   int32_t quality) {
+  auto &sessions = worker->sessions;
+  worker->clock++;
+  // one session of a size, probes of a search reset its quality
+  auto same = std::find_if(sessions.begin(), sessions.end(),
+                           [&image](const Session &s) {
+                             return s.width == image.width &&
+                                    s.height == image.height &&
+                                    s.format == image.format;
+                           });
+  if (same != sessions.end()) {
+    same->used = worker->clock;
+    if (same->quality == quality ||
+        same->encoder->SetJpegQuality(quality) == 0) {
+      same->quality = quality;
+      return same->encoder.get();
+    }
+  }
+  CodecConfig config = base_;
+  config.codec = IXR_CODEC_JPEG;
+  config.width = image.width;
+  config.height = image.height;
+  config.inputFormat = image.format;
+  config.memoryType = IXR_MEM_INTERNAL_CPU;
+  config.sharedMemoryId.clear();
+  config.asyncDepth = 1;
+  config.advanced.jpegQuality = quality;
+  Session s{factory_(config), image.width, image.height, image.format,
+            quality, worker->clock};
+  if (!s.encoder) return nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    allocations_++;
+  }
+  if (same != sessions.end()) {
+    // the encoder can't change its quality
+    *same = std::move(s);
+    return same->encoder.get();
+  }
+  if (sessions.size() == kCachedEncoders) {
+    // replace the least recently used one
+    auto lru = std::min_element(
+        sessions.begin(), sessions.end(),
+        [](const Session &a, const Session &b) { return a.used < b.used; });
+    *lru = std::move(s);
+    return lru->encoder.get();
+  }
+  sessions.push_back(std::move(s));
+  return sessions.back().encoder.get();
+}
+
+void JpegBatchEncoder::append(const std::vector<uint8_t> &data,
+                              JpegResult *result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  result->offset = arena_.size();
+  result->size = static_cast<uint32_t>(data.size());
+  arena_.insert(arena_.end(), data.begin(), data.end());
+}
+}  // namespace ixr
@@ -0,0 +1,136 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Encode batches of small JPEG images in parallel
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_JPEG_BATCH_H_
+#define LL_CODEC_CODEC_IXR_JPEG_BATCH_H_
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+struct JpegImage {
+  //! pixels in the layout of Encoder::DequeueInputBuffer in CPU memory
+  const void *data;
+  int32_t width;
+  int32_t height;
+  ColorFourcc format;   //!< IXR_COLOR_NV12 or IXR_COLOR_ARGB
+  int32_t quality;      //!< from 1 to 100, 100 if 0. The highest quality
+                        //!< to try if targetSize is set.
+  uint32_t targetSize;  //!< bytes, 0 to encode at the quality
+};
+
+struct JpegResult {
+  size_t offset;    //!< of the image in the arena, images are written in
+                    //!< the order they complete
+  uint32_t size;    //!< bytes of the image
+  int32_t quality;  //!< the quality encoded at
+  int32_t status;   //!< 0 if succeed, 1 if even the lowest quality exceeds
+                    //!< targetSize, -1 if it can't be encoded
+};
+
+/**
+ * @brief Encode many small images of mixed sizes, i.e. thumbnails or tiles
+ * of a sprite sheet, by a pool of threads.
+ *
+ * Each thread keeps an encoder of each size and format it has met, whose
+ * quality is reset for each image. Images are sorted by size, format and
+ * quality, and handed out in runs, so that a burst of one size reuses one
+ * session. With intel.useSoftware set,
+ * the software implementation of Media SDK runs on as many threads as
+ * cores.
+ *
+ * Images with a targetSize are encoded at the highest quality not
+ * exceeding it, found by a binary search between 1 and their quality. The
+ * search starts from the result of the last image of the same size and
+ * target, which takes two encodes if the result is the same. All images of
+ * a batch are written into one arena.
+ */
+class JpegBatchEncoder {
+ public:
+  //! Create and allocate an encoder, @see Replayer::EncoderFactory
+  using Factory = std::function<std::unique_ptr<Encoder>(const CodecConfig &)>;
+
+  //! Encoders kept by each thread
+  static constexpr size_t kCachedEncoders = 4;
+
+  /**
+   * @param base the adapter and vendor configurations of encoders
+   * @param threads number of threads, 0 for all cores with the software
+   *        implementation, 2 otherwise
+   * @param factory creates encoders, Encoder::Create of the adapter if null
+   */
+  explicit JpegBatchEncoder(const CodecConfig &base, uint32_t threads = 0,
+                            Factory factory = nullptr);
+
+  ~JpegBatchEncoder();
+
+  /**
+   * @brief Encode a batch of images, the arena of the last batch is
+   * discarded.
+   *
+   * @param [out] results of each image, in the order of images
+   * @return number of images with a negative status
+   */
+  size_t Encode(const JpegImage *images, size_t count, JpegResult *results);
+
+  //! Encoded images of the last batch, @see JpegResult::offset
+  const uint8_t *Arena() const { return arena_.data(); }
+  size_t ArenaSize() const { return arena_.size(); }
+
+  //! Encoders allocated since construction
+  uint64_t Allocations() const { return allocations_; }
+
+ private:
+  struct Session {
+    std::unique_ptr<Encoder> encoder;
+    int32_t width;
+    int32_t height;
+    ColorFourcc format;
+    int32_t quality;
+    uint64_t used;  //!< time stamp of the last use
+  };
+  //! The last search of a thread, similar images fit at similar quality
+  struct Hint {
+    int32_t width;
+    int32_t height;
+    ColorFourcc format;
+    int32_t top;
+    uint32_t targetSize;
+    int32_t quality;
+  };
+  struct Worker {
+    std::vector<Session> sessions;
+    std::vector<uint8_t> output;  //!< the image being encoded
+    std::vector<uint8_t> best;    //!< the best fit of a search
+    uint64_t clock;
+    Hint hint;
+  };
+
+  void work(Worker *worker, const JpegImage *images, JpegResult *results);
+  void encodeImage(Worker *worker, const JpegImage &image,
+                   JpegResult *result);
+  //! Encode into worker->output, @return false if failed
+  bool encode(Worker *worker, const JpegImage &image, int32_t quality);
+  Encoder *session(Worker *worker, const JpegImage &image, int32_t quality);
+  void append(const std::vector<uint8_t> &data, JpegResult *result);
+
+  CodecConfig base_;
+  Factory factory_;
+  std::vector<Worker> workers_;
+  std::vector<size_t> order_;  //!< images grouped by size
+  size_t next_;                //!< the next of order_ to encode
+  size_t run_;                 //!< images handed out at a time
+  std::vector<uint8_t> arena_;
+  uint64_t allocations_;
+  std::mutex mutex_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_JPEG_BATCH_H_
@@ -0,0 +1,729 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Decode baseline JPEG on CPU by parallel restart intervals
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_jpeg_decode.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include "ll_codec/codec/ixr_executor.h"
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IXR_JPEG_DECODE_SSE2
+#endif
+
+namespace ixr {
+namespace {
+constexpr uint8_t kSOF0 = 0xC0;
+constexpr uint8_t kSOF1 = 0xC1;
+constexpr uint8_t kDHT = 0xC4;
+constexpr uint8_t kRST0 = 0xD0;
+constexpr uint8_t kRST7 = 0xD7;
+constexpr uint8_t kSOI = 0xD8;
+constexpr uint8_t kEOI = 0xD9;
+constexpr uint8_t kSOS = 0xDA;
+constexpr uint8_t kDQT = 0xDB;
+constexpr uint8_t kDRI = 0xDD;
+constexpr uint8_t kTEM = 0x01;
+
+constexpr uint8_t kZigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// scales of the AAN IDCT, cos(k * pi / 16) * sqrt(2) but 1 of k = 0
+constexpr float kAanScale[8] = {1.0f,         1.387039845f, 1.306562965f,
+                                1.175875602f, 1.0f,         0.785694958f,
+                                0.541196100f, 0.275899379f};
+
+// BT.601 of JFIF in 14-bit fixed point
+constexpr int32_t kCrR = 22970;
+constexpr int32_t kCbG = -5638;
+constexpr int32_t kCrG = -11700;
+constexpr int32_t kCbB = 29032;
+constexpr int32_t kRound = 1 << 13;
+
+// symbols of codes up to kFastBits bits are looked up at once
+constexpr int kFastBits = 9;
+constexpr uint16_t kNoFast = 0xFFFF;
+
+struct Huffman {
+  bool defined;
+  uint16_t count;
+  uint16_t fast[1 << kFastBits];
+  uint8_t size[256];
+  uint8_t values[256];
+  int32_t maxcode[18];  //!< first code above a length, 16-bit aligned
+  int32_t delta[17];    //!< index of a symbol minus its code
+};
+
+struct Component {
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t tq;
+  uint8_t td;
+  uint8_t ta;
+};
+
+struct Interval {
+  uint8_t marker;
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct Picture {
+  JpegInfo info;
+  uint32_t numComps;
+  Component comps[3];
+  uint16_t quant[4][64];  //!< in natural order
+  bool quantDefined[4];
+  Huffman dc[4];
+  Huffman ac[4];
+  uint32_t hmax;
+  uint32_t vmax;
+  uint32_t mcusX;
+  uint32_t mcusY;
+  std::vector<Interval> intervals;
+};
+
+bool BuildHuffman(const uint8_t *counts, const uint8_t *values, Huffman *h) {
+  uint32_t k = 0, code = 0;
+  for (int len = 1; len <= 16; len++) {
+    h->delta[len] = static_cast<int32_t>(k) - static_cast<int32_t>(code);
+    for (uint32_t i = 0; i < counts[len - 1]; i++) h->size[k++] = len;
+    code += counts[len - 1];
+    if (code > (1u << len)) return false;
+    h->maxcode[len] = static_cast<int32_t>(code << (16 - len));
+    code <<= 1;
+  }
+  h->maxcode[17] = INT_MAX;
+  h->count = static_cast<uint16_t>(k);
+  std::memcpy(h->values, values, k);
+  std::fill(h->fast, h->fast + (1 << kFastBits), kNoFast);
+  code = 0;
+  for (uint32_t i = 0; i < k; i++) {
+    if (i && h->size[i] != h->size[i - 1]) {
+      code <<= h->size[i] - h->size[i - 1];
+    }
+    if (h->size[i] <= kFastBits) {
+      const uint32_t shift = kFastBits - h->size[i];
+      for (uint32_t j = 0; j < (1u << shift); j++) {
+        h->fast[(code << shift) + j] = static_cast<uint16_t>(i);
+      }
+    }
+    code++;
+  }
+  h->defined = true;
+  return true;
+}
+
+// bits of an interval, which contains no marker but stuffed zeros
+class BitReader {
+ public:
+  BitReader(const uint8_t *data, uint32_t size)
+      : p_(data), end_(data + size), buf_(0), bits_(0) {}
+
+  int Decode(const Huffman &h) {
+    fill();
+    uint16_t k = h.fast[buf_ >> (32 - kFastBits)];
+    if (k != kNoFast) {
+      consume(h.size[k]);
+      return h.values[k];
+    }
+    const int32_t t = static_cast<int32_t>(buf_ >> 16);
+    int len = kFastBits + 1;
+    while (t >= h.maxcode[len]) len++;
+    if (len > 16) return -1;
+    const int32_t i = static_cast<int32_t>(buf_ >> (32 - len)) + h.delta[len];
+    if (i < 0 || i >= h.count) return -1;
+    consume(len);
+    return h.values[i];
+  }
+
+  //! @return a value of t bits, sign extended
+  int32_t Receive(int t) {
+    fill();
+    const int32_t v = static_cast<int32_t>(buf_ >> (32 - t));
+    consume(t);
+    return v < (1 << (t - 1)) ? v - (1 << t) + 1 : v;
+  }
+
+ private:
+  void fill() {
+    while (bits_ <= 24) {
+      uint32_t b = 0;
+      if (p_ < end_) {
+        b = *p_++;
+        if (b == 0xFF && p_ < end_ && *p_ == 0) p_++;
+      }
+      buf_ |= b << (24 - bits_);
+      bits_ += 8;
+    }
+  }
+  void consume(int n) {
+    buf_ <<= n;
+    bits_ -= n;
+  }
+
+  const uint8_t *p_;
+  const uint8_t *end_;
+  uint32_t buf_;  //!< MSB first
+  int bits_;
+};
+
+bool DecodeBlock(BitReader *br, const Huffman &dc, const Huffman &ac,
+                 int32_t *pred, int32_t *coef) {
+  std::fill(coef, coef + 64, 0);
+  const int t = br->Decode(dc);
+  if (t < 0 || t > 11) return false;
+  *pred += t ? br->Receive(t) : 0;
+  coef[0] = *pred;
+  for (int k = 1; k < 64;) {
+    const int rs = br->Decode(ac);
+    if (rs < 0) return false;
+    const int r = rs >> 4, s = rs & 15;
+    if (!s) {
+      if (r != 15) break;  // EOB
+      k += 16;
+      continue;
+    }
+    k += r;
+    if (k > 63 || s > 10) return false;
+    coef[kZigzag[k++]] = br->Receive(s);
+  }
+  return true;
+}
+
+// One dimension of the float AAN IDCT of libjpeg, in place
+template <typename T>
+inline void Idct1D(T *d) {
+  T tmp0 = d[0], tmp1 = d[2], tmp2 = d[4], tmp3 = d[6];
+  T tmp10 = tmp0 + tmp2;
+  T tmp11 = tmp0 - tmp2;
+  T tmp13 = tmp1 + tmp3;
+  T tmp12 = (tmp1 - tmp3) * T(1.414213562f) - tmp13;
+  tmp0 = tmp10 + tmp13;
+  tmp3 = tmp10 - tmp13;
+  tmp1 = tmp11 + tmp12;
+  tmp2 = tmp11 - tmp12;
+
+  T tmp4 = d[1], tmp5 = d[3], tmp6 = d[5], tmp7 = d[7];
+  T z13 = tmp6 + tmp5;
+  T z10 = tmp6 - tmp5;
+  T z11 = tmp4 + tmp7;
+  T z12 = tmp4 - tmp7;
+  tmp7 = z11 + z13;
+  tmp11 = (z11 - z13) * T(1.414213562f);
+  T z5 = (z10 + z12) * T(1.847759065f);
+  tmp10 = T(1.082392200f) * z12 - z5;
+  tmp12 = T(-2.613125930f) * z10 + z5;
+  tmp6 = tmp12 - tmp7;
+  tmp5 = tmp11 - tmp6;
+  tmp4 = tmp10 + tmp5;
+
+  d[0] = tmp0 + tmp7;
+  d[7] = tmp0 - tmp7;
+  d[1] = tmp1 + tmp6;
+  d[6] = tmp1 - tmp6;
+  d[2] = tmp2 + tmp5;
+  d[5] = tmp2 - tmp5;
+  d[4] = tmp3 + tmp4;
+  d[3] = tmp3 - tmp4;
+}
+
+inline uint8_t Clamp(int32_t v) {
+  return static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+}
+
+#ifdef IXR_JPEG_DECODE_SSE2
+struct F4 {
+  __m128 v;
+  F4() = default;
+  F4(__m128 x) : v(x) {}  // NOLINT
+  explicit F4(float f) : v(_mm_set1_ps(f)) {}
+};
+inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+
+// rows of 8 floats as lo and hi halves
+void Transpose8(F4 *lo, F4 *hi) {
+  _MM_TRANSPOSE4_PS(lo[0].v, lo[1].v, lo[2].v, lo[3].v);
+  _MM_TRANSPOSE4_PS(lo[4].v, lo[5].v, lo[6].v, lo[7].v);
+  _MM_TRANSPOSE4_PS(hi[0].v, hi[1].v, hi[2].v, hi[3].v);
+  _MM_TRANSPOSE4_PS(hi[4].v, hi[5].v, hi[6].v, hi[7].v);
+  for (int i = 0; i < 4; i++) std::swap(lo[4 + i], hi[i]);
+}
+
+void Idct(const int32_t *coef, const float *q, uint8_t *out, size_t pitch) {
+  F4 lo[8], hi[8];
+  for (int r = 0; r < 8; r++) {
+    auto c = reinterpret_cast<const __m128i *>(coef + r * 8);
+    lo[r] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(c)),
+                       _mm_loadu_ps(q + r * 8));
+    hi[r] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(c + 1)),
+                       _mm_loadu_ps(q + r * 8 + 4));
+  }
+  // columns, then rows
+  Idct1D(lo);
+  Idct1D(hi);
+  Transpose8(lo, hi);
+  Idct1D(lo);
+  Idct1D(hi);
+  Transpose8(lo, hi);
+  const __m128i shift = _mm_set1_epi16(128);
+  for (int r = 0; r < 8; r++) {
+    __m128i w = _mm_packs_epi32(_mm_cvtps_epi32(lo[r].v),
+                                _mm_cvtps_epi32(hi[r].v));
+    w = _mm_adds_epi16(w, shift);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + r * pitch),
+                     _mm_packus_epi16(w, w));
+  }
+}
+
+// 8 pixels at a time, the rest by the scalar loop
+uint32_t YccToBgraSse2(const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                       uint8_t *dst, uint32_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i round = _mm_set1_epi32(kRound);
+  const __m128i cr_r = _mm_set1_epi32((kRound << 16) | (kCrR & 0xFFFF));
+  const __m128i cb_b = _mm_set1_epi32((kRound << 16) | (kCbB & 0xFFFF));
+  const __m128i cb_cr_g =
+      _mm_set1_epi32((kCrG * 65536) | (kCbG & 0xFFFF));
+  const __m128i alpha = _mm_set1_epi8(-1);
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto load = [&](const uint8_t *p) {
+      return _mm_unpacklo_epi8(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + i)), zero);
+    };
+    const __m128i y16 = load(y);
+    const __m128i u = _mm_sub_epi16(load(cb), half);
+    const __m128i v = _mm_sub_epi16(load(cr), half);
+    // pairs of 16-bit terms, summed to 32-bit and descaled
+    auto term = [&](__m128i a, __m128i b, __m128i k, bool rounded) {
+      __m128i l = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), k);
+      __m128i h = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), k);
+      if (!rounded) {
+        l = _mm_add_epi32(l, round);
+        h = _mm_add_epi32(h, round);
+      }
+      return _mm_adds_epi16(y16, _mm_packs_epi32(_mm_srai_epi32(l, 14),
+                                                 _mm_srai_epi32(h, 14)));
+    };
+    const __m128i r = term(v, one, cr_r, true);
+    const __m128i g = term(u, v, cb_cr_g, false);
+    const __m128i b = term(u, one, cb_b, true);
+    const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b),
+                                         _mm_packus_epi16(g, g));
+    const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+    auto out = reinterpret_cast<__m128i *>(dst + i * 4);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg, ra));
+  }
+  return i;
+}
+#else
+void Idct(const int32_t *coef, const float *q, uint8_t *out, size_t pitch) {
+  float ws[64];
+  for (int c = 0; c < 8; c++) {
+    float d[8];
+    for (int r = 0; r < 8; r++) d[r] = coef[r * 8 + c] * q[r * 8 + c];
+    Idct1D(d);
+    for (int r = 0; r < 8; r++) ws[r * 8 + c] = d[r];
+  }
+  for (int r = 0; r < 8; r++) {
+    Idct1D(ws + r * 8);
+    for (int c = 0; c < 8; c++) {
+      const long v = std::lrint(ws[r * 8 + c]);
+      out[r * pitch + c] = Clamp(static_cast<int32_t>(
+          std::min(std::max(v, -32768L), 32767L) + 128));
+    }
+  }
+}
+#endif
+
+// BGRA of a row
+void YccToBgra(const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+               uint8_t *dst, uint32_t n) {
+  uint32_t i = 0;
+#ifdef IXR_JPEG_DECODE_SSE2
+  i = YccToBgraSse2(y, cb, cr, dst, n);
+#endif
+  for (; i < n; i++) {
+    const int32_t u = cb[i] - 128, v = cr[i] - 128;
+    dst[i * 4 + 0] = Clamp(y[i] + ((kCbB * u + kRound) >> 14));
+    dst[i * 4 + 1] = Clamp(y[i] + ((kCbG * u + kCrG * v + kRound) >> 14));
+    dst[i * 4 + 2] = Clamp(y[i] + ((kCrR * v + kRound) >> 14));
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+uint16_t Read16(const uint8_t *p) { return uint16_t(p[0] << 8 | p[1]); }
+
+int ParsePicture(const uint8_t *data, size_t size, Picture *pic) {
+  std::vector<JpegSegment> segments;
+  if (ScanJpegMarkers(data, size, &segments) != 0) return -1;
+  pic->info = JpegInfo{};
+  pic->numComps = 0;
+  std::fill(pic->quantDefined, pic->quantDefined + 4, false);
+  for (int i = 0; i < 4; i++) pic->dc[i].defined = pic->ac[i].defined = false;
+  pic->intervals.clear();
+  bool scanned = false;
+  for (const auto &s : segments) {
+    const uint8_t *p = data + s.offset;
+    if (scanned) {
+      if (s.marker >= kRST0 && s.marker <= kRST7) {
+        pic->intervals.push_back(Interval{s.marker, s.coded, s.codedSize});
+      } else if (s.marker == kSOS) {
+        return -1;  // multiple scans
+      }
+      continue;
+    }
+    switch (s.marker) {
+      case kSOF0:
+      case kSOF1: {
+        if (s.size < 6 || p[0] != 8) return -1;
+        pic->info.height = Read16(p + 1);
+        pic->info.width = Read16(p + 3);
+        pic->numComps = p[5];
+        if (pic->numComps != 1 && pic->numComps != 3) return -1;
+        if (s.size < 6 + 3 * pic->numComps) return -1;
+        for (uint32_t c = 0; c < pic->numComps; c++) {
+          Component &comp = pic->comps[c];
+          comp.id = p[6 + c * 3];
+          comp.h = p[7 + c * 3] >> 4;
+          comp.v = p[7 + c * 3] & 15;
+          comp.tq = p[8 + c * 3];
+          if (comp.h < 1 || comp.h > 2 || comp.v < 1 || comp.v > 2 ||
+              comp.tq > 3) {
+            return -1;
+          }
+        }
+        break;
+      }
+      case kDHT:
+        for (uint32_t off = 0; off < s.size;) {
+          if (s.size - off < 17) return -1;
+          const uint8_t tc = p[off] >> 4, th = p[off] & 15;
+          uint32_t total = 0;
+          for (int i = 0; i < 16; i++) total += p[off + 1 + i];
+          if (tc > 1 || th > 3 || total > 256 || s.size - off < 17 + total) {
+            return -1;
+          }
+          Huffman *h = tc ? &pic->ac[th] : &pic->dc[th];
+          if (!BuildHuffman(p + off + 1, p + off + 17, h)) return -1;
+          off += 17 + total;
+        }
+        break;
+      case kDQT:
+        for (uint32_t off = 0; off < s.size;) {
+          const uint8_t pq = p[off] >> 4, tq = p[off] & 15;
+          const uint32_t bytes = pq ? 128 : 64;
+          if (pq > 1 || tq > 3 || s.size - off < 1 + bytes) return -1;
+          for (int k = 0; k < 64; k++) {
+            pic->quant[tq][kZigzag[k]] =
+                pq ? Read16(p + off + 1 + k * 2) : p[off + 1 + k];
+          }
+          pic->quantDefined[tq] = true;
+          off += 1 + bytes;
+        }
+        break;
+      case kDRI:
+        if (s.size < 2) return -1;
+        pic->info.restartInterval = Read16(p);
+        break;
+      case kSOS: {
+        if (!pic->numComps || s.size < 1 || p[0] != pic->numComps ||
+            s.size < 4 + 2 * pic->numComps) {
+          return -1;
+        }
+        for (uint32_t i = 0; i < pic->numComps; i++) {
+          const uint8_t id = p[1 + i * 2];
+          Component *comp = nullptr;
+          for (uint32_t c = 0; c < pic->numComps; c++) {
+            if (pic->comps[c].id == id) comp = &pic->comps[c];
+          }
+          if (!comp) return -1;
+          comp->td = p[2 + i * 2] >> 4;
+          comp->ta = p[2 + i * 2] & 15;
+          if (comp->td > 3 || comp->ta > 3 || !pic->dc[comp->td].defined ||
+              !pic->ac[comp->ta].defined || !pic->quantDefined[comp->tq]) {
+            return -1;
+          }
+        }
+        pic->intervals.push_back(Interval{s.marker, s.coded, s.codedSize});
+        scanned = true;
+        break;
+      }
+      default:
+        // progressive, lossless, arithmetic or hierarchical frames
+        if (s.marker >= 0xC2 && s.marker <= 0xCF && s.marker != 0xC4 &&
+            s.marker != 0xC8 && s.marker != 0xCC) {
+          return -1;
+        }
+        break;
+    }
+  }
+  if (!scanned || pic->info.width <= 0 || pic->info.height <= 0) return -1;
+  if (pic->numComps == 1) {
+    // a non-interleaved scan, of one block per MCU
+    pic->comps[0].h = pic->comps[0].v = 1;
+  }
+  pic->hmax = pic->vmax = 1;
+  for (uint32_t c = 0; c < pic->numComps; c++) {
+    pic->hmax = std::max<uint32_t>(pic->hmax, pic->comps[c].h);
+    pic->vmax = std::max<uint32_t>(pic->vmax, pic->comps[c].v);
+  }
+  pic->mcusX = (pic->info.width + 8 * pic->hmax - 1) / (8 * pic->hmax);
+  pic->mcusY = (pic->info.height + 8 * pic->vmax - 1) / (8 * pic->vmax);
+  pic->info.components = pic->numComps;
+  pic->info.intervals = static_cast<uint32_t>(pic->intervals.size());
+  return 0;
+}
+
+// Decode intervals into a surface, each thread owns one
+class IntervalDecoder {
+ public:
+  IntervalDecoder(const Picture &pic, const uint8_t *data,
+                  const JpegSurface &surface)
+      : pic_(pic), data_(data), surface_(surface) {
+    for (uint32_t c = 0; c < pic.numComps; c++) {
+      const uint16_t *q = pic.quant[pic.comps[c].tq];
+      for (int i = 0; i < 64; i++) {
+        // dequantize with the scales of AAN, and descale the output by 8
+        quant_[c][i] = q[i] * kAanScale[i / 8] * kAanScale[i % 8] / 8;
+      }
+    }
+  }
+
+  bool Decode(uint32_t index, uint32_t first, uint32_t last) {
+    const Interval &interval = pic_.intervals[index];
+    BitReader br(data_ + interval.offset, interval.size);
+    int32_t pred[3] = {0, 0, 0};
+    alignas(16) int32_t coef[64];
+    for (uint32_t m = first; m < last; m++) {
+      for (uint32_t c = 0; c < pic_.numComps; c++) {
+        const Component &comp = pic_.comps[c];
+        const uint32_t stride = comp.h * 8;
+        for (uint32_t by = 0; by < comp.v; by++) {
+          for (uint32_t bx = 0; bx < comp.h; bx++) {
+            if (!DecodeBlock(&br, pic_.dc[comp.td], pic_.ac[comp.ta],
+                             &pred[c], coef)) {
+              return false;
+            }
+            Idct(coef, quant_[c], planes_[c] + by * 8 * stride + bx * 8,
+                 stride);
+          }
+        }
+      }
+      if (surface_.format == IXR_COLOR_NV12) {
+        writeNV12(m % pic_.mcusX, m / pic_.mcusX);
+      } else {
+        writeBgra(m % pic_.mcusX, m / pic_.mcusX);
+      }
+    }
+    return true;
+  }
+
+ private:
+  //! a row of a component at the width of the MCU
+  const uint8_t *row(uint32_t c, uint32_t y) {
+    const Component &comp = pic_.comps[c];
+    const uint8_t *src =
+        planes_[c] + (y * comp.v / pic_.vmax) * (comp.h * 8);
+    if (comp.h == pic_.hmax) return src;
+    for (uint32_t x = 0; x < pic_.hmax * 8; x++) rows_[c][x] = src[x / 2];
+    return rows_[c];
+  }
+
+  uint8_t sample(uint32_t c, uint32_t x, uint32_t y) const {
+    const Component &comp = pic_.comps[c];
+    return planes_[c][(y * comp.v / pic_.vmax) * (comp.h * 8) +
+                      x * comp.h / pic_.hmax];
+  }
+
+  void extent(uint32_t mx, uint32_t my, uint32_t *x0, uint32_t *y0,
+              uint32_t *w, uint32_t *h) const {
+    *x0 = mx * pic_.hmax * 8;
+    *y0 = my * pic_.vmax * 8;
+    *w = std::min(pic_.hmax * 8, pic_.info.width - *x0);
+    *h = std::min(pic_.vmax * 8, pic_.info.height - *y0);
+  }
+
+  void writeBgra(uint32_t mx, uint32_t my) {
+    static const uint8_t neutral[16] = {128, 128, 128, 128, 128, 128,
+                                        128, 128, 128, 128, 128, 128,
+                                        128, 128, 128, 128};
+    uint32_t x0, y0, w, h;
+    extent(mx, my, &x0, &y0, &w, &h);
+    for (uint32_t r = 0; r < h; r++) {
+      const uint8_t *y = row(0, r);
+      const uint8_t *cb = pic_.numComps == 3 ? row(1, r) : neutral;
+      const uint8_t *cr = pic_.numComps == 3 ? row(2, r) : neutral;
+      YccToBgra(y, cb, cr,
+                surface_.y + size_t(y0 + r) * surface_.pitch + x0 * 4, w);
+    }
+  }
+
+  void writeNV12(uint32_t mx, uint32_t my) {
+    uint32_t x0, y0, w, h;
+    extent(mx, my, &x0, &y0, &w, &h);
+    for (uint32_t r = 0; r < h; r++) {
+      std::memcpy(surface_.y + size_t(y0 + r) * surface_.pitch + x0,
+                  row(0, r), w);
+    }
+    uint8_t *uv = surface_.uv
+                      ? surface_.uv
+                      : surface_.y + size_t(surface_.pitch) *
+                                         pic_.info.height;
+    for (uint32_t r = 0; r < (h + 1) / 2; r++) {
+      uint8_t *dst = uv + size_t(y0 / 2 + r) * surface_.pitch + x0;
+      for (uint32_t x = 0; x < (w + 1) / 2; x++) {
+        if (pic_.numComps == 1) {
+          dst[x * 2] = dst[x * 2 + 1] = 128;
+          continue;
+        }
+        // the mean of the 2x2 luma positions, same for 4:2:0
+        for (uint32_t c = 1; c < 3; c++) {
+          const uint32_t sum =
+              sample(c, x * 2, r * 2) + sample(c, x * 2 + 1, r * 2) +
+              sample(c, x * 2, r * 2 + 1) + sample(c, x * 2 + 1, r * 2 + 1);
+          dst[x * 2 + c - 1] = static_cast<uint8_t>((sum + 2) >> 2);
+        }
+      }
+    }
+  }
+
+  const Picture &pic_;
+  const uint8_t *data_;
+  JpegSurface surface_;
+  alignas(16) float quant_[3][64];
+  uint8_t planes_[3][256];  //!< samples of the MCU, 16x16 at most
+  uint8_t rows_[3][16];
+};
+}  // namespace
+
+int ScanJpegMarkers(const uint8_t *data, size_t size,
+                    std::vector<JpegSegment> *segments) {
+  segments->clear();
+  if (size < 2 || data[0] != 0xFF || data[1] != kSOI) return -1;
+  size_t pos = 2;
+  for (;;) {
+    // fill bytes may precede a marker
+    while (pos + 1 < size && data[pos] == 0xFF && data[pos + 1] == 0xFF) {
+      pos++;
+    }
+    if (pos + 2 > size || data[pos] != 0xFF) return -1;
+    JpegSegment s{data[pos + 1], static_cast<uint32_t>(pos + 2), 0, 0, 0};
+    pos += 2;
+    if (s.marker == kEOI) {
+      segments->push_back(s);
+      return 0;
+    }
+    if (s.marker == kTEM || (s.marker >= kRST0 && s.marker <= kRST7)) {
+      // without a payload, RSTn only follows a scan
+      segments->push_back(s);
+      continue;
+    }
+    if (pos + 2 > size) return -1;
+    const uint32_t length = Read16(data + pos);
+    if (length < 2 || pos + length > size) return -1;
+    s.offset = static_cast<uint32_t>(pos + 2);
+    s.size = length - 2;
+    pos += length;
+    if (s.marker != kSOS) {
+      segments->push_back(s);
+      continue;
+    }
+    // entropy-coded intervals, which end at a marker other than 0xFF00
+    size_t begin = pos;
+    for (;;) {
+      auto p = static_cast<const uint8_t *>(
+          std::memchr(data + pos, 0xFF, size - pos));
+      if (!p) return -1;
+      const size_t end = p - data;
+      size_t ff = end;
+      while (ff + 1 < size && data[ff + 1] == 0xFF) ff++;
+      if (ff + 1 >= size) return -1;
+      const uint8_t next = data[ff + 1];
+      if (next == 0x00) {
+        pos = ff + 2;
+        continue;
+      }
+      s.coded = static_cast<uint32_t>(begin);
+      s.codedSize = static_cast<uint32_t>(end - begin);
+      segments->push_back(s);
+      if (next < kRST0 || next > kRST7) {
+        pos = ff;
+        break;
+      }
+      s = JpegSegment{next, static_cast<uint32_t>(ff + 2), 0, 0, 0};
+      begin = pos = ff + 2;
+    }
+  }
+}
+
+JpegDecoderCpu::JpegDecoderCpu(uint32_t threads)
+    : threads_(threads ? threads : Executor::Shared().Threads()) {}
+
+int JpegDecoderCpu::Parse(const void *data, uint32_t size,
+                          JpegInfo *info) const {
+  std::unique_ptr<Picture> pic(new Picture);
+  if (ParsePicture(static_cast<const uint8_t *>(data), size, pic.get()) != 0) {
+    return -1;
+  }
+  *info = pic->info;
+  return 0;
+}
+
+int JpegDecoderCpu::Decode(const void *data, uint32_t size,
+                           const JpegSurface &surface) {
+  if (!surface.y || (surface.format != IXR_COLOR_NV12 &&
+                     surface.format != IXR_COLOR_ARGB)) {
+    return -1;
+  }
+  auto bytes = static_cast<const uint8_t *>(data);
+  std::unique_ptr<Picture> pic(new Picture);
+  if (ParsePicture(bytes, size, pic.get()) != 0) return -1;
+  const uint32_t total = pic->mcusX * pic->mcusY;
+  const uint32_t ri = pic->info.restartInterval;
+  const uint32_t expected = ri ? (total + ri - 1) / ri : 1;
+  const uint32_t count =
+      std::min(expected, static_cast<uint32_t>(pic->intervals.size()));
+  std::atomic<uint32_t> next(0);
+  std::atomic<bool> failed(count < expected);
+  auto work = [&]() {
+    std::unique_ptr<IntervalDecoder> decoder(
+        new IntervalDecoder(*pic, bytes, surface));
+    for (uint32_t i = next++; i < count; i = next++) {
+      // a lost interval would shift the MCUs of the others
+      if (i && pic->intervals[i].marker != kRST0 + ((i - 1) & 7)) {
+        failed = true;
+        continue;
+      }
+      const uint32_t first = ri ? i * ri : 0;
+      const uint32_t last = ri ? std::min(first + ri, total) : total;
+      if (!decoder->Decode(i, first, last)) failed = true;
+    }
+  };
+  TaskGroup group(IXR_TASK_INTERACTIVE);
+  const uint32_t threads = std::min(threads_, count);
+  for (uint32_t t = 1; t < threads; t++) group.Run(work);
+  work();
+  group.Wait();
+  return failed ? -1 : 0;
+}
+}  // namespace ixr
@@ -0,0 +1,90 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Decode baseline JPEG on CPU by parallel restart intervals
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_JPEG_DECODE_H_
+#define LL_CODEC_CODEC_IXR_JPEG_DECODE_H_
+#include <stdint.h>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+//! A marker segment of a JPEG picture
+struct JpegSegment {
+  uint8_t marker;      //!< the second byte of the marker, i.e. 0xDA of SOS
+  uint32_t offset;     //!< of the payload, after the length field
+  uint32_t size;       //!< bytes of the payload, 0 of RSTn
+  uint32_t coded;      //!< SOS and RSTn only, offset of the entropy-coded
+                       //!< interval which follows
+  uint32_t codedSize;  //!< bytes of the interval, without fill bytes
+};
+
+/**
+ * @brief Find the marker segments of a JPEG picture, from SOI to EOI. The
+ * entropy-coded data of a scan are split by RSTn markers into intervals,
+ * which are listed with their markers, so that each can be decoded alone.
+ *
+ * @return 0 if succeed, -1 if the picture is broken or truncated
+ */
+int ScanJpegMarkers(const uint8_t *data, size_t size,
+                    std::vector<JpegSegment> *segments);
+
+struct JpegInfo {
+  int32_t width;
+  int32_t height;
+  uint32_t components;       //!< 1 of gray, 3 of YCbCr
+  uint32_t restartInterval;  //!< MCUs of an interval, 0 without DRI
+  uint32_t intervals;        //!< entropy-coded intervals of the scan
+};
+
+//! A surface to decode into, in the manner of SurfaceView
+struct JpegSurface {
+  ColorFourcc format;  //!< IXR_COLOR_NV12 or IXR_COLOR_ARGB
+  uint32_t pitch;      //!< bytes of a row, of an even width of NV12
+  uint8_t *y;          //!< luma of NV12, or BGRA pixels of ARGB
+  uint8_t *uv;         //!< interleaved chroma of NV12, after the luma if
+                       //!< null
+};
+
+/**
+ * @brief Decode baseline JPEG, i.e. MJPEG of cameras, on nodes without a
+ * JPEG engine.
+ *
+ * Restart intervals are decoded by parallel threads, each one writes its
+ * MCUs straight into the surface. Pictures without DRI are decoded by one
+ * thread. IDCT is the float AAN of libjpeg, and YCbCr is converted to BGRA
+ * by BT.601 in 14-bit fixed point, both with SSE2 if the target has it.
+ * Chroma is replicated to ARGB, and averaged to NV12 from 4:4:4 or 4:2:2.
+ *
+ * Only one interleaved scan of 8-bit samples with sampling factors of 1 or
+ * 2 is supported, progressive and arithmetic coding are not.
+ */
+class JpegDecoderCpu {
+ public:
+  //! @param threads number of threads, 0 for all cores
+  explicit JpegDecoderCpu(uint32_t threads = 0);
+
+  /**
+   * @brief Read the headers of a picture
+   *
+   * @return 0 if succeed, -1 if it isn't supported or broken
+   */
+  int Parse(const void *data, uint32_t size, JpegInfo *info) const;
+
+  /**
+   * @brief Decode a picture into a surface of its size.
+   *
+   * @return 0 if succeed, -1 if it isn't supported or an interval is
+   * broken, the other intervals are still decoded.
+   */
+  int Decode(const void *data, uint32_t size, const JpegSurface &surface);
+
+ private:
+  uint32_t threads_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_JPEG_DECODE_H_
@@ -0,0 +1,205 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Annex-B NAL unit helpers for IXR codecs
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_NALU_H_
+#define LL_CODEC_CODEC_IXR_NALU_H_
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "ll_codec/codec/ixr_bitstream.h"
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+/**
+ * @brief Find the next start code (00 00 01) in an Annex-B bitstream
+ *
+ * @param data the bitstream
+ * @param size size of the bitstream
+ * @param from offset to search from
+ * @param prefix [out] size of the start code, 3 or 4 (00 00 00 01)
+ * @return offset of the start code, or size if not found
+ */
+inline uint32_t FindStartCode(const uint8_t *data, uint32_t size,
+                              uint32_t from, uint32_t *prefix) {
+  for (uint32_t i = from; i + 3 <= size;) {
+    // skip to the next zero byte, memchr is vectorized by the runtime
+    auto p = static_cast<const uint8_t *>(
+        std::memchr(data + i, 0, size - i - 2));
+    if (!p) break;
+    i = static_cast<uint32_t>(p - data);
+    if (data[i + 1] == 0 && data[i + 2] == 1) {
+      const bool four = i > from && data[i - 1] == 0;
+      if (prefix) *prefix = four ? 4 : 3;
+      return four ? i - 1 : i;
+    }
+    ++i;
+  }
+  if (prefix) *prefix = 0;
+  return size;
+}
+
+/**
+ * @brief Call fn(nal, size) on each NAL unit of an Annex-B bitstream, the
+ * start code and trailing_zero_8bits are excluded.
+ */
+template <typename Fn>
+inline void ForEachNalu(const uint8_t *data, uint32_t size, Fn fn) {
+  uint32_t prefix = 0;
+  for (uint32_t i = FindStartCode(data, size, 0, &prefix); i < size;) {
+    const uint32_t begin = i + prefix;
+    const uint32_t next = FindStartCode(data, size, begin, &prefix);
+    uint32_t end = next;
+    while (end > begin && data[end - 1] == 0) --end;
+    if (end > begin) fn(data + begin, end - begin);
+    i = next;
+  }
+}
+
+/**
+ * @brief Get nal_unit_type from the first byte of NAL header
+ */
+inline uint8_t NaluType(CodecFourcc codec, uint8_t header) {
+  return codec == IXR_CODEC_HEVC ? (header >> 1) & 0x3F : header & 0x1F;
+}
+
+/**
+ * @brief Test if a NAL unit is a coded slice
+ */
+inline bool IsSliceNalu(CodecFourcc codec, uint8_t header) {
+  const uint8_t type = NaluType(codec, header);
+  // HEVC: VCL NAL types are 0-31, AVC: non-IDR and IDR slices are 1-5
+  return codec == IXR_CODEC_HEVC ? type < 32 : type >= 1 && type <= 5;
+}
+
+/**
+ * @brief Find the offsets of the coded slices in an Annex-B bitstream.
+ * Each offset points to the start code of a slice NAL unit.
+ *
+ * @param codec AVC or HEVC
+ * @param data the bitstream
+ * @param size size of the bitstream
+ * @param offsets [out] can be null to count the slices only
+ * @param count [in] capacity of offsets
+ * @return the number of slices, may be larger than count
+ */
+inline uint32_t FindSlices(CodecFourcc codec, const uint8_t *data,
+                           uint32_t size, uint32_t *offsets, uint32_t count) {
+  uint32_t n = 0;
+  uint32_t prefix = 0;
+  for (uint32_t i = FindStartCode(data, size, 0, &prefix); i < size;) {
+    const uint32_t header = i + prefix;
+    if (header < size && IsSliceNalu(codec, data[header])) {
+      if (offsets && n < count) offsets[n] = i;
+      ++n;
+    }
+    i = FindStartCode(data, size, header, &prefix);
+  }
+  return n;
+}
+
+/**
+ * @brief Parse the picture type of a slice NAL unit. HEVC slices are assumed
+ * to have no extra slice header bits, as the encoders write them.
+ */
+inline FrameType SliceFrameType(CodecFourcc codec, const uint8_t *nal,
+                                uint32_t size) {
+  const uint8_t type = NaluType(codec, nal[0]);
+  if (codec == IXR_CODEC_HEVC) {
+    // IDR_W_RADL, IDR_N_LP, and other IRAP pictures
+    if (type == 19 || type == 20) return IXR_FRAME_IDR;
+    if (type >= 16 && type <= 23) return IXR_FRAME_I;
+  } else if (type == 5) {
+    return IXR_FRAME_IDR;
+  }
+  // NAL header and the extension of MVC
+  const uint32_t header = codec == IXR_CODEC_HEVC ? 2 : type == 20 ? 4 : 1;
+  if (size <= header) return IXR_FRAME_UNKNOWN;
+  if (type == 20) {
+    // non_idr_flag of MVC, or idr_flag of SVC
+    const bool svc = nal[1] & 0x80;
+    if (svc == bool(nal[1] & 0x40)) return IXR_FRAME_IDR;
+  }
+  // slice_type is within the first few bytes of the slice header
+  std::vector<uint8_t> rbsp;
+  UnescapeRbsp(nal + header, std::min(size - header, 16u), &rbsp);
+  BitReader br(rbsp.data(), static_cast<uint32_t>(rbsp.size()));
+  if (codec == IXR_CODEC_HEVC) {
+    // slice_segment_address of other segments needs the PPS
+    if (!br.Bit()) return IXR_FRAME_UNKNOWN;
+    br.Ue();  // slice_pic_parameter_set_id
+  } else {
+    br.Ue();  // first_mb_in_slice
+  }
+  const uint32_t slice = br.Ue();
+  if (!br.Good()) return IXR_FRAME_UNKNOWN;
+  // HEVC: 0 B, 1 P, 2 I; AVC: 0 P, 1 B, 2 I, 3 SP, 4 SI, plus 5 if fixed
+  static const FrameType kHevc[] = {IXR_FRAME_B, IXR_FRAME_P, IXR_FRAME_I};
+  static const FrameType kAvc[] = {IXR_FRAME_P, IXR_FRAME_B, IXR_FRAME_I,
+                                   IXR_FRAME_P, IXR_FRAME_I};
+  if (codec == IXR_CODEC_HEVC) {
+    return slice < 3 ? kHevc[slice] : IXR_FRAME_UNKNOWN;
+  }
+  return slice < 10 ? kAvc[slice % 5] : IXR_FRAME_UNKNOWN;
+}
+
+/**
+ * @brief Parse the picture type of the first slice in an Annex-B bitstream
+ */
+inline FrameType AccessUnitType(CodecFourcc codec, const uint8_t *data,
+                                uint32_t size) {
+  FrameType type = IXR_FRAME_UNKNOWN;
+  bool found = false;
+  ForEachNalu(data, size, [&](const uint8_t *nal, uint32_t len) {
+    if (found || !IsSliceNalu(codec, nal[0])) return;
+    type = SliceFrameType(codec, nal, len);
+    found = true;
+  });
+  return type;
+}
+
+/**
+ * @brief Fill the metadata of an output descriptor from its segments: the
+ * type of the first slice, the layer of HEVC or MVC view of it, and the pts
+ * of the output order at fps.
+ */
+inline void DescribeOutput(CodecFourcc codec, int32_t fps, uint32_t order,
+                           OutputDescriptor *desc) {
+  desc->frameOrder = order;
+  desc->pts = fps > 0 ? int64_t(order) * 90000 / fps : kPtsUnknown;
+  desc->type = IXR_FRAME_UNKNOWN;
+  desc->layer = desc->temporalId = 0;
+  if (codec == IXR_CODEC_JPEG) {
+    desc->type = IXR_FRAME_I;
+    return;
+  }
+  bool found = false;
+  for (uint32_t i = 0; i < desc->count && !found; i++) {
+    ForEachNalu(static_cast<const uint8_t *>(desc->segments[i].base),
+                static_cast<uint32_t>(desc->segments[i].size),
+                [&](const uint8_t *nal, uint32_t size) {
+                  if (found) return;
+                  const uint8_t type = NaluType(codec, nal[0]);
+                  if (codec == IXR_CODEC_HEVC && size >= 2) {
+                    desc->layer = ((nal[0] & 1) << 5) | (nal[1] >> 3);
+                    desc->temporalId = (nal[1] & 7) ? (nal[1] & 7) - 1 : 0;
+                  } else if ((type == 14 || type == 20) && size >= 4 &&
+                             !(nal[1] & 0x80)) {
+                    // nal_unit_header_mvc_extension
+                    desc->layer = (nal[2] << 2) | (nal[3] >> 6);
+                    desc->temporalId = (nal[3] >> 3) & 7;
+                  }
+                  if (IsSliceNalu(codec, nal[0]) || type == 20) {
+                    desc->type = SliceFrameType(codec, nal, size);
+                    found = true;
+                  }
+                });
+  }
+}
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_NALU_H_
@@ -0,0 +1,488 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Objective quality of decoded surfaces, PSNR/SSIM/MS-SSIM
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_quality.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ll_codec/codec/ixr_capture.h"
+#include "ll_codec/codec/ixr_executor.h"
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IXR_QUALITY_SSE2
+#endif
+
+namespace ixr {
+namespace {
+constexpr double kC1 = (0.01 * 255) * (0.01 * 255);
+constexpr double kC2 = (0.03 * 255) * (0.03 * 255);
+constexpr uint32_t kScales = 5;
+constexpr double kScaleWeights[kScales]{0.0448, 0.2856, 0.3001, 0.2363,
+                                        0.1333};
+// rows of a band are at least this many, to pay for a thread
+constexpr uint32_t kMinBandRows = 32;
+
+#ifdef IXR_QUALITY_SSE2
+__m128i Load(const uint8_t *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+// squared lanes of v selected by mask, summed in pairs
+__m128i MaskedSquare(__m128i v, __m128i mask) {
+  return _mm_madd_epi16(_mm_and_si128(v, mask), v);
+}
+#endif
+
+double Psnr(uint64_t sse, uint64_t samples) {
+  if (!sse) return kPsnrMax;
+  const double db = 10 * std::log10(255.0 * 255.0 * samples / sse);
+  return std::min(db, kPsnrMax);
+}
+
+/**
+ * Accumulate squared errors of n bytes into sse by channel, channel c is
+ * of bytes c, c + channels, ... Channels are 1, 2 or 4, only the first 3
+ * are accumulated.
+ */
+void SquaredErrors(const uint8_t *a, const uint8_t *b, uint32_t n,
+                   uint32_t channels, uint64_t *sse) {
+  const uint32_t used = std::min(channels, 3u);
+  uint32_t x = 0;
+#ifdef IXR_QUALITY_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i mask[3];
+  for (uint32_t c = 0; c < used; c++) {
+    int16_t m[8];
+    for (uint32_t i = 0; i < 8; i++) m[i] = i % channels == c ? -1 : 0;
+    mask[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(m));
+  }
+  while (x + 16 <= n) {
+    // 32-bit lanes hold at most 4096 steps of 2 * 2 * 255^2
+    __m128i acc[3]{zero, zero, zero};
+    const uint32_t stop = std::min(n & ~15u, x + 4096 * 16);
+    for (; x < stop; x += 16) {
+      const __m128i va = Load(a + x);
+      const __m128i vb = Load(b + x);
+      const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero),
+                                       _mm_unpacklo_epi8(vb, zero));
+      const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero),
+                                       _mm_unpackhi_epi8(vb, zero));
+      for (uint32_t c = 0; c < used; c++) {
+        acc[c] = _mm_add_epi32(acc[c], MaskedSquare(lo, mask[c]));
+        acc[c] = _mm_add_epi32(acc[c], MaskedSquare(hi, mask[c]));
+      }
+    }
+    for (uint32_t c = 0; c < used; c++) {
+      uint32_t lanes[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc[c]);
+      sse[c] += uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+  }
+#endif
+  for (; x < n; x++) {
+    const int d = int(a[x]) - b[x];
+    if (x % channels < used) sse[x % channels] += uint32_t(d * d);
+  }
+}
+
+// Sums of a 4x4 block: a, b, a^2 + b^2, a * b
+struct BlockSum {
+  int32_t s1, s2, ss, s12;
+};
+
+// Sums of a row of 4x4 blocks
+void BlockSums(const uint8_t *a, uint32_t pa, const uint8_t *b, uint32_t pb,
+               uint32_t blocks, BlockSum *sums) {
+  uint32_t k = 0;
+#ifdef IXR_QUALITY_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  // a pair of blocks from 32-bit lanes of pair sums
+  auto store = [](__m128i v, int32_t *first, int32_t *second) {
+    v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+    *first = _mm_cvtsi128_si32(v);
+    *second = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+  };
+  for (; k + 4 <= blocks; k += 4) {
+    __m128i s1[2]{zero, zero}, s2[2]{zero, zero};
+    __m128i ss[2]{zero, zero}, s12[2]{zero, zero};
+    for (uint32_t r = 0; r < 4; r++) {
+      const __m128i va = Load(a + size_t(r) * pa + k * 4);
+      const __m128i vb = Load(b + size_t(r) * pb + k * 4);
+      const __m128i ua[2]{_mm_unpacklo_epi8(va, zero),
+                          _mm_unpackhi_epi8(va, zero)};
+      const __m128i ub[2]{_mm_unpacklo_epi8(vb, zero),
+                          _mm_unpackhi_epi8(vb, zero)};
+      for (int h = 0; h < 2; h++) {
+        s1[h] = _mm_add_epi16(s1[h], ua[h]);
+        s2[h] = _mm_add_epi16(s2[h], ub[h]);
+        ss[h] = _mm_add_epi32(ss[h], _mm_madd_epi16(ua[h], ua[h]));
+        ss[h] = _mm_add_epi32(ss[h], _mm_madd_epi16(ub[h], ub[h]));
+        s12[h] = _mm_add_epi32(s12[h], _mm_madd_epi16(ua[h], ub[h]));
+      }
+    }
+    for (int h = 0; h < 2; h++) {
+      BlockSum &p = sums[k + 2 * h], &q = sums[k + 2 * h + 1];
+      store(_mm_madd_epi16(s1[h], ones), &p.s1, &q.s1);
+      store(_mm_madd_epi16(s2[h], ones), &p.s2, &q.s2);
+      store(ss[h], &p.ss, &q.ss);
+      store(s12[h], &p.s12, &q.s12);
+    }
+  }
+#endif
+  for (; k < blocks; k++) {
+    BlockSum s{0, 0, 0, 0};
+    for (uint32_t r = 0; r < 4; r++) {
+      const uint8_t *ra = a + size_t(r) * pa + k * 4;
+      const uint8_t *rb = b + size_t(r) * pb + k * 4;
+      for (uint32_t i = 0; i < 4; i++) {
+        s.s1 += ra[i];
+        s.s2 += rb[i];
+        s.ss += ra[i] * ra[i] + rb[i] * rb[i];
+        s.s12 += ra[i] * rb[i];
+      }
+    }
+    sums[k] = s;
+  }
+}
+
+// SSIM of an 8x8 window of 2x2 blocks, and its contrast-structure term
+double Window(const BlockSum &a, const BlockSum &b, const BlockSum &c,
+              const BlockSum &d, double *cs) {
+  const double n = 64;
+  const double m1 = (a.s1 + b.s1 + c.s1 + d.s1) / n;
+  const double m2 = (a.s2 + b.s2 + c.s2 + d.s2) / n;
+  const double vars = (a.ss + b.ss + c.ss + d.ss) / n - m1 * m1 - m2 * m2;
+  const double covar = (a.s12 + b.s12 + c.s12 + d.s12) / n - m1 * m2;
+  *cs = (2 * covar + kC2) / (vars + kC2);
+  return (2 * m1 * m2 + kC1) / (m1 * m1 + m2 * m2 + kC1) * *cs;
+}
+
+// Halve a plane by the mean of 2x2 pixels
+void Downscale(const uint8_t *src, uint32_t pitch, uint32_t width,
+               uint32_t height, uint8_t *dst) {
+  const uint32_t w = width / 2, h = height / 2;
+  for (uint32_t y = 0; y < h; y++) {
+    const uint8_t *r0 = src + size_t(2 * y) * pitch;
+    const uint8_t *r1 = r0 + pitch;
+    uint8_t *out = dst + size_t(y) * w;
+    uint32_t x = 0;
+#ifdef IXR_QUALITY_SSE2
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    for (; x + 8 <= w; x += 8) {
+      const __m128i a = Load(r0 + 2 * x);
+      const __m128i b = Load(r1 + 2 * x);
+      // sums of horizontal pairs, then of both rows
+      const __m128i sa =
+          _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+      const __m128i sb =
+          _mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8));
+      const __m128i s = _mm_srli_epi16(
+          _mm_add_epi16(_mm_add_epi16(sa, sb), _mm_set1_epi16(2)), 2);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + x),
+                       _mm_packus_epi16(s, s));
+    }
+#endif
+    for (; x < w; x++) {
+      out[x] = static_cast<uint8_t>(
+          (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+    }
+  }
+}
+}  // namespace
+
+SurfaceView PackedSurface(const void *frame, uint32_t width, uint32_t height,
+                          ColorFourcc format) {
+  auto p = static_cast<const uint8_t *>(frame);
+  SurfaceView s{format, width, height, width, p, nullptr};
+  switch (format) {
+    case IXR_COLOR_NV12:
+      s.uv = p + size_t(width) * height;
+      break;
+    case IXR_COLOR_P010:
+      s.pitch = width * 2;
+      s.uv = p + size_t(s.pitch) * height;
+      break;
+    default:
+      s.pitch = width * 4;
+      break;
+  }
+  return s;
+}
+
+QualityMeter::QualityMeter(uint32_t threads) : threads_(threads) {
+  if (!threads_) threads_ = Executor::Shared().Threads();
+}
+
+int QualityMeter::Compare(const SurfaceView &ref, const SurfaceView &dist,
+                          uint32_t metrics, QualityScore *score) {
+  if (ref.format != dist.format || ref.width != dist.width ||
+      ref.height != dist.height || !ref.y || !dist.y ||
+      (ref.format == IXR_COLOR_NV12 && (!ref.uv || !dist.uv))) {
+    return -1;
+  }
+  // kernels are of 8-bit samples
+  if (ref.format != IXR_COLOR_NV12 && ref.format != IXR_COLOR_ARGB) return -1;
+  *score = QualityScore{};
+  if (metrics & IXR_QUALITY_PSNR) psnr(ref, dist, score);
+  if (!(metrics & (IXR_QUALITY_SSIM | IXR_QUALITY_MSSSIM))) return 0;
+  const Plane a = luma(ref, &luma_[0]);
+  const Plane b = luma(dist, &luma_[1]);
+  double cs;
+  if (metrics & IXR_QUALITY_SSIM) score->ssim = ssim(a, b, &cs);
+  if (metrics & IXR_QUALITY_MSSSIM) score->msssim = msssim(a, b);
+  return 0;
+}
+
+void QualityMeter::psnr(const SurfaceView &ref, const SurfaceView &dist,
+                        QualityScore *score) {
+  const bool nv12 = ref.format == IXR_COLOR_NV12;
+  // NV12 rows of luma, then of chroma
+  const uint32_t rows = nv12 ? ref.height + ref.height / 2 : ref.height;
+  std::vector<uint64_t> sse(size_t(threads_) * 3, 0);
+  parallel(rows, [&](uint32_t band, uint32_t begin, uint32_t end) {
+    uint64_t *acc = &sse[size_t(band) * 3];
+    for (uint32_t y = begin; y < end; y++) {
+      if (!nv12) {
+        SquaredErrors(ref.y + size_t(y) * ref.pitch,
+                      dist.y + size_t(y) * dist.pitch, ref.width * 4, 4, acc);
+      } else if (y < ref.height) {
+        SquaredErrors(ref.y + size_t(y) * ref.pitch,
+                      dist.y + size_t(y) * dist.pitch, ref.width, 1, acc);
+      } else {
+        const size_t r = y - ref.height;
+        SquaredErrors(ref.uv + r * ref.pitch, dist.uv + r * dist.pitch,
+                      ref.width, 2, acc + 1);
+      }
+    }
+  });
+  uint64_t total[3]{0, 0, 0};
+  for (size_t i = 0; i < sse.size(); i++) total[i % 3] += sse[i];
+  const uint64_t pixels = uint64_t(ref.width) * ref.height;
+  if (nv12) {
+    score->psnr[0] = Psnr(total[0], pixels);
+    score->psnr[1] = Psnr(total[1], pixels / 4);
+    score->psnr[2] = Psnr(total[2], pixels / 4);
+    score->psnrAll = Psnr(total[0] + total[1] + total[2], pixels * 3 / 2);
+  } else {
+    // BGRA in memory
+    score->psnr[0] = Psnr(total[2], pixels);
+    score->psnr[1] = Psnr(total[1], pixels);
+    score->psnr[2] = Psnr(total[0], pixels);
+    score->psnrAll = Psnr(total[0] + total[1] + total[2], pixels * 3);
+  }
+}
+
+double QualityMeter::ssim(const Plane &a, const Plane &b, double *cs) {
+  const uint32_t bw = a.width / 4, bh = a.height / 4;
+  *cs = 1;
+  if (bw < 2 || bh < 2) return 1;
+  // windows of 2x2 blocks at a step of a block
+  const uint32_t ww = bw - 1, wh = bh - 1;
+  std::vector<double> sums(size_t(threads_) * 2, 0);
+  parallel(wh, [&](uint32_t band, uint32_t begin, uint32_t end) {
+    std::vector<BlockSum> rows[2]{std::vector<BlockSum>(bw),
+                                  std::vector<BlockSum>(bw)};
+    auto blocks = [&](uint32_t by, std::vector<BlockSum> *out) {
+      BlockSums(a.data + size_t(by) * 4 * a.pitch, a.pitch,
+                b.data + size_t(by) * 4 * b.pitch, b.pitch, bw, out->data());
+    };
+    blocks(begin, &rows[0]);
+    double ssim = 0, contrast = 0;
+    for (uint32_t wy = begin; wy < end; wy++) {
+      const auto &top = rows[(wy - begin) & 1];
+      auto &bottom = rows[(wy - begin + 1) & 1];
+      blocks(wy + 1, &bottom);
+      for (uint32_t wx = 0; wx < ww; wx++) {
+        double c;
+        ssim += Window(top[wx], top[wx + 1], bottom[wx], bottom[wx + 1], &c);
+        contrast += c;
+      }
+    }
+    sums[size_t(band) * 2] = ssim;
+    sums[size_t(band) * 2 + 1] = contrast;
+  });
+  double ssim = 0, contrast = 0;
+  for (size_t i = 0; i < sums.size(); i += 2) {
+    ssim += sums[i];
+    contrast += sums[i + 1];
+  }
+  const double windows = double(ww) * wh;
+  *cs = contrast / windows;
+  return ssim / windows;
+}
+
+double QualityMeter::msssim(Plane a, Plane b) {
+  double cs[kScales], ssims[kScales];
+  uint32_t scales = 0;
+  for (; scales < kScales; scales++) {
+    if (a.width < 8 || a.height < 8) break;
+    ssims[scales] = ssim(a, b, &cs[scales]);
+    if (scales + 1 == kScales) {
+      scales++;
+      break;
+    }
+    // ping-pong the downscaled planes of each surface
+    Plane *planes[2]{&a, &b};
+    for (int i = 0; i < 2; i++) {
+      Plane &p = *planes[i];
+      auto &buf = scale_[i][scales & 1];
+      buf.resize(size_t(p.width / 2) * (p.height / 2));
+      Downscale(p.data, p.pitch, p.width, p.height, buf.data());
+      p = Plane{buf.data(), p.width / 2, p.width / 2, p.height / 2};
+    }
+  }
+  if (!scales) return 1;
+  // weights of the scales taken are normalized
+  double weights = 0;
+  for (uint32_t i = 0; i < scales; i++) weights += kScaleWeights[i];
+  double score = 1;
+  for (uint32_t i = 0; i < scales; i++) {
+    const double v = i + 1 == scales ? ssims[i] : cs[i];
+    score *= std::pow(std::max(v, 0.0), kScaleWeights[i] / weights);
+  }
+  return score;
+}
+
+QualityMeter::Plane QualityMeter::luma(const SurfaceView &s,
+                                       std::vector<uint8_t> *buf) {
+  if (s.format == IXR_COLOR_NV12) {
+    return Plane{s.y, s.pitch, s.width, s.height};
+  }
+  buf->resize(size_t(s.width) * s.height);
+  parallel(s.height, [&](uint32_t, uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; y++) {
+      const uint8_t *p = s.y + size_t(y) * s.pitch;
+      uint8_t *out = buf->data() + size_t(y) * s.width;
+      // BT.601 limited range from BGRA
+      for (uint32_t x = 0; x < s.width; x++, p += 4) {
+        out[x] = static_cast<uint8_t>(
+            ((25 * p[0] + 129 * p[1] + 66 * p[2] + 128) >> 8) + 16);
+      }
+    }
+  });
+  return Plane{buf->data(), s.width, s.width, s.height};
+}
+
+void QualityMeter::parallel(
+    uint32_t n,
+    const std::function<void(uint32_t, uint32_t, uint32_t)> &fn) {
+  const uint32_t bands =
+      std::max(std::min(threads_, n / kMinBandRows), 1u);
+  // metrics aren't on the path of a frame, interactive tasks come first
+  TaskGroup group(IXR_TASK_BATCH);
+  for (uint32_t i = 1; i < bands; i++) {
+    group.Run([&fn, i, n, bands]() {
+      fn(i, uint32_t(uint64_t(n) * i / bands),
+         uint32_t(uint64_t(n) * (i + 1) / bands));
+    });
+  }
+  fn(0, 0, n / bands);
+  group.Wait();
+}
+
+QualityLoopback::QualityLoopback(const CodecConfig &config, uint32_t metrics,
+                                 DecoderFactory factory)
+    : config_(config),
+      decoded_(),
+      metrics_(metrics),
+      factory_(std::move(factory)),
+      frameSize_(CaptureFrameSize(config)) {
+  if (!factory_) {
+    factory_ = [](CodecConfig &c, void *nalu, uint32_t size) {
+      auto codec = Decoder::Create(c.adapter);
+      if (codec) codec->Allocate(c, nalu, size);
+      return codec;
+    };
+  }
+}
+
+QualityLoopback::~QualityLoopback() {}
+
+void QualityLoopback::PushSource(const void *frame) {
+  std::vector<uint8_t> buf;
+  if (!spare_.empty()) {
+    buf.swap(spare_.back());
+    spare_.pop_back();
+  }
+  auto p = static_cast<const uint8_t *>(frame);
+  buf.assign(p, p + frameSize_);
+  sources_.push_back(std::move(buf));
+}
+
+int QualityLoopback::PushBitstream(const void *data, uint32_t size) {
+  auto nalu = const_cast<void *>(data);
+  if (!decoder_) {
+    decoded_ = CodecConfig();
+    decoded_.codec = config_.codec;
+    decoded_.adapter = config_.adapter;
+    decoded_.outputFormat = config_.inputFormat;
+    decoded_.memoryType = IXR_MEM_INTERNAL_CPU;
+    decoded_.asyncDepth = config_.asyncDepth;
+    try {
+      decoder_ = factory_(decoded_, nalu, size);
+    } catch (...) {
+      decoder_.reset();
+    }
+    if (!decoder_) return -1;
+  }
+  if (decoder_->QueueInputBuffer(nalu, size) != 0) return -1;
+  return poll();
+}
+
+int QualityLoopback::Flush() {
+  if (!decoder_) return 0;
+  decoder_->QueueInputBuffer(nullptr, 0, kPtsUnknown);
+  return poll();
+}
+
+int QualityLoopback::poll() {
+  int scored = 0;
+  void *ptr = nullptr;
+  while (decoder_->DequeueOutputBuffer(&ptr) == 0) {
+    if (!sources_.empty()) {
+      // decoded surfaces are packed in the aligned size of the decoder
+      SurfaceView dist = PackedSurface(
+          ptr, static_cast<uint32_t>(decoded_.width),
+          static_cast<uint32_t>(decoded_.height), config_.inputFormat);
+      dist.width = static_cast<uint32_t>(config_.width);
+      dist.height = static_cast<uint32_t>(config_.height);
+      const SurfaceView ref = PackedSurface(
+          sources_.front().data(), dist.width, dist.height,
+          config_.inputFormat);
+      QualityScore score;
+      if (meter_.Compare(ref, dist, metrics_, &score) == 0) {
+        scores_.push_back(score);
+        scored++;
+      }
+      spare_.push_back(std::move(sources_.front()));
+      sources_.pop_front();
+    }
+    decoder_->ReleaseOutputBuffer(ptr);
+  }
+  return scored;
+}
+
+QualityScore QualityLoopback::Mean() const {
+  QualityScore mean{};
+  if (scores_.empty()) return mean;
+  for (auto &s : scores_) {
+    for (int i = 0; i < 3; i++) mean.psnr[i] += s.psnr[i];
+    mean.psnrAll += s.psnrAll;
+    mean.ssim += s.ssim;
+    mean.msssim += s.msssim;
+  }
+  const double n = static_cast<double>(scores_.size());
+  for (int i = 0; i < 3; i++) mean.psnr[i] /= n;
+  mean.psnrAll /= n;
+  mean.ssim /= n;
+  mean.msssim /= n;
+  return mean;
+}
+}  // namespace ixr
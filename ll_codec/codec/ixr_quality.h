@@ -0,0 +1,161 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Objective quality of decoded surfaces, PSNR/SSIM/MS-SSIM
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_QUALITY_H_
+#define LL_CODEC_CODEC_IXR_QUALITY_H_
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+
+namespace ixr {
+/**
+ * @brief A surface in CPU memory, in the manner of mfxFrameData: planes
+ * share one pitch.
+ */
+struct SurfaceView {
+  ColorFourcc format;
+  uint32_t width;     //!< in pixels, even for NV12
+  uint32_t height;    //!< in pixels, even for NV12
+  uint32_t pitch;     //!< bytes of a row
+  const uint8_t *y;   //!< luma of NV12/P010, or pixels of ARGB/Y410
+  const uint8_t *uv;  //!< interleaved chroma of NV12/P010
+};
+
+//! View of a packed frame, i.e. the input buffer of an encoder
+SurfaceView PackedSurface(const void *frame, uint32_t width, uint32_t height,
+                          ColorFourcc format);
+
+enum QualityMetric {
+  IXR_QUALITY_PSNR = 1,
+  IXR_QUALITY_SSIM = 2,
+  IXR_QUALITY_MSSSIM = 4,
+};
+
+//! PSNR of identical planes
+constexpr double kPsnrMax = 100.0;
+
+struct QualityScore {
+  double psnr[3];     //!< dB of Y, U, V of NV12, or of R, G, B of ARGB
+  double psnrAll;     //!< dB of all samples above
+  double ssim;        //!< of luma, ARGB is converted with BT.601
+  double msssim;      //!< of luma, 5 scales
+};
+
+/**
+ * @brief Compare a distorted surface with its reference.
+ *
+ * PSNR is of the mean squared error of a plane. SSIM is averaged over 8x8
+ * windows at a step of 4 pixels, from sums of 4x4 blocks. MS-SSIM takes 5
+ * dyadic scales with the weights of Wang et al., fewer if the surface is
+ * too small. Kernels use SSE2 if the target has it, and rows are split
+ * among threads.
+ */
+class QualityMeter {
+ public:
+  //! @param threads 0 for the number of cores
+  explicit QualityMeter(uint32_t threads = 0);
+
+  /**
+   * @brief Score a surface
+   *
+   * @param ref the reference, i.e. the source of the encoder
+   * @param dist the distorted surface of the same format and size
+   * @param metrics QualityMetric flags, others are left 0
+   * @param [out] score the score
+   * @return 0 if succeed, -1 if surfaces don't match or are of 10-bit
+   *         formats, which aren't supported yet
+   */
+  int Compare(const SurfaceView &ref, const SurfaceView &dist,
+              uint32_t metrics, QualityScore *score);
+
+ private:
+  struct Plane {
+    const uint8_t *data;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  void psnr(const SurfaceView &ref, const SurfaceView &dist,
+            QualityScore *score);
+  //! @return mean SSIM, and the mean of its contrast-structure term in cs
+  double ssim(const Plane &a, const Plane &b, double *cs);
+  double msssim(Plane a, Plane b);
+  Plane luma(const SurfaceView &s, std::vector<uint8_t> *buf);
+  //! Run fn(band, begin, end) over bands of [0, n) in parallel
+  void parallel(uint32_t n, const std::function<void(uint32_t, uint32_t,
+                                                     uint32_t)> &fn);
+
+  uint32_t threads_;
+  std::vector<uint8_t> luma_[2];
+  std::vector<uint8_t> scale_[2][2];  //!< downscaled planes of MS-SSIM
+};
+
+/**
+ * @brief Decode the bitstream of an encoder in the process, and score each
+ * decoded frame against its source.
+ *
+ * Sources are in encode order, which is also the decode order as the
+ * encoders don't use B frames. The decoder is created from the first
+ * bitstream, which must be an IDR with parameter sets.
+ */
+class QualityLoopback {
+ public:
+  //! Create and allocate a decoder, @see BackendInfo
+  using DecoderFactory = std::function<std::unique_ptr<Decoder>(
+      CodecConfig &, void *, uint32_t)>;
+
+  /**
+   * @param config configurations of the encoder, inputs must be in CPU
+   *        memory.
+   * @param metrics QualityMetric flags
+   * @param factory creates the decoder, Decoder::Create if null
+   */
+  QualityLoopback(const CodecConfig &config, uint32_t metrics,
+                  DecoderFactory factory = nullptr);
+
+  ~QualityLoopback();
+
+  //! Copy the source of the next encoded frame
+  void PushSource(const void *frame);
+
+  /**
+   * @brief Decode the bitstream of a frame and score the decoded frames.
+   *
+   * @return number of frames scored, -1 if it can't be decoded
+   */
+  int PushBitstream(const void *data, uint32_t size);
+
+  //! Decode and score the frames left in the decoder
+  int Flush();
+
+  //! Scores of frames in order
+  const std::vector<QualityScore> &Scores() const { return scores_; }
+
+  //! Mean of the scores, PSNR is averaged in dB
+  QualityScore Mean() const;
+
+ private:
+  int poll();
+
+  CodecConfig config_;
+  CodecConfig decoded_;  //!< written back by the decoder
+  uint32_t metrics_;
+  DecoderFactory factory_;
+  std::unique_ptr<Decoder> decoder_;
+  QualityMeter meter_;
+  uint32_t frameSize_;
+  std::deque<std::vector<uint8_t>> sources_;
+  std::vector<std::vector<uint8_t>> spare_;  //!< recycled source buffers
+  std::vector<QualityScore> scores_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_QUALITY_H_
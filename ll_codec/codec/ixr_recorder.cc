@@ -0,0 +1,428 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Record bitstreams of many sessions by asynchronous writes
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_recorder.h"
+#include <algorithm>
+#include <cstring>
+#ifdef IXR_CODEC_HAVE_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+#endif
+
+namespace ixr {
+#ifdef IXR_CODEC_HAVE_IO_URING
+/**
+ * @brief A ring of io_uring by system calls, writes are queued by one thread
+ * at a time and identified by their blocks.
+ */
+class BitstreamRecorder::Ring {
+ public:
+  ~Ring() {
+    if (sqes_) munmap(sqes_, sqesSize_);
+    if (cq_ && cq_ != sq_) munmap(cq_, cqSize_);
+    if (sq_) munmap(sq_, sqSize_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool Init(uint32_t entries) {
+    io_uring_params p{};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) return false;
+    sqSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    sq_ = Map(sqSize_, IORING_OFF_SQ_RING);
+    cq_ = single ? sq_ : Map(cqSize_, IORING_OFF_CQ_RING);
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(Map(sqesSize_, IORING_OFF_SQES));
+    if (!sq_ || !cq_ || !sqes_) return false;
+    auto at = [](void *ring, uint32_t offset) {
+      return reinterpret_cast<unsigned *>(static_cast<uint8_t *>(ring) +
+                                          offset);
+    };
+    sqTail_ = at(sq_, p.sq_off.tail);
+    sqMask_ = at(sq_, p.sq_off.ring_mask);
+    sqArray_ = at(sq_, p.sq_off.array);
+    cqHead_ = at(cq_, p.cq_off.head);
+    cqTail_ = at(cq_, p.cq_off.tail);
+    cqMask_ = at(cq_, p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(at(cq_, p.cq_off.cqes));
+    return true;
+  }
+
+  //! Register blocks for fixed writes, they're written by WRITEV otherwise
+  void Register(uint8_t *memory, uint32_t blockSize, uint32_t count) {
+    iov_.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+      iov_[i].iov_base = memory + size_t(i) * blockSize;
+      iov_[i].iov_len = blockSize;
+    }
+    registered_ = syscall(__NR_io_uring_register, fd_,
+                          IORING_REGISTER_BUFFERS, iov_.data(), count) == 0;
+  }
+
+  //! Queue a write, the ring has an entry for each block
+  void Write(int fd, uint32_t block, uint32_t length, uint64_t offset) {
+    const unsigned tail = *sqTail_;
+    const unsigned index = tail & *sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof *sqe);
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->user_data = block;
+    if (registered_) {
+      sqe->opcode = IORING_OP_WRITE_FIXED;
+      sqe->addr = reinterpret_cast<uint64_t>(iov_[block].iov_base);
+      sqe->len = length;
+      sqe->buf_index = static_cast<uint16_t>(block);
+    } else {
+      // iov_ of the block lives till the write completes
+      iov_[block].iov_len = length;
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->addr = reinterpret_cast<uint64_t>(&iov_[block]);
+      sqe->len = 1;
+    }
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  //! Take back the last n writes, which io_uring_enter didn't consume
+  void Unqueue(uint32_t n) {
+    __atomic_store_n(sqTail_, *sqTail_ - n, __ATOMIC_RELEASE);
+  }
+
+  //! @return number of writes submitted, -1 on error
+  int Enter(uint32_t submit, uint32_t wait) {
+    for (;;) {
+      const long ret =
+          syscall(__NR_io_uring_enter, fd_, submit, wait,
+                  wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (ret >= 0 || errno != EINTR) return static_cast<int>(ret);
+    }
+  }
+
+  //! Call fn(block, result) of each completion
+  template <typename Fn>
+  void Reap(Fn fn) {
+    unsigned head = *cqHead_;
+    const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+      fn(static_cast<uint32_t>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  void *Map(size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  int fd_ = -1;
+  void *sq_ = nullptr;
+  void *cq_ = nullptr;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqSize_ = 0;
+  size_t cqSize_ = 0;
+  size_t sqesSize_ = 0;
+  unsigned *sqTail_ = nullptr;
+  unsigned *sqMask_ = nullptr;
+  unsigned *sqArray_ = nullptr;
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned *cqMask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+  std::vector<iovec> iov_;
+  bool registered_ = false;
+};
+#else
+class BitstreamRecorder::Ring {};
+#endif
+
+BitstreamRecorder::BitstreamRecorder(uint32_t blockSize, uint32_t numBlocks,
+                                     uint32_t batch)
+    : blockSize_((std::max(blockSize, 1u) + kAlignment - 1) / kAlignment *
+                 kAlignment),
+      numBlocks_(std::max(numBlocks, 2u)),
+      batch_(std::max(batch, 1u)),
+      memory_(nullptr),
+      submitted_(0),
+      reaping_(false),
+      open_(0),
+      stats_() {
+  storage_.resize(size_t(blockSize_) * numBlocks_ + kAlignment);
+  const uintptr_t p = reinterpret_cast<uintptr_t>(storage_.data());
+  memory_ = storage_.data() + (kAlignment - p % kAlignment) % kAlignment;
+  for (uint32_t i = numBlocks_; i > 0; i--) {
+    free_.push_back(static_cast<int32_t>(i - 1));
+  }
+  owner_.assign(numBlocks_, nullptr);
+  length_.assign(numBlocks_, 0);
+  keep_.assign(numBlocks_, false);
+#ifdef IXR_CODEC_HAVE_IO_URING
+  ring_.reset(new Ring);
+  if (ring_->Init(numBlocks_)) {
+    ring_->Register(memory_, blockSize_, numBlocks_);
+  } else {
+    ring_.reset();
+  }
+#endif
+}
+
+BitstreamRecorder::~BitstreamRecorder() {
+  for (size_t i = 0; i < streams_.size(); i++) Close(static_cast<int>(i));
+}
+
+int BitstreamRecorder::Open(const char *path) {
+  if (!path) return -1;
+  std::unique_ptr<Stream> s(new Stream);
+  s->fd = -1;
+  s->file = nullptr;
+  s->direct = false;
+  s->closed = false;
+  s->failed = false;
+  s->block = -1;
+  s->fill = 0;
+  s->offset = 0;
+  s->size = 0;
+  s->inflight = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (open_ + 1 >= numBlocks_) return -1;
+#ifdef IXR_CODEC_HAVE_IO_URING
+  if (ring_) {
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    s->fd = open(path, flags | O_DIRECT, 0644);
+    s->direct = s->fd >= 0;
+    // i.e. tmpfs doesn't support O_DIRECT
+    if (s->fd < 0) s->fd = open(path, flags, 0644);
+    if (s->fd < 0) return -1;
+  }
+#endif
+  if (!ring_) {
+    s->file = std::fopen(path, "wb");
+    if (!s->file) return -1;
+  }
+  streams_.push_back(std::move(s));
+  open_++;
+  return static_cast<int>(streams_.size() - 1);
+}
+
+int BitstreamRecorder::Write(int stream, const IoVec *iov, uint32_t count) {
+  Stream *s = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream < 0 || size_t(stream) >= streams_.size()) return -1;
+    s = streams_[stream].get();
+  }
+  std::lock_guard<std::mutex> guard(s->mutex);
+  if (s->closed || s->failed) return -1;
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    auto src = static_cast<const uint8_t *>(iov[i].base);
+    size_t left = iov[i].size;
+    while (left) {
+      if (s->block < 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        s->block = acquire(&lock);
+      }
+      const uint32_t n =
+          static_cast<uint32_t>(std::min<size_t>(left, blockSize_ - s->fill));
+      std::memcpy(memory_ + size_t(s->block) * blockSize_ + s->fill, src, n);
+      s->fill += n;
+      s->size += n;
+      src += n;
+      left -= n;
+      bytes += n;
+      if (s->fill == blockSize_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        submit(s, blockSize_, false);
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.bytes += bytes;
+  return s->failed ? -1 : 0;
+}
+
+int BitstreamRecorder::Flush() {
+  std::vector<Stream *> streams;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &s : streams_) streams.push_back(s.get());
+  }
+  bool failed = false;
+  for (auto s : streams) {
+    std::lock_guard<std::mutex> guard(s->mutex);
+    if (s->closed) continue;
+    drain(s);
+    failed |= s->failed;
+  }
+  return failed ? -1 : 0;
+}
+
+int BitstreamRecorder::Close(int stream) {
+  Stream *s = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream < 0 || size_t(stream) >= streams_.size()) return -1;
+    s = streams_[stream].get();
+  }
+  std::lock_guard<std::mutex> guard(s->mutex);
+  if (s->closed) return -1;
+  drain(s);
+#ifdef IXR_CODEC_HAVE_IO_URING
+  if (s->fd >= 0) {
+    // cut the padding of the last aligned write
+    if (s->direct && ftruncate(s->fd, static_cast<off_t>(s->size)) != 0) {
+      s->failed = true;
+    }
+    if (close(s->fd) != 0) s->failed = true;
+  }
+#endif
+  if (s->file && std::fclose(s->file) != 0) s->failed = true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (s->block >= 0) free_.push_back(s->block);
+  s->block = -1;
+  s->closed = true;
+  open_--;
+  completed_.notify_all();
+  return s->failed ? -1 : 0;
+}
+
+BitstreamRecorder::Stats BitstreamRecorder::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+int32_t BitstreamRecorder::acquire(std::unique_lock<std::mutex> *lock) {
+  if (free_.empty()) complete(lock, false);
+  while (free_.empty()) {
+    // a block of the stream or another one is in flight, as streams are
+    // fewer than blocks
+    stats_.stalls++;
+    complete(lock, true);
+  }
+  const int32_t block = free_.back();
+  free_.pop_back();
+  return block;
+}
+
+void BitstreamRecorder::submit(Stream *s, uint32_t length, bool keep) {
+  const int32_t b = s->block;
+  owner_[b] = s;
+  length_[b] = length;
+  keep_[b] = keep;
+  stats_.writes++;
+  const uint8_t *data = memory_ + size_t(b) * blockSize_;
+#ifdef IXR_CODEC_HAVE_IO_URING
+  if (ring_) {
+    s->inflight++;
+    ring_->Write(s->fd, static_cast<uint32_t>(b), length, s->offset);
+    queue_.push_back(b);
+    if (queue_.size() >= batch_) flushQueue();
+  }
+#endif
+  if (!ring_) {
+    if (std::fwrite(data, 1, length, s->file) != length) s->failed = true;
+    if (!keep) free_.push_back(b);
+  }
+  if (!keep) {
+    s->block = -1;
+    s->fill = 0;
+    s->offset += length;
+  }
+}
+
+void BitstreamRecorder::drain(Stream *s) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (s->block >= 0 && s->fill) {
+    uint32_t length = s->fill;
+    if (s->direct) {
+      // an aligned write of the block, which is rewritten as it fills
+      length = (s->fill + kAlignment - 1) / kAlignment * kAlignment;
+      std::memset(memory_ + size_t(s->block) * blockSize_ + s->fill, 0,
+                  length - s->fill);
+    }
+    submit(s, length, s->direct);
+  }
+  flushQueue();
+  while (s->inflight) complete(&lock, true);
+  if (s->file && std::fflush(s->file) != 0) s->failed = true;
+}
+
+void BitstreamRecorder::flushQueue() {
+#ifdef IXR_CODEC_HAVE_IO_URING
+  if (!ring_ || queue_.empty()) return;
+  const int ret = ring_->Enter(static_cast<uint32_t>(queue_.size()), 0);
+  stats_.submits++;
+  // the rest is submitted with the next batch
+  if (ret > 0) {
+    const size_t n = std::min<size_t>(queue_.size(), ret);
+    queue_.erase(queue_.begin(), queue_.begin() + n);
+    submitted_ += static_cast<uint32_t>(n);
+  }
+#endif
+}
+
+void BitstreamRecorder::complete(std::unique_lock<std::mutex> *lock,
+                                 bool wait) {
+#ifdef IXR_CODEC_HAVE_IO_URING
+  if (!ring_) return;
+  if (wait) {
+    flushQueue();
+    if (!submitted_) {
+      // the submit failed, and no completion would come to wait for
+      ring_->Unqueue(static_cast<uint32_t>(queue_.size()));
+      for (int32_t b : queue_) finish(static_cast<uint32_t>(b), false);
+      queue_.clear();
+      completed_.notify_all();
+      return;
+    }
+    if (reaping_) {
+      completed_.wait(*lock);
+      return;
+    }
+    // wait without the lock, so that other streams keep queueing
+    reaping_ = true;
+    lock->unlock();
+    ring_->Enter(0, 1);
+    lock->lock();
+    reaping_ = false;
+  }
+  ring_->Reap([this](uint32_t block, int32_t result) {
+    submitted_--;
+    finish(block, result >= 0 && uint32_t(result) == length_[block]);
+  });
+  completed_.notify_all();
+#else
+  (void)lock;
+  (void)wait;
+#endif
+}
+
+void BitstreamRecorder::finish(uint32_t block, bool ok) {
+  Stream *s = owner_[block];
+  if (!ok) s->failed = true;
+  s->inflight--;
+  owner_[block] = nullptr;
+  if (!keep_[block]) free_.push_back(static_cast<int32_t>(block));
+}
+}  // namespace ixr
@@ -0,0 +1,151 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Record bitstreams of many sessions by asynchronous writes
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_RECORDER_H_
+#define LL_CODEC_CODEC_IXR_RECORDER_H_
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+/**
+ * @brief Record encoded frames of many sessions into files.
+ *
+ * Frames are appended to blocks of a pool shared by all streams. A full
+ * block is written by io_uring from registered memory, with O_DIRECT if the
+ * file system supports it, and the writes of all streams are submitted in
+ * batches by one system call. A block returns to the pool when its write
+ * completes, Write waits while the pool is empty, so the memory and the
+ * writes in flight are bounded.
+ *
+ * Without io_uring, i.e. on other systems or if the kernel refuses it,
+ * blocks are written by fwrite as they fill. All methods are thread-safe,
+ * frames of a stream must be written in order.
+ */
+class BitstreamRecorder {
+ public:
+  //! Alignment of O_DIRECT writes, in bytes
+  static constexpr uint32_t kAlignment = 4096;
+
+  struct Stats {
+    uint64_t bytes;    //!< bytes of frames
+    uint64_t writes;   //!< blocks written
+    uint64_t submits;  //!< system calls to submit writes
+    uint64_t stalls;   //!< waits for a free block
+  };
+
+  /**
+   * @param blockSize bytes of a block, rounded up to kAlignment
+   * @param numBlocks blocks of the pool, at least 2
+   * @param batch writes queued before they are submitted
+   */
+  explicit BitstreamRecorder(uint32_t blockSize = 1 << 20,
+                             uint32_t numBlocks = 64, uint32_t batch = 8);
+
+  //! Close all streams
+  ~BitstreamRecorder();
+
+  /**
+   * @brief Create a file for a stream. At most numBlocks - 1 streams are
+   * open at a time, as each one fills a block.
+   *
+   * @return id of the stream, -1 if the file can't be created
+   */
+  int Open(const char *path);
+
+  /**
+   * @brief Append the segments of a frame to a stream, i.e. an
+   * OutputDescriptor. Segments are copied into the pool, so the output of
+   * an encoder can be released on return.
+   *
+   * @return 0 if succeed, -1 if the stream is closed or a write failed
+   */
+  int Write(int stream, const IoVec *iov, uint32_t count);
+
+  int Write(int stream, const void *data, uint32_t size) {
+    const IoVec iov{data, size};
+    return Write(stream, &iov, 1);
+  }
+
+  /**
+   * @brief Write the frames buffered by all streams, and wait for all
+   * writes to complete.
+   *
+   * @return 0 if succeed, -1 if a write failed
+   */
+  int Flush();
+
+  /**
+   * @brief Write the rest of a stream and close its file
+   *
+   * @return 0 if succeed, -1 if a write of the stream failed
+   */
+  int Close(int stream);
+
+  //! true if blocks are written by io_uring
+  bool Async() const { return ring_ != nullptr; }
+
+  Stats GetStats() const;
+
+ private:
+  class Ring;
+  struct Stream {
+    std::mutex mutex;
+    int fd;              //!< of io_uring
+    std::FILE *file;     //!< without io_uring
+    bool direct;         //!< opened with O_DIRECT
+    bool closed;
+    std::atomic<bool> failed;
+    int32_t block;       //!< the block being filled, -1 if none
+    uint32_t fill;       //!< bytes in the block
+    uint64_t offset;     //!< of the block in the file
+    uint64_t size;       //!< bytes of the file
+    uint32_t inflight;   //!< writes not completed
+  };
+
+  //! @return a free block, waits for completions if there's none
+  int32_t acquire(std::unique_lock<std::mutex> *lock);
+  //! Queue the write of the block of a stream, the mutex_ is held
+  void submit(Stream *s, uint32_t length, bool keep);
+  //! Write the filled part of the block of a stream and wait for it
+  void drain(Stream *s);
+  //! Submit the queued writes, the mutex_ is held
+  void flushQueue();
+  //! Reap completions, wait for one at least if wait is set, the mutex_ is
+  //! held
+  void complete(std::unique_lock<std::mutex> *lock, bool wait);
+  //! Release a block whose write completed or failed, the mutex_ is held
+  void finish(uint32_t block, bool ok);
+
+  uint32_t blockSize_;
+  uint32_t numBlocks_;
+  uint32_t batch_;
+  std::vector<uint8_t> storage_;
+  uint8_t *memory_;  //!< of all blocks, aligned
+  std::vector<int32_t> free_;
+  std::vector<Stream *> owner_;    //!< stream of a block in flight
+  std::vector<uint32_t> length_;   //!< bytes of a write in flight
+  std::vector<bool> keep_;         //!< the block is still being filled
+  std::unique_ptr<Ring> ring_;
+  std::vector<int32_t> queue_;  //!< blocks of writes not submitted
+  uint32_t submitted_;          //!< writes submitted and not reaped
+  bool reaping_;                //!< a thread waits in the ring
+  //! streams are kept till the end, so that a closed id stays invalid
+  std::vector<std::unique_ptr<Stream>> streams_;
+  uint32_t open_;
+  Stats stats_;
+  mutable std::mutex mutex_;
+  std::condition_variable completed_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_RECORDER_H_
@@ -0,0 +1,139 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Long-term reference bookkeeping for loss recovery
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_REFERENCE_H_
+#define LL_CODEC_CODEC_IXR_REFERENCE_H_
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace ixr {
+//! Maximum long-term reference slots
+constexpr uint32_t kMaxLongTermRefs = 4;
+
+//! Reference decision of a frame, resolved by LongTermReferences
+struct ReferenceControl {
+  uint32_t frame;        //!< the frame this control applies to
+  int32_t mark;          //!< slot the frame is marked to, -1 if not marked
+  int64_t replaced;      //!< frame replaced in the marked slot, -1 if none
+  uint32_t use;          //!< bitmap of slots to reference, 0 for default
+  bool idr;              //!< no valid reference left, encode as IDR
+  uint32_t rejectFirst;  //!< first invalid frame
+  uint32_t rejectLast;   //!< last invalid frame, none if less than first
+};
+
+/**
+ * @brief Track which frame is held in each long-term reference slot, and
+ * resolve mark/invalidate requests into a ReferenceControl of the next
+ * queued frame.
+ *
+ * Frames are numbered by the order of queueing from 0. Not thread-safe,
+ * the owner serializes requests with queueing.
+ */
+class LongTermReferences {
+ public:
+  LongTermReferences() { Allocate(0); }
+
+  void Allocate(uint32_t slots) {
+    slots_.assign(std::min(slots, kMaxLongTermRefs), -1);
+    next_ = 0;
+    mark_ = false;
+    invalidate_ = false;
+    first_ = last_ = 0;
+  }
+
+  uint32_t Slots() const { return static_cast<uint32_t>(slots_.size()); }
+
+  /** @return the frame in slot, -1 if empty */
+  int64_t Frame(uint32_t slot) const { return slots_[slot]; }
+
+  /** Mark the next queued frame */
+  bool Mark() {
+    if (slots_.empty()) return false;
+    mark_ = true;
+    return true;
+  }
+
+  /** Invalidate frames from first to last, merged with pending ones */
+  bool Invalidate(uint32_t first, uint32_t last) {
+    if (first > last) return false;
+    first_ = invalidate_ ? std::min(first_, first) : first;
+    last_ = invalidate_ ? std::max(last_, last) : last;
+    invalidate_ = true;
+    return true;
+  }
+
+  /**
+   * @brief Resolve pending requests for frame, without changing the state.
+   * @return false if nothing is requested
+   */
+  bool Resolve(uint32_t frame, ReferenceControl *ctrl) const {
+    if (!mark_ && !invalidate_) return false;
+    *ctrl = ReferenceControl{frame, -1, -1, 0, false, 1, 0};
+    if (invalidate_ && frame > first_) {
+      ctrl->rejectFirst = first_;
+      ctrl->rejectLast = std::min(last_, frame - 1);
+      for (uint32_t i = 0; i < Slots(); ++i) {
+        if (slots_[i] >= 0 && slots_[i] < first_) ctrl->use |= 1u << i;
+      }
+      ctrl->idr = ctrl->use == 0;
+    }
+    if (mark_) {
+      // prefer a slot which is empty or going to be dropped
+      uint32_t slot = next_;
+      for (uint32_t i = 0; i < Slots(); ++i) {
+        if (ctrl->idr || !valid(*ctrl, slots_[i])) {
+          slot = i;
+          break;
+        }
+      }
+      ctrl->mark = static_cast<int32_t>(slot);
+      if (!ctrl->idr && valid(*ctrl, slots_[slot])) {
+        ctrl->replaced = slots_[slot];
+      }
+    }
+    return true;
+  }
+
+  /** An IDR of frame is encoded, which flushes the frames before it */
+  void Refresh(uint32_t frame) {
+    for (auto &f : slots_) {
+      if (f < frame) f = -1;
+    }
+  }
+
+  /** Apply a control after its frame is queued */
+  void Commit(const ReferenceControl &ctrl) {
+    for (auto &f : slots_) {
+      if (ctrl.idr || !valid(ctrl, f)) f = -1;
+    }
+    if (ctrl.mark >= 0) {
+      slots_[ctrl.mark] = ctrl.frame;
+      next_ = (ctrl.mark + 1) % Slots();
+    }
+    mark_ = false;
+    // an invalidation is kept until a frame comes after it
+    if (ctrl.rejectFirst <= ctrl.rejectLast || ctrl.frame > last_) {
+      invalidate_ = false;
+    }
+  }
+
+ private:
+  static bool valid(const ReferenceControl &ctrl, int64_t frame) {
+    return frame >= 0 && (frame < ctrl.rejectFirst || frame > ctrl.rejectLast);
+  }
+
+  std::vector<int64_t> slots_;
+  uint32_t next_;
+  bool mark_;
+  bool invalidate_;
+  uint32_t first_;
+  uint32_t last_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_REFERENCE_H_
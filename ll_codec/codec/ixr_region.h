@@ -0,0 +1,79 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Region of interest helpers for IXR encoders
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_REGION_H_
+#define LL_CODEC_CODEC_IXR_REGION_H_
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+//! Maximum regions of interest of a frame
+constexpr uint32_t kMaxRegions = 256;
+
+/**
+ * @brief Make concentric regions around the gaze point, the inner region
+ * comes first. Region i spans (i + 1) / (count + 1) of the frame in each
+ * dimension, clipped by the frame border.
+ *
+ * @param width frame width
+ * @param height frame height
+ * @param x horizontal gaze point
+ * @param y vertical gaze point
+ * @param deltaQP QP offset of each region, from inner to outer
+ * @param count number of regions
+ * @param regions [out] at least count regions
+ */
+inline void MakeFoveatedRegions(uint32_t width, uint32_t height, uint32_t x,
+                                uint32_t y, const int32_t *deltaQP,
+                                uint32_t count, RegionOfInterest *regions) {
+  x = std::min(x, width);
+  y = std::min(y, height);
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t w = width * (i + 1) / (count + 1) / 2;
+    const uint32_t h = height * (i + 1) / (count + 1) / 2;
+    regions[i].left = x > w ? x - w : 0;
+    regions[i].top = y > h ? y - h : 0;
+    regions[i].right = std::min(x + w, width);
+    regions[i].bottom = std::min(y + h, height);
+    regions[i].deltaQP = deltaQP[i];
+  }
+}
+
+/**
+ * @brief Rasterize regions into a QP delta map of blocks. Blocks covered by
+ * no region are 0, the former region wins where regions overlap.
+ *
+ * @param regions regions in pixels
+ * @param count number of regions
+ * @param block size in pixels of a block, i.e. 16 for MB
+ * @param blocksW number of blocks in a row
+ * @param blocksH number of blocks in a column
+ * @param map [out] blocksW * blocksH QP deltas, in raster scan order
+ */
+inline void FillQpDeltaMap(const RegionOfInterest *regions, uint32_t count,
+                           uint32_t block, uint32_t blocksW, uint32_t blocksH,
+                           int8_t *map) {
+  std::memset(map, 0, static_cast<size_t>(blocksW) * blocksH);
+  for (uint32_t i = count; i-- > 0;) {
+    const RegionOfInterest &r = regions[i];
+    const uint32_t x0 = r.left / block;
+    const uint32_t y0 = r.top / block;
+    const uint32_t x1 = std::min((r.right + block - 1) / block, blocksW);
+    const uint32_t y1 = std::min((r.bottom + block - 1) / block, blocksH);
+    if (x0 >= x1) continue;
+    const int8_t qp = static_cast<int8_t>(std::min(std::max(r.deltaQP, -51),
+                                                   51));
+    for (uint32_t y = y0; y < y1; ++y) {
+      std::memset(map + static_cast<size_t>(y) * blocksW + x0, qp, x1 - x0);
+    }
+  }
+}
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_REGION_H_
@@ -0,0 +1,320 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Replay a capture on a codec backend and measure it
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_replay.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace ixr {
+namespace {
+// a frame queued later than this is behind its schedule
+constexpr int64_t kLateNs = 1000000;
+constexpr int32_t kDefaultFps = 30;
+
+int64_t SteadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// nearest-rank percentile of sorted samples in ns, in ms
+double Percentile(const std::vector<int64_t> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1] / 1e6;
+}
+
+template <typename T>
+T Field(const uint8_t *payload, size_t offset) {
+  T v;
+  std::memcpy(&v, payload + offset, sizeof v);
+  return v;
+}
+}  // namespace
+
+Replayer::Replayer(EncoderFactory encoder, DecoderFactory decoder)
+    : encoderFactory_(std::move(encoder)),
+      decoderFactory_(std::move(decoder)),
+      metrics_(0),
+      config_(),
+      head_(0),
+      report_(),
+      start_(0) {
+  if (!encoderFactory_) {
+    encoderFactory_ = [](const CodecConfig &config) {
+      auto codec = Encoder::Create(config.adapter);
+      if (codec) codec->Allocate(config);
+      return codec;
+    };
+  }
+  if (!decoderFactory_) {
+    decoderFactory_ = [](CodecConfig &config, void *nalu, uint32_t size) {
+      auto codec = Decoder::Create(config.adapter);
+      if (codec) codec->Allocate(config, nalu, size);
+      return codec;
+    };
+  }
+}
+
+int Replayer::Run(CaptureReader *reader, ReplayPacing pacing,
+                  ReplayReport *report) {
+  report_ = ReplayReport();
+  latency_.clear();
+  start_ = SteadyNow();
+  bool ok = true, opened = false;
+  uint64_t frames = 0;
+  CaptureChunk chunk;
+  const uint8_t *payload = nullptr;
+  try {
+    while (ok && reader->Next(&chunk, &payload)) {
+      const bool input = chunk.tag == IXR_CAPTURE_FRAME ||
+                         chunk.tag == IXR_CAPTURE_BITSTREAM;
+      bool late = false;
+      if (pacing == IXR_REPLAY_RECORDED) {
+        late = !wait(start_ + chunk.time);
+      } else if (pacing == IXR_REPLAY_REALTIME && input) {
+        const int64_t fps = config_.fps > 0 ? config_.fps : kDefaultFps;
+        late = !wait(start_ + int64_t(frames * 1000000000ull / fps));
+      }
+      if (input) {
+        frames++;
+        report_.late += late;
+      }
+      if (chunk.tag == IXR_CAPTURE_ENCODER) {
+        ok = opened = openEncoder(payload, chunk.size);
+      } else if (chunk.tag == IXR_CAPTURE_DECODER) {
+        ok = opened = openDecoder(payload, chunk.size);
+      } else {
+        replay(chunk, payload, reader->Frame());
+      }
+    }
+    if (ok && decoder_) {
+      // flush the frames held by the decoder
+      decoder_->QueueInputBuffer(nullptr, 0, kPtsUnknown);
+      pollFrames();
+    }
+    if (ok && loopback_) loopback_->Flush();
+  } catch (...) {
+    ok = false;
+  }
+  if (loopback_) {
+    report_.scored = loopback_->Scores().size();
+    report_.quality = loopback_->Mean();
+  }
+  encoder_.reset();
+  decoder_.reset();
+  loopback_.reset();
+  const double seconds = (SteadyNow() - start_) / 1e9;
+  report_.seconds = seconds;
+  report_.fps = seconds > 0 ? report_.outputs / seconds : 0;
+  std::sort(latency_.begin(), latency_.end());
+  report_.latencyP50 = Percentile(latency_, 0.5);
+  report_.latencyP90 = Percentile(latency_, 0.9);
+  report_.latencyP99 = Percentile(latency_, 0.99);
+  report_.latencyMax = latency_.empty() ? 0 : latency_.back() / 1e6;
+  if (report) *report = report_;
+  return ok && opened ? 0 : -1;
+}
+
+bool Replayer::openEncoder(const uint8_t *data, uint32_t size) {
+  CodecConfig config;
+  if (!GetCodecConfig(data, size, &config)) return false;
+  encoder_.reset();
+  decoder_.reset();
+  // frames in GPU memory are replayed from CPU memory
+  if (!CaptureFrameSize(config)) config.memoryType = IXR_MEM_INTERNAL_CPU;
+  buffers_.clear();
+  if (config.memoryType == IXR_MEM_EXTERNAL_CPU) {
+    buffers_.resize(std::max<size_t>(config.sharedMemoryId.size(), 1));
+    config.sharedMemoryId.clear();
+    for (auto &b : buffers_) {
+      b.assign(CaptureFrameSize(config), 0);
+      config.sharedMemoryId.push_back(b.data());
+    }
+  }
+  config_ = config;
+  queued_.clear();
+  head_ = 0;
+  bitstream_.clear();
+  loopback_.reset();
+  if (metrics_) {
+    loopback_.reset(new QualityLoopback(config, metrics_, decoderFactory_));
+  }
+  encoder_ = encoderFactory_(config);
+  return encoder_ != nullptr;
+}
+
+bool Replayer::openDecoder(const uint8_t *data, uint32_t size) {
+  if (size < 4) return false;
+  const uint32_t bytes = Field<uint32_t>(data, 0);
+  if (bytes > size - 4) return false;
+  CodecConfig config;
+  if (!GetCodecConfig(data + 4, bytes, &config)) return false;
+  encoder_.reset();
+  decoder_.reset();
+  loopback_.reset();
+  buffers_.clear();
+  std::vector<uint8_t> header(data + 4 + bytes, data + size);
+  config_ = config;
+  queued_.clear();
+  head_ = 0;
+  decoder_ = decoderFactory_(config, header.data(),
+                             static_cast<uint32_t>(header.size()));
+  return decoder_ != nullptr;
+}
+
+void Replayer::queueFrame(const std::vector<uint8_t> &frame,
+                          int32_t recorded) {
+  const uint32_t size = CaptureFrameSize(config_);
+  void *ptr = nullptr;
+  if (buffers_.empty()) {
+    ptr = encoder_->DequeueInputBuffer();
+  } else {
+    ptr = buffers_[report_.frames % buffers_.size()].data();
+  }
+  // frames without pixels are replayed with what is in the buffer
+  if (ptr && frame.size() == size) std::memcpy(ptr, frame.data(), size);
+  const int64_t t = SteadyNow();
+  const int ret = ptr ? encoder_->QueueInputBuffer(ptr) : -1;
+  report_.frames++;
+  report_.mismatch += ret != recorded;
+  if (ret != 0) return;
+  queued_.push_back(t);
+  if (loopback_) loopback_->PushSource(ptr);
+}
+
+void Replayer::dequeueFrame(int32_t recorded) {
+  void *buf = nullptr;
+  uint32_t size = 0;
+  const int ret = encoder_->DequeueOutputBuffer(&buf, &size);
+  const int64_t t = SteadyNow();
+  report_.mismatch += ret != recorded;
+  if (ret < 0) return;
+  report_.bytes += size;
+  if (loopback_) {
+    auto p = static_cast<const uint8_t *>(buf);
+    bitstream_.insert(bitstream_.end(), p, p + size);
+    if (ret == 0) {
+      loopback_->PushBitstream(bitstream_.data(),
+                               static_cast<uint32_t>(bitstream_.size()));
+      bitstream_.clear();
+    }
+  }
+  encoder_->ReleaseOutputBuffer(buf);
+  // a partial output doesn't complete the frame
+  if (ret != 0 || head_ >= queued_.size()) return;
+  latency_.push_back(t - queued_[head_++]);
+  report_.outputs++;
+  if (head_ == queued_.size()) {
+    queued_.clear();
+    head_ = 0;
+  }
+}
+
+void Replayer::queueBitstream(const uint8_t *data, uint32_t size,
+                              int32_t recorded) {
+  const int64_t pts = static_cast<int64_t>(queued_.size());
+  queued_.push_back(SteadyNow());
+  const int ret =
+      decoder_->QueueInputBuffer(const_cast<uint8_t *>(data), size, pts);
+  report_.frames++;
+  report_.mismatch += ret != recorded;
+  pollFrames();
+}
+
+void Replayer::pollFrames() {
+  void *ptr = nullptr;
+  int64_t pts = kPtsUnknown;
+  while (decoder_->DequeueOutputBuffer(&ptr, &pts) == 0) {
+    const int64_t t = SteadyNow();
+    if (pts >= 0 && pts < static_cast<int64_t>(queued_.size())) {
+      latency_.push_back(t - queued_[pts]);
+    }
+    report_.outputs++;
+    decoder_->ReleaseOutputBuffer(ptr);
+  }
+}
+
+void Replayer::replay(const CaptureChunk &chunk, const uint8_t *payload,
+                      const std::vector<uint8_t> &frame) {
+  const uint32_t size = chunk.size;
+  if (decoder_) {
+    // outputs are polled instead of replayed
+    if (chunk.tag == IXR_CAPTURE_BITSTREAM && size >= 12) {
+      queueBitstream(payload + 12, size - 12, Field<int32_t>(payload, 0));
+    }
+    return;
+  }
+  if (!encoder_) return;
+  auto data = const_cast<uint8_t *>(payload);
+  switch (chunk.tag) {
+    case IXR_CAPTURE_FRAME:
+      if (size >= 12) queueFrame(frame, Field<int32_t>(payload, 0));
+      break;
+    case IXR_CAPTURE_OUTPUT:
+      if (size >= 8) dequeueFrame(Field<int32_t>(payload, 0));
+      break;
+    case IXR_CAPTURE_USER_DATA:
+      encoder_->QueueUserData(data, size);
+      break;
+    case IXR_CAPTURE_SEI:
+      if (size >= 4) {
+        encoder_->QueueSeiPayload(Field<uint32_t>(payload, 0), payload + 4,
+                                  size - 4);
+      }
+      break;
+    case IXR_CAPTURE_TIME_CODE:
+      if (size == sizeof(TimeCode)) {
+        encoder_->QueueTimeCode(Field<TimeCode>(payload, 0));
+      }
+      break;
+    case IXR_CAPTURE_ROI: {
+      std::vector<RegionOfInterest> regions(size / sizeof(RegionOfInterest));
+      if (!regions.empty()) {
+        std::memcpy(regions.data(), payload,
+                    regions.size() * sizeof(RegionOfInterest));
+      }
+      encoder_->QueueRegionOfInterest(regions.data(),
+                                      static_cast<uint32_t>(regions.size()));
+      break;
+    }
+    case IXR_CAPTURE_INTRA_REFRESH:
+      encoder_->RequestIntraRefresh();
+      break;
+    case IXR_CAPTURE_LONG_TERM:
+      encoder_->MarkLongTermReference();
+      break;
+    case IXR_CAPTURE_INVALIDATE:
+      if (size == 8) {
+        encoder_->InvalidateReferences(Field<uint32_t>(payload, 0),
+                                       Field<uint32_t>(payload, 4));
+      }
+      break;
+    case IXR_CAPTURE_FLOW_CONTROL:
+      if (size == 8) {
+        encoder_->SetFlowControlParam(Field<float>(payload, 0),
+                                      Field<uint32_t>(payload, 4));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool Replayer::wait(int64_t due) {
+  const int64_t now = SteadyNow();
+  if (now < due) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+    return true;
+  }
+  return now - due <= kLateNs;
+}
+}  // namespace ixr
@@ -0,0 +1,123 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Replay a capture on a codec backend and measure it
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_REPLAY_H_
+#define LL_CODEC_CODEC_IXR_REPLAY_H_
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ll_codec/codec/ixr_capture.h"
+#include "ll_codec/codec/ixr_quality.h"
+
+namespace ixr {
+enum ReplayPacing {
+  //! Calls are made back to back, to measure the throughput.
+  IXR_REPLAY_MAXIMUM,
+  //! Calls are made at their recorded time, to reproduce the session.
+  IXR_REPLAY_RECORDED,
+  //! Input frames are queued at CodecConfig::fps, other calls follow them.
+  IXR_REPLAY_REALTIME,
+};
+
+struct ReplayReport {
+  uint64_t frames;     //!< frames queued
+  uint64_t outputs;    //!< frames dequeued
+  uint64_t bytes;      //!< bytes of encoded frames
+  uint64_t late;       //!< frames queued behind their schedule
+  uint64_t mismatch;   //!< calls which return differently from the capture
+  double seconds;      //!< time of the replay
+  double fps;          //!< frames dequeued per second
+  double latencyP50;   //!< ms from queueing a frame to dequeueing it
+  double latencyP90;
+  double latencyP99;
+  double latencyMax;
+  uint64_t scored;       //!< frames scored by the loopback
+  QualityScore quality;  //!< mean score of the loopback
+};
+
+/**
+ * @brief Drive a codec by the calls of a capture.
+ *
+ * The session is created by the factories, which can create any backend,
+ * i.e. another vendor or a brokered session, from the recorded
+ * configurations. Inputs in GPU memory are replayed from CPU memory with
+ * blank frames, and external memories are replaced by buffers of the
+ * replayer.
+ *
+ * Encoder calls are replayed in the recorded order, each output is
+ * released at once. Decoders are polled after each queued bitstream and
+ * drained at the end, time stamps are replaced by the frame numbers to
+ * measure the latency.
+ */
+class Replayer {
+ public:
+  //! Create and allocate an encoder, @see BackendInfo
+  using EncoderFactory =
+      std::function<std::unique_ptr<Encoder>(const CodecConfig &)>;
+  //! Create and allocate a decoder, @see BackendInfo
+  using DecoderFactory = std::function<std::unique_ptr<Decoder>(
+      CodecConfig &, void *, uint32_t)>;
+
+  /**
+   * @param encoder creates encoders, Encoder::Create of the recorded
+   *        adapter if null.
+   * @param decoder creates decoders, Decoder::Create of the recorded
+   *        adapter if null.
+   */
+  explicit Replayer(EncoderFactory encoder = nullptr,
+                    DecoderFactory decoder = nullptr);
+
+  /**
+   * @brief Decode the outputs of encoders by the decoder factory, and score
+   * them against the replayed frames, @see QualityLoopback
+   *
+   * @param metrics QualityMetric flags, 0 to disable
+   */
+  void SetLoopback(uint32_t metrics) { metrics_ = metrics; }
+
+  /**
+   * @brief Replay a capture till its end.
+   *
+   * @param reader the capture
+   * @param pacing when calls are made
+   * @param [out] report statistics of the replay
+   * @return 0 if succeed, -1 if the capture is broken or the session
+   * can't be created.
+   */
+  int Run(CaptureReader *reader, ReplayPacing pacing, ReplayReport *report);
+
+ private:
+  bool openEncoder(const uint8_t *data, uint32_t size);
+  bool openDecoder(const uint8_t *data, uint32_t size);
+  void queueFrame(const std::vector<uint8_t> &frame, int32_t recorded);
+  void dequeueFrame(int32_t recorded);
+  void queueBitstream(const uint8_t *data, uint32_t size, int32_t recorded);
+  void pollFrames();
+  void replay(const CaptureChunk &chunk, const uint8_t *payload,
+              const std::vector<uint8_t> &frame);
+  //! @return false if it's already behind the due time
+  bool wait(int64_t due);
+
+  EncoderFactory encoderFactory_;
+  DecoderFactory decoderFactory_;
+  std::unique_ptr<Encoder> encoder_;
+  std::unique_ptr<Decoder> decoder_;
+  std::unique_ptr<QualityLoopback> loopback_;
+  uint32_t metrics_;
+  std::vector<uint8_t> bitstream_;  //!< partial outputs of a frame
+  CodecConfig config_;
+  std::vector<std::vector<uint8_t>> buffers_;  //!< external memories
+  std::vector<int64_t> queued_;  //!< queue time of frames by their number
+  size_t head_;                  //!< the next frame of encoder to dequeue
+  std::vector<int64_t> latency_;
+  ReplayReport report_;
+  int64_t start_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_REPLAY_H_
@@ -0,0 +1,176 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : RTP packetizer of H.264 (RFC 6184) and HEVC (RFC 7798)
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_rtp.h"
+#include <algorithm>
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+// NAL unit types of aggregation and fragmentation units
+constexpr uint8_t kAvcStapA = 24;
+constexpr uint8_t kAvcFuA = 28;
+constexpr uint8_t kHevcAp = 48;
+constexpr uint8_t kHevcFu = 49;
+
+inline void WriteBE16(uint8_t *p, uint32_t v) {
+  p[0] = static_cast<uint8_t>(v >> 8);
+  p[1] = static_cast<uint8_t>(v);
+}
+
+inline void WriteBE32(uint8_t *p, uint32_t v) {
+  WriteBE16(p, v >> 16);
+  WriteBE16(p + 2, v);
+}
+}  // namespace
+
+RtpPacketizer::RtpPacketizer(CodecFourcc codec, const RtpConfig &config)
+    : codec_(codec), config_(config), sequence_(config.sequence) {
+  if (config_.maxPacketSize == 0) config_.maxPacketSize = 1200;
+  // a fragment carries at least a byte
+  config_.maxPacketSize = std::max(config_.maxPacketSize, kRtpMinPacketSize);
+  arena_.reserve(4096);
+  slices_.reserve(256);
+  nals_.reserve(32);
+  group_.reserve(32);
+  iov_.reserve(256);
+  packets_.reserve(128);
+}
+
+uint32_t RtpPacketizer::Packetize(const uint8_t *data, uint32_t size,
+                                  uint32_t timestamp) {
+  arena_.clear();
+  slices_.clear();
+  nals_.clear();
+  iov_.clear();
+  packets_.clear();
+  ForEachNalu(data, size, [this](const uint8_t *nal, uint32_t len) {
+    if (len > headerSize()) nals_.push_back(Slice{nal, 0, len});
+  });
+  const uint32_t payload = config_.maxPacketSize - kRtpHeaderSize;
+  for (size_t i = 0; i < nals_.size();) {
+    if (nals_[i].size > payload) {
+      fragment(nals_[i].data, nals_[i].size, timestamp);
+      ++i;
+      continue;
+    }
+    // aggregate the following NAL units as long as they fit
+    group_.assign(1, nals_[i]);
+    uint32_t used = headerSize() + 2 + nals_[i].size;
+    size_t j = i + 1;
+    for (; j < nals_.size() && used + 2 + nals_[j].size <= payload; ++j) {
+      group_.push_back(nals_[j]);
+      used += 2 + nals_[j].size;
+    }
+    if (group_.size() == 1) {
+      single(nals_[i].data, nals_[i].size, timestamp);
+    } else {
+      aggregate(group_, timestamp);
+    }
+    i = j;
+  }
+  if (!packets_.empty()) arena_[packets_.back().header + 1] |= 0x80;
+  // the arena doesn't move any more
+  for (auto &s : slices_) {
+    iov_.push_back(IoVec{s.data ? s.data : &arena_[s.offset], s.size});
+  }
+  return NumPackets();
+}
+
+uint8_t *RtpPacketizer::beginPacket(uint32_t extra, uint32_t timestamp) {
+  const uint32_t offset = static_cast<uint32_t>(arena_.size());
+  packets_.push_back(
+      Range{static_cast<uint32_t>(slices_.size()), 0, offset});
+  uint8_t *p = pushArena(kRtpHeaderSize + extra);
+  p[0] = 0x80;  // version 2, no padding, extension or CSRC
+  p[1] = config_.payloadType & 0x7F;
+  WriteBE16(p + 2, sequence_++);
+  WriteBE32(p + 4, timestamp);
+  WriteBE32(p + 8, config_.ssrc);
+  return p + kRtpHeaderSize;
+}
+
+uint8_t *RtpPacketizer::pushArena(uint32_t size) {
+  const uint32_t offset = static_cast<uint32_t>(arena_.size());
+  arena_.resize(offset + size);
+  slices_.push_back(Slice{nullptr, offset, size});
+  packets_.back().count++;
+  return &arena_[offset];
+}
+
+void RtpPacketizer::pushData(const uint8_t *data, uint32_t size) {
+  slices_.push_back(Slice{data, 0, size});
+  packets_.back().count++;
+}
+
+void RtpPacketizer::single(const uint8_t *nal, uint32_t size,
+                           uint32_t timestamp) {
+  beginPacket(0, timestamp);
+  pushData(nal, size);
+}
+
+void RtpPacketizer::aggregate(const std::vector<Slice> &nals,
+                              uint32_t timestamp) {
+  uint8_t *p = beginPacket(headerSize() + 2, timestamp);
+  if (codec_ == IXR_CODEC_HEVC) {
+    // F is OR-ed, LayerId and TID are the lowest of all units
+    uint8_t f = 0, layer = 63, tid = 7;
+    for (auto &n : nals) {
+      f |= n.data[0] & 0x80;
+      layer = std::min<uint8_t>(
+          layer, ((n.data[0] & 1) << 5) | (n.data[1] >> 3));
+      tid = std::min<uint8_t>(tid, n.data[1] & 7);
+    }
+    p[0] = f | (kHevcAp << 1) | (layer >> 5);
+    p[1] = static_cast<uint8_t>(((layer & 31) << 3) | tid);
+  } else {
+    // F is OR-ed, NRI is the highest of all units
+    uint8_t f = 0, nri = 0;
+    for (auto &n : nals) {
+      f |= n.data[0] & 0x80;
+      nri = std::max<uint8_t>(nri, n.data[0] & 0x60);
+    }
+    p[0] = f | nri | kAvcStapA;
+  }
+  WriteBE16(p + headerSize(), nals[0].size);
+  pushData(nals[0].data, nals[0].size);
+  for (size_t i = 1; i < nals.size(); ++i) {
+    WriteBE16(pushArena(2), nals[i].size);
+    pushData(nals[i].data, nals[i].size);
+  }
+}
+
+void RtpPacketizer::fragment(const uint8_t *nal, uint32_t size,
+                             uint32_t timestamp) {
+  const bool hevc = codec_ == IXR_CODEC_HEVC;
+  const uint32_t header = headerSize();
+  const uint8_t type = NaluType(codec_, nal[0]);
+  // the NAL header is replaced by payload header and FU header
+  const uint32_t chunk = config_.maxPacketSize - kRtpHeaderSize - header - 1;
+  uint32_t left = size - header;
+  const uint8_t *p = nal + header;
+  // fragments of even size, so the last one isn't tiny
+  const uint32_t n = (left + chunk - 1) / chunk;
+  const uint32_t even = (left + n - 1) / n;
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint32_t len = std::min(even, left);
+    uint8_t *h = beginPacket(header + 1, timestamp);
+    if (hevc) {
+      h[0] = static_cast<uint8_t>((nal[0] & 0x81) | (kHevcFu << 1));
+      h[1] = nal[1];
+    } else {
+      h[0] = static_cast<uint8_t>((nal[0] & 0xE0) | kAvcFuA);
+    }
+    h[header] = static_cast<uint8_t>((i == 0 ? 0x80 : 0) |
+                                     (i + 1 == n ? 0x40 : 0) | type);
+    pushData(p, len);
+    p += len;
+    left -= len;
+  }
+}
+}  // namespace ixr
@@ -0,0 +1,108 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : RTP packetizer of H.264 (RFC 6184) and HEVC (RFC 7798)
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_RTP_H_
+#define LL_CODEC_CODEC_IXR_RTP_H_
+#include <stdint.h>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+//! Size of a RTP header without CSRC and extension
+constexpr uint32_t kRtpHeaderSize = 12;
+//! A RTP header, the payload and FU headers of HEVC, and a byte of data
+constexpr uint32_t kRtpMinPacketSize = kRtpHeaderSize + 4;
+
+struct RtpConfig {
+  uint32_t ssrc;
+  uint8_t payloadType;     //!< dynamic payload type, 96-127
+  uint16_t sequence;       //!< sequence number of the first packet
+  uint32_t maxPacketSize;  //!< RTP header and payload, 1200 if 0, raised
+                           //!< to kRtpMinPacketSize if less
+};
+
+/**
+ * @brief Split Annex-B access units into RTP packets without copying
+ * the payload.
+ *
+ * Each packet is a list of IoVec, the RTP header and payload headers are
+ * in an internal arena, NAL units are referenced in place. So that a frame
+ * can be sent by sendmmsg (or WSASendTo with WSABUF) right after
+ * DequeueOutputBuffer, and the bitstream is released after sending.
+ *
+ * Small NAL units (i.e. parameter sets and SEI) are aggregated into
+ * STAP-A (AVC) or AP (HEVC), large ones are fragmented into FU-A (AVC) or
+ * FU (HEVC), in non-interleaved mode. The marker bit is set on the last
+ * packet of an access unit.
+ */
+class RtpPacketizer {
+ public:
+  RtpPacketizer(CodecFourcc codec, const RtpConfig &config);
+
+  /**
+   * @brief Packetize an access unit. Packets of the last access unit are
+   * invalidated.
+   *
+   * @param data Annex-B bitstream of a frame, must outlive the packets
+   * @param size size of the bitstream
+   * @param timestamp RTP timestamp, 90kHz
+   * @return number of packets
+   */
+  uint32_t Packetize(const uint8_t *data, uint32_t size, uint32_t timestamp);
+
+  uint32_t NumPackets() const {
+    return static_cast<uint32_t>(packets_.size());
+  }
+
+  /**
+   * @brief Get a packet of the last access unit
+   *
+   * @param index packet index
+   * @param count [out] number of IoVec of the packet
+   * @return pointer to the IoVec list
+   */
+  const IoVec *Packet(uint32_t index, uint32_t *count) const {
+    *count = packets_[index].count;
+    return &iov_[packets_[index].first];
+  }
+
+  //! Sequence number of the next packet
+  uint16_t Sequence() const { return sequence_; }
+
+ private:
+  struct Slice {
+    const uint8_t *data;  //!< null if in the arena
+    uint32_t offset;
+    uint32_t size;
+  };
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+    uint32_t header;  //!< offset of RTP header in the arena
+  };
+
+  uint32_t headerSize() const { return codec_ == IXR_CODEC_HEVC ? 2 : 1; }
+  uint8_t *beginPacket(uint32_t extra, uint32_t timestamp);
+  uint8_t *pushArena(uint32_t size);
+  void pushData(const uint8_t *data, uint32_t size);
+  void single(const uint8_t *nal, uint32_t size, uint32_t timestamp);
+  void aggregate(const std::vector<Slice> &nals, uint32_t timestamp);
+  void fragment(const uint8_t *nal, uint32_t size, uint32_t timestamp);
+
+  CodecFourcc codec_;
+  RtpConfig config_;
+  uint16_t sequence_;
+  std::vector<uint8_t> arena_;
+  std::vector<Slice> slices_;
+  std::vector<Slice> nals_;
+  std::vector<Slice> group_;
+  std::vector<IoVec> iov_;
+  std::vector<Range> packets_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_RTP_H_
@@ -0,0 +1,401 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Stitch AVC pictures of horizontal stripes into one picture
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_stitch.h"
+#include <algorithm>
+#include <iterator>
+#include "ll_codec/codec/ixr_bitstream.h"
+#include "ll_codec/codec/ixr_nalu.h"
+
+namespace ixr {
+namespace {
+constexpr uint8_t kStartCode[] = {0, 0, 0, 1};
+enum : uint8_t { kNalIdr = 5, kNalSps = 7, kNalPps = 8 };
+enum : uint32_t { kSliceP, kSliceB, kSliceI, kSliceSP, kSliceSI };
+
+struct Level {
+  uint8_t idc;
+  uint32_t maxFs;    // MBs per frame
+  uint32_t maxMbps;  // MBs per second
+};
+
+// Table A-1 of H.264, level 1b is left out
+constexpr Level kLevels[] = {
+    {10, 99, 1485},         {11, 396, 3000},        {12, 396, 6000},
+    {13, 396, 11880},       {20, 396, 11880},       {21, 792, 19800},
+    {22, 1620, 20250},      {30, 1620, 40500},      {31, 3600, 108000},
+    {32, 5120, 216000},     {40, 8192, 245760},     {41, 8192, 245760},
+    {42, 8704, 522240},     {50, 22080, 589824},    {51, 36864, 983040},
+    {52, 36864, 2073600},   {60, 139264, 4177920},  {61, 139264, 8355840},
+    {62, 139264, 16711680},
+};
+constexpr size_t kNumLevels = sizeof(kLevels) / sizeof(Level);
+
+// SPS fields and the positions of the fields to rewrite
+struct SpsLayout {
+  uint32_t id;
+  uint32_t level;
+  uint32_t chromaFormat;
+  uint32_t separateColourPlane;
+  uint32_t log2MaxFrameNum;
+  uint32_t pocType;
+  uint32_t log2MaxPocLsb;
+  uint32_t deltaPicOrderAlwaysZero;
+  uint32_t widthMbs;
+  uint32_t frameMbsOnly;
+  uint32_t crop[4];  // left, right, top, bottom
+  uint64_t heightPos;
+  uint64_t heightEnd;
+  uint64_t cropPos;
+  uint64_t restPos;
+};
+
+// profiles with chroma_format_idc and scaling matrices in SPS
+bool HighProfile(uint32_t profile) {
+  static const uint32_t kProfiles[] = {100, 110, 122, 244, 44,  83, 86,
+                                       118, 128, 138, 139, 134, 135};
+  return std::find(std::begin(kProfiles), std::end(kProfiles), profile) !=
+         std::end(kProfiles);
+}
+
+void SkipScalingList(BitReader *br, int size) {
+  int32_t last = 8, next = 8;
+  for (int j = 0; j < size; j++) {
+    if (next != 0) next = (last + br->Se() + 256) % 256;
+    last = next == 0 ? last : next;
+  }
+}
+
+bool ReadSps(const uint8_t *rbsp, uint32_t size, SpsLayout *l) {
+  BitReader br(rbsp, size);
+  const uint32_t profile = br.U(8);
+  br.U(8);  // constraint_set flags
+  l->level = br.U(8);
+  l->id = br.Ue();
+  l->chromaFormat = 1;
+  l->separateColourPlane = 0;
+  if (HighProfile(profile)) {
+    l->chromaFormat = br.Ue();
+    if (l->chromaFormat == 3) l->separateColourPlane = br.Bit();
+    br.Ue();  // bit_depth_luma_minus8
+    br.Ue();  // bit_depth_chroma_minus8
+    br.Bit();
+    if (br.Bit()) {
+      const int lists = l->chromaFormat != 3 ? 8 : 12;
+      for (int i = 0; i < lists; i++) {
+        if (br.Bit()) SkipScalingList(&br, i < 6 ? 16 : 64);
+      }
+    }
+  }
+  l->log2MaxFrameNum = br.Ue() + 4;
+  l->pocType = br.Ue();
+  l->log2MaxPocLsb = 0;
+  l->deltaPicOrderAlwaysZero = 0;
+  if (l->pocType == 0) {
+    l->log2MaxPocLsb = br.Ue() + 4;
+  } else if (l->pocType == 1) {
+    l->deltaPicOrderAlwaysZero = br.Bit();
+    br.Se();
+    br.Se();
+    const uint32_t cycle = br.Ue();
+    if (cycle > 255) return false;
+    for (uint32_t i = 0; i < cycle; i++) br.Se();
+  }
+  br.Ue();   // max_num_ref_frames
+  br.Bit();  // gaps_in_frame_num_value_allowed_flag
+  l->widthMbs = br.Ue() + 1;
+  l->heightPos = br.Pos();
+  br.Ue();
+  l->heightEnd = br.Pos();
+  l->frameMbsOnly = br.Bit();
+  if (!l->frameMbsOnly) br.Bit();
+  br.Bit();  // direct_8x8_inference_flag
+  l->cropPos = br.Pos();
+  std::fill(l->crop, l->crop + 4, 0);
+  if (br.Bit()) {
+    for (auto &c : l->crop) c = br.Ue();
+  }
+  l->restPos = br.Pos();
+  return br.Good();
+}
+
+void AppendNalu(const uint8_t *nal, uint32_t size, std::vector<uint8_t> *out) {
+  out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  out->insert(out->end(), nal, nal + size);
+}
+}  // namespace
+
+int SliceStitcher::Reset(uint32_t width, uint32_t height,
+                         const std::vector<uint32_t> &tops, float fps) {
+  width_ = width;
+  height_ = height;
+  fps_ = fps;
+  stripes_.clear();
+  const uint32_t widthMbs = (width + 15) / 16;
+  const uint64_t fs = uint64_t(widthMbs) * ((height + 15) / 16);
+  if (fs > kLevels[kNumLevels - 1].maxFs) return -1;
+  stripes_.assign(tops.size(), Stripe());
+  for (size_t i = 0; i < tops.size(); i++) {
+    stripes_[i].firstMb = tops[i] / 16 * widthMbs;
+  }
+  return 0;
+}
+
+int SliceStitcher::Stitch(const uint8_t *const *units, const uint32_t *sizes,
+                          std::vector<uint8_t> *out) {
+  out->clear();
+  if (stripes_.empty()) return -1;
+  bool ok = true;
+  bool idr = false;
+  for (size_t i = 0; i < stripes_.size() && ok; i++) {
+    Stripe &stripe = stripes_[i];
+    uint32_t slices = 0;
+    ForEachNalu(units[i], sizes[i], [&](const uint8_t *nal, uint32_t size) {
+      if (!ok) return;
+      const uint8_t type = nal[0] & 0x1F;
+      if (type == kNalSps) {
+        ok = parseSps(nal, size, &stripe);
+        // the first stripe holds the parameter sets of the full picture
+        if (ok && i == 0) ok = rewriteSps(nal, size, out);
+      } else if (type == kNalPps) {
+        ok = parsePps(nal, size, &stripe);
+        if (ok && i == 0) AppendNalu(nal, size, out);
+      } else if (IsSliceNalu(IXR_CODEC_AVC, nal[0])) {
+        if (slices == 0 && i == 0) idr = type == kNalIdr;
+        // frame types must be in sync, or references of stripes differ
+        if ((type == kNalIdr) != idr) {
+          ok = false;
+        } else if (i == 0) {
+          AppendNalu(nal, size, out);
+        } else {
+          ok = rewriteSlice(nal, size, stripe, out);
+        }
+        slices++;
+      } else if (i == 0) {
+        // SEI, AUD and others of the first stripe
+        AppendNalu(nal, size, out);
+      }
+    });
+    if (!slices) ok = false;
+  }
+  return ok ? 0 : -1;
+}
+
+bool SliceStitcher::parseSps(const uint8_t *nal, uint32_t size,
+                             Stripe *stripe) {
+  UnescapeRbsp(nal + 1, size - 1, &rbsp_);
+  SpsLayout l;
+  if (!ReadSps(rbsp_.data(), static_cast<uint32_t>(rbsp_.size()), &l)) {
+    return false;
+  }
+  // fields and MBAFF pictures are not stitched
+  if (!l.frameMbsOnly || l.widthMbs != (width_ + 15) / 16) return false;
+  Sps &sps = stripe->sps[l.id];
+  sps.log2MaxFrameNum = l.log2MaxFrameNum;
+  sps.pocType = l.pocType;
+  sps.log2MaxPocLsb = l.log2MaxPocLsb;
+  sps.deltaPicOrderAlwaysZero = l.deltaPicOrderAlwaysZero;
+  sps.frameMbsOnly = l.frameMbsOnly;
+  sps.separateColourPlane = l.separateColourPlane;
+  sps.chromaArrayType = l.separateColourPlane ? 0 : l.chromaFormat;
+  sps.widthMbs = l.widthMbs;
+  return true;
+}
+
+bool SliceStitcher::parsePps(const uint8_t *nal, uint32_t size,
+                             Stripe *stripe) {
+  UnescapeRbsp(nal + 1, size - 1, &rbsp_);
+  BitReader br(rbsp_.data(), static_cast<uint32_t>(rbsp_.size()));
+  const uint32_t id = br.Ue();
+  Pps pps;
+  pps.spsId = br.Ue();
+  pps.cabac = br.Bit();
+  pps.bottomFieldPicOrder = br.Bit();
+  // slice groups are not stitched
+  if (br.Ue() != 0) return false;
+  pps.numRefIdx[0] = br.Ue() + 1;
+  pps.numRefIdx[1] = br.Ue() + 1;
+  pps.weightedPred = br.Bit();
+  pps.weightedBipred = br.U(2);
+  br.Se();  // pic_init_qp_minus26
+  br.Se();  // pic_init_qs_minus26
+  br.Se();  // chroma_qp_index_offset
+  pps.deblockingControl = br.Bit();
+  br.Bit();  // constrained_intra_pred_flag
+  pps.redundantPicCnt = br.Bit();
+  if (!br.Good()) return false;
+  pps.raw.assign(nal, nal + size);
+  // slices of all stripes refer to the PPS of the first stripe
+  if (stripe != &stripes_[0]) {
+    auto first = stripes_[0].pps.find(id);
+    if (first == stripes_[0].pps.end() || first->second.raw != pps.raw) {
+      return false;
+    }
+  }
+  stripe->pps[id] = std::move(pps);
+  return true;
+}
+
+bool SliceStitcher::rewriteSps(const uint8_t *nal, uint32_t size,
+                               std::vector<uint8_t> *out) {
+  UnescapeRbsp(nal + 1, size - 1, &rbsp_);
+  const uint32_t bytes = static_cast<uint32_t>(rbsp_.size());
+  SpsLayout l;
+  if (!ReadSps(rbsp_.data(), bytes, &l)) return false;
+  const uint64_t stop = FindRbspStopBit(rbsp_.data(), bytes);
+  if (stop < l.restPos) return false;
+  const uint32_t rows = (height_ + 15) / 16;
+  // the lowest level of the full picture, the frame size is checked in Reset
+  // and only a frame rate beyond level 6.2 is marked as 6.2
+  const uint64_t fs = uint64_t(l.widthMbs) * rows;
+  const uint64_t mbps = static_cast<uint64_t>(fs * fps_);
+  uint32_t level = kLevels[kNumLevels - 1].idc;
+  for (auto &lv : kLevels) {
+    if (fs <= lv.maxFs && mbps <= lv.maxMbps) {
+      level = lv.idc;
+      break;
+    }
+  }
+  level = std::max(level, l.level);
+  // crop the bottom of the last MB row, in units of chroma rows
+  const uint32_t unitY = l.chromaFormat == 1 && !l.separateColourPlane ? 2 : 1;
+  uint32_t crop[4] = {l.crop[0], l.crop[1], l.crop[2],
+                      (rows * 16 - height_) / unitY};
+  packed_.clear();
+  BitWriter bw(&packed_);
+  bw.Copy(rbsp_.data(), 0, 16);
+  bw.U(level, 8);
+  bw.Copy(rbsp_.data(), 24, l.heightPos);
+  bw.Ue(rows - 1);
+  bw.Copy(rbsp_.data(), l.heightEnd, l.cropPos);
+  const bool cropping = crop[0] || crop[1] || crop[2] || crop[3];
+  bw.Bit(cropping);
+  if (cropping) {
+    for (auto c : crop) bw.Ue(c);
+  }
+  bw.Copy(rbsp_.data(), l.restPos, stop);
+  bw.Trailing();
+  out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  out->push_back(nal[0]);
+  EscapeRbsp(packed_.data(), static_cast<uint32_t>(packed_.size()), out);
+  return true;
+}
+
+bool SliceStitcher::rewriteSlice(const uint8_t *nal, uint32_t size,
+                                 const Stripe &stripe,
+                                 std::vector<uint8_t> *out) {
+  const uint8_t type = nal[0] & 0x1F;
+  const bool idr = type == kNalIdr;
+  const uint32_t refIdc = (nal[0] >> 5) & 3;
+  UnescapeRbsp(nal + 1, size - 1, &rbsp_);
+  const uint32_t bytes = static_cast<uint32_t>(rbsp_.size());
+  BitReader br(rbsp_.data(), bytes);
+  const uint32_t firstMb = br.Ue();
+  const uint64_t headerPos = br.Pos();
+  const uint32_t sliceType = br.Ue() % 5;
+  auto ppsIt = stripe.pps.find(br.Ue());
+  if (ppsIt == stripe.pps.end()) return false;
+  const Pps &pps = ppsIt->second;
+  auto spsIt = stripe.sps.find(pps.spsId);
+  if (spsIt == stripe.sps.end()) return false;
+  const Sps &sps = spsIt->second;
+  const bool p = sliceType == kSliceP || sliceType == kSliceSP;
+  const bool b = sliceType == kSliceB;
+  // parse the rest of slice_header() to find where the slice data starts
+  if (sps.separateColourPlane) br.U(2);
+  br.U(sps.log2MaxFrameNum);
+  if (idr) br.Ue();  // idr_pic_id
+  if (sps.pocType == 0) {
+    br.U(sps.log2MaxPocLsb);
+    if (pps.bottomFieldPicOrder) br.Se();
+  } else if (sps.pocType == 1 && !sps.deltaPicOrderAlwaysZero) {
+    br.Se();
+    if (pps.bottomFieldPicOrder) br.Se();
+  }
+  if (pps.redundantPicCnt) br.Ue();
+  if (b) br.Bit();  // direct_spatial_mv_pred_flag
+  uint32_t numRefIdx[2] = {pps.numRefIdx[0], pps.numRefIdx[1]};
+  if ((p || b) && br.Bit()) {
+    numRefIdx[0] = br.Ue() + 1;
+    if (b) numRefIdx[1] = br.Ue() + 1;
+  }
+  const int lists = b ? 2 : p ? 1 : 0;
+  // ref_pic_list_modification()
+  for (int i = 0; i < lists; i++) {
+    if (!br.Bit()) continue;
+    uint32_t idc;
+    do {
+      idc = br.Ue();
+      if (idc > 3) return false;
+      if (idc != 3) br.Ue();
+    } while (idc != 3 && br.Good());
+  }
+  // pred_weight_table()
+  if ((pps.weightedPred && p) || (pps.weightedBipred == 1 && b)) {
+    br.Ue();
+    if (sps.chromaArrayType) br.Ue();
+    for (int i = 0; i < lists; i++) {
+      for (uint32_t j = 0; j < numRefIdx[i] && br.Good(); j++) {
+        if (br.Bit()) {
+          br.Se();
+          br.Se();
+        }
+        if (sps.chromaArrayType && br.Bit()) {
+          for (int k = 0; k < 4; k++) br.Se();
+        }
+      }
+    }
+  }
+  // dec_ref_pic_marking()
+  if (refIdc) {
+    if (idr) {
+      br.U(2);
+    } else if (br.Bit()) {
+      uint32_t op;
+      do {
+        op = br.Ue();
+        if (op > 6) return false;
+        if (op == 1 || op == 3) br.Ue();
+        if (op == 2) br.Ue();
+        if (op == 3 || op == 6) br.Ue();
+        if (op == 4) br.Ue();
+      } while (op != 0 && br.Good());
+    }
+  }
+  if (pps.cabac && (p || b)) br.Ue();  // cabac_init_idc
+  br.Se();                              // slice_qp_delta
+  if (sliceType == kSliceSP || sliceType == kSliceSI) {
+    if (sliceType == kSliceSP) br.Bit();
+    br.Se();
+  }
+  if (pps.deblockingControl && br.Ue() != 1) {
+    br.Se();
+    br.Se();
+  }
+  const uint64_t headerEnd = br.Pos();
+  if (!br.Good()) return false;
+  packed_.clear();
+  BitWriter bw(&packed_);
+  bw.Ue(firstMb + stripe.firstMb);
+  bw.Copy(rbsp_.data(), headerPos, headerEnd);
+  if (pps.cabac) {
+    // cabac_alignment_one_bit, then CABAC data is copied in bytes
+    while (!bw.Aligned()) bw.Bit(1);
+    bw.Copy(rbsp_.data(), (headerEnd + 7) & ~uint64_t(7), uint64_t(bytes) * 8);
+  } else {
+    const uint64_t stop = FindRbspStopBit(rbsp_.data(), bytes);
+    if (stop < headerEnd) return false;
+    bw.Copy(rbsp_.data(), headerEnd, stop);
+    bw.Trailing();
+  }
+  out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  out->push_back(nal[0]);
+  EscapeRbsp(packed_.data(), static_cast<uint32_t>(packed_.size()), out);
+  return true;
+}
+}  // namespace ixr
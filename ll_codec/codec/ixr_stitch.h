@@ -0,0 +1,102 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Stitch AVC pictures of horizontal stripes into one picture
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_STITCH_H_
+#define LL_CODEC_CODEC_IXR_STITCH_H_
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+namespace ixr {
+/**
+ * @brief Stitch access units of horizontal stripes of a picture into one
+ * conformant AVC access unit.
+ *
+ * Each stripe is a picture of the full width, encoded by its own encoder
+ * with the same parameters and the same frame types, and MVs must not point
+ * out of the top or bottom edges (@see enableStitching). Slices of all
+ * stripes are chained in top-down order with first_mb_in_slice offset to the
+ * position of the stripe, and the SPS of the first stripe is rewritten to
+ * the size of the full picture. Slice data is copied as is, only the slice
+ * header is re-packed.
+ *
+ * Single slice group, progressive pictures only.
+ */
+class SliceStitcher {
+ public:
+  /**
+   * @brief Set the geometry of the full picture.
+   *
+   * @param width width of the full picture
+   * @param height height of the full picture
+   * @param tops the first row of each stripe in ascending order, tops[0] is
+   *        0 and others are multiples of 16.
+   * @param fps frame rate, to choose the level of the full picture
+   * @return 0 if succeed, -1 if the full picture is larger than the frame
+   *         size of level 6.2, then Stitch fails until the next Reset.
+   */
+  int Reset(uint32_t width, uint32_t height, const std::vector<uint32_t> &tops,
+             float fps);
+
+  /**
+   * @brief Stitch access units of all stripes in Annex-B.
+   *
+   * @param units access units of each stripe, in the order of Reset
+   * @param sizes sizes of the access units
+   * @param out [out] the stitched access unit
+   * @return 0 if succeed, -1 if the units can't be stitched
+   */
+  int Stitch(const uint8_t *const *units, const uint32_t *sizes,
+             std::vector<uint8_t> *out);
+
+ private:
+  struct Sps {
+    uint32_t log2MaxFrameNum;
+    uint32_t pocType;
+    uint32_t log2MaxPocLsb;
+    uint32_t deltaPicOrderAlwaysZero;
+    uint32_t frameMbsOnly;
+    uint32_t separateColourPlane;
+    uint32_t chromaArrayType;
+    uint32_t widthMbs;
+  };
+
+  struct Pps {
+    uint32_t spsId;
+    uint32_t cabac;
+    uint32_t bottomFieldPicOrder;
+    uint32_t numRefIdx[2];
+    uint32_t weightedPred;
+    uint32_t weightedBipred;
+    uint32_t redundantPicCnt;
+    uint32_t deblockingControl;
+    std::vector<uint8_t> raw;  //!< the NAL unit
+  };
+
+  struct Stripe {
+    std::map<uint32_t, Sps> sps;
+    std::map<uint32_t, Pps> pps;
+    uint32_t firstMb;
+  };
+
+  bool parseSps(const uint8_t *nal, uint32_t size, Stripe *stripe);
+  bool parsePps(const uint8_t *nal, uint32_t size, Stripe *stripe);
+  bool rewriteSps(const uint8_t *nal, uint32_t size,
+                  std::vector<uint8_t> *out);
+  bool rewriteSlice(const uint8_t *nal, uint32_t size, const Stripe &stripe,
+                    std::vector<uint8_t> *out);
+
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  float fps_ = 0;
+  std::vector<Stripe> stripes_;
+  std::vector<uint8_t> rbsp_;
+  std::vector<uint8_t> packed_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_STITCH_H_
@@ -0,0 +1,166 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Encode a picture as stripes on parallel encoders
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "ll_codec/codec/ixr_tiled_encoder.h"
+#include <algorithm>
+#include <cstring>
+#include "ll_codec/codec/ixr_executor.h"
+
+namespace ixr {
+TiledEncoder::TiledEncoder(uint32_t stripes, Factory factory)
+    : factory_(std::move(factory)),
+      count_(std::max(stripes, 1u)),
+      config_(),
+      ready_(false),
+      held_(false) {
+  if (!factory_) {
+    factory_ = [](AdapterVendor vid) { return Encoder::Create(vid); };
+  }
+}
+
+TiledEncoder::~TiledEncoder() { Deallocate(); }
+
+int TiledEncoder::Allocate(const CodecConfig &config) {
+  Deallocate();
+  if (config.codec != IXR_CODEC_AVC || config.width <= 0 ||
+      config.height <= 0 || config.memoryType != IXR_MEM_INTERNAL_CPU ||
+      (config.inputFormat != IXR_COLOR_NV12 &&
+       config.inputFormat != IXR_COLOR_ARGB)) {
+    return -1;
+  }
+  // split MB rows evenly, the last stripe takes the rest rows
+  const uint32_t width = static_cast<uint32_t>(config.width);
+  const uint32_t height = static_cast<uint32_t>(config.height);
+  const uint32_t rows = (height + 15) / 16;
+  const uint32_t n = std::min(count_, rows);
+  std::vector<uint32_t> tops(n);
+  for (uint32_t i = 0; i < n; i++) tops[i] = rows * i / n * 16;
+  // pictures beyond the frame size of level 6.2 can't be stitched
+  if (stitcher_.Reset(width, height, tops, static_cast<float>(config.fps))) {
+    return -1;
+  }
+  stripes_.resize(n);
+  config_ = config;
+  for (uint32_t i = 0; i < n; i++) {
+    Stripe &s = stripes_[i];
+    s.top = tops[i];
+    s.height = (i + 1 < n ? tops[i + 1] : height) - s.top;
+    s.output = nullptr;
+    s.size = 0;
+    s.status = 0;
+    s.encoder = factory_(config.adapter);
+    if (!s.encoder) {
+      Deallocate();
+      return -1;
+    }
+    CodecConfig c = config;
+    c.height = static_cast<int32_t>(s.height);
+    c.bitrate = std::max(
+        static_cast<int32_t>(int64_t(config.bitrate) * s.height / height), 1);
+    c.advanced.enableStitching = 1;
+    s.encoder->Allocate(c);
+  }
+  // stripes share the scheduler of the first session if they can
+  for (uint32_t i = 1; i < n; i++) {
+    stripes_[i].encoder->JoinSession(stripes_[0].encoder.get());
+  }
+  const size_t pixels = size_t(width) * height;
+  input_.assign(config.inputFormat == IXR_COLOR_NV12 ? pixels * 3 / 2
+                                                      : pixels * 4,
+                0);
+  ready_ = false;
+  held_ = false;
+  return 0;
+}
+
+void TiledEncoder::Deallocate() {
+  // joined sessions are closed before the first one
+  for (size_t i = stripes_.size(); i > 0; i--) {
+    stripes_[i - 1].encoder.reset();
+  }
+  input_.clear();
+  output_.clear();
+  ready_ = false;
+  held_ = false;
+}
+
+void *TiledEncoder::DequeueInputBuffer() {
+  return input_.empty() ? nullptr : input_.data();
+}
+
+int TiledEncoder::QueueInputBuffer(void *) {
+  if (input_.empty() || held_) return -1;
+  {
+    TaskGroup group(IXR_TASK_INTERACTIVE);
+    for (size_t i = 1; i < stripes_.size(); i++) {
+      group.Run([this, i]() { encode(&stripes_[i]); });
+    }
+    encode(&stripes_[0]);
+    group.Wait();
+  }
+  std::vector<const uint8_t *> units(stripes_.size());
+  std::vector<uint32_t> sizes(stripes_.size());
+  bool failed = false;
+  for (size_t i = 0; i < stripes_.size(); i++) {
+    units[i] = static_cast<const uint8_t *>(stripes_[i].output);
+    sizes[i] = stripes_[i].size;
+    failed |= stripes_[i].status != 0 || !units[i];
+  }
+  int ret = failed ? -1 : stitcher_.Stitch(units.data(), sizes.data(),
+                                           &output_);
+  for (auto &s : stripes_) {
+    if (s.output) s.encoder->ReleaseOutputBuffer(s.output);
+    s.output = nullptr;
+  }
+  ready_ = ret == 0;
+  return ret;
+}
+
+int TiledEncoder::DequeueOutputBuffer(void **ptr, uint32_t *size) {
+  if (!ready_) return -1;
+  ready_ = false;
+  held_ = true;
+  *ptr = output_.data();
+  *size = static_cast<uint32_t>(output_.size());
+  return 0;
+}
+
+void TiledEncoder::ReleaseOutputBuffer(void *ptr) {
+  if (ptr == output_.data()) held_ = false;
+}
+
+void TiledEncoder::encode(Stripe *s) {
+  s->status = -1;
+  s->output = nullptr;
+  s->size = 0;
+  try {
+    auto dst = static_cast<uint8_t *>(s->encoder->DequeueInputBuffer());
+    if (!dst) return;
+    const size_t width = static_cast<size_t>(config_.width);
+    if (config_.inputFormat == IXR_COLOR_NV12) {
+      // luma rows, then the interleaved chroma rows of the stripe
+      const size_t luma = width * static_cast<size_t>(config_.height);
+      std::memcpy(dst, input_.data() + width * s->top, width * s->height);
+      std::memcpy(dst + width * s->height,
+                  input_.data() + luma + width * (s->top / 2),
+                  width * (s->height / 2));
+    } else {
+      std::memcpy(dst, input_.data() + width * 4 * s->top,
+                  width * 4 * s->height);
+    }
+    if (s->encoder->QueueInputBuffer(dst) != 0) return;
+    if (s->encoder->DequeueOutputBuffer(&s->output, &s->size) != 0) {
+      s->output = nullptr;
+      return;
+    }
+    s->status = 0;
+  } catch (...) {
+    s->status = -1;
+  }
+}
+}  // namespace ixr
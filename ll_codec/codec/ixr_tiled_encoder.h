@@ -0,0 +1,102 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Encode a picture as stripes on parallel encoders
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_TILED_ENCODER_H_
+#define LL_CODEC_CODEC_IXR_TILED_ENCODER_H_
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ll_codec/codec/ixr_codec.h"
+#include "ll_codec/codec/ixr_stitch.h"
+
+namespace ixr {
+/**
+ * @brief Encode pictures too large for one encoder session, i.e. 8K or 16K
+ * VR panoramas, as horizontal stripes on parallel encoders, and stitch them
+ * into one AVC bitstream.
+ *
+ * Each stripe is a multiple of 16 rows except the last one, and is encoded
+ * by its own encoder with enableStitching on, the bitrate is shared by the
+ * area of stripes. Intel encoders are joined to the session of the first
+ * stripe, so that they share one scheduler. Stripes run as interactive
+ * tasks of the shared Executor.
+ *
+ * Pictures are in CPU memory, the stripes are copied into the encoders in
+ * parallel. QueueInputBuffer blocks until the picture is encoded.
+ */
+class TiledEncoder {
+ public:
+  using Factory = std::function<std::unique_ptr<Encoder>(AdapterVendor)>;
+
+  /**
+   * @param stripes number of stripes, at least 1
+   * @param factory creates the encoder of each stripe, Encoder::Create if
+   *        null. Mock encoders can be created to benchmark the stitching.
+   */
+  explicit TiledEncoder(uint32_t stripes, Factory factory = nullptr);
+
+  ~TiledEncoder();
+
+  /**
+   * @brief Allocate encoders of all stripes.
+   *
+   * @param config codec configurations of the full picture, only AVC with
+   *        IXR_MEM_INTERNAL_CPU is supported.
+   * @return 0 if succeed, -1 if the configuration isn't supported, or the
+   *         picture is larger than the frame size of AVC level 6.2.
+   */
+  int Allocate(const CodecConfig &config);
+
+  void Deallocate();
+
+  /**
+   * @brief Get the buffer of the full picture, in the layout of
+   * Encoder::DequeueInputBuffer.
+   */
+  void *DequeueInputBuffer();
+
+  /**
+   * @brief Encode the picture in the input buffer.
+   *
+   * @param ptr unused, the input buffer is always encoded
+   * @return 0 if succeed, -1 if any stripe fails or can't be stitched, or
+   * the last output isn't released yet.
+   */
+  int QueueInputBuffer(void *ptr);
+
+  //! @see Encoder::DequeueOutputBuffer
+  int DequeueOutputBuffer(void **ptr, uint32_t *size);
+
+  //! @see Encoder::ReleaseOutputBuffer
+  void ReleaseOutputBuffer(void *ptr);
+
+ private:
+  struct Stripe {
+    std::unique_ptr<Encoder> encoder;
+    uint32_t top;
+    uint32_t height;
+    void *output;
+    uint32_t size;
+    int status;
+  };
+
+  void encode(Stripe *stripe);
+
+  Factory factory_;
+  uint32_t count_;
+  std::vector<Stripe> stripes_;
+  SliceStitcher stitcher_;
+  CodecConfig config_;
+  std::vector<uint8_t> input_;
+  std::vector<uint8_t> output_;
+  bool ready_;
+  bool held_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_TILED_ENCODER_H_
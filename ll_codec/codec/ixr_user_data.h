@@ -0,0 +1,192 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Per-frame user data slots and SEI helpers for IXR encoders
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#ifndef LL_CODEC_CODEC_IXR_USER_DATA_H_
+#define LL_CODEC_CODEC_IXR_USER_DATA_H_
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include "ll_codec/codec/ixr_codec_def.h"
+
+namespace ixr {
+//! SEI payload type of user_data_unregistered
+constexpr uint16_t kSeiUserDataUnregistered = 5;
+
+//! SEI payload type of HEVC time_code
+constexpr uint16_t kSeiTimeCode = 136;
+
+//! Size of a time_code SEI with one full clock timestamp
+constexpr uint32_t kTimeCodeSeiSize = 6;
+
+//! The uuid_iso_iec_11578 prefixed to user data written as SEI
+constexpr uint8_t kUserDataUuid[16]{0x6c, 0x6c, 0x74, 0x65, 0x63, 0x68,
+                                    0x2d, 0x75, 0x73, 0x65, 0x72, 0x2d,
+                                    0x64, 0x61, 0x74, 0x61};
+
+//! Default size of user data of each frame
+constexpr uint32_t kUserDataSizeDefault = 256;
+
+/**
+ * @brief Code a HEVC time_code SEI payload with one full clock timestamp
+ *
+ * @param tc the time code
+ * @param sei [out] at least kTimeCodeSeiSize bytes
+ * @return size of the payload
+ */
+inline uint32_t WriteTimeCodeSei(const TimeCode &tc, uint8_t *sei) {
+  // {value, bits} of each syntax element
+  const uint32_t syntax[][2]{
+      {1, 2},                       // num_clock_ts
+      {1, 1},                       // clock_timestamp_flag
+      {0, 1},                       // units_field_based_flag
+      {tc.dropFrame ? 4u : 0u, 5},  // counting_type
+      {1, 1},                       // full_timestamp_flag
+      {0, 1},                       // discontinuity_flag
+      {0, 1},                       // cnt_dropped_flag
+      {tc.frames, 9},               // n_frames
+      {tc.seconds, 6},              // seconds_value
+      {tc.minutes, 6},              // minutes_value
+      {tc.hours, 5},                // hours_value
+      {0, 5},                       // time_offset_length
+      {1, 1},                       // payload_bit_equal_to_one
+  };
+  uint64_t bits = 0;
+  uint32_t n = 0;
+  for (auto &s : syntax) {
+    bits = (bits << s[1]) | (s[0] & ((1u << s[1]) - 1));
+    n += s[1];
+  }
+  // payload_bit_equal_to_zero till byte aligned
+  const uint32_t size = (n + 7) / 8;
+  bits <<= size * 8 - n;
+  for (uint32_t i = 0; i < size; ++i) {
+    sei[i] = static_cast<uint8_t>(bits >> (8 * (size - 1 - i)));
+  }
+  return size;
+}
+
+/**
+ * @brief A fixed arena of user data slots, one slot per frame in flight.
+ *
+ * The input thread writes the slot of the next queued frame and commits it
+ * along with the input surface. The output thread advances to the slot of
+ * each dequeued bitstream and reads it back. Nothing is allocated after
+ * Allocate().
+ */
+class FrameUserData {
+ public:
+  FrameUserData() : capacity_(0), written_(0), read_(0) {}
+
+  /**
+   * @brief Reserve the arena
+   *
+   * @param slots number of frames can be in flight, including the pending
+   *        input and the current output
+   * @param capacity size in bytes of each slot
+   */
+  void Allocate(uint32_t slots, uint32_t capacity) {
+    capacity_ = capacity;
+    arena_.assign(static_cast<size_t>(slots) * capacity, 0);
+    length_.assign(slots, 0);
+    written_ = 0;
+    read_ = 0;
+  }
+
+  void Deallocate() {
+    arena_.clear();
+    length_.clear();
+    capacity_ = 0;
+  }
+
+  /**
+   * @brief Copy data into the slot of the next queued frame.
+   *
+   * @return false if data is too large, the slot is taken already or
+   *         all slots are in use.
+   */
+  bool Write(const void *data, uint32_t size) {
+    if (length_.empty() || size > capacity_ || !writable()) return false;
+    const size_t slot = written_ % length_.size();
+    if (length_[slot]) return false;
+    std::memcpy(&arena_[slot * capacity_], data, size);
+    length_[slot] = size;
+    return true;
+  }
+
+  /**
+   * @brief Empty the slot of the next queued frame, i.e. the data written
+   * can't be carried by the frame.
+   */
+  void Discard() {
+    if (!length_.empty()) length_[written_ % length_.size()] = 0;
+  }
+
+  /**
+   * @brief Bind the pending slot to the frame just queued.
+   * A frame without user data commits an empty slot.
+   */
+  bool Commit() {
+    if (length_.empty() || !writable()) return false;
+    uint32_t w = written_.load(std::memory_order_relaxed) + 1;
+    length_[w % length_.size()] = 0;
+    written_.store(w, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Move the read slot to the bitstream just dequeued.
+   */
+  void Advance() {
+    uint32_t r = read_.load(std::memory_order_relaxed);
+    if (r != written_.load(std::memory_order_acquire)) read_.store(r + 1);
+  }
+
+  /**
+   * @brief Copy out the user data of the current output frame.
+   *
+   * @param data pointer to an allocated memory, can be null to query size
+   * @param size [in] size of data, [out] size of user data
+   * @return false if no output is dequeued or data is too small.
+   */
+  bool Read(void *data, uint32_t *size) const {
+    const uint32_t r = read_;
+    if (length_.empty() || r == 0 || !size) return false;
+    const size_t slot = (r - 1) % length_.size();
+    const uint32_t len = length_[slot];
+    if (data) {
+      if (*size < len) {
+        *size = len;
+        return false;
+      }
+      std::memcpy(data, &arena_[slot * capacity_], len);
+    }
+    *size = len;
+    return true;
+  }
+
+  /** @return user data of the frame queued next, or null if empty */
+  const char *Pending(uint32_t *size) const {
+    if (length_.empty()) return nullptr;
+    const size_t slot = written_ % length_.size();
+    *size = length_[slot];
+    return *size ? &arena_[slot * capacity_] : nullptr;
+  }
+
+ private:
+  // the pending slot doesn't overlap the current output slot
+  bool writable() const { return written_ - read_ + 1 < length_.size(); }
+
+  std::vector<char> arena_;
+  std::vector<uint32_t> length_;
+  uint32_t capacity_;
+  std::atomic<uint32_t> written_;
+  std::atomic<uint32_t> read_;
+};
+}  // namespace ixr
+#endif  // LL_CODEC_CODEC_IXR_USER_DATA_H_
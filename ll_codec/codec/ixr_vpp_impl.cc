@@ -72,18 +72,20 @@ void* VppImplIntel::DequeueInputBuffer() {
     mfxStatus sts = m_allocator->GetHDL(
         m_allocator->pthis, free_surface->Data.MemId, &texpair.first);
     CheckStatus(sts, "- Error in GetHDL", __FILE__, __LINE__);
-    std::unique_lock<std::mutex> lock(m_MapMutex);
-    m_TextureSurfaces[texpair.first] = free_surface;
-    lock.unlock();
+    if (!m_TextureSurfaces.Set(texpair.first, free_surface)) {
+      CheckStatus(MFX_ERR_NOT_ENOUGH_BUFFER, "- Too many handles", __FILE__,
+                  __LINE__);
+    }
     return texpair.first;
   }
   return nullptr;
 }
 
 int VppImplIntel::QueueInputBuffer(void* ptr) {
-  std::unique_lock<std::mutex> lock(m_MapMutex);
-  mfxFrameSurface1* inp = m_TextureSurfaces.at(ptr);
-  lock.unlock();
+  mfxFrameSurface1* inp = m_TextureSurfaces.Get(ptr);
+  if (!inp) {
+    CheckStatus(MFX_ERR_NOT_FOUND, "- Unknown input", __FILE__, __LINE__);
+  }
   mfxFrameSurface1* outp;
   mfxSyncPoint sync;
   m_SurfaceInUse.push_back(inp);
@@ -113,8 +115,10 @@ int VppImplIntel::DequeueOutputBuffer(void** ptr, uint32_t* size) {
                                 &texpair.first);
       CheckStatus(sts, "- Error in GetHDL", __FILE__, __LINE__);
       *ptr = texpair.first;
-      std::unique_lock<std::mutex> lock(m_MapMutex);
-      m_TextureSurfaces[*ptr] = surf;
+      if (!m_TextureSurfaces.Set(*ptr, surf)) {
+        CheckStatus(MFX_ERR_NOT_ENOUGH_BUFFER, "- Too many handles", __FILE__,
+                    __LINE__);
+      }
     }
     return sts;
   }
@@ -122,10 +126,8 @@ int VppImplIntel::DequeueOutputBuffer(void** ptr, uint32_t* size) {
 }
 
 void VppImplIntel::ReleaseOutputBuffer(void* ptr) {
-  std::unique_lock<std::mutex> lock(m_MapMutex);
-  mfxFrameSurface1* surf = m_TextureSurfaces.at(ptr);
-  lock.unlock();
-  m_Object->ReleaseSurface(surf);
+  mfxFrameSurface1* surf = m_TextureSurfaces.Get(ptr);
+  if (surf) m_Object->ReleaseSurface(surf);
 }
 
 uint32_t VppImplIntel::formatConvert(ColorFourcc f) {
@@ -134,6 +136,10 @@ uint32_t VppImplIntel::formatConvert(ColorFourcc f) {
       return MFX_FOURCC_NV12;
     case IXR_COLOR_ARGB:
       return MFX_FOURCC_RGB4;
+    case IXR_COLOR_P010:
+      return MFX_FOURCC_P010;
+    case IXR_COLOR_Y410:
+      return MFX_FOURCC_Y410;
     default:
       break;
   }
@@ -183,6 +189,9 @@ void VppImplIntel::createAllocator(const mfxvr::vrpar::config& par) {
   CheckStatus(m_allocator->Alloc(m_allocator->pthis, &req, &resp),
               "- Error in Alloc input frames", __FILE__, __LINE__);
   m_InputSurfaces.resize(resp.NumFrameActual);
+  // handles of both input and output surfaces
+  m_TextureSurfaces.Reset(mfxU32(m_InputSurfaces.size()) +
+                          m_Object->NumOutputSurfaces());
   mfxU16 i = 0;
   for (auto&& surf : m_InputSurfaces) {
     sts = m_Object->QueryInfo(&surf.Info);
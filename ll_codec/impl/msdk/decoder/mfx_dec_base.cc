@@ -26,7 +26,7 @@ namespace dec {
 // Todo config me.
 constexpr mfxU32 kAllocBytes = 16 << 20;
 
-CVRDecBase::CVRDecBase() {
+CVRDecBase::CVRDecBase(bool sw) {
   std::memset(&responce_, 0, sizeof(responce_));
   std::memset(&input_bytes_, 0, sizeof(input_bytes_));
   std::memset(&cached_bytes_, 0, sizeof(cached_bytes_));
@@ -34,8 +34,9 @@ CVRDecBase::CVRDecBase() {
   cached_bytes_.MaxLength = kAllocBytes;
   cached_bytes_.Data = new mfxU8[kAllocBytes];
   old_offset_ = 0;
+  last_sync_ = nullptr;
   vpp_.reset(new vpp::VppChain());
-  initSession();
+  initSession(sw);
 }
 
 CVRDecBase::~CVRDecBase() { delete[] cached_bytes_.Data; }
@@ -61,10 +62,13 @@ bool CVRDecBase::InputAvaiable() {
   // For all surfaces, it's free if it is
   // 1. not locked by msdk and
   // 2. not used after outputs
-  return !getFreeSurface(1).empty();
+  int slot = worker_status_.Acquire();
+  if (slot < 0) return false;
+  worker_status_.Recycle(slot);
+  return true;
 }
 
-bool CVRDecBase::QueueInput(void *src, mfxU32 size) {
+bool CVRDecBase::QueueInput(void *src, mfxU32 size, mfxU64 pts) {
   mfxStatus sts = MFX_ERR_NONE;
   const bool kVppUsed = vpp_->VppChainSize() > 0;
   input_bytes_.Data = static_cast<mfxU8 *>(src);
@@ -94,10 +98,13 @@ bool CVRDecBase::QueueInput(void *src, mfxU32 size) {
   } else {
     old_offset_ = 0;
   }
+  // MSDK stamps a frame with the bitstream's time stamp when it starts to
+  // decode that frame.
+  inp->TimeStamp = pts;
   for (;;) {
     // get unlocked work surface
-    auto workers = getFreeSurface(1);
-    if (workers.empty()) {
+    int slot = worker_status_.Acquire();
+    if (slot < 0) {
       // not enough free surface, return false to tell caller
       // to queue in the same buffer once again.
       if (inp == &cached_bytes_) {
@@ -107,9 +114,10 @@ bool CVRDecBase::QueueInput(void *src, mfxU32 size) {
         return false;
       }
     }
-    mfxFrameSurface1 *worker = workers[0];
+    mfxFrameSurface1 *worker = worker_status_.Surface(slot);
     mfxFrameSurface1 *outp;
     mfxSyncPoint sync;
+    mfxSyncPoint busy = last_sync_;
     for (;;) {
       if (!src && size == 0) {
         // signal EOF
@@ -117,26 +125,30 @@ bool CVRDecBase::QueueInput(void *src, mfxU32 size) {
       } else {
         sts = mfx_dec_->DecodeFrameAsync(inp, worker, &outp, &sync);
       }
-      if (sts == MFX_WRN_DEVICE_BUSY || sts == MFX_WRN_VIDEO_PARAM_CHANGED) {
-        std::this_thread::yield();
-      } else {
+      if (sts == MFX_WRN_DEVICE_BUSY) {
+        WaitForDevice(sess_, &busy);
+      } else if (sts != MFX_WRN_VIDEO_PARAM_CHANGED) {
         break;
       }
     }
     if (sts == MFX_ERR_NONE) {
-      worker_status_[outp].inuse = true;
-      worker_status_[outp].surf = outp;
+      last_sync_ = sync;
+      int out = worker_status_.Slot(outp);
+      SurfaceStatus &status = worker_status_.Data(out);
+      status.surf = outp;
       if (kVppUsed) {
         mfxFrameSurface1 *vpp_outp;
         sts = vpp_->RunVpp1(outp, &vpp_outp, &sync);
         CheckStatus(sts, "RunFrameVPPAsync", __FILE__, __LINE__);
-        worker_status_[outp].surf = vpp_outp;
+        status.surf = vpp_outp;
       }
-      worker_status_[outp].sync = sync;
+      status.sync = sync;
+      worker_status_.SetState(out, SurfaceTable<SurfaceStatus>::kInUse);
       outputs_.Push(outp);
-    } else if (sts != MFX_ERR_MORE_SURFACE) {
-      break;
     }
+    // the worker is locked by msdk until it's output or not referenced
+    worker_status_.Recycle(slot);
+    if (sts != MFX_ERR_NONE && sts != MFX_ERR_MORE_SURFACE) break;
     if (inp->DataLength == 0) break;
   }
   CheckStatus(sts, "DecodeFrameAsync", __FILE__, __LINE__, MFX_ERR_MORE_DATA);
@@ -150,45 +162,54 @@ bool CVRDecBase::QueueInput(void *src, mfxU32 size) {
   return old_offset_ == 0;
 }
 
-void CVRDecBase::DequeueOutputSurface(void **surface) {
+void CVRDecBase::DequeueOutputSurface(void **surface, mfxU64 *pts) {
   mfxFrameSurface1 *outputhead;
   if (outputs_.TryPop(&outputhead)) {
-    mfxSyncPoint sync = worker_status_[outputhead].sync;
-    mfxFrameSurface1 *surf = worker_status_[outputhead].surf;
-    assert(worker_status_[outputhead].inuse);
+    int slot = worker_status_.Slot(outputhead);
+    mfxSyncPoint sync = worker_status_.Data(slot).sync;
+    mfxFrameSurface1 *surf = worker_status_.Data(slot).surf;
+    assert(worker_status_.GetState(slot) ==
+           SurfaceTable<SurfaceStatus>::kInUse);
     mfxStatus sts = sess_.SyncOperation(sync, MFX_INFINITE);
     CheckStatus(sts, "SyncOperation", __FILE__, __LINE__);
     sts = allocator_->GetHDL(allocator_->pthis, surf->Data.MemId, surface);
     CheckStatus(sts, "GetHDL", __FILE__, __LINE__);
-    std::lock_guard<std::mutex> locker(release_mutex_);
-    release_tab_[*surface] = outputhead;
+    if (pts) *pts = outputhead->Data.TimeStamp;
+    if (!release_tab_.Set(*surface, outputhead)) {
+      CheckStatus(MFX_ERR_NOT_ENOUGH_BUFFER, "- Too many output handles",
+                  __FILE__, __LINE__);
+    }
   } else {
     *surface = nullptr;
+    if (pts) *pts = MFX_TIMESTAMP_UNKNOWN;
     return;
   }
 }
 
 void CVRDecBase::ReleaseOutputSurface(void *surface) {
-  std::lock_guard<std::mutex> locker(release_mutex_);
-  mfxFrameSurface1 *frame = release_tab_.at(surface);
-  if (worker_status_.find(frame) != worker_status_.end()) {
-    worker_status_[frame].inuse = false;
-    worker_status_[frame].sync = 0;
-    vpp_->ReleaseSurface(worker_status_[frame].surf);
+  mfxFrameSurface1 *frame = release_tab_.Get(surface);
+  if (!frame) {
+    CheckStatus(MFX_ERR_NOT_FOUND, "- Unknown output surface", __FILE__,
+                __LINE__);
   }
-  release_tab_.erase(surface);
+  release_tab_.Set(surface, nullptr);
+  int slot = worker_status_.Slot(frame);
+  worker_status_.Data(slot).sync = 0;
+  vpp_->ReleaseSurface(worker_status_.Data(slot).surf);
+  worker_status_.Release(slot);
 }
 
-void CVRDecBase::initSession() {
+void CVRDecBase::initSession(bool sw) {
   // The version has to be "1.0" to successfully init mfx.
   mfxVersion version{0, 1};
   mfxInitParam par{};
-  par.Implementation = MFX_IMPL_HARDWARE_ANY | MFX_IMPL_VIA_D3D11;
+  par.Implementation =
+      sw ? MFX_IMPL_SOFTWARE : MFX_IMPL_HARDWARE_ANY | MFX_IMPL_VIA_D3D11;
   par.GPUCopy = MFX_GPUCOPY_DEFAULT;
   par.Version = version;
   // Try to use HW implementation first, then software impl.
   mfxStatus sts = sess_.InitEx(par);
-  if (sts != MFX_ERR_NONE) {
+  if (sts != MFX_ERR_NONE && !sw) {
     par.Implementation = MFX_IMPL_SOFTWARE;
     sts = sess_.InitEx(par);
   }
@@ -305,7 +326,6 @@ void CVRDecBase::initFrames(vrpar::config *par) {
   workers_.resize(responce_.NumFrameActual);
   mfxU16 i = 0;
   for (auto &surf : workers_) {
-    worker_status_[&surf] = {};
     std::memset(&surf, 0, sizeof surf);
     surf.Info = request.Info;
     if (par->renderer) {
@@ -314,17 +334,9 @@ void CVRDecBase::initFrames(vrpar::config *par) {
       allocator_->Lock(allocator_->pthis, responce_.mids[i++], &surf.Data);
     }
   }
-}
-
-std::vector<mfxFrameSurface1 *> CVRDecBase::getFreeSurface(int num) {
-  std::vector<mfxFrameSurface1 *> freed;
-  for (auto &surf : workers_) {
-    if (surf.Data.Locked == 0 && !worker_status_[&surf].inuse) {
-      freed.push_back(&surf);
-    }
-    if (freed.size() == num) break;
-  }
-  return freed;
+  worker_status_.Reset(workers_.data(), mfxU32(workers_.size()));
+  // outputs are handles of either workers or vpp surfaces
+  release_tab_.Reset(mfxU32(workers_.size()) + vpp_->NumOutputSurfaces());
 }
 
 }  // namespace dec
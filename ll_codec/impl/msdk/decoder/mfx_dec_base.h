@@ -11,12 +11,12 @@ Using MediaSDK in Android as the codec
 #ifndef LL_CODEC_MFXVR_DECODER_MFX_DEC_BASE_H_
 #define LL_CODEC_MFXVR_DECODER_MFX_DEC_BASE_H_
 #include <deque>
-#include <map>
 #include <memory>
 #include <vector>
 #include "ll_codec/impl/thread_safe_stl/queue/thread_safe_queue.h"
 #include "ll_codec/impl/msdk/utility/mfx_alloc_base.h"
 #include "ll_codec/impl/msdk/utility/mfx_base.h"
+#include "ll_codec/impl/msdk/utility/mfx_surface_table.h"
 #include "ll_codec/impl/msdk/vpp/mfx_vpp_chain.h"
 
 
@@ -45,10 +45,10 @@ class CMVCExt : public CExtBuffer<mfxExtMVCSeqDesc> {
   }
 };
 
+// payload of an output surface, in use until released
 struct SurfaceStatus {
-  mfxFrameSurface1 *surf = nullptr;
+  mfxFrameSurface1 *surf = nullptr;  // the vpp output, or itself
   mfxSyncPoint sync = nullptr;
-  bool inuse = false;
 };
 
 /**
@@ -61,7 +61,8 @@ struct SurfaceStatus {
  */
 class CVRDecBase : public noncopyable {
  public:
-  CVRDecBase();
+  //! \param sw use the software implementation only
+  explicit CVRDecBase(bool sw = false);
 
   virtual ~CVRDecBase();
 
@@ -86,20 +87,24 @@ class CVRDecBase : public noncopyable {
    * 
    * @param src the pointer to data
    * @param size the length in bytes
+   * @param pts presentation time stamp of the frame in 90kHz, carried to
+   *        the decoded surface
    * @return true if all the data has been processed by decoder,
    *         false if some bytes remained unprocessed. If there're
    *         bytes remained, you must queue-in again and keep data
    *         available.
    */
-  bool QueueInput(void *src, mfxU32 size);
+  bool QueueInput(void *src, mfxU32 size,
+                  mfxU64 pts = MFX_TIMESTAMP_UNKNOWN);
 
   /**
    * @brief Dequeue-out decoded surface
    * 
    * @param surface is a bulk of memory if memtype is CPU,
    *        or is a handle of texture otherwise.
+   * @param pts presentation time stamp of the surface, optional.
    */
-  void DequeueOutputSurface(void **surface);
+  void DequeueOutputSurface(void **surface, mfxU64 *pts = nullptr);
 
   /**
    * @brief Return the surface to decoder and unlock it.
@@ -109,7 +114,7 @@ class CVRDecBase : public noncopyable {
   void ReleaseOutputSurface(void *surface);
 
  private:  // func
-  void initSession();
+  void initSession(bool sw);
 
   void initParameters(vrpar::config *par);
 
@@ -117,7 +122,6 @@ class CVRDecBase : public noncopyable {
 
   void initFrames(vrpar::config *par);
 
-  std::vector<mfxFrameSurface1 *> getFreeSurface(int num);
 
  private:  // var
   MFXVideoSession sess_;
@@ -125,13 +129,13 @@ class CVRDecBase : public noncopyable {
   mfxBitstream input_bytes_;
   mfxBitstream cached_bytes_;
   mfxU32 old_offset_;
+  mfxSyncPoint last_sync_;  //!< of the last decoded frame
   mfxFrameAllocResponse responce_;
   std::vector<mfxExtBuffer *> external_buff_;
   std::vector<mfxFrameSurface1> workers_;
-  std::map<mfxFrameSurface1 *, SurfaceStatus> worker_status_;
+  SurfaceTable<SurfaceStatus> worker_status_;
   ixr::SafeQueue<mfxFrameSurface1 *> outputs_;
-  std::map<mfxHDL, mfxFrameSurface1 *> release_tab_;
-  mutable std::mutex release_mutex_;
+  HandleTable<mfxFrameSurface1> release_tab_;
   std::unique_ptr<CMVCExt> ext_mvc_;
   std::unique_ptr<CMFXAllocator> allocator_;
   std::unique_ptr<MFXVideoDECODE> mfx_dec_;
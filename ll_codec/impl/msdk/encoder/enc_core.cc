@@ -18,6 +18,7 @@ namespace enc {
 Core::Core(mfxSession s, mfxFrameAllocator *alloc, const vrpar::config &par) {
   VppChain::Alloc(s, alloc, par);
   mfxStatus sts = initEncParams(par);
+  CheckStatus(sts, "- Error in Enc::initEncParams", __FILE__, __LINE__);
   // load hevc plugin
   if (par.codec == MFX_CODEC_HEVC) {
     sts = MFXVideoUSER_Load(s, &MFX_PLUGINID_HEVCE_HW, 1);
@@ -43,11 +44,15 @@ mfxStatus Core::RunEnc(mfxFrameSurface1 *in, mfxBitstream *out,
     vpp_out = in;
   }
   vpp_out->Info.FrameId.ViewId = (m_process_id - 1) % m_MvcViews;
+  // reference lists in ctrl identify frames by FrameOrder
+  vpp_out->Data.FrameOrder = in->Data.FrameOrder;
+  // the last task in flight, either vpp of this frame or the last encode
+  mfxSyncPoint busy = m_Sync[0];
   for (;;) {
     out->DataLength = 0;
     sts = m_MfxEnc->EncodeFrameAsync(ctrl, vpp_out, out, &m_Sync[0]);
     if (sts == MFX_WRN_DEVICE_BUSY)
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      WaitForDevice(m_session, &busy);
     else
       break;
   }
@@ -74,6 +79,11 @@ mfxStatus Core::QueryInfo(mfxFrameInfo *info) {
   return sts;
 }
 
+mfxStatus Core::ResetQuality(mfxU16 quality) {
+  m_EncParams.mfx.Quality = quality;
+  return m_MfxEnc->Reset(&m_EncParams);
+}
+
 mfxStatus Core::initEncParams(const vrpar::config &par) {
   std::memset(&m_EncParams, 0, sizeof(m_EncParams));
   m_EncParams.mfx.CodecId = par.codec;
@@ -100,16 +110,30 @@ mfxStatus Core::initEncParams(const vrpar::config &par) {
       m_EncParams.mfx.MaxKbps = m_EncParams.mfx.TargetKbps;
     }
   }
-  if (par.numRoi) {
-    m_EncParams.mfx.RateControlMethod = MFX_RATECONTROL_CQP;
-    m_EncParams.mfx.QPI = 0;
-    m_EncParams.mfx.QPP = 0;
-  }
   m_EncParams.mfx.GopRefDist = 1;                       // no B frame
   m_EncParams.mfx.GopPicSize = par.gop ? par.gop : 30;  // default: 30
-  m_EncParams.mfx.NumRefFrame = 1;
+  // intra refresh takes place of IDR, and IDR would flush long-term refs
+  if ((par.intraRefresh || par.numLtr) && !par.gop) {
+    m_EncParams.mfx.GopPicSize = 0xFFFF;
+  }
+  // keep long-term references in DPB besides the last frame
+  m_EncParams.mfx.NumRefFrame = 1 + par.numLtr;
   m_EncParams.mfx.IdrInterval = 0;
   m_EncParams.mfx.NumSlice = 0;
+  // coding options are shared by features, attached only if used
+  std::memset(&m_CodingOption, 0, sizeof(mfxExtCodingOption));
+  m_CodingOption.Header.BufferId = MFX_EXTBUFF_CODING_OPTION;
+  m_CodingOption.Header.BufferSz = sizeof(m_CodingOption);
+  std::memset(&m_CodingOption2, 0, sizeof(mfxExtCodingOption2));
+  m_CodingOption2.Header.BufferId = MFX_EXTBUFF_CODING_OPTION2;
+  m_CodingOption2.Header.BufferSz = sizeof(m_CodingOption2);
+  std::memset(&m_CodingOption3, 0, sizeof(mfxExtCodingOption3));
+  m_CodingOption3.Header.BufferId = MFX_EXTBUFF_CODING_OPTION3;
+  m_CodingOption3.Header.BufferSz = sizeof(m_CodingOption3);
+  std::memset(&m_MvBoundaries, 0, sizeof(mfxExtMVOverPicBoundaries));
+  m_MvBoundaries.Header.BufferId = MFX_EXTBUFF_MV_OVER_PIC_BOUNDARIES;
+  m_MvBoundaries.Header.BufferSz = sizeof(m_MvBoundaries);
+  bool useOption = false, useOption2 = false, useOption3 = false;
   m_EncParams.mfx.CodecProfile = MFX_PROFILE_AVC_HIGH;
   m_EncParams.mfx.CodecLevel = MFX_LEVEL_AVC_52;
   m_EncParams.mfx.BufferSizeInKB = 4096;
@@ -121,8 +145,20 @@ mfxStatus Core::initEncParams(const vrpar::config &par) {
   m_EncParams.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
   if (par.renderer) m_EncParams.IOPattern = MFX_IOPATTERN_IN_VIDEO_MEMORY;
   // frame info parameters
-  m_EncParams.mfx.FrameInfo.FourCC = MFX_FOURCC_NV12;
-  m_EncParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+  const mfxU32 fourcc =
+      par.out.color_format ? par.out.color_format : MFX_FOURCC_NV12;
+  m_EncParams.mfx.FrameInfo.FourCC = fourcc;
+  m_EncParams.mfx.FrameInfo.ChromaFormat = getChromaFormatFromFourCC(fourcc);
+  m_EncParams.mfx.FrameInfo.BitDepthLuma = getBitDepthFromFourCC(fourcc);
+  m_EncParams.mfx.FrameInfo.BitDepthChroma = getBitDepthFromFourCC(fourcc);
+  m_EncParams.mfx.FrameInfo.Shift = getShiftFromFourCC(fourcc);
+  if (MFX_CODEC_HEVC == par.codec && getBitDepthFromFourCC(fourcc)) {
+    // 4:4:4 10-bit is of the range extensions
+    m_EncParams.mfx.CodecProfile = fourcc == MFX_FOURCC_P010
+                                       ? MFX_PROFILE_HEVC_MAIN10
+                                       : MFX_PROFILE_HEVC_REXT;
+    m_EncParams.mfx.CodecLevel = 0;
+  }
   m_EncParams.mfx.FrameInfo.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
   /**
    * width must be a multiple of 16
@@ -153,81 +189,72 @@ mfxStatus Core::initEncParams(const vrpar::config &par) {
                            par.listRoiQPI, ratio, 16);
     m_EncExtBuf.push_back(m_ExtRoi->getAddressOf());
   }
-  // Intra-Refresh Configuration
-  if (par.intraRefresh) {
-#if 0
-    std::memset(&m_CodingOption, 0, sizeof(mfxExtCodingOption));
-    m_CodingOption.Header.BufferId = MFX_EXTBUFF_CODING_OPTION;
-    m_CodingOption.Header.BufferSz = sizeof(m_CodingOption);
-
-    std::memset(&m_CodingOption2, 0, sizeof(mfxExtCodingOption2));
-    m_CodingOption2.Header.BufferId = MFX_EXTBUFF_CODING_OPTION2;
-    m_CodingOption2.Header.BufferSz = sizeof(m_CodingOption2);
-
-    std::memset(&m_CodingOption3, 0, sizeof(mfxExtCodingOption3));
-    m_CodingOption3.Header.BufferId = MFX_EXTBUFF_CODING_OPTION3;
-    m_CodingOption3.Header.BufferSz = sizeof(m_CodingOption3);
-
+  // static frames are coded as skipped, see mfxEncodeCtrl::SkipFrame
+  if (par.skipFrame && MFX_CODEC_JPEG != par.codec) {
+    m_CodingOption2.SkipFrame = MFX_SKIPFRAME_INSERT_DUMMY;
+    useOption2 = true;
+  }
+  // time code of each frame is carried in pic_timing SEI
+  if (par.timeCode && MFX_CODEC_AVC == par.codec) {
+    m_CodingOption.PicTimingSEI = MFX_CODINGOPTION_ON;
+    useOption = true;
+  }
+  // Intra-Refresh Configuration, a column of MBs is coded as intra in each
+  // frame, so that no IDR is needed to recover from errors
+  if (par.intraRefresh && MFX_CODEC_JPEG != par.codec) {
     m_CodingOption.RecoveryPointSEI = MFX_CODINGOPTION_ON;
-    m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption);
-
-    m_CodingOption2.IntRefType = 1;  // column row refresh.
-    m_CodingOption2.IntRefCycleSize = 10;
-    m_CodingOption2.IntRefQPDelta = 3;
-    m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption2);
-
-    m_CodingOption3.IntRefCycleDist = 0;
-    m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption3);
-#endif
-  }
-  // slice based encode
-  if (par.slice) {
-#if 0
-    m_EncParams.mfx.NumSlice = 4;
-    std::memset(&m_CodingOption3, 0, sizeof(mfxExtCodingOption3));
-    m_CodingOption3.Header.BufferId = MFX_EXTBUFF_CODING_OPTION3;
-    m_CodingOption3.Header.BufferSz = sizeof(m_CodingOption3);
-    int PartialOutputMode = par.sliceMode;
-    switch (PartialOutputMode - 1) {
-      case MFX_PARTIAL_BITSTREAM_SLICE:
-        m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_ON;
-        m_CodingOption3.PartialBitstreamGranularity =
-            MFX_PARTIAL_BITSTREAM_SLICE;
-        m_CodingOption3.PartialBitstreamBlockSize =
-            static_cast<mfxU16>(par.sliceData);
-        // printf("partialoutput slice\r\n");
+    useOption = true;
+    m_CodingOption2.IntRefType = MFX_REFRESH_VERTICAL;
+    m_CodingOption2.IntRefCycleSize = par.intraRefreshCycle;
+    m_CodingOption2.IntRefQPDelta = par.intraRefreshQpDelta;
+    useOption2 = true;
+    m_CodingOption3.IntRefCycleDist = par.intraRefreshDist;
+    useOption3 = true;
+  }
+  // slice based encode, slices are output as soon as they are ready
+  if (par.slice && MFX_CODEC_JPEG != par.codec) {
+    mfxU16 granularity = MFX_PARTIAL_BITSTREAM_SLICE;
+    switch (par.sliceMode) {
+      case vrpar::SLICE_MB:
+        m_CodingOption2.NumMbPerSlice = static_cast<mfxU16>(par.sliceData);
+        useOption2 = true;
         break;
-      case MFX_PARTIAL_BITSTREAM_TILE:
-        m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_ON;
-        m_CodingOption3.PartialBitstreamGranularity =
-            MFX_PARTIAL_BITSTREAM_TILE;
-        m_CodingOption3.PartialBitstreamBlockSize =
-            static_cast<mfxU16>(par.sliceData);
-        // printf("partialoutput Tile\r\n");
+      case vrpar::SLICE_BYTE:
+        m_CodingOption2.MaxSliceSize = static_cast<mfxU32>(par.sliceData);
+        useOption2 = true;
         break;
-      case MFX_PARTIAL_BITSTREAM_BLOCK:
-        m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_ON;
-        m_CodingOption3.PartialBitstreamGranularity =
-            MFX_PARTIAL_BITSTREAM_BLOCK;
-        m_CodingOption3.PartialBitstreamBlockSize =
-            static_cast<mfxU16>(par.sliceData);
-        // printf("partialoutput block\r\n");
+      case vrpar::SLICE_TILE:
+        m_EncParams.mfx.NumSlice = static_cast<mfxU16>(par.sliceData);
+        granularity = MFX_PARTIAL_BITSTREAM_TILE;
         break;
-      case MFX_PARTIAL_BITSTREAM_ANY:
-        // printf("partialoutput any\r\n");
-        m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_ON;
-        m_CodingOption3.PartialBitstreamGranularity = MFX_PARTIAL_BITSTREAM_ANY;
+      case vrpar::SLICE_BLOCK:
         m_CodingOption3.PartialBitstreamBlockSize =
             static_cast<mfxU16>(par.sliceData);
+        granularity = MFX_PARTIAL_BITSTREAM_BLOCK;
         break;
       default:
-        // printf("partialoutput off\r\n");
-        m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_OFF;
-        break;
+        return MFX_ERR_INVALID_VIDEO_PARAM;
     }
-    m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption3);
-#endif
+    m_CodingOption3.EnablePartialBitstreamOutput = MFX_CODINGOPTION_ON;
+    m_CodingOption3.PartialBitstreamGranularity = granularity;
+    useOption3 = true;
+  }
+  // The picture is a stripe of a larger one. MVs never point out of the
+  // top or bottom edges, and slice edges are not deblocked, so that decoding
+  // the stitched picture doesn't drift. Frame types must be the same in all
+  // stripes, scene change detection is off.
+  if (par.stitchable && MFX_CODEC_AVC == par.codec) {
+    m_MvBoundaries.StickTop = MFX_CODINGOPTION_ON;
+    m_MvBoundaries.StickBottom = MFX_CODINGOPTION_ON;
+    m_EncExtBuf.push_back((mfxExtBuffer *)&m_MvBoundaries);
+    m_CodingOption2.DisableDeblockingIdc = 2;
+    m_CodingOption2.AdaptiveI = MFX_CODINGOPTION_OFF;
+    m_CodingOption2.AdaptiveB = MFX_CODINGOPTION_OFF;
+    useOption2 = true;
   }
+  if (useOption) m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption);
+  if (useOption2) m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption2);
+  if (useOption3) m_EncExtBuf.push_back((mfxExtBuffer *)&m_CodingOption3);
   if (!m_EncExtBuf.empty()) {
     m_EncParams.ExtParam = &m_EncExtBuf[0];
     m_EncParams.NumExtParam = static_cast<mfxU16>(m_EncExtBuf.size());
@@ -32,6 +32,9 @@ class Core : public vpp::VppChain {
   /* Query surface information */
   mfxStatus QueryInfo(mfxFrameInfo *info);
 
+  /* Reset the quality of JPEG */
+  mfxStatus ResetQuality(mfxU16 quality);
+
  protected:
   // MFX encode API wrapper
   std::unique_ptr<MFXVideoENCODE> m_MfxEnc;
@@ -42,6 +45,7 @@ class Core : public vpp::VppChain {
   mfxExtCodingOption m_CodingOption;
   mfxExtCodingOption2 m_CodingOption2;
   mfxExtCodingOption3 m_CodingOption3;
+  mfxExtMVOverPicBoundaries m_MvBoundaries;
   // external buffers
   std::vector<mfxExtBuffer *> m_EncExtBuf;
   std::vector<mfxSyncPoint> m_Sync;
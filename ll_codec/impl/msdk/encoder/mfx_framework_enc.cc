@@ -11,6 +11,7 @@ Mod      :    Date      Author
 Updated Vpp. 2017.3.30
 ********************************************************************/
 #include "ll_codec/impl/msdk/encoder/mfx_framework_enc.h"
+#include <algorithm>
 #include <cmath>
 #include <memory>
 #if _WIN32
@@ -20,16 +21,19 @@ Updated Vpp. 2017.3.30
 
 namespace mfxvr {
 namespace enc {
+// maximum SEI messages in one frame
+constexpr size_t kMaxPayloads = 8;
 
-CVRmfxFramework::CVRmfxFramework(bool hw) {
+CVRmfxFramework::CVRmfxFramework(bool hw, bool sw) {
   mfxInitParam initpar{};
   mfxVersion version{0, 1};
   initpar.Version = version;
   initpar.GPUCopy = MFX_GPUCOPY_DEFAULT;
   initpar.Implementation = MFX_IMPL_HARDWARE_ANY;
   if (hw) initpar.Implementation |= MFX_IMPL_VIA_D3D11;
+  if (sw) initpar.Implementation = MFX_IMPL_SOFTWARE;
   mfxStatus sts = m_session.InitEx(initpar);
-  if (sts != MFX_ERR_NONE) {
+  if (sts != MFX_ERR_NONE && !sw) {
     initpar.Implementation = MFX_IMPL_SOFTWARE;
     sts = m_session.InitEx(initpar);
   }
@@ -42,6 +46,9 @@ CVRmfxFramework::CVRmfxFramework(bool hw) {
               ver.Minor);
   m_bSystemMemory = false;
   m_bInputLocked = false;
+  m_bRefreshPending = false;
+  m_unInputFull = 0;
+  m_unOutputStarved = 0;
 }
 
 CVRmfxFramework::~CVRmfxFramework() { m_InputSurfaces.clear(); }
@@ -85,11 +92,65 @@ void CVRmfxFramework::Allocate(const vrpar::config &par,
       CheckStatus(sts, "- Alloc::Lock", __FILE__, __LINE__);
     }
   }
+  allocateOutput(resp.NumFrameActual);
+}
+
+void CVRmfxFramework::Allocate(const vrpar::config &par,
+                               const std::vector<mfxHDL> &external) {
+  if (par.renderer || external.empty()) {
+    CheckStatus(MFX_ERR_INVALID_VIDEO_PARAM,
+                "- External input must be non-empty system memories",
+                __FILE__, __LINE__);
+  }
+  m_Par = par;
+  std::memset(&m_Ctrl, 0, sizeof(m_Ctrl));
+  if (!m_allocator) m_allocator.reset(new CVRSysAllocator());
+  createAllocator(nullptr);
+  m_Core = std::make_unique<Core>(m_session, m_allocator.get(), par);
+  m_InputSurfaces.resize(external.size());
+  m_ExternalBuffers = external;
+  m_ExternalBinding = external;
+  mfxStatus sts;
+  for (size_t i = 0; i < m_InputSurfaces.size(); ++i) {
+    mfxFrameSurface1 &surf = m_InputSurfaces[i];
+    std::memset(&surf, 0, sizeof surf);
+    sts = m_Core->QueryInfo(&surf.Info);
+    CheckStatus(sts, "- Core::QueryInfo", __FILE__, __LINE__);
+    if (surf.Info.Width != par.in.width || surf.Info.Height != par.in.height) {
+      CheckStatus(MFX_ERR_INVALID_VIDEO_PARAM, MFX_ERR_NONE,
+                  "- External input requires 16-aligned size, got %dx%d",
+                  par.in.width, par.in.height);
+    }
+    sts = bindExternalBuffer(&surf, external[i]);
+    CheckStatus(sts, "- Bind external buffer", __FILE__, __LINE__);
+  }
+  allocateOutput(m_InputSurfaces.size());
+}
+
+void CVRmfxFramework::allocateOutput(size_t depth) {
   m_unIIterator = 0;
   m_unOIterator = 0;
-  m_BsBufSize = par.outputSizeMax;
-  m_Pool = std::make_unique<SimplePool>(resp.NumFrameActual * m_BsBufSize +
-                                        m_BsBufSize);
+  m_unInputFull = 0;
+  m_unOutputStarved = 0;
+  m_BsBufSize = m_Par.outputSizeMax;
+  m_Pool = std::make_unique<SimplePool>(depth * m_BsBufSize + m_BsBufSize);
+  m_OutputRefs.clear();
+  m_OutputRefs.reserve(depth + 1);
+  m_Payloads.resize(depth);
+  for (auto &p : m_Payloads) {
+    p.data.resize(m_Par.payloadSizeMax);
+    p.payload.resize(kMaxPayloads);
+    p.list.reserve(kMaxPayloads);
+    p.used = 0;
+    std::memset(&p.timecode, 0, sizeof p.timecode);
+    std::memset(&p.refresh, 0, sizeof p.refresh);
+    std::memset(&p.refList, 0, sizeof p.refList);
+    std::memset(&p.roi, 0, sizeof p.roi);
+    std::memset(&p.dirty, 0, sizeof p.dirty);
+    p.skip = 0;
+    p.ext.reserve(5);
+    p.frameType = MFX_FRAMETYPE_UNKNOWN;
+  }
 }
 
 mfxEncodeStat CVRmfxFramework::GetEncodeStatus() {
@@ -104,8 +165,15 @@ mfxHDL CVRmfxFramework::dequeueInputBuffer() {
   if (m_unIIterator < m_unOIterator)
     CheckStatus(MFX_ERR_UNKNOWN, "- IO status error", __FILE__, __LINE__);
   // full
-  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return nullptr;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) {
+    m_unInputFull++;
+    return nullptr;
+  }
   if (m_bInputLocked) return nullptr;
+  if (!m_ExternalBinding.empty()) {
+    m_bInputLocked = true;
+    return m_ExternalBinding[m_unIIterator % m_ExternalBinding.size()];
+  }
   mfxHDLPair texpair;
   mfxStatus sts = m_allocator->GetHDL(
       m_allocator->pthis,
@@ -133,11 +201,187 @@ bool CVRmfxFramework::QueueInputBuffer() {
   // full
   if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return false;
   if (!m_bInputLocked) return false;
+  if (m_bRefreshPending.exchange(false)) attachIntraRefresh(m_unIIterator);
+  m_InputSurfaces[m_unIIterator % m_InputSurfaces.size()].Data.FrameOrder =
+      m_unIIterator;
   m_unIIterator++;
   m_bInputLocked = false;
   return true;
 }
 
+bool CVRmfxFramework::QueueInputBuffer(mfxHDL external) {
+  if (m_ExternalBuffers.empty() || !external) return QueueInputBuffer();
+  if (std::find(m_ExternalBuffers.begin(), m_ExternalBuffers.end(),
+                external) == m_ExternalBuffers.end()) {
+    CheckStatus(MFX_ERR_INVALID_HANDLE, "- Unregistered external buffer",
+                __FILE__, __LINE__);
+  }
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return false;
+  auto slot = m_unIIterator % m_InputSurfaces.size();
+  if (m_ExternalBinding[slot] != external) {
+    mfxStatus sts = bindExternalBuffer(&m_InputSurfaces[slot], external);
+    CheckStatus(sts, "- Bind external buffer", __FILE__, __LINE__);
+    m_ExternalBinding[slot] = external;
+  }
+  // the buffer is queued directly, dequeueInputBuffer is optional
+  m_bInputLocked = true;
+  return QueueInputBuffer();
+}
+
+mfxU8 *CVRmfxFramework::AttachPayload(mfxU16 type, mfxU32 size) {
+  if (m_Payloads.empty()) return nullptr;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return nullptr;
+  FramePayload &fp = m_Payloads[m_unIIterator % m_Payloads.size()];
+  // payload_type and payload_size are coded as 0xFF...xx
+  const mfxU32 header = type / 255 + 1 + size / 255 + 1;
+  if (fp.list.size() >= kMaxPayloads ||
+      fp.used + header + size > fp.data.size()) {
+    return nullptr;
+  }
+  mfxU8 *head = fp.data.data() + fp.used;
+  mfxU8 *p = head;
+  for (mfxU32 t = type; ; t -= 255) {
+    *p++ = static_cast<mfxU8>(t >= 255 ? 255 : t);
+    if (t < 255) break;
+  }
+  for (mfxU32 t = size; ; t -= 255) {
+    *p++ = static_cast<mfxU8>(t >= 255 ? 255 : t);
+    if (t < 255) break;
+  }
+  mfxPayload &pl = fp.payload[fp.list.size()];
+  std::memset(&pl, 0, sizeof pl);
+  pl.Type = type;
+  pl.Data = head;
+  pl.BufSize = static_cast<mfxU16>(header + size);
+  pl.NumBit = pl.BufSize * 8;
+  fp.list.push_back(&pl);
+  fp.used += header + size;
+  return p;
+}
+
+bool CVRmfxFramework::AttachTimeCode(const mfxExtTimeCode &tc) {
+  if (m_Payloads.empty() || !m_Par.timeCode) return false;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return false;
+  FramePayload &fp = m_Payloads[m_unIIterator % m_Payloads.size()];
+  fp.timecode = tc;
+  fp.timecode.Header.BufferId = MFX_EXTBUFF_TIME_CODE;
+  fp.timecode.Header.BufferSz = sizeof(fp.timecode);
+  auto ext = reinterpret_cast<mfxExtBuffer *>(&fp.timecode);
+  if (std::find(fp.ext.begin(), fp.ext.end(), ext) == fp.ext.end()) {
+    fp.ext.push_back(ext);
+  }
+  return true;
+}
+
+bool CVRmfxFramework::AttachReferenceList(const mfxExtAVCRefListCtrl &list,
+                                          mfxU16 frameType) {
+  if (m_Payloads.empty() || m_Par.codec == MFX_CODEC_JPEG) return false;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return false;
+  FramePayload &fp = m_Payloads[m_unIIterator % m_Payloads.size()];
+  fp.refList = list;
+  fp.refList.Header.BufferId = MFX_EXTBUFF_AVC_REFLIST_CTRL;
+  fp.refList.Header.BufferSz = sizeof(fp.refList);
+  auto ext = reinterpret_cast<mfxExtBuffer *>(&fp.refList);
+  if (std::find(fp.ext.begin(), fp.ext.end(), ext) == fp.ext.end()) {
+    fp.ext.push_back(ext);
+  }
+  if (frameType != MFX_FRAMETYPE_UNKNOWN) fp.frameType = frameType;
+  return true;
+}
+
+mfxExtEncoderROI *CVRmfxFramework::AttachRegions() {
+  if (m_Payloads.empty() || m_Par.codec == MFX_CODEC_JPEG) return nullptr;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return nullptr;
+  FramePayload &fp = m_Payloads[m_unIIterator % m_Payloads.size()];
+  std::memset(&fp.roi, 0, sizeof fp.roi);
+  fp.roi.Header.BufferId = MFX_EXTBUFF_ENCODER_ROI;
+  fp.roi.Header.BufferSz = sizeof(fp.roi);
+  fp.roi.ROIMode = MFX_ROI_MODE_QP_DELTA;
+  auto ext = reinterpret_cast<mfxExtBuffer *>(&fp.roi);
+  if (std::find(fp.ext.begin(), fp.ext.end(), ext) == fp.ext.end()) {
+    fp.ext.push_back(ext);
+  }
+  return &fp.roi;
+}
+
+mfxExtDirtyRect *CVRmfxFramework::AttachDirtyRects() {
+  if (m_Payloads.empty() || m_Par.codec == MFX_CODEC_JPEG) return nullptr;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return nullptr;
+  FramePayload &fp = m_Payloads[m_unIIterator % m_Payloads.size()];
+  std::memset(&fp.dirty, 0, sizeof fp.dirty);
+  fp.dirty.Header.BufferId = MFX_EXTBUFF_DIRTY_RECTANGLES;
+  fp.dirty.Header.BufferSz = sizeof(fp.dirty);
+  auto ext = reinterpret_cast<mfxExtBuffer *>(&fp.dirty);
+  if (std::find(fp.ext.begin(), fp.ext.end(), ext) == fp.ext.end()) {
+    fp.ext.push_back(ext);
+  }
+  return &fp.dirty;
+}
+
+bool CVRmfxFramework::SkipFrame(bool skip) {
+  if (m_Payloads.empty() || !m_Par.skipFrame) return false;
+  if (m_unIIterator - m_unOIterator >= m_InputSurfaces.size()) return false;
+  m_Payloads[m_unIIterator % m_Payloads.size()].skip = skip ? 1 : 0;
+  return true;
+}
+
+bool CVRmfxFramework::SetJpegQuality(mfxU16 quality) {
+  if (m_Par.codec != MFX_CODEC_JPEG || m_bInputLocked) return false;
+  if (m_unIIterator != m_unOIterator) return false;
+  if (m_Core->ResetQuality(quality) < MFX_ERR_NONE) return false;
+  m_Par.jpegQuality = quality;
+  return true;
+}
+
+bool CVRmfxFramework::DiscardInputBuffer() {
+  if (!m_bInputLocked) return false;
+  m_bInputLocked = false;
+  return true;
+}
+
+bool CVRmfxFramework::RequestIntraRefresh() {
+  if (m_Payloads.empty() || m_Par.codec == MFX_CODEC_JPEG) return false;
+  m_bRefreshPending = true;
+  return true;
+}
+
+void CVRmfxFramework::attachIntraRefresh(mfxU32 index) {
+  FramePayload &fp = m_Payloads[index % m_Payloads.size()];
+  if (!m_Par.intraRefresh) {
+    fp.frameType = MFX_FRAMETYPE_I | MFX_FRAMETYPE_REF | MFX_FRAMETYPE_IDR;
+    return;
+  }
+  // a new refresh type at runtime restarts the cycle
+  std::memset(&fp.refresh, 0, sizeof fp.refresh);
+  fp.refresh.Header.BufferId = MFX_EXTBUFF_CODING_OPTION2;
+  fp.refresh.Header.BufferSz = sizeof(fp.refresh);
+  fp.refresh.IntRefType = MFX_REFRESH_VERTICAL;
+  fp.refresh.IntRefCycleSize = m_Par.intraRefreshCycle;
+  fp.refresh.IntRefQPDelta = m_Par.intraRefreshQpDelta;
+  fp.ext.push_back(reinterpret_cast<mfxExtBuffer *>(&fp.refresh));
+}
+
+void CVRmfxFramework::bindPayload(mfxU32 index) {
+  if (m_Payloads.empty()) return;
+  FramePayload &fp = m_Payloads[index % m_Payloads.size()];
+  m_Ctrl.NumPayload = static_cast<mfxU16>(fp.list.size());
+  m_Ctrl.Payload = fp.list.empty() ? nullptr : fp.list.data();
+  m_Ctrl.NumExtParam = static_cast<mfxU16>(fp.ext.size());
+  m_Ctrl.ExtParam = fp.ext.empty() ? nullptr : fp.ext.data();
+  m_Ctrl.FrameType = fp.frameType;
+  m_Ctrl.SkipFrame = fp.skip;
+}
+
+void CVRmfxFramework::releasePayload(mfxU32 index) {
+  if (m_Payloads.empty()) return;
+  FramePayload &fp = m_Payloads[index % m_Payloads.size()];
+  fp.list.clear();
+  fp.used = 0;
+  fp.ext.clear();
+  fp.frameType = MFX_FRAMETYPE_UNKNOWN;
+  fp.skip = 0;
+}
+
 bool CVRmfxFramework::Run() {
   if (m_unOIterator > m_unIIterator)
     CheckStatus(MFX_ERR_UNKNOWN, "- IO status error", __FILE__, __LINE__);
@@ -149,7 +393,12 @@ bool CVRmfxFramework::Run() {
   std::memset(&m_Output, 0, sizeof m_Output);
   m_Output.Data = m_Pool->Alloc<mfxU8 *>(m_BsBufSize);
   m_Output.MaxLength = m_BsBufSize;
-  if (m_Output.Data == nullptr) return false;
+  if (m_Output.Data == nullptr) {
+    // the frame stays queued till an output is released
+    m_unOutputStarved++;
+    return false;
+  }
+  bindPayload(m_unOIterator);
   // core run
   mfxStatus sts = m_Core->RunEnc(in, &m_Output, &m_Ctrl);
   return sts == MFX_ERR_NONE;
@@ -161,7 +410,20 @@ int CVRmfxFramework::DequeueOutputBuffer(mfxU8 **pointer, mfxU32 *size) {
   *size = m_Output.DataLength;
   m_Output.DataOffset += m_Output.DataLength;
   m_Output.DataLength = 0;
+  if (sts == MFX_ERR_NONE || sts == MFX_PARTIAL_OUTPUT) {
+    std::lock_guard<std::mutex> lock(m_OutputLock);
+    auto ref = std::find_if(
+        m_OutputRefs.begin(), m_OutputRefs.end(),
+        [&](const OutputRef &r) { return r.head == m_Output.Data; });
+    if (ref == m_OutputRefs.end()) {
+      m_OutputRefs.push_back(OutputRef{m_Output.Data, 0, false});
+      ref = m_OutputRefs.end() - 1;
+    }
+    ref->parts++;
+    ref->complete = sts == MFX_ERR_NONE;
+  }
   if (sts == MFX_ERR_NONE) {
+    releasePayload(m_unOIterator);
     m_unOIterator++;
     if (m_Par.rateControl > MFX_RATECONTROL_USERDEFINED) {
       mfxF32 fMax = m_Par.targetKbps * 128.0f / m_Par.fps;
@@ -183,10 +445,15 @@ mfxBitstream CVRmfxFramework::DequeueOutputBuffer() {
   mfxBitstream out{};
   out.Data = m_Pool->Alloc<mfxU8 *>(m_BsBufSize);
   out.MaxLength = m_BsBufSize;
-  if (out.Data == nullptr) return out;
+  if (out.Data == nullptr) {
+    m_unOutputStarved++;
+    return out;
+  }
+  bindPayload(m_unOIterator);
   // core run
   m_Core->RunEnc(in, &out, &m_Ctrl);
   m_Core->MemorySync(UINT_MAX);
+  releasePayload(m_unOIterator);
   m_unOIterator++;
   if (m_Par.rateControl > MFX_RATECONTROL_USERDEFINED) {
     mfxF32 fMax = m_Par.targetKbps * 128.0f / m_Par.fps;
@@ -197,7 +464,61 @@ mfxBitstream CVRmfxFramework::DequeueOutputBuffer() {
 }
 
 void CVRmfxFramework::ReleaseOutputBuffer(const mfxBitstream &buf) {
-  m_Pool->Dealloc(buf.Data);
+  mfxU8 *head = buf.Data;
+  {
+    std::lock_guard<std::mutex> lock(m_OutputLock);
+    // a part points into the buffer of its frame
+    auto ref = std::find_if(m_OutputRefs.begin(), m_OutputRefs.end(),
+                            [&](const OutputRef &r) {
+                              return buf.Data >= r.head &&
+                                     buf.Data < r.head + m_BsBufSize;
+                            });
+    if (ref != m_OutputRefs.end()) {
+      if (ref->parts) ref->parts--;
+      if (ref->parts || !ref->complete) return;
+      head = ref->head;
+      m_OutputRefs.erase(ref);
+    }
+  }
+  m_Pool->Dealloc(head);
+}
+
+mfxStatus CVRmfxFramework::bindExternalBuffer(mfxFrameSurface1 *surf,
+                                              mfxHDL buf) {
+  if (!surf || !buf) return MFX_ERR_NULL_PTR;
+  mfxFrameData &data = surf->Data;
+  const mfxU16 w = m_Par.in.width;
+  const mfxU16 h = m_Par.in.height;
+  data.MemId = nullptr;
+  data.B = data.Y = static_cast<mfxU8 *>(buf);
+  switch (m_Par.in.color_format) {
+    case MFX_FOURCC_NV12:
+      data.U = data.Y + w * h;
+      data.V = data.U + 1;
+      data.Pitch = w;
+      break;
+    case MFX_FOURCC_RGB4:
+      data.G = data.B + 1;
+      data.R = data.B + 2;
+      data.A = data.B + 3;
+      data.Pitch = 4 * w;
+      break;
+    case MFX_FOURCC_P010:
+      data.U = data.Y + w * h * 2;
+      data.V = data.U + 2;
+      data.Pitch = 2 * w;
+      break;
+    case MFX_FOURCC_Y410:
+      data.Y410 = static_cast<mfxY410 *>(buf);
+      data.Y = nullptr;
+      data.V = nullptr;
+      data.A = nullptr;
+      data.Pitch = 4 * w;
+      break;
+    default:
+      return MFX_ERR_UNSUPPORTED;
+  }
+  return MFX_ERR_NONE;
 }
 
 void CVRmfxFramework::createAllocator(mfxHDL hdl) {
@@ -14,6 +14,7 @@ Updated Vpp. 2017.3.30
 #define LL_CODEC_MFXVR_ENCODER_DETAIL_MFX_FRAMEWORK_ENC_H_
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "ll_codec/impl/msdk/encoder/enc_core.h"
 #include "ll_codec/impl/msdk/utility/mfx_base.h"
@@ -25,12 +26,28 @@ namespace enc {
 
 class CVRmfxFramework : public CVRmfxSession {
  public:
-  explicit CVRmfxFramework(bool hw = true);
+  /**
+   * \param hw use D3D11 for hardware implementation
+   * \param sw use the software implementation only
+   */
+  explicit CVRmfxFramework(bool hw = true, bool sw = false);
 
   virtual ~CVRmfxFramework();
 
   void Allocate(const vrpar::config &par, mfxFrameAllocResponse &resp);
 
+  /**
+   * Use caller-owned system memories as input surfaces, no internal input
+   * frame is allocated and no pixel is copied.
+   * Each buffer must hold a tightly packed frame of par.in (NV12 or RGB4),
+   * whose width and height are multiple of 16, and must keep alive until
+   * the encoder is destroyed.
+   *
+   * \param [in] par: encoder parameters, par.renderer must be null.
+   * \param [in] external: the registered buffers.
+   */
+  void Allocate(const vrpar::config &par, const std::vector<mfxHDL> &external);
+
   mfxEncodeStat GetEncodeStatus();
 
   template <class FrameType>
@@ -40,8 +57,94 @@ class CVRmfxFramework : public CVRmfxSession {
 
   bool QueueInputBuffer();
 
+  /**
+   * Queue a registered external buffer as the next input surface.
+   * The buffer can't be written until its output is dequeued.
+   */
+  bool QueueInputBuffer(mfxHDL external);
+
+  /**
+   * Reserve a SEI message in the next queued frame. The message is written
+   * into the bitstream by the encoder, no re-muxing is needed.
+   *
+   * \param [in] type: SEI payload type, i.e. 5 for user_data_unregistered.
+   * \param [in] size: payload size in bytes.
+   * \return pointer to the payload body to be filled by caller, or null if
+   *         vrpar::config::payloadSizeMax is exceeded.
+   */
+  mfxU8 *AttachPayload(mfxU16 type, mfxU32 size);
+
+  /**
+   * Set the time code of the next queued frame, which is written in
+   * pic_timing SEI. Requires vrpar::config::timeCode.
+   */
+  bool AttachTimeCode(const mfxExtTimeCode &tc);
+
+  /**
+   * Restart the intra refresh cycle from the next queued frame, or encode
+   * the next queued frame as IDR if vrpar::config::intraRefresh is off.
+   * It's safe to call from any thread.
+   */
+  bool RequestIntraRefresh();
+
+  /**
+   * Set the reference list of the next queued frame, whose FrameOrder is
+   * the number of frames queued before it.
+   *
+   * \param [in] list: preferred, rejected and long-term references.
+   * \param [in] frameType: forced frame type, or MFX_FRAMETYPE_UNKNOWN.
+   */
+  bool AttachReferenceList(const mfxExtAVCRefListCtrl &list,
+                           mfxU16 frameType);
+
+  /**
+   * Get the ROI of the next queued frame to fill in, in QP delta mode.
+   * It replaces the ROI set by vrpar::config::numRoi for this frame.
+   *
+   * \return null if ROI isn't supported or no input slot is free.
+   */
+  mfxExtEncoderROI *AttachRegions();
+
+  /**
+   * Get the dirty rectangles of the next queued frame to fill in.
+   *
+   * \return null if no input slot is free.
+   */
+  mfxExtDirtyRect *AttachDirtyRects();
+
+  /**
+   * Encode the next queued frame as skipped or not, requires
+   * vrpar::config::skipFrame.
+   */
+  bool SkipFrame(bool skip = true);
+
+  /**
+   * Reset the JPEG encoder to another quality, no frame may be in flight.
+   *
+   * \return false if it isn't JPEG, or frames are in flight.
+   */
+  bool SetJpegQuality(mfxU16 quality);
+
+  /**
+   * Give back the input buffer of DequeueInputBuffer without encoding it.
+   * Attachments of the frame are kept for the next queued one.
+   */
+  bool DiscardInputBuffer();
+
+  /**
+   * Start the next queued frame.
+   *
+   * \return false if no frame is queued, or no output buffer is free as
+   *         the outputs aren't released, @see OutputStarvedCount.
+   */
   bool Run();
 
+  /**
+   * Sync the frame started by Run() and get its bitstream.
+   * With vrpar::config::slice, returns MFX_PARTIAL_OUTPUT for each part
+   * of the frame ready so far, and MFX_ERR_NONE for the last part. Every
+   * part must be released by ReleaseOutputBuffer.
+   */
   int DequeueOutputBuffer(mfxU8 **pointer, mfxU32 *size);
 
   mfxBitstream DequeueOutputBuffer();
@@ -58,17 +161,54 @@ class CVRmfxFramework : public CVRmfxSession {
     m_Par.targetKbps = throughput;
   }
 
+  // DequeueInputBuffer calls failed as all input surfaces are queued
+  mfxU32 InputFullCount() const { return m_unInputFull; }
+
+  // frames not started as the output pool is taken by unreleased buffers
+  mfxU32 OutputStarvedCount() const { return m_unOutputStarved; }
+
  private:  // param
   std::unique_ptr<Core> m_Core;
   std::unique_ptr<SimplePool> m_Pool;
   std::atomic_bool m_bInputLocked;
+  std::atomic_bool m_bRefreshPending;
   // frame surfaces for VPP input
   // may have multiple inputs
   std::vector<mfxFrameSurface1> m_InputSurfaces;
   // I/O index
   mfxU32 m_unIIterator;
   mfxU32 m_unOIterator;
+  // backpressure counters, read from any thread
+  std::atomic<mfxU32> m_unInputFull;
+  std::atomic<mfxU32> m_unOutputStarved;
   bool m_bSystemMemory;
+  // registered external buffers, and the one bound to each input surface
+  std::vector<mfxHDL> m_ExternalBuffers;
+  std::vector<mfxHDL> m_ExternalBinding;
+  // SEI payloads carried along with each input surface
+  struct FramePayload {
+    std::vector<mfxU8> data;
+    std::vector<mfxPayload> payload;
+    std::vector<mfxPayload *> list;
+    mfxU32 used;
+    mfxExtTimeCode timecode;
+    mfxExtCodingOption2 refresh;
+    mfxExtAVCRefListCtrl refList;
+    mfxExtEncoderROI roi;
+    mfxExtDirtyRect dirty;
+    mfxU16 skip;
+    std::vector<mfxExtBuffer *> ext;
+    mfxU16 frameType;
+  };
+  std::vector<FramePayload> m_Payloads;
+  // bitstream buffers dequeued in parts, freed after all parts are released
+  struct OutputRef {
+    mfxU8 *head;
+    mfxU32 parts;
+    bool complete;
+  };
+  std::vector<OutputRef> m_OutputRefs;
+  std::mutex m_OutputLock;
   vrpar::config m_Par;
   mfxEncodeCtrl m_Ctrl;
   mfxBitstream m_Output;
@@ -79,6 +219,16 @@ class CVRmfxFramework : public CVRmfxSession {
 
   mfxHDL dequeueInputBuffer();
 
+  mfxStatus bindExternalBuffer(mfxFrameSurface1 *surf, mfxHDL buf);
+
+  void allocateOutput(size_t depth);
+
+  void bindPayload(mfxU32 index);
+
+  void releasePayload(mfxU32 index);
+
+  void attachIntraRefresh(mfxU32 index);
+
   mfxU16 adjustQuality(const mfxU16 &unLastQp, const mfxU32 &unLen,
                        const mfxU32 &unMaxLen);
 };
@@ -0,0 +1,89 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Cache of the libraries and plugins found by MFXInitEx
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#pragma once
+
+#include "mfx_dispatcher.h"
+#include "mfx_plugin_hive.h"
+
+namespace MFX
+{
+
+// the library selected by MFXInitEx for a pair of implementation and version
+struct DiscoveryEntry
+{
+    // mfxInitParam::Implementation and Version of MFXInitEx
+    mfxIMPL implementation;
+    mfxVersion requiredVersion;
+
+    msdk_disp_char dllName[MFX_MAX_DLL_PATH];
+    eMfxImplType implType;
+    mfxIMPL impl;
+    mfxIMPL implInterface;
+    int storageID;
+    msdk_disp_char subkeyName[MFX_MAX_REGISTRY_KEY_NAME];
+    // version of the library when its plugins were scanned
+    mfxVersion actualApiVersion;
+};
+
+struct DiscoveryRecord
+{
+    DiscoveryEntry entry;
+    MFXPluginStorage pluginHive;
+};
+
+// Libraries and plugins are discovered by scanning the registry and folders,
+// which costs more than loading the library. The result of a scan is kept
+// for the process, so that later sessions of the same parameters load the
+// library directly. If MFX_DISPATCHER_CACHE names a file, the result is also
+// kept in that file for later processes.
+//
+// An entry is dropped if its library fails to load or reports another API
+// version, and MFXInitEx scans again. Callers hold the dispatcher guard.
+class MFXDiscoveryCache
+{
+public:
+    static MFXDiscoveryCache & Instance();
+
+    // return NULL if the parameters haven't been scanned
+    const DiscoveryRecord * Find(mfxIMPL implementation, mfxVersion version);
+
+    void Store(const mfxInitParam &par, const msdk_disp_char *dllName,
+               const MFX_DISP_HANDLE &handle, mfxVersion actualApiVersion);
+
+    void Remove(mfxIMPL implementation, mfxVersion version);
+
+    // drop the records and load MFX_DISPATCHER_CACHE again, as a new
+    // process does
+    void Reload();
+
+    // counters of Find and the time spent in scans and cached loads
+    struct Statistics
+    {
+        mfxU32 hits;
+        mfxU32 misses;
+        double scanSeconds;
+        double cachedSeconds;
+    };
+    Statistics & GetStatistics() { return m_stat; }
+
+private:
+    MFXDiscoveryCache();
+
+    void Load();
+    void Save();
+
+    MFXVector<DiscoveryRecord> m_records;
+    Statistics m_stat;
+
+    // unimplemented by intent to make this class non-copyable
+    MFXDiscoveryCache(const MFXDiscoveryCache &);
+    void operator=(const MFXDiscoveryCache &);
+};
+
+} // namespace MFX
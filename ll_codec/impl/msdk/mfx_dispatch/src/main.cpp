@@ -39,6 +39,9 @@ File Name: main.cpp
 #include <stdlib.h> /* for qsort on Linux */
 #include "mfx_load_plugin.h"
 #include "mfx_plugin_hive.h"
+#include "mfx_discovery_cache.h"
+
+#include <chrono>
 
 // module-local definitions
 namespace
@@ -93,6 +96,11 @@ namespace
 
     MFX::mfxCriticalSection dispGuard = 0;
 
+    double SecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
 } // namespace
 
 using namespace MFX;
@@ -105,6 +113,51 @@ using namespace MFX;
 typedef MFXVector<MFX_DISP_HANDLE*> HandleVector;
 typedef MFXVector<mfxStatus>        StatusVector;
 
+// path of a loaded candidate, to cache the selected one after sorting
+struct LoadedDLL
+{
+    MFX_DISP_HANDLE *handle;
+    msdk_disp_char path[MFX_MAX_DLL_PATH];
+};
+typedef MFXVector<LoadedDLL> LoadedDLLVector;
+
+static void PushLoadedDLL(LoadedDLLVector &loaded, MFX_DISP_HANDLE *pHandle, const msdk_disp_char *dllName)
+{
+    LoadedDLL dll;
+    dll.handle = pHandle;
+    msdk_disp_char_cpy_s(dll.path, sizeof(dll.path) / sizeof(dll.path[0]), dllName);
+    loaded.push_back(dll);
+}
+
+// Load the library found by a former scan of the same parameters
+static bool LoadCachedDLL(mfxInitParam &par, MFX_DISP_HANDLE *pHandle)
+{
+    MFX::MFXDiscoveryCache &cache = MFX::MFXDiscoveryCache::Instance();
+    const MFX::DiscoveryRecord *record = cache.Find(par.Implementation, par.Version);
+    if (!record)
+    {
+        return false;
+    }
+
+    const MFX::DiscoveryEntry &entry = record->entry;
+    DISPATCHER_LOG_INFO((("loading cached library %S\n"), MSDK2WIDE(entry.dllName)));
+    mfxStatus mfxRes = pHandle->LoadSelectedDLL(entry.dllName, entry.implType, entry.impl, entry.implInterface, par);
+    // the plugins were scanned for another version of the library
+    if (((MFX_ERR_NONE != mfxRes) && (MFX_WRN_PARTIAL_ACCELERATION != mfxRes)) ||
+        !(pHandle->actualApiVersion == entry.actualApiVersion))
+    {
+        DISPATCHER_LOG_WRN((("cached library is changed, scanning again\n")));
+        pHandle->Close();
+        cache.Remove(par.Implementation, par.Version);
+        return false;
+    }
+
+    pHandle->storageID = entry.storageID;
+    msdk_disp_char_cpy_s(pHandle->subkeyName, sizeof(pHandle->subkeyName) / sizeof(pHandle->subkeyName[0]), entry.subkeyName);
+    pHandle->pluginHive = record->pluginHive;
+    return true;
+}
+
 struct VectorHandleGuard
 {
     VectorHandleGuard(HandleVector& aVector): m_vector(aVector) {}
@@ -184,6 +237,8 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
     mfxStatus mfxRes;
     HandleVector allocatedHandle;
     VectorHandleGuard handleGuard(allocatedHandle);
+    LoadedDLLVector loadedDLL;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
     MFX_DISP_HANDLE *pHandle;
     msdk_disp_char dllName[MFX_MAX_DLL_PATH];
@@ -230,6 +285,25 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
 
     DISPATCHER_LOG_INFO((("Required API version is %u.%u\n"), requiredVersion.Major, requiredVersion.Minor));
 
+    // skip the scan if the parameters were scanned by this process or a
+    // former one
+    try
+    {
+        if (LoadCachedDLL(par, pHandle))
+        {
+            MFX::MFXDiscoveryCache::Statistics &stat = MFX::MFXDiscoveryCache::Instance().GetStatistics();
+            stat.cachedSeconds += SecondsSince(startTime);
+            DISPATCHER_LOG_INFO((("cached loads: %u in %.3f s, scans: %u in %.3f s\n"),
+                stat.hits, stat.cachedSeconds, stat.misses, stat.scanSeconds));
+            *((MFX_DISP_HANDLE **) session) = pHandle;
+            return pHandle->loadStatus;
+        }
+    }
+    catch(...)
+    {
+        DISPATCHER_LOG_ERROR((("unknown exception while loading cached library\n")))
+    }
+
     // Load HW library or RT from system location
     curImplIdx = implTypesRange[implMethod].minIndex;
     maxImplIdx = implTypesRange[implMethod].maxIndex;
@@ -288,6 +362,7 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
                         libIterator.GetSubKeyName(pHandle->subkeyName, sizeof(pHandle->subkeyName)/sizeof(pHandle->subkeyName[0])) ;
                         pHandle->storageID = libIterator.GetStorageID();
                         allocatedHandle.push_back(pHandle);
+                        PushLoadedDLL(loadedDLL, pHandle, dllName);
                         pHandle = new MFX_DISP_HANDLE(requiredVersion);
                     }
 
@@ -359,6 +434,7 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
                     }
                     pHandle->storageID = MFX::MFX_UNKNOWN_KEY;
                     allocatedHandle.push_back(pHandle);
+                    PushLoadedDLL(loadedDLL, pHandle, dllName);
                     pHandle = new MFX_DISP_HANDLE(requiredVersion);
                 }
 
@@ -423,6 +499,7 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
                 {                    
                     pHandle->storageID = MFX::MFX_UNKNOWN_KEY;
                     allocatedHandle.push_back(pHandle);
+                    PushLoadedDLL(loadedDLL, pHandle, dllName);
                     pHandle = new MFX_DISP_HANDLE(requiredVersion);
                 }
         }
@@ -490,6 +567,20 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session)
 
             MFX::MFXPluginsInFS plgsInFS(apiVerActual);
             hive.insert(hive.end(), plgsInFS.begin(), plgsInFS.end());
+
+            // cache the selected library and its plugins
+            LoadedDLLVector::iterator dll = loadedDLL.begin(),
+                                      dllEnd = loadedDLL.end();
+            for (; dll != dllEnd; ++dll)
+            {
+                if (dll->handle == pHandle)
+                {
+                    MFX::MFXDiscoveryCache &cache = MFX::MFXDiscoveryCache::Instance();
+                    cache.Store(par, dll->path, *pHandle, apiVerActual);
+                    cache.GetStatistics().scanSeconds += SecondsSince(startTime);
+                    break;
+                }
+            }
         }
     }
     catch(...)
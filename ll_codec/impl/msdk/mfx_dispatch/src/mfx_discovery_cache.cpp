@@ -0,0 +1,219 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Cache of the libraries and plugins found by MFXInitEx
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include "mfx_discovery_cache.h"
+#include "mfx_dispatcher_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    // "MFXD" and the layout version of the cache file
+    const mfxU32 cacheMagic = 0x4458464D;
+    const mfxU32 cacheVersion = 1;
+
+    struct CacheHeader
+    {
+        mfxU32 magic;
+        mfxU32 version;
+        // the file is discarded if it was saved by another build
+        mfxU32 entrySize;
+        mfxU32 pluginSize;
+        mfxU32 count;
+    };
+
+    FILE * OpenCacheFile(bool write)
+    {
+        FILE *file = NULL;
+#if defined(_WIN32) || defined(_WIN64)
+        const wchar_t *path = _wgetenv(L"MFX_DISPATCHER_CACHE");
+        if (path && *path)
+        {
+            _wfopen_s(&file, path, write ? L"wb" : L"rb");
+        }
+#else
+        const char *path = getenv("MFX_DISPATCHER_CACHE");
+        if (path && *path)
+        {
+            file = fopen(path, write ? "wb" : "rb");
+        }
+#endif
+        return file;
+    }
+
+    bool SameKey(const MFX::DiscoveryEntry &entry, mfxIMPL implementation, mfxVersion version)
+    {
+        return entry.implementation == implementation &&
+               entry.requiredVersion.Version == version.Version;
+    }
+
+} // namespace
+
+namespace MFX
+{
+
+MFXDiscoveryCache & MFXDiscoveryCache::Instance()
+{
+    // created under the dispatcher guard
+    static MFXDiscoveryCache cache;
+    return cache;
+}
+
+MFXDiscoveryCache::MFXDiscoveryCache()
+{
+    memset(&m_stat, 0, sizeof(m_stat));
+    Load();
+}
+
+const DiscoveryRecord * MFXDiscoveryCache::Find(mfxIMPL implementation, mfxVersion version)
+{
+    MFXVector<DiscoveryRecord>::iterator it = m_records.begin(),
+                                         et = m_records.end();
+    for (; it != et; ++it)
+    {
+        if (SameKey(it->entry, implementation, version))
+        {
+            m_stat.hits++;
+            return &(*it);
+        }
+    }
+    m_stat.misses++;
+    return NULL;
+}
+
+void MFXDiscoveryCache::Store(const mfxInitParam &par, const msdk_disp_char *dllName,
+                              const MFX_DISP_HANDLE &handle, mfxVersion actualApiVersion)
+{
+    DiscoveryRecord record;
+
+    memset(&record.entry, 0, sizeof(record.entry));
+    record.entry.implementation = par.Implementation;
+    record.entry.requiredVersion = par.Version;
+    msdk_disp_char_cpy_s(record.entry.dllName,
+        sizeof(record.entry.dllName) / sizeof(record.entry.dllName[0]), dllName);
+    record.entry.implType = handle.implType;
+    record.entry.impl = handle.impl;
+    record.entry.implInterface = handle.implInterface;
+    record.entry.storageID = handle.storageID;
+    msdk_disp_char_cpy_s(record.entry.subkeyName,
+        sizeof(record.entry.subkeyName) / sizeof(record.entry.subkeyName[0]), handle.subkeyName);
+    record.entry.actualApiVersion = actualApiVersion;
+    record.pluginHive = handle.pluginHive;
+
+    // a record replaces the one of the same parameters
+    Remove(par.Implementation, par.Version);
+    m_records.push_back(record);
+    Save();
+}
+
+void MFXDiscoveryCache::Remove(mfxIMPL implementation, mfxVersion version)
+{
+    MFXVector<DiscoveryRecord>::iterator it = m_records.begin(),
+                                         et = m_records.end();
+    for (; it != et; ++it)
+    {
+        if (SameKey(it->entry, implementation, version))
+        {
+            m_records.erase(it);
+            Save();
+            return;
+        }
+    }
+}
+
+void MFXDiscoveryCache::Reload()
+{
+    m_records.clear();
+    Load();
+}
+
+void MFXDiscoveryCache::Load()
+{
+    FILE *file = OpenCacheFile(false);
+    if (!file)
+    {
+        return;
+    }
+
+    CacheHeader header;
+    bool valid = 1 == fread(&header, sizeof(header), 1, file) &&
+                 cacheMagic == header.magic &&
+                 cacheVersion == header.version &&
+                 sizeof(DiscoveryEntry) == header.entrySize &&
+                 sizeof(PluginDescriptionRecord) == header.pluginSize;
+
+    MFXVector<DiscoveryRecord> records;
+    for (mfxU32 i = 0; valid && i < header.count; i++)
+    {
+        DiscoveryRecord record;
+        mfxU32 plugins = 0;
+        valid = 1 == fread(&record.entry, sizeof(record.entry), 1, file) &&
+                1 == fread(&plugins, sizeof(plugins), 1, file);
+        // terminate the strings of a corrupted file
+        record.entry.dllName[MFX_MAX_DLL_PATH - 1] = 0;
+        record.entry.subkeyName[MFX_MAX_REGISTRY_KEY_NAME - 1] = 0;
+        for (mfxU32 j = 0; valid && j < plugins; j++)
+        {
+            PluginDescriptionRecord plugin;
+            valid = 1 == fread(&plugin, sizeof(plugin), 1, file);
+            plugin.sPath[MAX_PLUGIN_PATH - 1] = 0;
+            plugin.sName[MAX_PLUGIN_NAME - 1] = 0;
+            record.pluginHive.push_back(plugin);
+        }
+        records.push_back(record);
+    }
+    fclose(file);
+
+    if (valid)
+    {
+        m_records = records;
+        DISPATCHER_LOG_INFO((("loaded %u cached libraries\n"), header.count))
+    }
+    else
+    {
+        DISPATCHER_LOG_WRN((("discarded the dispatcher cache\n")))
+    }
+}
+
+void MFXDiscoveryCache::Save()
+{
+    FILE *file = OpenCacheFile(true);
+    if (!file)
+    {
+        return;
+    }
+
+    CacheHeader header;
+    header.magic = cacheMagic;
+    header.version = cacheVersion;
+    header.entrySize = sizeof(DiscoveryEntry);
+    header.pluginSize = sizeof(PluginDescriptionRecord);
+    header.count = m_records.size();
+    fwrite(&header, sizeof(header), 1, file);
+
+    MFXVector<DiscoveryRecord>::iterator it = m_records.begin(),
+                                         et = m_records.end();
+    for (; it != et; ++it)
+    {
+        mfxU32 plugins = it->pluginHive.size();
+        fwrite(&it->entry, sizeof(it->entry), 1, file);
+        fwrite(&plugins, sizeof(plugins), 1, file);
+
+        MFXPluginStorage::iterator plugin = it->pluginHive.begin(),
+                                   end = it->pluginHive.end();
+        for (; plugin != end; ++plugin)
+        {
+            fwrite(&(*plugin), sizeof(*plugin), 1, file);
+        }
+    }
+    fclose(file);
+}
+
+} // namespace MFX
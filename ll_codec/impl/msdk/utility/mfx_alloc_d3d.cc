@@ -74,6 +74,8 @@ const std::map<mfxU32, DXGI_FORMAT> MFXFormat = {
     MFXFMT(MFX_FOURCC_AYUV, DXGI_FORMAT_AYUV),
     MFXFMT(MFX_FOURCC_YUY2, DXGI_FORMAT_YUY2),
     MFXFMT(MFX_FOURCC_P8, DXGI_FORMAT_P8),  // used for HEVC codec
+    MFXFMT(MFX_FOURCC_P010, DXGI_FORMAT_P010),
+    MFXFMT(MFX_FOURCC_Y410, DXGI_FORMAT_Y410),
 };
 
 constexpr uint32_t SUPPORTED_TYPE =
@@ -207,15 +209,26 @@ mfxStatus CVRDX11Allocator::LockFrame(mfxMemId mid, mfxFrameData *ptr) {
     dc.Format = DXGI_FORMAT_P8;
   }
   switch (dc.Format) {
-    case DXGI_FORMAT_NV12: {
+    case DXGI_FORMAT_NV12:
+    case DXGI_FORMAT_P010: {
       ptr->Y = static_cast<mfxU8 *>(mappeddata.pData);
       ptr->U = static_cast<mfxU8 *>(mappeddata.pData) +
                dc.Height * mappeddata.RowPitch;
-      ptr->V = ptr->U + 1;
+      // U and V of P010 are 16-bit
+      ptr->V = ptr->U + (dc.Format == DXGI_FORMAT_P010 ? 2 : 1);
       ptr->Pitch = static_cast<mfxU16>(mappeddata.RowPitch);
       ptr->PitchHigh = static_cast<mfxU16>(dc.Height);
       break;
     }
+    case DXGI_FORMAT_Y410: {
+      ptr->Pitch = static_cast<mfxU16>(mappeddata.RowPitch);
+      ptr->PitchHigh = static_cast<mfxU16>(dc.Height);
+      ptr->Y410 = static_cast<mfxY410 *>(mappeddata.pData);
+      ptr->Y = 0;
+      ptr->V = 0;
+      ptr->A = 0;
+      break;
+    }
     case DXGI_FORMAT_P8: {
       ptr->Pitch = static_cast<mfxU16>(mappeddata.RowPitch);
       ptr->PitchHigh = static_cast<mfxU16>(dc.Height);
@@ -65,6 +65,7 @@ mfxStatus CVRSysAllocator::AllocFrames(mfxFrameAllocRequest *request,
     case MFX_FOURCC_RGB4:
     case MFX_FOURCC_AYUV:
     case MFX_FOURCC_A2RGB10:  // 4B/P
+    case MFX_FOURCC_Y410:
     case MFX_FOURCC_P210:     // 16bits
       nbytes = Width2 * Height2 * 4;
       break;
@@ -169,6 +170,14 @@ mfxStatus CVRSysAllocator::LockFrame(mfxMemId mid, mfxFrameData *ptr) {
       ptr->A = ptr->Y + 3;
       ptr->Pitch = 4 * Width2;
       break;
+    case MFX_FOURCC_Y410:
+      // all channels are in one word, the other planes must be null
+      ptr->Y410 = reinterpret_cast<mfxY410 *>(ptr->B);
+      ptr->Y = nullptr;
+      ptr->V = nullptr;
+      ptr->A = nullptr;
+      ptr->Pitch = 4 * Width2;
+      break;
     default:
       return MFX_ERR_UNSUPPORTED;
   }
@@ -192,6 +201,9 @@ mfxStatus CVRSysAllocator::GetFrameHDL(mfxMemId mid, mfxHDL *handle) {
       case MFX_FOURCC_R16:
         pair->first = fr.B;
         break;
+      case MFX_FOURCC_Y410:
+        pair->first = fr.Y410;
+        break;
       default:
         pair->first = fr.Y;
         break;
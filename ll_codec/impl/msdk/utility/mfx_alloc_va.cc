@@ -16,6 +16,10 @@ using MFXFMT = std::pair<mfxU32, uint>;
 const std::map<mfxU32, uint> MFXFormat = {
     MFXFMT(MFX_FOURCC_NV12, VA_FOURCC_NV12),
     MFXFMT(MFX_FOURCC_RGB4, VA_FOURCC_RGBA),
+    MFXFMT(MFX_FOURCC_P010, VA_FOURCC_P010),
+#ifdef VA_FOURCC_Y410
+    MFXFMT(MFX_FOURCC_Y410, VA_FOURCC_Y410),
+#endif
 };
 
 CMFXAllocator::CMFXAllocator() {
@@ -99,6 +103,14 @@ mfxStatus CVRVAAllocator::AllocFrames(mfxFrameAllocRequest *request,
     case MFX_FOURCC_RGB4:
       va_rt_format = VA_RT_FORMAT_RGB32;
       break;
+    case MFX_FOURCC_P010:
+      va_rt_format = VA_RT_FORMAT_YUV420_10BPP;
+      break;
+#ifdef VA_FOURCC_Y410
+    case MFX_FOURCC_Y410:
+      va_rt_format = VA_RT_FORMAT_YUV444_10;
+      break;
+#endif
     default:
       return MFX_ERR_UNSUPPORTED;
   }
@@ -21,9 +21,11 @@ Intel MediaSDK utilities
 #include <mfxvideo++.h>
 
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include "ll_codec/impl/msdk/utility/mfx_alloc_base.h"
@@ -40,17 +42,59 @@ inline mfxU16 getChromaFormatFromFourCC(mfxU32 fourcc) {
     case MFX_FOURCC_RGB4:
     case MFX_FOURCC_AYUV:
     case MFX_FOURCC_BGR4:
+    case MFX_FOURCC_A2RGB10:
+    case MFX_FOURCC_Y410:
       return MFX_CHROMAFORMAT_YUV444;
     case MFX_FOURCC_YUY2:
       return MFX_CHROMAFORMAT_YUV422V;
+    case MFX_FOURCC_P210:
+      return MFX_CHROMAFORMAT_YUV422;
     case MFX_FOURCC_NV12:
     case MFX_FOURCC_YV12:
+    case MFX_FOURCC_P010:
       return MFX_CHROMAFORMAT_YUV420;
     default:
       return 0;
   }
 }
 
+//! Bits of a sample, 0 of 8-bit formats which leave it to default
+inline mfxU16 getBitDepthFromFourCC(mfxU32 fourcc) {
+  switch (fourcc) {
+    case MFX_FOURCC_P010:
+    case MFX_FOURCC_P210:
+    case MFX_FOURCC_Y410:
+    case MFX_FOURCC_A2RGB10:
+      return 10;
+    default:
+      return 0;
+  }
+}
+
+//! 1 if samples are in the MSBs of 16-bit words, as P010 in system memory
+inline mfxU16 getShiftFromFourCC(mfxU32 fourcc) {
+  return fourcc == MFX_FOURCC_P010 || fourcc == MFX_FOURCC_P210 ? 1 : 0;
+}
+
+//! Longest wait for a task in flight, before an async call is retried
+constexpr mfxU32 kDeviceBusyWaitMs = 100;
+
+/**
+ * @brief Wait for the device on MFX_WRN_DEVICE_BUSY, in the manner of the
+ * Media SDK samples: block until the task of sync completes rather than
+ * poll. Without a task in flight, sleep 1 ms. The sync point is cleared
+ * once done, a completed one would return at once.
+ */
+inline void WaitForDevice(mfxSession session, mfxSyncPoint *sync) {
+  if (*sync) {
+    mfxStatus sts = MFXVideoCORE_SyncOperation(session, *sync,
+                                               kDeviceBusyWaitMs);
+    if (sts != MFX_WRN_IN_EXECUTION) *sync = nullptr;
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
 enum { MFX_RATECONTROL_USERDEFINED = 100, MFX_RATECONTROL_AUTO };
 
 enum { MFX_MEMTYPE_VR_SPECIAL = 128 };
@@ -66,6 +110,14 @@ enum Rotate {
 
 enum Mirror { MIRROR_NONE = 0, MIRROR_HORIZONTAL = 1, MIRROR_VERTICAL = 2 };
 
+/* meaning of config::sliceData */
+enum SliceMode {
+  SLICE_MB = 0,     //!< number of MBs in each slice
+  SLICE_BYTE = 1,   //!< maximum size in bytes of each slice
+  SLICE_TILE = 2,   //!< number of slices (tiles for HEVC) in a frame
+  SLICE_BLOCK = 3,  //!< size in bytes of each partial output
+};
+
 /* parameters for a single surface */
 struct surface {
   mfxU32 color_format;  //!< FOURCC style colorspace. I.E. 'R' 'G' 'B' 'A'.
@@ -112,13 +164,23 @@ struct config {
   mfxU8 enableQSVFF;  //!< enable QSV to hard-encode AVC frame
   mfxI32 asyncDepth;
   mfxI32 outputSizeMax;
+  mfxU32 payloadSizeMax;  //!< bytes reserved for SEI payloads of each frame
   mfxI32 constQP[3];
   mfxU16 numRoi;         //!< number of regions in ROI.
-  mfxI16 listRoiQPI[8];  //!< enable encoder ROI feature, the value should be
-                         //!< QPI/QPP
+  mfxI16 listRoiQPI[8];  //!< enable encoder ROI feature, QP delta of each
+                         //!< region from inner to outer
   mfxU16 intraRefresh;   //!< Enable Error Recovery with intra refresh
-  mfxU16 slice;          //!< turn on slice based encode
-  mfxI32 sliceMode;
+  mfxU16 intraRefreshCycle;    //!< frames to refresh the whole picture
+  mfxU16 intraRefreshDist;     //!< frames between starts of two cycles
+  mfxI16 intraRefreshQpDelta;  //!< QP delta of the refreshed region
+  mfxU16 numLtr;               //!< number of long-term references
+  mfxU16 timeCode;       //!< For AVC encode only. Write pic_timing SEI.
+  mfxU16 skipFrame;      //!< frames can be skipped by mfxEncodeCtrl
+  mfxU16 stitchable;     //!< For AVC encode only. Keep MVs and deblocking
+                         //!< inside the picture to be stitched with others
+  mfxU16 slice;          //!< turn on slice based encode, each slice is
+                         //!< output as soon as it's ready
+  mfxI32 sliceMode;      //!< As enum #SliceMode
   mfxI32 sliceData;
   mfxHDL renderer;  //!< The native handle for render device.
                     //!< (ID3D11Device*/vaDisplay)
@@ -0,0 +1,238 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+
+Author   :    Wenyi Tang
+Email    :    wenyi.tang@intel.com
+Created  :    Oct. 19th, 2026
+Mod      :    Date      Author
+
+Flat state tables of frame surfaces, indexed by surface slots
+********************************************************************/
+#ifndef LL_CODEC_MFXVR_UTILITY_MFX_SURFACE_TABLE_H_
+#define LL_CODEC_MFXVR_UTILITY_MFX_SURFACE_TABLE_H_
+#include <mfxstructures.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mfxvr {
+/**
+ * \brief A lock-free LIFO of slot indices (Treiber stack).
+ *
+ * The head is tagged with a counter against ABA. Each slot is listed at
+ * most once, so that Push from several threads never corrupts the list.
+ */
+class SlotFreeList {
+ public:
+  static constexpr mfxU32 kNil = 0xFFFFFFFF;
+
+  /**
+   * Reset the list with all slots listed. Not thread-safe.
+   */
+  void Reset(mfxU32 count) {
+    next_.reset(new std::atomic<mfxU32>[count]);
+    listed_.reset(new std::atomic<bool>[count]);
+    for (mfxU32 i = 0; i < count; i++) {
+      next_[i] = i + 1 < count ? i + 1 : kNil;
+      listed_[i] = true;
+    }
+    head_ = count ? 0 : kNil;
+  }
+
+  bool Pop(mfxU32 *slot) {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (;;) {
+      mfxU32 index = static_cast<mfxU32>(head);
+      if (index == kNil) return false;
+      uint64_t next = (head & ~0xFFFFFFFFull) + (1ull << 32) +
+                      next_[index].load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, next, std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+        listed_[index].store(false);
+        *slot = index;
+        return true;
+      }
+    }
+  }
+
+  //! Push a slot if it isn't listed yet
+  void Push(mfxU32 slot) {
+    if (listed_[slot].exchange(true)) return;
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+      next_[slot].store(static_cast<mfxU32>(head), std::memory_order_relaxed);
+      next = (head & ~0xFFFFFFFFull) + (1ull << 32) + slot;
+    } while (!head_.compare_exchange_weak(head, next,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+  }
+
+ private:
+  std::atomic<uint64_t> head_{kNil};  // tag << 32 | slot
+  std::unique_ptr<std::atomic<mfxU32>[]> next_;
+  std::unique_ptr<std::atomic<bool>[]> listed_;
+};
+
+/**
+ * \brief State of a pool of surfaces, which are contiguous in memory.
+ *
+ * Each surface has an atomic state word and a payload T, the payload is
+ * written by the owner of the surface before the state is published. Free
+ * surfaces are kept in a lock-free list, a listed surface may be locked by
+ * MSDK or be acquired by others, which is skipped by Acquire.
+ *
+ * Acquire is called from one thread at a time, typically the one runs
+ * DecodeFrameAsync or RunFrameVPPAsync. Release is from any thread.
+ */
+template <class T>
+class SurfaceTable {
+ public:
+  enum State : mfxU32 {
+    kFree = 0,  //!< owned by MSDK or nobody
+    kInUse,     //!< owned by user until released
+  };
+
+  /**
+   * Reset the table with all surfaces free. Not thread-safe.
+   *
+   * \param base the first surface of the pool.
+   * \param count number of surfaces.
+   */
+  void Reset(mfxFrameSurface1 *base, mfxU32 count) {
+    base_ = base;
+    count_ = count;
+    state_.reset(new std::atomic<mfxU32>[count]);
+    for (mfxU32 i = 0; i < count; i++) state_[i] = kFree;
+    data_.assign(count, T());
+    held_.clear();
+    held_.reserve(count);
+    free_.Reset(count);
+  }
+
+  mfxU32 Size() const { return count_; }
+
+  //! \return slot of the surface, or -1 if it isn't in this pool
+  int Slot(const mfxFrameSurface1 *surf) const {
+    if (surf < base_ || surf >= base_ + count_) return -1;
+    return static_cast<int>(surf - base_);
+  }
+
+  mfxFrameSurface1 *Surface(int slot) const { return base_ + slot; }
+
+  // Sequentially consistent with the listed flags, so that a slot released
+  // during Acquire is either seen free or listed again.
+  mfxU32 GetState(int slot) const { return state_[slot].load(); }
+
+  void SetState(int slot, mfxU32 state) { state_[slot].store(state); }
+
+  T &Data(int slot) { return data_[slot]; }
+
+  /**
+   * Take a free surface that isn't locked by MSDK. Call Recycle after the
+   * surface is handed to MSDK, or set it in use.
+   *
+   * \return slot of the surface, or -1 if none is free.
+   */
+  int Acquire() {
+    int found = -1;
+    mfxU32 slot;
+    while (free_.Pop(&slot)) {
+      // in use slots are listed again on release
+      if (GetState(slot) != kFree) continue;
+      if (base_[slot].Data.Locked) {
+        held_.push_back(slot);
+        continue;
+      }
+      found = static_cast<int>(slot);
+      break;
+    }
+    for (auto &s : held_) free_.Push(s);
+    held_.clear();
+    return found;
+  }
+
+  //! List an acquired surface again unless it's in use
+  void Recycle(int slot) {
+    if (GetState(slot) == kFree) free_.Push(slot);
+  }
+
+  //! Return a surface in use to the free list
+  void Release(int slot) {
+    SetState(slot, kFree);
+    free_.Push(slot);
+  }
+
+ private:
+  mfxFrameSurface1 *base_ = nullptr;
+  mfxU32 count_ = 0;
+  std::unique_ptr<std::atomic<mfxU32>[]> state_;
+  std::vector<T> data_;
+  std::vector<mfxU32> held_;
+  SlotFreeList free_;
+};
+
+/**
+ * \brief Map of surface handles to values, in an open addressing table.
+ *
+ * Handles of a pool are fixed once allocated, so keys are never erased,
+ * and both Set and Get are lock-free. The value of a handle can be
+ * updated, i.e. set to null after the surface is released.
+ */
+template <class T>
+class HandleTable {
+ public:
+  /**
+   * Reset the table for at most count handles. Not thread-safe.
+   */
+  void Reset(mfxU32 count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) capacity <<= 1;
+    mask_ = capacity - 1;
+    entries_.reset(new Entry[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+      entries_[i].key = nullptr;
+      entries_[i].value = nullptr;
+    }
+  }
+
+  //! \return false if the table is full
+  bool Set(mfxHDL key, T *value) {
+    for (size_t i = hash(key), n = 0; n <= mask_; i = (i + 1) & mask_, n++) {
+      mfxHDL k = entries_[i].key.load(std::memory_order_acquire);
+      if (!k && entries_[i].key.compare_exchange_strong(k, key)) k = key;
+      if (k == key) {
+        entries_[i].value.store(value, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //! \return the value, or null if the handle is unknown
+  T *Get(mfxHDL key) const {
+    for (size_t i = hash(key), n = 0; n <= mask_; i = (i + 1) & mask_, n++) {
+      mfxHDL k = entries_[i].key.load(std::memory_order_acquire);
+      if (!k) return nullptr;
+      if (k == key) return entries_[i].value.load(std::memory_order_acquire);
+    }
+    return nullptr;
+  }
+
+ private:
+  struct Entry {
+    std::atomic<mfxHDL> key;
+    std::atomic<T *> value;
+  };
+
+  size_t hash(mfxHDL key) const {
+    uint64_t h = reinterpret_cast<uintptr_t>(key) >> 4;
+    return static_cast<size_t>(h * 0x9E3779B97F4A7C15ull >> 32) & mask_;
+  }
+
+  std::unique_ptr<Entry[]> entries_;
+  size_t mask_ = 0;
+};
+}  // namespace mfxvr
+#endif  // LL_CODEC_MFXVR_UTILITY_MFX_SURFACE_TABLE_H_
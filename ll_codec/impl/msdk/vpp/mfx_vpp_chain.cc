@@ -111,15 +111,22 @@ mfxStatus VppChain::RunVpp1(mfxFrameSurface1 *inp, mfxFrameSurface1 **outp,
   m_process_id++;
   mfxFrameSurface1 *vpp_in = inp, *vpp_out = nullptr;
   for (auto &ins : m_vpp_list) {
-    vpp_out = getFreeSurface(&ins);
-    if (!vpp_out) return MFX_ERR_MORE_SURFACE;
+    int slot = ins.table->Acquire();
+    if (slot < 0) return MFX_ERR_MORE_SURFACE;
+    vpp_out = ins.table->Surface(slot);
     mfxStatus sts = runVppInternal(&ins, vpp_in, vpp_out);
     CheckStatus(sts, "RunVppAsync", __FILE__, __LINE__);
+    ins.table->Data(slot) = ins.sync[0];
+    // outputs of the last vpp are in use until released, intermediate ones
+    // are free once MSDK unlocks them.
+    if (&ins == &m_vpp_list.back()) {
+      ins.table->SetState(slot, SurfaceTable<mfxSyncPoint>::kInUse);
+    }
+    ins.table->Recycle(slot);
     vpp_in = vpp_out;
     *outp = vpp_out;
     *sync = ins.sync[0];
   }
-  m_surface_inuse[*outp] = true;
   return MFX_ERR_NONE;
 }
 
@@ -132,16 +139,23 @@ mfxStatus VppChain::SyncVpp1(mfxSyncPoint sync, mfxU32 timeout) {
 
 mfxStatus VppChain::ReleaseSurface(mfxFrameSurface1 *used) {
   if (m_vpp_list.empty()) return MFX_ERR_NOT_INITIALIZED;
-  if (m_surface_inuse[used]) {
-    m_surface_inuse[used] = false;
-  } else {
+  auto &table = *m_vpp_list.back().table;
+  int slot = table.Slot(used);
+  if (slot < 0 ||
+      table.GetState(slot) != SurfaceTable<mfxSyncPoint>::kInUse) {
     return MFX_ERR_NOT_FOUND;
   }
+  table.Release(slot);
   return MFX_ERR_NONE;
 }
 
 mfxU32 VppChain::VppChainSize() const { return mfxU32(m_vpp_list.size()); }
 
+mfxU32 VppChain::NumOutputSurfaces() const {
+  if (m_vpp_list.empty()) return 0;
+  return mfxU32(m_vpp_list.back().surf.size());
+}
+
 mfxVideoParam VppChain::makeDefPar(const vrpar::surface &in,
                                    const vrpar::surface &out) const {
   mfxVideoParam pardefault{};
@@ -154,6 +168,9 @@ mfxVideoParam VppChain::makeDefPar(const vrpar::surface &in,
   pardefault.vpp.In.FourCC = in.color_format;
   pardefault.vpp.In.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
   pardefault.vpp.In.ChromaFormat = getChromaFormatFromFourCC(in.color_format);
+  pardefault.vpp.In.BitDepthLuma = getBitDepthFromFourCC(in.color_format);
+  pardefault.vpp.In.BitDepthChroma = getBitDepthFromFourCC(in.color_format);
+  pardefault.vpp.In.Shift = getShiftFromFourCC(in.color_format);
   pardefault.vpp.In.Width = (in.width + 15) >> 4 << 4;
   pardefault.vpp.In.Height = (in.height + 15) >> 4 << 4;
   pardefault.vpp.In.CropW = in.cropW;
@@ -166,6 +183,9 @@ mfxVideoParam VppChain::makeDefPar(const vrpar::surface &in,
   pardefault.vpp.Out.FourCC = out.color_format;
   pardefault.vpp.Out.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
   pardefault.vpp.Out.ChromaFormat = getChromaFormatFromFourCC(out.color_format);
+  pardefault.vpp.Out.BitDepthLuma = getBitDepthFromFourCC(out.color_format);
+  pardefault.vpp.Out.BitDepthChroma = getBitDepthFromFourCC(out.color_format);
+  pardefault.vpp.Out.Shift = getShiftFromFourCC(out.color_format);
   pardefault.vpp.Out.Width = (out.width + 15) >> 4 << 4;
   pardefault.vpp.Out.Height = (out.height + 15) >> 4 << 4;
   pardefault.vpp.Out.CropW = out.cropW;
@@ -223,6 +243,8 @@ void VppChain::allocFrames(const mfxFrameAllocator *alloc) {
         surf.Data.MemId = vpp.resp.mids[i++];
       }
     }
+    vpp.table = std::make_unique<SurfaceTable<mfxSyncPoint>>();
+    vpp.table->Reset(vpp.surf.data(), mfxU32(vpp.surf.size()));
   }
 }
 
@@ -241,10 +263,11 @@ mfxStatus VppChain::runVppInternal(ultravpp *ins, mfxFrameSurface1 *in,
   if (!in || !out) return MFX_ERR_NULL_PTR;
   mfxU16 outputOffset = (m_process_id - 1) % m_meta_buffer_num;
   in->Info.FrameId.ViewId = outputOffset;
+  mfxSyncPoint busy = ins->sync[0];
   for (;;) {
     sts = ins->vpp->RunFrameVPPAsync(in, out, nullptr, &ins->sync[0]);
     if (sts == MFX_WRN_DEVICE_BUSY) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      WaitForDevice(m_session, &busy);
     } else {
       break;
     }
@@ -253,14 +276,5 @@ mfxStatus VppChain::runVppInternal(ultravpp *ins, mfxFrameSurface1 *in,
   return MFX_ERR_NONE;
 }
 
-mfxFrameSurface1 *VppChain::getFreeSurface(ultravpp *ins) {
-  for (auto &surf : ins->surf) {
-    if (surf.Data.Locked == 0 && !m_surface_inuse[&surf]) {
-      return &surf;
-    }
-  }
-  return nullptr;
-}
-
 }  // namespace vpp
 }  // namespace mfxvr
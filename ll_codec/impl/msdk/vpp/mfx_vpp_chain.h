@@ -11,10 +11,10 @@ Updated Init and Run process. 2017.3.30
 ********************************************************************/
 #ifndef LL_CODEC_MFXVR_VPP_MFX_VPP_CHAIN_H_
 #define LL_CODEC_MFXVR_VPP_MFX_VPP_CHAIN_H_
-#include <map>
 #include <memory>
 #include <vector>
 #include "ll_codec/impl/msdk/utility/mfx_base.h"
+#include "ll_codec/impl/msdk/utility/mfx_surface_table.h"
 
 namespace mfxvr {
 namespace vpp {
@@ -30,6 +30,8 @@ struct ultravpp {
   std::vector<mfxSyncPoint> sync;      //!< a set of sync points
   mfxVideoParam par;                   //!< MFX VPP parameters list
   mfxFrameAllocResponse resp;  //!< responses for each allocated vpp frames
+  //! state of surf, with sync point of the last run
+  std::unique_ptr<SurfaceTable<mfxSyncPoint>> table;
 };
 
 /**
@@ -92,6 +94,11 @@ class VppChain : public noncopyable {
    */
   mfxU32 VppChainSize() const;
 
+  /**
+   * \return numbers of output surfaces of the last vpp, 0 if no vpp.
+   */
+  mfxU32 NumOutputSurfaces() const;
+
   mfxStatus QueryInfo(mfxFrameInfo *info);
 
  protected:  // func
@@ -112,8 +119,6 @@ class VppChain : public noncopyable {
   virtual mfxStatus runVppInternal(ultravpp *ins, mfxFrameSurface1 *in,
                                    mfxFrameSurface1 *out);
 
-  mfxFrameSurface1 *getFreeSurface(ultravpp *ins);
-
  protected:                     // var
   mfxSession m_session;         //!< make a copy of session
   vrpar::config m_codec_param;  //!< make a copy of init parameters
@@ -123,7 +128,6 @@ class VppChain : public noncopyable {
   std::unique_ptr<CVPPScaling> m_ext_scaling;
   std::unique_ptr<CVPPRotate> m_ext_rotate;
   std::unique_ptr<CVPPMirror> m_ext_mirror;
-  std::map<mfxFrameSurface1 *, bool> m_surface_inuse;
   mfxU16 m_meta_buffer_num;
   mfxU16 m_process_id;
   bool m_use_sys_mem;
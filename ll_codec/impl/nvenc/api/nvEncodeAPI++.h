@@ -262,6 +262,10 @@ class CNvEncoder {
     return m_pNvApi->nvEncEncodePicture(m_hEncSession, params);
   }
 
+  NVENCSTATUS InvalidateRefFrames(uint64_t timestamp) {
+    return m_pNvApi->nvEncInvalidateRefFrames(m_hEncSession, timestamp);
+  }
+
   NVENCSTATUS GetEncodeStat(NV_ENC_STAT *stat) {
     stat->version = NV_ENC_STAT_VER;
     return m_pNvApi->nvEncGetEncodeStats(m_hEncSession, stat);
@@ -47,6 +47,15 @@ enum NV_SLICE_MODE {
   NV_ENC_NUM_SLICES_IN_PIC = 3
 };
 
+// reference control of a frame, for loss recovery
+struct ReferenceControl {
+  int markIdx;            // LTR index the frame is marked as, -1 if not
+  uint32_t useBitmap;     // LTR indices the frame references, 0 for default
+  bool forceIdr;          // encode the frame as IDR
+  uint64_t invalidFirst;  // frames to invalidate, none if first > last
+  uint64_t invalidLast;
+};
+
 struct EncodeConfig {
   int width;
   int height;
@@ -63,14 +72,17 @@ struct EncodeConfig {
   int sliceData;
   int asyncDepth;
   int outputBufferSize;
+  int seiSizeMax;  // bytes reserved for SEI payloads of each frame
   NV_ENC_BUFFER_FORMAT inputFormat;
   std::vector<NV_ENC_INPUT_PTR> sharedTextures;
   int intraRefreshPeriod;
   int intraRefreshDuration;
+  int numLongTermRefs;
   int enableSliceMode : 1;
   int enableAsyncMode : 1;
   int enableTemporalAQ : 1;
   int enableIntraRefresh : 1;
+  int enableQpDeltaMap : 1;  // QP delta map per frame, AQ is turned off
 };
 }  // namespace nvenc
 #endif  // LL_CODEC_NVENC_NV_CONFIGURE_H_
@@ -9,6 +9,7 @@ changelog
 #ifndef LL_CODEC_NVENC_NV_FRAMEWORK_H_
 #define LL_CODEC_NVENC_NV_FRAMEWORK_H_
 #include <stdint.h>
+#include <atomic>
 #include <map>
 #include <vector>
 #include "ll_codec/impl/nvenc/api/nvEncodeAPI++.h"
@@ -20,6 +21,13 @@ namespace nvenc {
 
 struct NV_ENC_BITSTREAM;
 
+// SEI payloads carried along with a frame
+struct NV_ENC_SEI_ARENA {
+  std::vector<uint8_t> data;
+  std::vector<NV_ENC_SEI_PAYLOAD> list;
+  uint32_t used;
+};
+
 /**
  * Framework for NVENC.
  */
@@ -62,6 +70,45 @@ class CVRNvFramework {
    */
   bool NV_ENC_API QueueInputBuffer(const HANDLE &tex);
 
+  /**
+   * Reserve a SEI message in the next queued frame, which is inserted by
+   * the encoder in place.
+   *
+   * \param type  SEI payload type, i.e. 5 for user_data_unregistered.
+   * \param size  payload size in bytes.
+   * \return pointer to the payload body to be filled by caller, or null if
+   *         EncodeConfig::seiSizeMax is exceeded.
+   */
+  uint8_t *NV_ENC_API AttachPayload(uint32_t type, uint32_t size);
+
+  /**
+   * Force an intra refresh cycle from the next queued frame, or an IDR if
+   * intra refresh is disabled. It's safe to call from any thread.
+   */
+  void NV_ENC_API RequestIntraRefresh() { m_bRefreshPending = true; }
+
+  /**
+   * Set the reference control of the next queued frame. Frames are numbered
+   * by the order of QueueInputBuffer from 0.
+   */
+  void NV_ENC_API SetReferenceControl(const ReferenceControl &ctrl) {
+    m_RefCtrl = ctrl;
+    m_bRefCtrlPending = true;
+  }
+
+  /**
+   * Get the QP delta map of the next queued frame to fill in, one signed
+   * byte per block in raster scan order. Blocks are 16x16 MBs for H.264 and
+   * 32x32 CTBs for HEVC.
+   *
+   * \param [out] block    block size in pixels.
+   * \param [out] blocksW  number of blocks in a row.
+   * \param [out] blocksH  number of blocks in a column.
+   * \return null if EncodeConfig::enableQpDeltaMap isn't set.
+   */
+  int8_t *NV_ENC_API AttachQpDeltaMap(uint32_t *block, uint32_t *blocksW,
+                                      uint32_t *blocksH);
+
   /**
    * Dequeue output bitstream from internal memory.
    * This call will wait until the encoder outputs one frame, so don't call this
@@ -101,6 +148,13 @@ class CVRNvFramework {
   NV_EXTERN_BUF m_CachedRegisteredResources;
   NV_VID_CACHE m_CachedVideoMemory;
   std::vector<NV_ENC_BITSTREAM> m_OutputBuffers;
+  NV_ENC_SEI_ARENA m_PendingSei;
+  std::atomic_bool m_bRefreshPending;
+  ReferenceControl m_RefCtrl;
+  bool m_bRefCtrlPending;
+  uint64_t m_nFrameOrder;
+  std::vector<int8_t> m_QpDeltaMap;
+  bool m_bQpMapPending;
   int m_nOutputRIndex;
   int m_nOutputWIndex;
   GUID m_EncodeGuid;
@@ -116,6 +170,10 @@ class CVRNvFramework {
   void destroyIObuffers();
 
   int dequeueOutputIndex();
+
+  void resetSeiArena(NV_ENC_SEI_ARENA *sei, size_t size);
+
+  void applyReferenceControl(NV_ENC_PIC_PARAMS *params);
 };
 }  // namespace nvenc
 
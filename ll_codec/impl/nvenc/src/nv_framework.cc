@@ -7,8 +7,12 @@ Created     : Nov. 11th, 2017
 changelog
 ********************************************************************/
 #include "ll_codec/impl/nvenc/nv_framework.h"
+#include <utility>
 
 namespace nvenc {
+// maximum SEI messages in one frame
+constexpr size_t kMaxSeiPayloads = 8;
+
 struct NV_ENC_BITSTREAM {
   void *pSysmem;
   uint32_t size;
@@ -16,6 +20,7 @@ struct NV_ENC_BITSTREAM {
   HANDLE sync;
   bool canWrite;
   bool canRead;
+  NV_ENC_SEI_ARENA sei;  // must keep alive until the frame is encoded
 };
 
 CVRNvFramework::CVRNvFramework() {
@@ -28,6 +33,10 @@ CVRNvFramework::CVRNvFramework() {
   m_EncodeConfig.version = NV_ENC_CONFIG_VER;
   std::memset(&m_EncodeInitPar, 0, sizeof m_EncodeInitPar);
   m_EncodeInitPar.version = NV_ENC_INITIALIZE_PARAMS_VER;
+  m_bRefreshPending = false;
+  m_bRefCtrlPending = false;
+  m_nFrameOrder = 0;
+  m_bQpMapPending = false;
 }
 
 CVRNvFramework::~CVRNvFramework() {}
@@ -80,15 +89,69 @@ bool CVRNvFramework::QueueInputBuffer(const HANDLE &tex) {
   encodeParams.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
   encodeParams.outputBitstream = currentBitstream.pVmem;
   encodeParams.completionEvent = currentBitstream.sync;
+  // hand over the pending SEI to this frame, no memory is reallocated
+  std::swap(m_PendingSei, currentBitstream.sei);
+  resetSeiArena(&m_PendingSei, m_PendingSei.data.size());
+  NV_ENC_SEI_ARENA &sei = currentBitstream.sei;
+  if (!sei.list.empty()) {
+    auto cnt = static_cast<uint32_t>(sei.list.size());
+    if (m_Par.codec == NV_ENC_CODEC_HEVC) {
+      encodeParams.codecPicParams.hevcPicParams.seiPayloadArrayCnt = cnt;
+      encodeParams.codecPicParams.hevcPicParams.seiPayloadArray =
+          sei.list.data();
+    } else {
+      encodeParams.codecPicParams.h264PicParams.seiPayloadArrayCnt = cnt;
+      encodeParams.codecPicParams.h264PicParams.seiPayloadArray =
+          sei.list.data();
+    }
+  }
+  encodeParams.inputTimeStamp = m_nFrameOrder;
+  if (m_bRefCtrlPending) applyReferenceControl(&encodeParams);
+  if (m_bQpMapPending) {
+    encodeParams.qpDeltaMap = m_QpDeltaMap.data();
+    encodeParams.qpDeltaMapSize = static_cast<uint32_t>(m_QpDeltaMap.size());
+  }
+  if (m_bRefreshPending.exchange(false)) {
+    if (m_Par.enableIntraRefresh) {
+      auto cnt = static_cast<uint32_t>(m_Par.intraRefreshDuration);
+      if (m_Par.codec == NV_ENC_CODEC_HEVC) {
+        encodeParams.codecPicParams.hevcPicParams
+            .forceIntraRefreshWithFrameCnt = cnt;
+      } else {
+        encodeParams.codecPicParams.h264PicParams
+            .forceIntraRefreshWithFrameCnt = cnt;
+      }
+    } else {
+      encodeParams.encodePicFlags |= NV_ENC_PIC_FLAG_FORCEIDR;
+    }
+  }
   sts = m_pCore->EncodeFrame(&encodeParams);
   CHECK_STATUS(sts, "encode frames");
   sts = m_pCore->UnmapResource(mapped);
   CHECK_STATUS(sts, "unmap resources");
+  m_bRefCtrlPending = false;
+  m_bQpMapPending = false;
+  m_nFrameOrder++;
   currentBitstream.canWrite = false;
   currentBitstream.canRead = false;
   return sts == NV_ENC_SUCCESS;
 }
 
+uint8_t *CVRNvFramework::AttachPayload(uint32_t type, uint32_t size) {
+  NV_ENC_SEI_ARENA &sei = m_PendingSei;
+  if (sei.list.size() >= kMaxSeiPayloads ||
+      sei.used + size > sei.data.size()) {
+    return nullptr;
+  }
+  NV_ENC_SEI_PAYLOAD payload{};
+  payload.payloadType = type;
+  payload.payloadSize = size;
+  payload.payload = sei.data.data() + sei.used;
+  sei.list.push_back(payload);
+  sei.used += size;
+  return payload.payload;
+}
+
 bool CVRNvFramework::DequeueOutputBuffer(void **ptr, uint32_t *size) {
   int n = m_nOutputRIndex % m_OutputBuffers.size();
   NV_ENC_BITSTREAM *bs = &m_OutputBuffers[n];
@@ -150,6 +213,10 @@ void CVRNvFramework::initParameters(const EncodeConfig &par) {
   m_EncodeInitPar.encodeConfig = &m_EncodeConfig;
 
   m_EncodeConfig.gopLength = par.gopLength;
+  // intra refresh takes place of IDR, and IDR would flush long-term refs
+  if ((par.enableIntraRefresh || par.numLongTermRefs > 0) && !par.gopLength) {
+    m_EncodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
+  }
   m_EncodeConfig.frameIntervalP = 1;
   m_EncodeConfig.frameFieldMode = NV_ENC_PARAMS_FRAME_FIELD_MODE_FRAME;
   m_EncodeConfig.mvPrecision = NV_ENC_MV_PRECISION_QUARTER_PEL;
@@ -177,11 +244,14 @@ void CVRNvFramework::initParameters(const EncodeConfig &par) {
       break;
   }
   m_EncodeConfig.rcParams.zeroReorderDelay = 1;
-  m_EncodeConfig.rcParams.enableAQ = 1;
+  // the external QP delta map isn't supported along with AQ
+  m_EncodeConfig.rcParams.enableAQ = par.enableQpDeltaMap ? 0 : 1;
+  m_EncodeConfig.rcParams.enableExtQPDeltaMap = par.enableQpDeltaMap ? 1 : 0;
   m_EncodeConfig.rcParams.aqStrength = 0;  // auto
   // h264 specific params
   m_EncodeConfig.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
-  m_EncodeConfig.encodeCodecConfig.h264Config.idrPeriod = par.gopLength;
+  m_EncodeConfig.encodeCodecConfig.h264Config.idrPeriod =
+      m_EncodeConfig.gopLength;
   // -- check chroma support
   if (!m_pCore->IsSupportInputFormat(m_EncodeGuid, par.inputFormat)) {
     CHECK_STATUS(NV_ENC_ERR_UNSUPPORTED_PARAM, "Unsupported input format");
@@ -192,6 +262,17 @@ void CVRNvFramework::initParameters(const EncodeConfig &par) {
     case NV_ENC_BUFFER_FORMAT_IYUV:
       m_EncodeConfig.encodeCodecConfig.h264Config.chromaFormatIDC = 1;
       break;
+    case NV_ENC_BUFFER_FORMAT_YUV420_10BIT:
+      if (par.codec != NV_ENC_CODEC_HEVC ||
+          !m_pCore->IsSupportCapacity(m_EncodeGuid,
+                                      NV_ENC_CAPS_SUPPORT_10BIT_ENCODE)) {
+        CHECK_STATUS(NV_ENC_ERR_UNSUPPORTED_PARAM,
+                     "Don't support 10-bit encode on this device");
+      }
+      m_EncodeConfig.profileGUID = NV_ENC_HEVC_PROFILE_MAIN10_GUID;
+      m_EncodeConfig.encodeCodecConfig.hevcConfig.chromaFormatIDC = 1;
+      m_EncodeConfig.encodeCodecConfig.hevcConfig.pixelBitDepthMinus8 = 2;
+      break;
     case NV_ENC_BUFFER_FORMAT_YUV444:
       if (!m_pCore->IsSupportCapacity(m_EncodeGuid,
                                       NV_ENC_CAPS_SUPPORT_YUV444_ENCODE)) {
@@ -209,8 +290,26 @@ void CVRNvFramework::initParameters(const EncodeConfig &par) {
       CHECK_STATUS(NV_ENC_ERR_UNSUPPORTED_PARAM, "Unsupported input format");
       break;
   }
+  // -- long-term reference, marked per picture
+  if (par.numLongTermRefs > 0 && par.codec == NV_ENC_CODEC_HEVC) {
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.enableLTR = 1;
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.ltrNumFrames =
+        par.numLongTermRefs;
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.ltrTrustMode = 0;
+  } else if (par.numLongTermRefs > 0) {
+    m_EncodeConfig.encodeCodecConfig.h264Config.enableLTR = 1;
+    m_EncodeConfig.encodeCodecConfig.h264Config.ltrNumFrames =
+        par.numLongTermRefs;
+    m_EncodeConfig.encodeCodecConfig.h264Config.ltrTrustMode = 0;
+  }
   // -- intra refresh
-  if (par.enableIntraRefresh) {
+  if (par.enableIntraRefresh && par.codec == NV_ENC_CODEC_HEVC) {
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.enableIntraRefresh = 1;
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.intraRefreshCnt =
+        par.intraRefreshDuration;
+    m_EncodeConfig.encodeCodecConfig.hevcConfig.intraRefreshPeriod =
+        par.intraRefreshPeriod;
+  } else if (par.enableIntraRefresh) {
     m_EncodeConfig.encodeCodecConfig.h264Config.enableIntraRefresh = 1;
     m_EncodeConfig.encodeCodecConfig.h264Config.intraRefreshCnt =
         par.intraRefreshDuration;
@@ -229,7 +328,7 @@ void CVRNvFramework::initParameters(const EncodeConfig &par) {
       m_EncodeInitPar.enableEncodeAsync = 1;
     }
   }
-  if (par.enableTemporalAQ) {
+  if (par.enableTemporalAQ && !par.enableQpDeltaMap) {
     if (m_pCore->IsSupportCapacity(m_EncodeGuid,
                                    NV_ENC_CAPS_SUPPORT_TEMPORAL_AQ)) {
       m_EncodeConfig.rcParams.enableTemporalAQ = 1;
@@ -257,7 +356,9 @@ void CVRNvFramework::allocateIObuffers(const EncodeConfig &par) {
     CHECK_STATUS(sts, "Create bitstream buffer");
     sts = m_pCore->RegisterSyncEvent(&buf.sync);
     CHECK_STATUS(sts, "Register sync event");
+    resetSeiArena(&buf.sei, par.seiSizeMax);
   }
+  resetSeiArena(&m_PendingSei, par.seiSizeMax);
   m_nOutputRIndex = 0;
   m_nOutputWIndex = 0;
 }
@@ -288,4 +389,60 @@ int CVRNvFramework::dequeueOutputIndex() {
   m_nOutputWIndex++;
   return n;
 }
+
+int8_t *CVRNvFramework::AttachQpDeltaMap(uint32_t *block, uint32_t *blocksW,
+                                         uint32_t *blocksH) {
+  if (!m_Par.enableQpDeltaMap) return nullptr;
+  *block = m_Par.codec == NV_ENC_CODEC_HEVC ? 32 : 16;
+  *blocksW = (m_Par.width + *block - 1) / *block;
+  *blocksH = (m_Par.height + *block - 1) / *block;
+  m_QpDeltaMap.resize(static_cast<size_t>(*blocksW) * *blocksH);
+  m_bQpMapPending = true;
+  return m_QpDeltaMap.data();
+}
+
+void CVRNvFramework::applyReferenceControl(NV_ENC_PIC_PARAMS *params) {
+  const ReferenceControl &ctrl = m_RefCtrl;
+  // the DPB never holds more than 16 frames
+  uint64_t first = ctrl.invalidFirst;
+  if (ctrl.invalidLast >= 16 && first < ctrl.invalidLast - 15) {
+    first = ctrl.invalidLast - 15;
+  }
+  for (uint64_t f = first; ctrl.invalidFirst <= ctrl.invalidLast &&
+                           f <= ctrl.invalidLast; ++f) {
+    NVENCSTATUS sts = m_pCore->InvalidateRefFrames(f);
+    CHECK_STATUS(sts, "Invalidate reference frames");
+  }
+  if (ctrl.forceIdr) {
+    params->encodePicFlags |= NV_ENC_PIC_FLAG_FORCEIDR;
+  }
+  const bool hevc = m_Par.codec == NV_ENC_CODEC_HEVC;
+  auto &h264 = params->codecPicParams.h264PicParams;
+  auto &hevc_ = params->codecPicParams.hevcPicParams;
+  if (ctrl.markIdx >= 0) {
+    if (hevc) {
+      hevc_.ltrMarkFrame = 1;
+      hevc_.ltrMarkFrameIdx = ctrl.markIdx;
+    } else {
+      h264.ltrMarkFrame = 1;
+      h264.ltrMarkFrameIdx = ctrl.markIdx;
+    }
+  }
+  if (ctrl.useBitmap && !ctrl.forceIdr) {
+    if (hevc) {
+      hevc_.ltrUseFrames = 1;
+      hevc_.ltrUseFrameBitmap = ctrl.useBitmap;
+    } else {
+      h264.ltrUseFrames = 1;
+      h264.ltrUseFrameBitmap = ctrl.useBitmap;
+    }
+  }
+}
+
+void CVRNvFramework::resetSeiArena(NV_ENC_SEI_ARENA *sei, size_t size) {
+  sei->data.resize(size);
+  sei->list.clear();
+  sei->list.reserve(kMaxSeiPayloads);
+  sei->used = 0;
+}
 }  // namespace nvenc
@@ -7,10 +7,22 @@ Created     : Nov. 14th, 2017
 changelog
 ********************************************************************/
 #include "ll_codec/codec/ixr_codec.h"
+#include "ll_codec/codec/ixr_codec_config.h"
+#include "ll_codec/codec/ixr_decode_service.h"
+#include "ll_codec/codec/ixr_display_queue.h"
+#include "ll_codec/codec/ixr_jpeg_decode.h"
+#ifdef IXR_CODEC_BUILD_MSDK
+#include "ll_codec/impl/msdk/utility/mfx_surface_table.h"
+#endif
 #include "res.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 using namespace ixr;
 
@@ -149,6 +161,503 @@ TEST_F(IntelCodecTest, H264DecodeIntoCpuNV12) {
   t0.join();
 }
 
+TEST_F(IntelCodecTest, H264DecodeWithDisplayQueue) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto encoder = ixr::Encoder::Create(info);
+  std::vector<std::vector<char>> frames;
+  for (int i = 0; i < 3; i++) {
+    void *ptr = encoder->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    ASSERT_EQ(encoder->QueueInputBuffer(nullptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    ASSERT_EQ(encoder->DequeueOutputBuffer(&buf, &len), 0);
+    char *bytes = static_cast<char *>(buf);
+    frames.emplace_back(bytes, bytes + len);
+    encoder->ReleaseOutputBuffer(buf);
+  }
+  ixr::CodecConfig dpar{};
+  dpar.codec = ixr::IXR_CODEC_AVC;
+  dpar.adapter = ixr::IXR_CODEC_VID_INTEL;
+  dpar.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  dpar.outputFormat = ixr::IXR_COLOR_NV12;
+  auto codec = ixr::Decoder::Create(ixr::IXR_CODEC_VID_INTEL);
+  codec->Allocate(dpar, frames[0].data(), frames[0].size());
+  // frames arrive out of display order
+  const int64_t kPts[3] = {6000, 0, 3000};
+  for (int i = 0; i < 3; i++) {
+    while (codec->QueueInputBuffer(frames[i].data(), frames[i].size(),
+                                   kPts[i])) {
+    }
+  }
+  EXPECT_EQ(codec->QueueInputBuffer(0, 0), 0);
+  DisplayConfig config{};
+  config.jitterFrames = 2;
+  DisplayQueue queue(codec.get(), config);
+  queue.Flush();
+  void *tex = nullptr;
+  int64_t pts = kPtsUnknown;
+  std::vector<int64_t> shown;
+  while (queue.Poll(0, &tex, &pts) == 0) {
+    shown.push_back(pts);
+    codec->ReleaseOutputBuffer(tex);
+  }
+  EXPECT_EQ(shown, std::vector<int64_t>({0, 3000, 6000}));
+  EXPECT_EQ(queue.Dropped(), 0U);
+}
+
+// A decoder of frames with given time stamps, which tracks the frames held
+class FakeDecoder : public Decoder {
+ public:
+  void Decoded(int64_t pts) {
+    ready_.push_back(pts);
+    held_++;
+  }
+
+  int DequeueOutputBuffer(void **ptr, int64_t *pts) override {
+    if (ready_.empty()) return -1;
+    *pts = ready_.front();
+    ready_.erase(ready_.begin());
+    // frames are numbered from 1 in the order of output
+    stamps_.push_back(*pts);
+    *ptr = reinterpret_cast<void *>(static_cast<intptr_t>(stamps_.size()));
+    return 0;
+  }
+
+  void ReleaseOutputBuffer(void *ptr) override {
+    released_.push_back(stamps_[reinterpret_cast<intptr_t>(ptr) - 1]);
+    held_--;
+  }
+
+  std::vector<int64_t> ready_;
+  std::vector<int64_t> stamps_;    //!< of the frames output
+  std::vector<int64_t> released_;  //!< stamps of the frames released
+  int held_ = 0;
+};
+
+// Poll once, return the time stamp shown or kPtsUnknown
+static int64_t PollOnce(DisplayQueue *queue, FakeDecoder *decoder,
+                        int64_t now) {
+  void *frame = nullptr;
+  int64_t pts = kPtsUnknown;
+  if (queue->Poll(now, &frame, &pts)) return kPtsUnknown;
+  decoder->ReleaseOutputBuffer(frame);
+  return pts;
+}
+
+TEST(DisplayQueue, ReorderInJitterBuffer) {
+  FakeDecoder decoder;
+  DisplayConfig config{};
+  config.jitterFrames = 2;
+  DisplayQueue queue(&decoder, config);
+  decoder.Decoded(6000);
+  decoder.Decoded(0);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), kPtsUnknown);
+  decoder.Decoded(3000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), 0);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), kPtsUnknown);
+  decoder.Decoded(9000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), 3000);
+  EXPECT_EQ(queue.Size(), 2U);
+  queue.Flush();
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), 6000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), 9000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), kPtsUnknown);
+  EXPECT_EQ(queue.Dropped(), 0U);
+  EXPECT_EQ(decoder.held_, 0);
+}
+
+TEST(DisplayQueue, PaceToVsync) {
+  FakeDecoder decoder;
+  DisplayConfig config{};
+  config.jitterFrames = 1;
+  config.vsyncPeriod = 1500;  // 60 Hz display of 30 fps frames
+  config.dropLate = 1;
+  DisplayQueue queue(&decoder, config);
+  decoder.Decoded(3000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 10000), kPtsUnknown);
+  decoder.Decoded(0);
+  // the first frame is shown at the vsync it's released
+  EXPECT_EQ(PollOnce(&queue, &decoder, 10000), 0);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 11500), kPtsUnknown);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 13000), 3000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 14500), kPtsUnknown);
+  // frames due at the same vsync, all but the last are dropped
+  for (int64_t pts : {6000, 9000, 12000}) decoder.Decoded(pts);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 22000), 12000);
+  EXPECT_EQ(queue.Dropped(), 2U);
+  EXPECT_EQ(decoder.released_[2], 6000);
+  EXPECT_EQ(decoder.released_[3], 9000);
+  // behind the clock for more than a vsync, the clock is caught up, so the
+  // following frame isn't dropped
+  decoder.Decoded(15000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 40000), 15000);
+  decoder.Decoded(18000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 41500), kPtsUnknown);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 43000), 18000);
+  EXPECT_EQ(queue.Dropped(), 2U);
+  // a frame before the last shown one is too late to be reordered
+  decoder.Decoded(1000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 44500), kPtsUnknown);
+  EXPECT_EQ(queue.Dropped(), 3U);
+  EXPECT_EQ(decoder.released_.back(), 1000);
+  decoder.Decoded(21000);
+  queue.Clear();
+  EXPECT_EQ(queue.Size(), 0U);
+  EXPECT_EQ(decoder.held_, 0);
+}
+
+TEST(DisplayQueue, ShowLateFrames) {
+  FakeDecoder decoder;
+  DisplayConfig config{};
+  config.vsyncPeriod = 1500;
+  config.frameDuration = 3000;
+  DisplayQueue queue(&decoder, config);
+  // frames without time stamps are stamped by frameDuration
+  decoder.Decoded(kPtsUnknown);
+  decoder.Decoded(kPtsUnknown);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 0), 0);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 1500), kPtsUnknown);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 3000), 3000);
+  // both are due, the late one is kept and shown at the next vsync
+  decoder.Decoded(6000);
+  decoder.Decoded(7000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 7500), 6000);
+  EXPECT_EQ(PollOnce(&queue, &decoder, 9000), 7000);
+  EXPECT_EQ(queue.Dropped(), 0U);
+  EXPECT_EQ(decoder.held_, 0);
+}
+
+TEST_F(IntelCodecTest, H264DecodeManyStreams) {
+  const int kStreams = 4;
+  DecodeService service(2);
+  int ids[kStreams];
+  for (int i = 0; i < kStreams; i++) {
+    ixr::CodecConfig par{};
+    par.codec = ixr::IXR_CODEC_AVC;
+    par.adapter = ixr::IXR_CODEC_VID_INTEL;
+    par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+    par.outputFormat = ixr::IXR_COLOR_NV12;
+    ids[i] = service.AddStream(par, const_cast<char *>(sBitstream),
+                               sizeof sBitstream, StreamConfig{});
+    ASSERT_GE(ids[i], 0);
+    EXPECT_EQ(service.QueuePacket(ids[i], sBitstream, sizeof sBitstream, i),
+              0);
+    EXPECT_EQ(service.QueuePacket(ids[i], nullptr, 0, kPtsUnknown), 0);
+  }
+  for (int i = 0; i < kStreams; i++) {
+    void *tex = nullptr;
+    int64_t pts = kPtsUnknown;
+    while (service.DequeueOutputBuffer(ids[i], &tex, &pts)) {
+      ASSERT_EQ(service.GetStreamStat(ids[i]).error, 0);
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(pts, i);
+    service.ReleaseOutputBuffer(ids[i], tex);
+  }
+  for (int i = 0; i < kStreams; i++) service.RemoveStream(ids[i]);
+}
+
+#ifdef IXR_CODEC_BUILD_MSDK
+TEST(SlotFreeList, PopAndPush) {
+  mfxvr::SlotFreeList list;
+  list.Reset(4);
+  std::vector<bool> popped(4, false);
+  mfxU32 slot = 0;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(list.Pop(&slot));
+    ASSERT_LT(slot, 4U);
+    EXPECT_FALSE(popped[slot]);
+    popped[slot] = true;
+  }
+  EXPECT_FALSE(list.Pop(&slot));
+  // a slot is listed once however many times it's pushed
+  list.Push(2);
+  list.Push(2);
+  ASSERT_TRUE(list.Pop(&slot));
+  EXPECT_EQ(slot, 2U);
+  EXPECT_FALSE(list.Pop(&slot));
+}
+
+TEST(SurfaceTable, AcquireRecycleRelease) {
+  std::vector<mfxFrameSurface1> pool(4);
+  for (auto &s : pool) memset(&s, 0, sizeof s);
+  using Table = mfxvr::SurfaceTable<int>;
+  Table table;
+  table.Reset(pool.data(), 4);
+  EXPECT_EQ(table.Slot(pool.data() + 4), -1);
+  EXPECT_EQ(table.Slot(pool.data() + 3), 3);
+  // a surface locked by MSDK is skipped and stays listed
+  pool[1].Data.Locked = 1;
+  std::vector<int> taken;
+  for (int slot; (slot = table.Acquire()) >= 0;) {
+    EXPECT_NE(slot, 1);
+    table.SetState(slot, Table::kInUse);
+    table.Data(slot) = slot * 10;
+    taken.push_back(slot);
+  }
+  EXPECT_EQ(taken.size(), 3U);
+  pool[1].Data.Locked = 0;
+  EXPECT_EQ(table.Acquire(), 1);
+  // a surface handed to MSDK is listed again, one in use isn't
+  table.Recycle(1);
+  table.Recycle(taken[0]);
+  EXPECT_EQ(table.Acquire(), 1);
+  EXPECT_EQ(table.Acquire(), -1);
+  table.Release(taken[0]);
+  EXPECT_EQ(table.GetState(taken[0]), static_cast<mfxU32>(Table::kFree));
+  EXPECT_EQ(table.Acquire(), taken[0]);
+  EXPECT_EQ(table.Data(taken[1]), taken[1] * 10);
+}
+
+TEST(SurfaceTable, ReleaseFromOtherThreads) {
+  const int kSlots = 8, kFrames = 20000;
+  std::vector<mfxFrameSurface1> pool(kSlots);
+  for (auto &s : pool) memset(&s, 0, sizeof s);
+  using Table = mfxvr::SurfaceTable<int>;
+  Table table;
+  table.Reset(pool.data(), kSlots);
+  std::vector<std::atomic<int>> owners(kSlots);
+  for (auto &o : owners) o = 0;
+  std::mutex lock;
+  std::vector<int> outputs;
+  std::atomic<int> released(0);
+  std::atomic<bool> done(false);
+  auto consumer = [&]() {
+    while (!done || released < kFrames) {
+      int slot = -1;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!outputs.empty()) {
+          slot = outputs.back();
+          outputs.pop_back();
+        }
+      }
+      if (slot < 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      EXPECT_EQ(table.Data(slot), slot);
+      owners[slot] = 0;
+      table.Release(slot);
+      released++;
+    }
+  };
+  std::thread c0(consumer), c1(consumer);
+  // the decoding thread acquires, the consumers release
+  for (int i = 0; i < kFrames;) {
+    const int slot = table.Acquire();
+    if (slot < 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    // a slot is never handed out twice
+    EXPECT_EQ(owners[slot].exchange(1), 0);
+    table.Data(slot) = slot;
+    table.SetState(slot, Table::kInUse);
+    std::lock_guard<std::mutex> guard(lock);
+    outputs.push_back(slot);
+    i++;
+  }
+  done = true;
+  c0.join();
+  c1.join();
+  int free = 0;
+  while (table.Acquire() >= 0) free++;
+  EXPECT_EQ(free, kSlots);
+}
+
+TEST(HandleTable, SetAndGet) {
+  mfxvr::HandleTable<int> table;
+  table.Reset(64);
+  std::vector<int> values(64);
+  auto handle = [](int i) {
+    return reinterpret_cast<mfxHDL>(static_cast<uintptr_t>(0x1000 + i * 64));
+  };
+  std::thread writers[2];
+  for (int t = 0; t < 2; t++) {
+    writers[t] = std::thread([&, t]() {
+      for (int i = t; i < 64; i += 2) {
+        EXPECT_TRUE(table.Set(handle(i), &values[i]));
+      }
+    });
+  }
+  for (auto &w : writers) w.join();
+  for (int i = 0; i < 64; i++) EXPECT_EQ(table.Get(handle(i)), &values[i]);
+  EXPECT_EQ(table.Get(handle(64)), nullptr);
+  // a released surface is set to null, and its handle is kept
+  EXPECT_TRUE(table.Set(handle(3), nullptr));
+  EXPECT_EQ(table.Get(handle(3)), nullptr);
+  EXPECT_TRUE(table.Set(handle(3), &values[3]));
+  EXPECT_EQ(table.Get(handle(3)), &values[3]);
+}
+#endif
+
+TEST(JpegCpu, DecodeRestartIntervals) {
+  auto src = reinterpret_cast<const uint8_t *>(JPEG::sPicJpeg);
+  uint32_t size = sizeof JPEG::sPicJpeg;
+  std::vector<ixr::JpegSegment> segments;
+  ASSERT_EQ(ixr::ScanJpegMarkers(src, size, &segments), 0);
+  ixr::JpegInfo info;
+  ixr::JpegDecoderCpu one(1), four(4);
+  ASSERT_EQ(one.Parse(src, size, &info), 0);
+  EXPECT_EQ(info.width, JPEG::kWidth);
+  EXPECT_EQ(info.height, JPEG::kHeight);
+  EXPECT_GE(info.intervals, 1U);
+
+  const uint32_t pitch = info.width * 4;
+  std::vector<uint8_t> bgra1(pitch * info.height), bgra4(bgra1.size());
+  ASSERT_EQ(one.Decode(src, size, {ixr::IXR_COLOR_ARGB, pitch, bgra1.data()}),
+            0);
+  ASSERT_EQ(four.Decode(src, size, {ixr::IXR_COLOR_ARGB, pitch, bgra4.data()}),
+            0);
+  // intervals are independent, so any split gives the same pixels
+  EXPECT_EQ(bgra1, bgra4);
+
+  const uint32_t even = (info.width + 1) & ~1;
+  std::vector<uint8_t> nv12(even * (info.height + (info.height + 1) / 2));
+  const ixr::JpegSurface surface{ixr::IXR_COLOR_NV12, even, nv12.data()};
+  EXPECT_EQ(four.Decode(src, size, surface), 0);
+  // both formats are of the same picture, BT.601 luma of BGRA is the luma of
+  // NV12 unless a channel is clipped
+  for (int32_t y = 0; y < info.height; y++) {
+    for (int32_t x = 0; x < info.width; x++) {
+      const uint8_t *pixel = &bgra4[y * pitch + x * 4];
+      if (*std::min_element(pixel, pixel + 3) == 0 ||
+          *std::max_element(pixel, pixel + 3) == 255) {
+        continue;
+      }
+      const double luma =
+          0.114 * pixel[0] + 0.587 * pixel[1] + 0.299 * pixel[2];
+      ASSERT_NEAR(luma, nv12[y * even + x], 2.0) << x << "," << y;
+    }
+  }
+  // a truncated picture fails
+  EXPECT_EQ(four.Decode(src, size / 2, surface), -1);
+}
+
+// Luma of the 8x8 blocks and chroma of the MCUs of FlatJpeg
+static const uint8_t kFlatCb[4] = {88, 118, 148, 178};
+static const uint8_t kFlatCr[4] = {158, 78, 128, 188};
+static uint8_t FlatLuma(uint32_t x, uint32_t y) {
+  return static_cast<uint8_t>(16 + 12 * (y / 8 * 4 + x / 8));
+}
+
+// Baseline JPEG of 32x32 in 4:2:0, of which every block is flat. The
+// quantization table is all ones and each MCU is a restart interval.
+static std::vector<uint8_t> FlatJpeg() {
+  std::vector<uint8_t> out = {0xFF, 0xD8};
+  auto segment = [&out](uint8_t marker, const std::vector<uint8_t> &data) {
+    const size_t length = data.size() + 2;
+    out.insert(out.end(), {0xFF, marker, uint8_t(length >> 8),
+                           uint8_t(length)});
+    out.insert(out.end(), data.begin(), data.end());
+  };
+  std::vector<uint8_t> dqt(65, 1);
+  dqt[0] = 0;
+  segment(0xDB, dqt);
+  segment(0xC0, {8, 0, 32, 0, 32, 3, 1, 0x22, 0, 2, 0x11, 0, 3, 0x11, 0});
+  // DC of Table K.3, AC has EOB only
+  const uint8_t dcBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1};
+  std::vector<uint8_t> dht = {0x00};
+  dht.insert(dht.end(), dcBits, dcBits + 16);
+  for (uint8_t i = 0; i < 12; i++) dht.push_back(i);
+  dht.insert(dht.end(), {0x10, 1});
+  dht.insert(dht.end(), 15, 0);
+  dht.push_back(0x00);
+  segment(0xC4, dht);
+  segment(0xDD, {0, 1});
+  segment(0xDA, {3, 1, 0x00, 2, 0x00, 3, 0x00, 0, 63, 0});
+  // canonical codes of the DC categories
+  uint32_t dcCode[12], dcLength[12], code = 0;
+  for (uint32_t len = 1, k = 0; len <= 16; len++, code <<= 1) {
+    for (uint32_t i = 0; i < dcBits[len - 1]; i++, k++) {
+      dcCode[k] = code++;
+      dcLength[k] = len;
+    }
+  }
+  uint32_t acc = 0, bits = 0;
+  auto put = [&](uint32_t v, uint32_t n) {
+    while (n--) {
+      acc = (acc << 1) | ((v >> n) & 1);
+      if (++bits < 8) continue;
+      out.push_back(static_cast<uint8_t>(acc));
+      if (acc == 0xFF) out.push_back(0);  // stuffed
+      acc = bits = 0;
+    }
+  };
+  for (uint32_t m = 0; m < 4; m++) {
+    if (m) out.insert(out.end(), {0xFF, uint8_t(0xD0 + (m - 1) % 8)});
+    const uint32_t x = m % 2 * 16, y = m / 2 * 16;
+    const uint8_t samples[] = {FlatLuma(x, y), FlatLuma(x + 8, y),
+                               FlatLuma(x, y + 8), FlatLuma(x + 8, y + 8),
+                               kFlatCb[m], kFlatCr[m]};
+    int32_t pred[3] = {};  // reset by the restart
+    for (int b = 0; b < 6; b++) {
+      int32_t &p = pred[b < 4 ? 0 : b - 3];
+      const int32_t dc = (samples[b] - 128) * 8;
+      const int32_t diff = dc - p;
+      p = dc;
+      uint32_t t = 0;
+      while (std::abs(diff) >> t) t++;
+      put(dcCode[t], dcLength[t]);
+      if (t) put(diff >= 0 ? diff : diff + (1 << t) - 1, t);
+      put(0, 1);  // EOB
+    }
+    while (bits) put(1, 1);
+  }
+  out.insert(out.end(), {0xFF, 0xD9});
+  return out;
+}
+
+TEST(JpegCpu, DecodeFlatBlocks) {
+  const std::vector<uint8_t> jpeg = FlatJpeg();
+  const uint32_t size = static_cast<uint32_t>(jpeg.size());
+  ixr::JpegInfo info;
+  ixr::JpegDecoderCpu one(1), four(4);
+  ASSERT_EQ(one.Parse(jpeg.data(), size, &info), 0);
+  EXPECT_EQ(info.width, 32);
+  EXPECT_EQ(info.height, 32);
+  EXPECT_EQ(info.components, 3U);
+  EXPECT_EQ(info.restartInterval, 1U);
+  EXPECT_EQ(info.intervals, 4U);
+  for (auto *decoder : {&one, &four}) {
+    std::vector<uint8_t> nv12(32 * 48), bgra(32 * 32 * 4);
+    ASSERT_EQ(decoder->Decode(jpeg.data(), size,
+                              {ixr::IXR_COLOR_NV12, 32, nv12.data()}),
+              0);
+    ASSERT_EQ(decoder->Decode(jpeg.data(), size,
+                              {ixr::IXR_COLOR_ARGB, 32 * 4, bgra.data()}),
+              0);
+    for (uint32_t y = 0; y < 32; y++) {
+      for (uint32_t x = 0; x < 32; x++) {
+        const uint32_t m = y / 16 * 2 + x / 16;
+        const uint8_t *uv = &nv12[32 * 32 + y / 2 * 32 + x / 2 * 2];
+        ASSERT_EQ(nv12[y * 32 + x], FlatLuma(x, y)) << x << "," << y;
+        ASSERT_EQ(uv[0], kFlatCb[m]);
+        ASSERT_EQ(uv[1], kFlatCr[m]);
+        // BT.601 in float
+        const double l = FlatLuma(x, y), u = kFlatCb[m] - 128.0,
+                     v = kFlatCr[m] - 128.0;
+        const double bgr[] = {l + 1.772 * u, l - 0.344136 * u - 0.714136 * v,
+                              l + 1.402 * v};
+        const uint8_t *pixel = &bgra[(y * 32 + x) * 4];
+        for (int c = 0; c < 3; c++) {
+          ASSERT_NEAR(pixel[c], std::min(std::max(bgr[c], 0.0), 255.0), 1.0)
+              << x << "," << y;
+        }
+        ASSERT_EQ(pixel[3], 255);
+      }
+    }
+  }
+}
+
 TEST_F(IntelCodecTest, JpegDecodeIntoCpuRGB4) {
   ixr::CodecConfig par{};
   par.codec = ixr::IXR_CODEC_JPEG;
@@ -6,11 +6,46 @@ Email       : wenyi.tang@intel.com
 Created     : Nov. 14th, 2017
 changelog
 ********************************************************************/
+#include "ll_codec/codec/ixr_backpressure.h"
+#include "ll_codec/codec/ixr_bit_depth.h"
+#include "ll_codec/codec/ixr_bitstream.h"
+#include "ll_codec/codec/ixr_broker.h"
+#include "ll_codec/codec/ixr_capture.h"
 #include "ll_codec/codec/ixr_codec.h"
+#include "ll_codec/codec/ixr_codec_config.h"
+#include "ll_codec/codec/ixr_executor.h"
+#include "ll_codec/codec/ixr_fmp4.h"
+#include "ll_codec/codec/ixr_frame_diff.h"
+#include "ll_codec/codec/ixr_jpeg_batch.h"
+#include "ll_codec/codec/ixr_nalu.h"
+#include "ll_codec/codec/ixr_quality.h"
+#include "ll_codec/codec/ixr_recorder.h"
+#include "ll_codec/codec/ixr_reference.h"
+#include "ll_codec/codec/ixr_region.h"
+#include "ll_codec/codec/ixr_replay.h"
+#include "ll_codec/codec/ixr_rtp.h"
+#include "ll_codec/codec/ixr_stitch.h"
+#include "ll_codec/codec/ixr_tiled_encoder.h"
+#ifdef IXR_CODEC_BUILD_MSDK
+#include "ll_codec/impl/msdk/mfx_dispatch/include/mfx_discovery_cache.h"
+#endif
 #include "res.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 using namespace ixr;
 
@@ -81,6 +116,1991 @@ TEST_F(IntelCodecTest, H264EncodeFromCpuRGB4) {
   codec->ReleaseOutputBuffer(buf);
 }
 
+TEST_F(IntelCodecTest, H264EncodeFromExternalCpuNV12) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_EXTERNAL_CPU;
+  std::vector<std::vector<char>> frames(par.asyncDepth);
+  for (auto &f : frames) {
+    f.assign(sFrameNV12, sFrameNV12 + sizeof sFrameNV12);
+    par.sharedMemoryId.push_back(f.data());
+  }
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (auto &f : frames) {
+    EXPECT_EQ(codec->QueueInputBuffer(f.data()), 0) << "QueueInput Failed";
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0)
+        << "DequeueOutput Failed";
+    EXPECT_GT(len, 0U);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  char unregistered[16]{};
+  EXPECT_ANY_THROW(codec->QueueInputBuffer(unregistered));
+}
+
+TEST_F(IntelCodecTest, H264EncodeWithUserData) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.userDataSizeMax = sizeof(int32_t);
+  par.advanced.enableUserDataSei = 1;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (int32_t i = 0; i < 4; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    if (i % 2 == 0) EXPECT_EQ(codec->QueueUserData(&i, sizeof i), 0);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    int32_t frame = -1;
+    uint32_t size = sizeof frame;
+    EXPECT_EQ(codec->DequeueUserData(&frame, &size), 0);
+    EXPECT_EQ(size, i % 2 == 0 ? sizeof i : 0U);
+    if (size) EXPECT_EQ(frame, i);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  int64_t too_large = 0;
+  EXPECT_EQ(codec->QueueUserData(&too_large, sizeof too_large), -1);
+}
+
+TEST_F(IntelCodecTest, H264EncodeWithSei) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.seiSizeMax = 32;
+  par.advanced.enableTimeCode = 1;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  const char sei[] = "0123456789abcdef-pose";
+  for (uint16_t i = 0; i < 4; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueSeiPayload(5, sei, sizeof sei), 0);
+    TimeCode tc{0, 0, 0, i, 0};
+    EXPECT_EQ(codec->QueueTimeCode(tc), 0);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    std::string bs(static_cast<char *>(buf), len);
+    EXPECT_NE(bs.find(sei), std::string::npos) << "SEI is not written";
+    codec->ReleaseOutputBuffer(buf);
+  }
+  char too_large[64]{};
+  EXPECT_EQ(codec->QueueSeiPayload(5, too_large, sizeof too_large), -1);
+}
+
+TEST_F(IntelCodecTest, H264EncodeSlicePartialOutput) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.advanced.enableSlice = 1;
+  par.advanced.sliceMode = ixr::TILE_BASED;
+  par.advanced.sliceData = 4;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  void *ptr = codec->DequeueInputBuffer();
+  memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+  EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+  uint32_t slices = 0;
+  int ret = 1;
+  while (ret == 1) {
+    void *buf = nullptr;
+    uint32_t len = 0;
+    ret = codec->DequeueOutputBuffer(&buf, &len);
+    EXPECT_GE(ret, 0);
+    uint32_t count = 0;
+    EXPECT_EQ(codec->GetSliceOffsets(nullptr, &count), 0);
+    slices += count;
+    codec->ReleaseOutputBuffer(buf);
+  }
+  EXPECT_EQ(slices, 4U);
+}
+
+TEST_F(IntelCodecTest, H264EncodeOutputSegments) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.gop = 30;
+  par.advanced.enableSlice = 1;
+  par.advanced.sliceMode = ixr::TILE_BASED;
+  par.advanced.sliceData = 4;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (uint32_t i = 0; i < 2; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    // all slices of the frame in one descriptor
+    OutputDescriptor desc;
+    ASSERT_EQ(codec->DequeueOutputSegments(&desc), 0);
+    EXPECT_EQ(desc.numBuffers, 4U);
+    ASSERT_GE(desc.count, 1U);
+    size_t size = 0;
+    for (uint32_t j = 0; j < desc.count; j++) size += desc.segments[j].size;
+    EXPECT_EQ(size, desc.size);
+    auto head = static_cast<const uint8_t *>(desc.segments[0].base);
+    EXPECT_EQ(FindStartCode(head, desc.size, 0, nullptr), 0U);
+    EXPECT_EQ(desc.type, i == 0 ? IXR_FRAME_IDR : IXR_FRAME_P);
+    EXPECT_EQ(desc.frameOrder, i);
+    EXPECT_EQ(desc.pts, int64_t(i) * 90000 / par.fps);
+    EXPECT_EQ(desc.layer, 0U);
+    codec->ReleaseOutputSegments(desc);
+  }
+}
+
+TEST_F(IntelCodecTest, H264EncodeWithIntraRefresh) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.gop = 0;
+  par.advanced.enableIntraRefresh = 1;
+  par.advanced.intraRefreshDuration = 4;
+  par.advanced.intraRefreshQpDelta = -2;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (int i = 0; i < 8; i++) {
+    // pretend a packet loss is reported
+    if (i == 5) EXPECT_EQ(codec->RequestIntraRefresh(), 0);
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_GT(len, 0U);
+    codec->ReleaseOutputBuffer(buf);
+  }
+}
+
+TEST_F(IntelCodecTest, H264EncodeWithLongTermReference) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.advanced.numLongTermRefs = 2;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (uint32_t i = 0; i < 8; i++) {
+    if (i == 0) EXPECT_EQ(codec->MarkLongTermReference(), 0);
+    // pretend frames since 2 are lost, recover from frame 0
+    if (i == 5) EXPECT_EQ(codec->InvalidateReferences(2, i - 1), 0);
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_GT(len, 0U);
+    codec->ReleaseOutputBuffer(buf);
+  }
+}
+
+TEST(LongTermReferences, MarkInvalidateRefresh) {
+  LongTermReferences refs;
+  refs.Allocate(2);
+  ReferenceControl ctrl;
+  EXPECT_FALSE(refs.Resolve(0, &ctrl));
+  // frame 0 and 5 are marked into both slots
+  for (uint32_t frame : {0u, 5u}) {
+    ASSERT_TRUE(refs.Mark());
+    ASSERT_TRUE(refs.Resolve(frame, &ctrl));
+    EXPECT_EQ(ctrl.mark, frame ? 1 : 0);
+    EXPECT_EQ(ctrl.replaced, -1);
+    EXPECT_FALSE(ctrl.idr);
+    refs.Commit(ctrl);
+  }
+  EXPECT_EQ(refs.Frame(0), 0);
+  EXPECT_EQ(refs.Frame(1), 5);
+  // frame 9 references the slots before the loss
+  ASSERT_TRUE(refs.Invalidate(6, 8));
+  ASSERT_TRUE(refs.Resolve(9, &ctrl));
+  EXPECT_EQ(ctrl.use, 3U);
+  EXPECT_EQ(ctrl.rejectFirst, 6U);
+  EXPECT_EQ(ctrl.rejectLast, 8U);
+  EXPECT_FALSE(ctrl.idr);
+  refs.Commit(ctrl);
+  EXPECT_FALSE(refs.Resolve(10, &ctrl));
+  // all slots are taken, the oldest one is reused
+  ASSERT_TRUE(refs.Mark());
+  ASSERT_TRUE(refs.Resolve(10, &ctrl));
+  EXPECT_EQ(ctrl.mark, 0);
+  EXPECT_EQ(ctrl.replaced, 0);
+  refs.Commit(ctrl);
+  EXPECT_EQ(refs.Frame(0), 10);
+  // no valid reference is left, fall back to IDR
+  ASSERT_TRUE(refs.Invalidate(4, 12));
+  ASSERT_TRUE(refs.Resolve(13, &ctrl));
+  EXPECT_TRUE(ctrl.idr);
+  EXPECT_EQ(ctrl.use, 0U);
+  refs.Commit(ctrl);
+  EXPECT_EQ(refs.Frame(0), -1);
+  EXPECT_EQ(refs.Frame(1), -1);
+  // an empty slot is preferred to the next one
+  for (uint32_t frame : {14u, 20u}) {
+    ASSERT_TRUE(refs.Mark());
+    ASSERT_TRUE(refs.Resolve(frame, &ctrl));
+    refs.Commit(ctrl);
+  }
+  EXPECT_EQ(refs.Frame(0), 14);
+  EXPECT_EQ(refs.Frame(1), 20);
+  // an IDR of the encoder at frame 20 flushes the frames before it
+  refs.Refresh(20);
+  EXPECT_EQ(refs.Frame(0), -1);
+  EXPECT_EQ(refs.Frame(1), 20);
+  ASSERT_TRUE(refs.Invalidate(21, 22));
+  ASSERT_TRUE(refs.Resolve(23, &ctrl));
+  EXPECT_EQ(ctrl.use, 2U);
+  refs.Commit(ctrl);
+  refs.Refresh(30);
+  ASSERT_TRUE(refs.Invalidate(31, 31));
+  ASSERT_TRUE(refs.Resolve(32, &ctrl));
+  EXPECT_TRUE(ctrl.idr);
+}
+
+TEST(LongTermReferences, IdrAccessUnit) {
+  // SPS, PPS and an IDR slice, then a P slice of AVC
+  const uint8_t idr[] = {0, 0, 0, 1, 0x67, 0x42,    // SPS
+                         0, 0, 0, 1, 0x68, 0xCE,    // PPS
+                         0, 0, 1, 0x65, 0x88, 0x84};  // IDR
+  const uint8_t p[] = {0, 0, 0, 1, 0x41, 0x9A, 0x02};
+  EXPECT_EQ(AccessUnitType(IXR_CODEC_AVC, idr, sizeof idr), IXR_FRAME_IDR);
+  EXPECT_EQ(AccessUnitType(IXR_CODEC_AVC, p, sizeof p), IXR_FRAME_P);
+  EXPECT_EQ(AccessUnitType(IXR_CODEC_AVC, idr, 12), IXR_FRAME_UNKNOWN);
+}
+
+TEST_F(IntelCodecTest, H264EncodeWithFoveatedRoi) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.advanced.enableDynamicRoi = 1;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  const int32_t qp[3]{-6, 0, 6};
+  for (uint32_t i = 0; i < 4; i++) {
+    // the gaze point moves every frame
+    RegionOfInterest roi[3];
+    MakeFoveatedRegions(kWidth, kHeight, kWidth * i / 4, kHeight / 2, qp, 3,
+                        roi);
+    EXPECT_EQ(codec->QueueRegionOfInterest(roi, 3), 0);
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_GT(len, 0U);
+    codec->ReleaseOutputBuffer(buf);
+  }
+}
+
+TEST_F(IntelCodecTest, H264EncodeDropStaticFrames) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.advanced.staticFrameMode = ixr::IXR_STATIC_DROP;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  for (int i = 0; i < 3; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    // only the top-left pixel changes in the last frame
+    if (i == 2) static_cast<uint8_t *>(ptr)[0] ^= 0xFF;
+    int ret = codec->QueueInputBuffer(ptr);
+    EXPECT_EQ(ret, i == 1 ? 1 : 0);
+    uint32_t count = 0;
+    EXPECT_EQ(codec->GetDirtyRects(nullptr, &count), 0);
+    EXPECT_EQ(count, i == 1 ? 0U : 1U);
+    if (ret == 1) continue;
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_GT(len, 0U);
+    codec->ReleaseOutputBuffer(buf);
+  }
+}
+
+TEST_F(IntelCodecTest, H264EncodeRetrySkippedFrame) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.advanced.staticFrameMode = ixr::IXR_STATIC_SKIP;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  uint32_t lens[3] = {};
+  void *buf = nullptr;
+  void *ptr = codec->DequeueInputBuffer();
+  memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+  EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+  EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &lens[0]), 0);
+  codec->ReleaseOutputBuffer(buf);
+  // the last frame again is static, but fails as no buffer is dequeued
+  EXPECT_EQ(codec->QueueInputBuffer(nullptr), -1);
+  // the retry changes as a whole and isn't skipped, the next one is
+  for (int i = 1; i < 3; i++) {
+    ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    for (uint32_t j = 0; j < kWidth * kHeight; j++) {
+      static_cast<uint8_t *>(ptr)[j] ^= 0xFF;
+    }
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &lens[i]), 0);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  EXPECT_GT(lens[1], lens[2] * 4);
+}
+
+static bool SameRect(const DirtyRect &r, uint32_t left, uint32_t top,
+                     uint32_t right, uint32_t bottom) {
+  return r.left == left && r.top == top && r.right == right &&
+         r.bottom == bottom;
+}
+
+TEST(FrameDiff, DirtyBlocksOfNV12) {
+  const uint32_t w = 64, h = 48;
+  std::vector<uint8_t> frame(w * h * 3 / 2, 128);
+  FrameDiff diff;
+  diff.Allocate(w, h, IXR_COLOR_NV12);
+  // the first frame is dirty as a whole
+  ASSERT_EQ(diff.Update(frame.data()), 1U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 0, 0, w, h));
+  EXPECT_EQ(diff.Update(frame.data()), 0U);
+  EXPECT_TRUE(diff.Rects().empty());
+  // a luma pixel dirties its 16x16 block
+  frame[5 * w + 20]++;
+  ASSERT_EQ(diff.Update(frame.data()), 1U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 16, 0, 32, 16));
+  EXPECT_EQ(diff.Update(frame.data()), 0U);
+  // a UV row covers 2 luma rows, and a UV pair a luma pixel pair
+  frame[w * h + 10 * w + 41]++;
+  ASSERT_EQ(diff.Update(frame.data()), 1U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 32, 16, 48, 32));
+  // adjacent blocks are merged into one rectangle
+  for (uint32_t y : {0u, 17u}) {
+    for (uint32_t x : {0u, 17u}) frame[y * w + x]++;
+  }
+  frame[(h - 1) * w + w - 1]++;
+  ASSERT_EQ(diff.Update(frame.data()), 2U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 0, 0, 32, 32));
+  EXPECT_TRUE(SameRect(diff.Rects()[1], 48, 32, 64, 48));
+  diff.Reset();
+  ASSERT_EQ(diff.Update(frame.data()), 1U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 0, 0, w, h));
+}
+
+TEST(FrameDiff, DirtyBlocksOfARGB) {
+  // sizes not multiple of the block are clipped
+  const uint32_t w = 40, h = 20;
+  std::vector<uint8_t> frame(w * h * 4, 0);
+  FrameDiff diff;
+  diff.Allocate(w, h, IXR_COLOR_ARGB);
+  diff.Update(frame.data());
+  frame[(18 * w + 33) * 4 + 3] = 0xFF;
+  ASSERT_EQ(diff.Update(frame.data()), 1U);
+  EXPECT_TRUE(SameRect(diff.Rects()[0], 32, 16, 40, 20));
+}
+
+TEST_F(IntelCodecTest, H264EncodeIntoRtpPackets) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  void *ptr = codec->DequeueInputBuffer();
+  memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+  EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+  void *buf = nullptr;
+  uint32_t len = 0;
+  EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+  RtpPacketizer rtp(par.codec, RtpConfig{0x1234, 96, 0, 1200});
+  const uint32_t n = rtp.Packetize(static_cast<uint8_t *>(buf), len, 3000);
+  EXPECT_GT(n, 1U);
+  EXPECT_EQ(rtp.Sequence(), n);
+  auto bs = static_cast<const uint8_t *>(buf);
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t count = 0;
+    const IoVec *iov = rtp.Packet(i, &count);
+    size_t size = 0;
+    for (uint32_t j = 0; j < count; j++) size += iov[j].size;
+    EXPECT_LE(size, 1200U);
+    // the marker bit is set on the last packet only
+    auto header = static_cast<const uint8_t *>(iov[0].base);
+    EXPECT_EQ((header[1] & 0x80) != 0, i + 1 == n);
+    // NAL units are sent in place
+    auto payload = static_cast<const uint8_t *>(iov[count - 1].base);
+    EXPECT_TRUE(payload >= bs && payload < bs + len);
+  }
+  codec->ReleaseOutputBuffer(buf);
+}
+
+// An access unit of parameter sets, SEI and a slice of 3000 bytes
+static std::vector<uint8_t> SyntheticAccessUnit(CodecFourcc codec) {
+  const bool hevc = codec == IXR_CODEC_HEVC;
+  // VPS, SPS, PPS, SEI and IDR of HEVC, or SPS, PPS, SEI and IDR of AVC
+  const std::vector<uint16_t> headers =
+      hevc ? std::vector<uint16_t>{0x4001, 0x4201, 0x4401, 0x4E01, 0x2601}
+           : std::vector<uint16_t>{0x67, 0x68, 0x06, 0x65};
+  std::vector<uint8_t> au;
+  for (size_t i = 0; i < headers.size(); i++) {
+    au.insert(au.end(), {0, 0, 0, 1});
+    if (hevc) au.push_back(static_cast<uint8_t>(headers[i] >> 8));
+    au.push_back(static_cast<uint8_t>(headers[i]));
+    const uint32_t size = i + 1 == headers.size() ? 3000 : 8 + i * 4;
+    // no zero byte, so no emulation prevention is needed
+    for (uint32_t k = 0; k < size; k++) au.push_back(k % 251 + 1);
+  }
+  return au;
+}
+
+// Rebuild Annex-B NAL units from a RTP packet
+static void Depacketize(CodecFourcc codec, const uint8_t *packet,
+                        size_t size, std::vector<uint8_t> *au) {
+  const bool hevc = codec == IXR_CODEC_HEVC;
+  const uint32_t header = hevc ? 2 : 1;
+  const uint8_t *p = packet + kRtpHeaderSize;
+  const size_t len = size - kRtpHeaderSize;
+  const uint8_t type = NaluType(codec, p[0]);
+  if (type == (hevc ? 48 : 24)) {
+    for (size_t off = header; off + 2 <= len;) {
+      const size_t n = (p[off] << 8) | p[off + 1];
+      au->insert(au->end(), {0, 0, 0, 1});
+      au->insert(au->end(), p + off + 2, p + off + 2 + n);
+      off += 2 + n;
+    }
+  } else if (type == (hevc ? 49 : 28)) {
+    const uint8_t fu = p[header];
+    if (fu & 0x80) {
+      au->insert(au->end(), {0, 0, 0, 1});
+      if (hevc) {
+        au->push_back(static_cast<uint8_t>((p[0] & 0x81) | (fu & 0x3F) << 1));
+        au->push_back(p[1]);
+      } else {
+        au->push_back(static_cast<uint8_t>((p[0] & 0xE0) | (fu & 0x1F)));
+      }
+    }
+    au->insert(au->end(), p + header + 1, p + len);
+  } else {
+    au->insert(au->end(), {0, 0, 0, 1});
+    au->insert(au->end(), p, p + len);
+  }
+}
+
+TEST(RtpPacketizer, AggregateAndFragment) {
+  for (auto codec : {IXR_CODEC_AVC, IXR_CODEC_HEVC}) {
+    const bool hevc = codec == IXR_CODEC_HEVC;
+    const auto au = SyntheticAccessUnit(codec);
+    RtpPacketizer rtp(codec, RtpConfig{0x1234, 96, 65534, 1200});
+    // parameter sets and SEI in one aggregation, the slice in 3 fragments
+    const uint32_t n = rtp.Packetize(au.data(), au.size(), 3000);
+    ASSERT_EQ(n, 4U);
+    EXPECT_EQ(rtp.Sequence(), 2);
+    std::vector<uint8_t> out, packet;
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t count = 0;
+      const IoVec *iov = rtp.Packet(i, &count);
+      packet.clear();
+      for (uint32_t j = 0; j < count; j++) {
+        auto base = static_cast<const uint8_t *>(iov[j].base);
+        packet.insert(packet.end(), base, base + iov[j].size);
+      }
+      ASSERT_LE(packet.size(), 1200U);
+      EXPECT_EQ(packet[0], 0x80);
+      EXPECT_EQ(packet[1], (i + 1 == n ? 0x80 : 0) | 96);
+      EXPECT_EQ((packet[2] << 8) | packet[3], (65534 + i) & 0xFFFF);
+      EXPECT_EQ(packet[7], 3000 & 0xFF);
+      const uint8_t *payload = &packet[kRtpHeaderSize];
+      const uint8_t type = NaluType(codec, payload[0]);
+      if (i == 0) {
+        EXPECT_EQ(type, hevc ? 48 : 24);
+      } else {
+        EXPECT_EQ(type, hevc ? 49 : 28);
+        // start and end bits of FU header
+        const uint8_t fu = payload[hevc ? 2 : 1];
+        EXPECT_EQ((fu & 0x80) != 0, i == 1);
+        EXPECT_EQ((fu & 0x40) != 0, i + 1 == n);
+        EXPECT_EQ(fu & (hevc ? 0x3F : 0x1F), hevc ? 19 : 5);
+      }
+      Depacketize(codec, packet.data(), packet.size(), &out);
+    }
+    EXPECT_EQ(out, au);
+  }
+}
+
+TEST(RtpPacketizer, SmallPackets) {
+  for (auto codec : {IXR_CODEC_AVC, IXR_CODEC_HEVC}) {
+    const auto au = SyntheticAccessUnit(codec);
+    // too small ones are raised to carry a byte in each fragment
+    for (uint32_t size : {1U, kRtpHeaderSize + 3, kRtpMinPacketSize, 40U}) {
+      RtpPacketizer rtp(codec, RtpConfig{0x1234, 96, 0, size});
+      const uint32_t n = rtp.Packetize(au.data(), au.size(), 3000);
+      ASSERT_GT(n, 0U);
+      std::vector<uint8_t> out, packet;
+      for (uint32_t i = 0; i < n; i++) {
+        uint32_t count = 0;
+        const IoVec *iov = rtp.Packet(i, &count);
+        packet.clear();
+        for (uint32_t j = 0; j < count; j++) {
+          auto base = static_cast<const uint8_t *>(iov[j].base);
+          packet.insert(packet.end(), base, base + iov[j].size);
+        }
+        ASSERT_LE(packet.size(), std::max(size, kRtpMinPacketSize));
+        Depacketize(codec, packet.data(), packet.size(), &out);
+      }
+      EXPECT_EQ(out, au);
+    }
+  }
+}
+
+#ifdef __linux__
+TEST(RtpPacketizer, SendOverLoopback) {
+  const auto au = SyntheticAccessUnit(IXR_CODEC_AVC);
+  RtpPacketizer rtp(IXR_CODEC_AVC, RtpConfig{0x1234, 96, 0, 1200});
+  const uint32_t n = rtp.Packetize(au.data(), au.size(), 0);
+  int rx = socket(AF_INET, SOCK_DGRAM, 0);
+  int tx = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(rx, 0);
+  ASSERT_GE(tx, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof addr;
+  ASSERT_EQ(bind(rx, reinterpret_cast<sockaddr *>(&addr), addrlen), 0);
+  ASSERT_EQ(getsockname(rx, reinterpret_cast<sockaddr *>(&addr), &addrlen), 0);
+  timeval timeout{1, 0};
+  setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  // one datagram of each packet, the payload is sent in place
+  std::vector<iovec> iov;
+  std::vector<mmsghdr> msgs(n);
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t count = 0;
+    const IoVec *v = rtp.Packet(i, &count);
+    for (uint32_t j = 0; j < count; j++) {
+      iov.push_back(iovec{const_cast<void *>(v[j].base), v[j].size});
+    }
+    msgs[i].msg_hdr.msg_name = &addr;
+    msgs[i].msg_hdr.msg_namelen = addrlen;
+    msgs[i].msg_hdr.msg_iovlen = count;
+  }
+  for (uint32_t i = 0, k = 0; i < n; k += msgs[i++].msg_hdr.msg_iovlen) {
+    msgs[i].msg_hdr.msg_iov = &iov[k];
+  }
+  EXPECT_EQ(sendmmsg(tx, msgs.data(), n, 0), static_cast<int>(n));
+  std::vector<uint8_t> out, packet(1500);
+  for (uint32_t i = 0; i < n; i++) {
+    const ssize_t len = recv(rx, packet.data(), packet.size(), 0);
+    ASSERT_GT(len, static_cast<ssize_t>(kRtpHeaderSize));
+    Depacketize(IXR_CODEC_AVC, packet.data(), len, &out);
+  }
+  EXPECT_EQ(out, au);
+  close(tx);
+  close(rx);
+}
+#endif
+
+TEST_F(IntelCodecTest, H264EncodeIntoFragmentedMp4) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.gop = 4;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  std::string mp4;
+  Fmp4Config mux{par.codec, kWidth, kHeight, 90000, 30, 2, 0};
+  Fmp4Writer writer(mux, [&](const IoVec *iov, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      mp4.append(static_cast<const char *>(iov[i].base), iov[i].size);
+    }
+    return true;
+  });
+  for (uint32_t i = 0; i < 8; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_TRUE(
+        writer.AddSample(static_cast<uint8_t *>(buf), len, i * 90000 / 30));
+    codec->ReleaseOutputBuffer(buf);
+  }
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_EQ(writer.Fragments(), 4U);
+  EXPECT_EQ(mp4.substr(4, 4), "ftyp");
+  LogOutput("test_encode_nv12_intel_cpu.mp4", &mp4[0],
+            static_cast<int>(mp4.size()));
+}
+
+static uint32_t ReadU32(const std::string &s, size_t at) {
+  auto p = reinterpret_cast<const uint8_t *>(&s[at]);
+  return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Types of the boxes in s from begin, whose sizes must add up to the end
+static std::string TopLevelBoxes(const std::string &s, size_t begin = 0) {
+  std::string types;
+  size_t at = begin;
+  while (at + 8 <= s.size()) {
+    types += s.substr(at + 4, 4);
+    const uint32_t size = ReadU32(s, at);
+    if (size < 8) break;
+    at += size;
+  }
+  return at == s.size() ? types : "";
+}
+
+// An AVC access unit, with parameter sets if it's IDR
+static std::string AvcAccessUnit(bool idr, uint32_t slice) {
+  std::string au;
+  if (idr) {
+    au += std::string("\0\0\0\1\x67\x42\xC0\x1E\xDA\x02\x80", 11);
+    au += std::string("\0\0\0\1\x68\xCE\x38\x80", 8);
+  }
+  au += std::string("\0\0\1", 3);
+  au += idr ? '\x65' : '\x41';
+  for (uint32_t k = 1; k < slice; k++) au += static_cast<char>(k % 251 + 1);
+  return au;
+}
+
+static void AppendNal(std::initializer_list<uint8_t> header,
+                      const std::vector<uint8_t> &rbsp,
+                      std::vector<uint8_t> *au) {
+  au->insert(au->end(), {0, 0, 0, 1});
+  au->insert(au->end(), header);
+  EscapeRbsp(rbsp.data(), static_cast<uint32_t>(rbsp.size()), au);
+}
+
+TEST(Fmp4Writer, SampleBoxes) {
+  std::vector<std::string> writes;
+  Fmp4Config mux{IXR_CODEC_AVC, 64, 48, 90000, 30, 1, 0};
+  Fmp4Writer writer(mux, [&](const IoVec *iov, uint32_t count) {
+    writes.emplace_back();
+    for (uint32_t i = 0; i < count; i++) {
+      writes.back().append(static_cast<const char *>(iov[i].base),
+                           iov[i].size);
+    }
+    return true;
+  });
+  auto p = AvcAccessUnit(false, 50);
+  EXPECT_FALSE(writer.AddSample(reinterpret_cast<const uint8_t *>(&p[0]),
+                                p.size(), 0));
+  EXPECT_TRUE(writes.empty());
+  auto idr = AvcAccessUnit(true, 101);
+  ASSERT_TRUE(writer.AddSample(reinterpret_cast<const uint8_t *>(&idr[0]),
+                               idr.size(), 3000));
+  ASSERT_TRUE(writer.AddSample(reinterpret_cast<const uint8_t *>(&p[0]),
+                               p.size(), 6000));
+  ASSERT_EQ(writes.size(), 3U);
+  EXPECT_EQ(TopLevelBoxes(writes[0]), "ftypmoov");
+  // avcC carries SPS and PPS, profile and level are copied from SPS
+  const size_t avcc = writes[0].find("avcC");
+  ASSERT_NE(avcc, std::string::npos);
+  EXPECT_EQ(writes[0].substr(avcc + 4, 4), std::string("\1\x42\xC0\x1E", 4));
+  EXPECT_EQ(writes[0].substr(avcc + 12, 7), idr.substr(4, 7));
+  EXPECT_EQ(writes[0].substr(avcc + 22, 4), idr.substr(15, 4));
+  EXPECT_EQ(writer.Fragments(), 2U);
+  for (size_t i = 1; i < writes.size(); i++) {
+    const std::string &frag = writes[i];
+    ASSERT_EQ(TopLevelBoxes(frag), "moofmdat");
+    const uint32_t moof = ReadU32(frag, 0);
+    const uint32_t sample = i == 1 ? 4 + 101 : 4 + 50;
+    EXPECT_EQ(ReadU32(frag, moof), 8 + sample);
+    EXPECT_EQ(ReadU32(frag, frag.find("mfhd") + 8), i);
+    // decode time from the first sample
+    const size_t tfdt = frag.find("tfdt");
+    EXPECT_EQ(ReadU32(frag, tfdt + 12), i == 1 ? 0U : 3000U);
+    // data_offset points to the sample after the mdat header
+    const size_t trun = frag.find("trun");
+    EXPECT_EQ(ReadU32(frag, trun + 8), 1U);
+    EXPECT_EQ(ReadU32(frag, trun + 12), moof + 8);
+    EXPECT_EQ(ReadU32(frag, trun + 16), 3000U);
+    EXPECT_EQ(ReadU32(frag, trun + 20), sample);
+    EXPECT_EQ(ReadU32(frag, trun + 24), i == 1 ? 0x02000000U : 0x01010000U);
+    // NAL units are length prefixed, parameter sets are dropped
+    EXPECT_EQ(ReadU32(frag, moof + 8), sample - 4);
+    EXPECT_EQ(frag[moof + 12], i == 1 ? '\x65' : '\x41');
+  }
+}
+
+TEST(Fmp4Writer, BufferedFragments) {
+  std::vector<std::string> writes;
+  Fmp4Config mux{IXR_CODEC_AVC, 64, 48, 90000, 30, 3, 0};
+  Fmp4Writer writer(mux, [&](const IoVec *iov, uint32_t count) {
+    writes.emplace_back();
+    for (uint32_t i = 0; i < count; i++) {
+      writes.back().append(static_cast<const char *>(iov[i].base),
+                           iov[i].size);
+    }
+    return true;
+  });
+  // a key frame closes the fragment of 2 samples
+  const bool keys[] = {true, false, true, false, false, false};
+  const uint64_t pts[] = {0, 3000, 7000, 10000, 13000, 16000};
+  for (int i = 0; i < 6; i++) {
+    auto au = AvcAccessUnit(keys[i], 20 + i);
+    ASSERT_TRUE(writer.AddSample(reinterpret_cast<const uint8_t *>(&au[0]),
+                                 au.size(), pts[i]));
+  }
+  ASSERT_EQ(writes.size(), 3U);
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_TRUE(writer.Flush());
+  ASSERT_EQ(writes.size(), 4U);
+  const uint32_t counts[] = {2, 3, 1};
+  // a sample lasts till the next one, or as the one before at the end
+  const uint32_t durations[][3] = {
+      {3000, 4000}, {3000, 3000, 3000}, {3000}};
+  for (int f = 0; f < 3; f++) {
+    const std::string &frag = writes[f + 1];
+    ASSERT_EQ(TopLevelBoxes(frag), "moofmdat");
+    const size_t trun = frag.find("trun");
+    ASSERT_EQ(ReadU32(frag, trun + 8), counts[f]);
+    uint32_t payload = 0;
+    for (uint32_t i = 0; i < counts[f]; i++) {
+      const size_t at = trun + 16 + 12 * i;
+      EXPECT_EQ(ReadU32(frag, at), durations[f][i]);
+      payload += ReadU32(frag, at + 4);
+      EXPECT_EQ(ReadU32(frag, at + 8),
+                i == 0 && f < 2 ? 0x02000000U : 0x01010000U);
+    }
+    EXPECT_EQ(ReadU32(frag, ReadU32(frag, 0)), 8 + payload);
+  }
+}
+
+// SPS of HEVC with a sub-layer, or of AVC High 4:2:2
+static std::vector<uint8_t> FormatSps(CodecFourcc codec, uint32_t chroma,
+                                      uint32_t depth) {
+  std::vector<uint8_t> rbsp;
+  BitWriter bw(&rbsp);
+  if (codec == IXR_CODEC_HEVC) {
+    bw.U(0, 4);
+    bw.U(1, 3);  // sps_max_sub_layers_minus1
+    bw.Bit(1);
+    bw.U(2, 8);  // Main10
+    bw.U(0x20000000, 32);
+    bw.U(0x9, 4);
+    bw.U(0, 32);
+    bw.U(0, 12);
+    bw.U(120, 8);  // level 4
+    bw.U(3, 2);    // sub-layer profile and level
+    bw.U(0, 14);
+    for (int i = 0; i < 3; i++) bw.U(0x5A5A5A, 24);
+    bw.U(0x5A5A, 16);
+    bw.U(90, 8);
+    bw.Ue(0);
+    bw.Ue(chroma);
+    if (chroma == 3) bw.Bit(0);
+    bw.Ue(64);
+    bw.Ue(48);
+    bw.Bit(1);  // conformance window
+    for (int i = 0; i < 4; i++) bw.Ue(i);
+  } else {
+    bw.U(122, 8);
+    bw.U(0, 8);
+    bw.U(40, 8);
+    bw.Ue(0);
+    bw.Ue(chroma);
+    if (chroma == 3) bw.Bit(0);
+  }
+  bw.Ue(depth - 8);
+  bw.Ue(depth - 8);
+  bw.Bit(0);
+  bw.Bit(0);
+  bw.Ue(0);
+  bw.Trailing();
+  return rbsp;
+}
+
+TEST(Fmp4Writer, SampleFormatOfSps) {
+  struct Case {
+    CodecFourcc codec;
+    uint32_t chroma;
+    uint32_t depth;
+  };
+  const Case cases[] = {{IXR_CODEC_HEVC, 1, 10},
+                        {IXR_CODEC_HEVC, 3, 10},
+                        {IXR_CODEC_HEVC, 1, 8},
+                        {IXR_CODEC_AVC, 2, 10}};
+  for (auto &c : cases) {
+    const bool hevc = c.codec == IXR_CODEC_HEVC;
+    std::vector<uint8_t> au;
+    if (hevc) {
+      AppendNal({0x40, 0x01}, {0x0C, 0x01, 0xFF, 0xFF}, &au);
+      AppendNal({0x42, 0x01}, FormatSps(c.codec, c.chroma, c.depth), &au);
+      AppendNal({0x44, 0x01}, {0xC1, 0x72, 0xB4}, &au);
+      AppendNal({0x26, 0x01}, {0xAF, 0x00, 0x41}, &au);
+    } else {
+      AppendNal({0x67}, FormatSps(c.codec, c.chroma, c.depth), &au);
+      AppendNal({0x68}, {0xCE, 0x38, 0x80}, &au);
+      AppendNal({0x65}, {0x88, 0x84, 0x21}, &au);
+    }
+    std::string init;
+    Fmp4Config mux{c.codec, 64, 48, 90000, 30, 1, 0};
+    Fmp4Writer writer(mux, [&](const IoVec *iov, uint32_t count) {
+      if (!init.empty()) return true;
+      for (uint32_t i = 0; i < count; i++) {
+        init.append(static_cast<const char *>(iov[i].base), iov[i].size);
+      }
+      return true;
+    });
+    ASSERT_TRUE(writer.AddSample(au.data(), au.size(), 0));
+    // chroma_format_idc and bit depths are read from SPS
+    const std::string format{char(0xFC | c.chroma), char(0xF0 | c.depth),
+                             char(0xF0 | c.depth)};
+    if (hevc) {
+      const size_t hvcc = init.find("hvcC");
+      ASSERT_NE(hvcc, std::string::npos);
+      EXPECT_EQ(init.substr(hvcc + 20, 3), format);
+    } else {
+      const size_t avcc = init.find("avcC");
+      ASSERT_NE(avcc, std::string::npos);
+      const size_t end = avcc - 4 + ReadU32(init, avcc - 4);
+      EXPECT_EQ(init.substr(end - 4, 3), format);
+    }
+  }
+}
+
+// SPS of 4:2:0 progressive pictures, High profile if not Baseline
+static std::vector<uint8_t> StripeSps(uint32_t profile, uint32_t widthMbs,
+                                      uint32_t heightMbs, uint32_t cropBottom) {
+  std::vector<uint8_t> rbsp;
+  BitWriter bw(&rbsp);
+  bw.U(profile, 8);
+  bw.U(0, 8);
+  bw.U(30, 8);  // level 3.0
+  bw.Ue(0);
+  if (profile != 66) {
+    bw.Ue(1);  // chroma_format_idc
+    bw.Ue(0);
+    bw.Ue(0);
+    bw.Bit(0);
+    bw.Bit(0);  // no scaling matrix
+  }
+  bw.Ue(0);  // log2_max_frame_num_minus4
+  bw.Ue(0);  // pic_order_cnt_type
+  bw.Ue(2);  // log2_max_pic_order_cnt_lsb_minus4
+  bw.Ue(1);
+  bw.Bit(0);
+  bw.Ue(widthMbs - 1);
+  bw.Ue(heightMbs - 1);
+  bw.Bit(1);  // frame_mbs_only_flag
+  bw.Bit(1);
+  bw.Bit(cropBottom != 0);
+  if (cropBottom) {
+    for (uint32_t c : {0u, 0u, 0u, cropBottom}) bw.Ue(c);
+  }
+  bw.Bit(0);  // no VUI
+  bw.Trailing();
+  return rbsp;
+}
+
+static std::vector<uint8_t> StripePps(bool cabac) {
+  std::vector<uint8_t> rbsp;
+  BitWriter bw(&rbsp);
+  bw.Ue(0);
+  bw.Ue(0);
+  bw.Bit(cabac);
+  bw.Bit(0);
+  bw.Ue(0);  // one slice group
+  bw.Ue(0);
+  bw.Ue(0);
+  bw.Bit(0);
+  bw.U(0, 2);
+  bw.Se(0);
+  bw.Se(0);
+  bw.Se(0);
+  bw.Bit(1);  // deblocking_filter_control_present_flag
+  bw.Bit(0);
+  bw.Bit(0);
+  bw.Trailing();
+  return rbsp;
+}
+
+// a slice of an IDR (I) or P picture, its data has a start code emulation
+static std::vector<uint8_t> StripeSlice(bool idr, bool cabac, uint32_t firstMb,
+                                        uint32_t frame) {
+  std::vector<uint8_t> rbsp;
+  BitWriter bw(&rbsp);
+  bw.Ue(firstMb);
+  bw.Ue(idr ? 7 : 5);
+  bw.Ue(0);
+  bw.U(frame, 4);
+  if (idr) bw.Ue(0);
+  bw.U(frame * 2, 6);
+  if (!idr) {
+    bw.Bit(0);  // num_ref_idx_active_override_flag
+    bw.Bit(0);  // ref_pic_list_modification_flag_l0
+  }
+  bw.Bit(0);  // no_output_of_prior_pics_flag or adaptive marking
+  if (idr) bw.Bit(0);
+  if (cabac && !idr) bw.Ue(1);
+  bw.Se(idr ? -2 : 1);
+  bw.Ue(idr ? 0 : 1);
+  if (idr) {
+    bw.Se(-1);
+    bw.Se(2);
+  }
+  if (cabac) {
+    while (!bw.Aligned()) bw.Bit(1);
+    for (uint32_t b : {0x00u, 0x00u, 0x01u, 0xABu, frame, 0x80u}) {
+      bw.U(b, 8);
+    }
+  } else {
+    bw.U(0x2D, 7);
+    bw.U(0, 16);
+    bw.U(0x3, 8);
+    bw.U(frame, 9);
+    bw.Trailing();
+  }
+  return rbsp;
+}
+
+TEST(SliceStitcher, RepackFirstMbInSlice) {
+  // 320x72 in stripes of 3 and 2 MB rows, both stripes have 2 slices
+  const uint32_t kWidthMbs = 20;
+  for (bool cabac : {false, true}) {
+    SCOPED_TRACE(cabac ? "CABAC" : "CAVLC");
+    const uint32_t profile = cabac ? 100 : 66;
+    SliceStitcher stitcher;
+    ASSERT_EQ(stitcher.Reset(320, 72, {0, 48}, 30), 0);
+    for (uint32_t frame = 0; frame < 2; frame++) {
+      const bool idr = frame == 0;
+      std::vector<uint8_t> units[2], expected, out;
+      if (idr) {
+        AppendNal({0x67}, StripeSps(profile, kWidthMbs, 3, 0), &units[0]);
+        AppendNal({0x68}, StripePps(cabac), &units[0]);
+        AppendNal({0x67}, StripeSps(profile, kWidthMbs, 2, 4), &units[1]);
+        AppendNal({0x68}, StripePps(cabac), &units[1]);
+        // the SPS of the full picture crops 8 rows of the last MB row
+        AppendNal({0x67}, StripeSps(profile, kWidthMbs, 5, 4), &expected);
+        AppendNal({0x68}, StripePps(cabac), &expected);
+      }
+      const uint8_t header = idr ? 0x65 : 0x41;
+      const uint32_t firstMbs[2][2] = {{0, 40}, {0, 20}};
+      for (int i = 0; i < 2; i++) {
+        for (uint32_t mb : firstMbs[i]) {
+          AppendNal({header}, StripeSlice(idr, cabac, mb, frame), &units[i]);
+          AppendNal({header},
+                    StripeSlice(idr, cabac, mb + i * 3 * kWidthMbs, frame),
+                    &expected);
+        }
+      }
+      const uint8_t *data[] = {units[0].data(), units[1].data()};
+      const uint32_t sizes[] = {static_cast<uint32_t>(units[0].size()),
+                                static_cast<uint32_t>(units[1].size())};
+      ASSERT_EQ(stitcher.Stitch(data, sizes, &out), 0);
+      EXPECT_EQ(out, expected);
+    }
+    // frame types of stripes are out of sync
+    std::vector<uint8_t> idr, p, out;
+    AppendNal({0x65}, StripeSlice(true, cabac, 0, 2), &idr);
+    AppendNal({0x41}, StripeSlice(false, cabac, 0, 2), &p);
+    const uint8_t *data[] = {idr.data(), p.data()};
+    const uint32_t sizes[] = {static_cast<uint32_t>(idr.size()),
+                              static_cast<uint32_t>(p.size())};
+    EXPECT_EQ(stitcher.Stitch(data, sizes, &out), -1);
+  }
+}
+
+TEST(SliceStitcher, RefuseBeyondLevel62) {
+  SliceStitcher stitcher;
+  // 8K fits in MaxFS of level 6.2, 16K doesn't
+  EXPECT_EQ(stitcher.Reset(7680, 4320, {0, 2160}, 60), 0);
+  EXPECT_EQ(stitcher.Reset(15360, 7680, {0, 3840}, 30), -1);
+  std::vector<uint8_t> au, out;
+  AppendNal({0x65}, StripeSlice(true, false, 0, 0), &au);
+  const uint8_t *data[] = {au.data(), au.data()};
+  const uint32_t sizes[] = {static_cast<uint32_t>(au.size()),
+                            static_cast<uint32_t>(au.size())};
+  EXPECT_EQ(stitcher.Stitch(data, sizes, &out), -1);
+  // no encoder is created for such a picture
+  uint32_t created = 0;
+  TiledEncoder codec(4, [&created](AdapterVendor) {
+    created++;
+    return std::unique_ptr<Encoder>();
+  });
+  CodecConfig par{};
+  par.codec = IXR_CODEC_AVC;
+  par.width = 15360;
+  par.height = 7680;
+  par.fps = 30;
+  par.memoryType = IXR_MEM_INTERNAL_CPU;
+  par.inputFormat = IXR_COLOR_NV12;
+  EXPECT_EQ(codec.Allocate(par), -1);
+  EXPECT_EQ(created, 0U);
+}
+
+TEST_F(IntelCodecTest, H264EncodeTiled) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  par.gop = 4;
+  TiledEncoder codec(2);
+  ASSERT_EQ(codec.Allocate(par), 0);
+  std::string bitstream;
+  for (uint32_t i = 0; i < 8; i++) {
+    void *ptr = codec.DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec.QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    ASSERT_EQ(codec.DequeueOutputBuffer(&buf, &len), 0);
+    // slices of both stripes are in one picture
+    EXPECT_GE(FindSlices(par.codec, static_cast<uint8_t *>(buf), len,
+                         nullptr, 0),
+              2U);
+    bitstream.append(static_cast<char *>(buf), len);
+    codec.ReleaseOutputBuffer(buf);
+  }
+  LogOutput("test_encode_nv12_intel_tiled.264", &bitstream[0],
+            static_cast<int>(bitstream.size()));
+}
+
+// A backend of fake codecs, which spend `cost` seconds of the clock on
+// each frame. Encoders output a frame in `parts`, and decoders `delay` frames
+// later.
+struct FakeBackend {
+  std::atomic<double> *clock;
+  double cost;
+  int parts;
+  int delay;
+  bool fail;    //!< fails to create codecs
+  int created;
+  int alive;
+  int dropped;  //!< codecs destroyed with outputs held
+  int frames;   //!< frames queued
+};
+
+class FakeEncoder : public Encoder {
+ public:
+  explicit FakeEncoder(FakeBackend *backend) : backend_(backend) {
+    backend_->created++;
+    backend_->alive++;
+  }
+
+  ~FakeEncoder() override {
+    backend_->alive--;
+    if (held_) backend_->dropped++;
+  }
+
+  void *DequeueInputBuffer() override { return input_; }
+
+  int QueueInputBuffer(void *) override {
+    *backend_->clock = *backend_->clock + backend_->cost;
+    backend_->frames++;
+    queued_++;
+    return 0;
+  }
+
+  int DequeueOutputBuffer(void **ptr, uint32_t *size) override {
+    if (!queued_) return -1;
+    *ptr = &output_[part_];
+    *size = 1;
+    held_++;
+    if (++part_ < backend_->parts) return 1;
+    part_ = 0;
+    queued_--;
+    return 0;
+  }
+
+  void ReleaseOutputBuffer(void *) override { held_--; }
+
+ private:
+  FakeBackend *backend_;
+  uint8_t input_[16] = {};
+  uint8_t output_[4] = {};
+  std::atomic<int> queued_{0};
+  int part_ = 0;
+  std::atomic<int> held_{0};
+};
+
+class FakeDecoder : public Decoder {
+ public:
+  explicit FakeDecoder(FakeBackend *backend) : backend_(backend) {
+    backend_->created++;
+    backend_->alive++;
+  }
+
+  ~FakeDecoder() override {
+    backend_->alive--;
+    if (held_) backend_->dropped++;
+  }
+
+  int QueueInputBuffer(void *ptr, uint32_t, int64_t pts) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (ptr) {
+      *backend_->clock = *backend_->clock + backend_->cost;
+      backend_->frames++;
+      delayed_.push_back(pts);
+    }
+    // like MSDK, a flush outputs at most one frame
+    if (!delayed_.empty() &&
+        (!ptr || delayed_.size() > static_cast<size_t>(backend_->delay))) {
+      ready_.push_back(delayed_.front());
+      delayed_.erase(delayed_.begin());
+    }
+    return 0;
+  }
+
+  int DequeueOutputBuffer(void **ptr, int64_t *pts) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (ready_.empty()) return -1;
+    *pts = ready_.front();
+    ready_.erase(ready_.begin());
+    *ptr = &output_[*pts % sizeof output_];
+    held_++;
+    return 0;
+  }
+
+  void ReleaseOutputBuffer(void *) override { held_--; }
+
+ private:
+  FakeBackend *backend_;
+  std::mutex lock_;
+  std::vector<int64_t> delayed_;
+  std::vector<int64_t> ready_;
+  uint8_t output_[16] = {};
+  std::atomic<int> held_{0};
+};
+
+static BackendInfo FakeBackendInfo(const char *name, bool software,
+                                   double pixelRate, FakeBackend *backend) {
+  BackendInfo info{};
+  info.name = name;
+  info.software = software;
+  info.pixelRate = pixelRate;
+  info.encoder = [backend](const CodecConfig &) -> std::unique_ptr<Encoder> {
+    if (backend->fail) return nullptr;
+    return std::unique_ptr<Encoder>(new FakeEncoder(backend));
+  };
+  info.decoder = [backend](CodecConfig &, void *,
+                           uint32_t) -> std::unique_ptr<Decoder> {
+    if (backend->fail) return nullptr;
+    return std::unique_ptr<Decoder>(new FakeDecoder(backend));
+  };
+  return info;
+}
+
+static CodecConfig BrokerConfig() {
+  CodecConfig par{};
+  par.codec = IXR_CODEC_AVC;
+  par.width = 64;
+  par.height = 64;
+  par.fps = 30;
+  return par;
+}
+
+TEST(CodecBroker, PlaceByLoad) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  // a session demands 64x64 at 30 fps
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[3] = {};
+  for (auto &f : fakes) f.clock = &now;
+  const int a = broker.AddBackend(
+      FakeBackendInfo("a", false, kDemand * 2.5, &fakes[0]));
+  const int b = broker.AddBackend(
+      FakeBackendInfo("b", false, kDemand * 1.2, &fakes[1]));
+  const int sw =
+      broker.AddBackend(FakeBackendInfo("sw", true, kDemand * 1.5, &fakes[2]));
+  // hardware with room by the lowest load, software with room, then the
+  // least loaded one
+  const int expected[] = {a, a, b, sw, a};
+  std::vector<std::unique_ptr<Encoder>> sessions;
+  for (int backend : expected) {
+    sessions.push_back(broker.CreateEncoder(BrokerConfig()));
+    ASSERT_TRUE(sessions.back());
+    EXPECT_EQ(broker.GetBackend(sessions.back().get()), backend);
+  }
+  EXPECT_EQ(broker.GetBackendStat(a).sessions, 3U);
+  EXPECT_DOUBLE_EQ(broker.GetBackendStat(a).demand, kDemand * 3);
+  sessions.clear();
+  EXPECT_EQ(broker.GetBackendStat(a).sessions, 0U);
+  EXPECT_EQ(fakes[0].alive + fakes[1].alive + fakes[2].alive, 0);
+}
+
+TEST(CodecBroker, SkipFailedBackend) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[2] = {};
+  for (auto &f : fakes) f.clock = &now;
+  const int a =
+      broker.AddBackend(FakeBackendInfo("a", false, kDemand * 4, &fakes[0]));
+  const int b =
+      broker.AddBackend(FakeBackendInfo("b", false, kDemand * 2, &fakes[1]));
+  fakes[0].fail = true;
+  auto first = broker.CreateEncoder(BrokerConfig());
+  ASSERT_TRUE(first);
+  EXPECT_EQ(broker.GetBackend(first.get()), b);
+  EXPECT_EQ(broker.GetBackendStat(a).sessions, 0U);
+  // the failed backend isn't tried until it's retried 10s later
+  fakes[0].fail = false;
+  now = now + 5;
+  auto second = broker.CreateEncoder(BrokerConfig());
+  EXPECT_EQ(broker.GetBackend(second.get()), b);
+  EXPECT_EQ(fakes[0].created, 0);
+  now = now + 5;
+  auto third = broker.CreateEncoder(BrokerConfig());
+  EXPECT_EQ(broker.GetBackend(third.get()), a);
+  // nothing is created if all backends fail
+  fakes[0].fail = fakes[1].fail = true;
+  EXPECT_FALSE(broker.CreateEncoder(BrokerConfig()));
+}
+
+TEST(CodecBroker, MigrateAtSafePoint) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[2] = {};
+  for (auto &f : fakes) f.clock = &now;
+  // a is estimated the fastest but measured at 1.5x of its capacity
+  fakes[0].cost = 0.05;
+  fakes[0].parts = fakes[1].parts = 2;
+  const int a =
+      broker.AddBackend(FakeBackendInfo("a", false, kDemand * 20, &fakes[0]));
+  const int b =
+      broker.AddBackend(FakeBackendInfo("b", false, kDemand * 10, &fakes[1]));
+  auto codec = broker.CreateEncoder(BrokerConfig());
+  ASSERT_TRUE(codec);
+  ASSERT_EQ(broker.GetBackend(codec.get()), a);
+  now = now + 2;  // settled
+  void *parts[2] = {};
+  uint32_t size = 0;
+  ASSERT_EQ(codec->QueueInputBuffer(codec->DequeueInputBuffer()), 0);
+  EXPECT_EQ(codec->DequeueOutputBuffer(&parts[0], &size), 1);
+  EXPECT_EQ(codec->DequeueOutputBuffer(&parts[1], &size), 0);
+  EXPECT_NEAR(broker.GetBackendStat(a).load, 1.5, 1e-6);
+  // not moved while the first part is still held
+  codec->ReleaseOutputBuffer(parts[1]);
+  codec->DequeueInputBuffer();
+  EXPECT_EQ(broker.GetBackend(codec.get()), a);
+  EXPECT_EQ(fakes[1].created, 0);
+  codec->ReleaseOutputBuffer(parts[0]);
+  codec->DequeueInputBuffer();
+  EXPECT_EQ(broker.GetBackend(codec.get()), b);
+  EXPECT_EQ(fakes[0].alive, 0);
+  EXPECT_EQ(fakes[0].dropped, 0);
+  EXPECT_EQ(fakes[1].alive, 1);
+  EXPECT_EQ(broker.GetBackendStat(a).migrated, 1U);
+  EXPECT_EQ(broker.GetBackendStat(a).sessions, 0U);
+  EXPECT_EQ(broker.GetBackendStat(b).placed, 1U);
+  // the output order goes on after the move
+  OutputDescriptor desc{};
+  ASSERT_EQ(codec->QueueInputBuffer(codec->DequeueInputBuffer()), 0);
+  ASSERT_EQ(codec->DequeueOutputSegments(&desc), 0);
+  EXPECT_EQ(desc.frameOrder, 1U);
+  codec->ReleaseOutputSegments(desc);
+  codec.reset();
+  EXPECT_EQ(fakes[1].dropped, 0);
+}
+
+TEST(CodecBroker, MigrateWithExternalMemory) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[2] = {};
+  for (auto &f : fakes) f.clock = &now;
+  fakes[0].cost = 0.05;
+  fakes[0].parts = fakes[1].parts = 1;
+  const int a =
+      broker.AddBackend(FakeBackendInfo("a", false, kDemand * 20, &fakes[0]));
+  const int b =
+      broker.AddBackend(FakeBackendInfo("b", false, kDemand * 10, &fakes[1]));
+  auto codec = broker.CreateEncoder(BrokerConfig());
+  ASSERT_TRUE(codec);
+  ASSERT_EQ(broker.GetBackend(codec.get()), a);
+  now = now + 2;
+  // frames never come from DequeueInputBuffer
+  uint8_t frame[16] = {};
+  void *ptr = nullptr;
+  uint32_t size = 0;
+  ASSERT_EQ(codec->QueueInputBuffer(frame), 0);
+  ASSERT_EQ(codec->DequeueOutputBuffer(&ptr, &size), 0);
+  codec->ReleaseOutputBuffer(ptr);
+  ASSERT_EQ(codec->QueueInputBuffer(frame), 0);
+  EXPECT_EQ(broker.GetBackend(codec.get()), b);
+  EXPECT_EQ(fakes[0].frames, 1);
+  EXPECT_EQ(fakes[1].frames, 1);
+  EXPECT_EQ(fakes[0].alive, 0);
+}
+
+TEST(CodecBroker, MigrateWithOutputThread) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[2] = {};
+  for (auto &f : fakes) f.clock = &now;
+  fakes[0].cost = 0.05;
+  fakes[0].parts = fakes[1].parts = 2;
+  const int a =
+      broker.AddBackend(FakeBackendInfo("a", false, kDemand * 20, &fakes[0]));
+  const int b =
+      broker.AddBackend(FakeBackendInfo("b", false, kDemand * 10, &fakes[1]));
+  auto codec = broker.CreateEncoder(BrokerConfig());
+  ASSERT_TRUE(codec);
+  ASSERT_EQ(broker.GetBackend(codec.get()), a);
+  now = now + 2;
+  const uint32_t kFrames = 60;
+  std::atomic<uint32_t> released{0};
+  std::atomic<bool> stopped{false};
+  // the output side polls all the time, also while the encoder is moved
+  std::thread output([&]() {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::vector<void *> parts;
+    while (released < kFrames && std::chrono::steady_clock::now() < deadline) {
+      void *ptr = nullptr;
+      uint32_t size = 0;
+      const int ret = codec->DequeueOutputBuffer(&ptr, &size);
+      if (ret < 0) continue;
+      parts.push_back(ptr);
+      if (ret > 0) continue;
+      for (void *part : parts) codec->ReleaseOutputBuffer(part);
+      parts.clear();
+      released++;
+    }
+    stopped = true;
+  });
+  for (uint32_t i = 0; i < kFrames; i++) {
+    // a safe point comes after the last frame is released
+    while (released < i && !stopped) std::this_thread::yield();
+    EXPECT_EQ(codec->QueueInputBuffer(codec->DequeueInputBuffer()), 0);
+  }
+  output.join();
+  EXPECT_EQ(released, kFrames);
+  EXPECT_EQ(broker.GetBackend(codec.get()), b);
+  EXPECT_EQ(broker.GetBackendStat(a).migrated, 1U);
+  EXPECT_EQ(fakes[0].alive, 0);
+  EXPECT_EQ(fakes[0].dropped, 0);
+  EXPECT_EQ(fakes[0].frames + fakes[1].frames, static_cast<int>(kFrames));
+  codec.reset();
+  EXPECT_EQ(fakes[1].dropped, 0);
+}
+
+TEST(CodecBroker, DrainBeforeMove) {
+  std::atomic<double> now{100};
+  CodecBroker broker(0.9, [&now]() { return now.load(); });
+  const double kDemand = 64 * 64 * 30;
+  FakeBackend fakes[2] = {};
+  for (auto &f : fakes) f.clock = &now;
+  fakes[0].cost = 0.05;
+  fakes[0].delay = fakes[1].delay = 3;
+  const int a =
+      broker.AddBackend(FakeBackendInfo("a", false, kDemand * 20, &fakes[0]));
+  const int b =
+      broker.AddBackend(FakeBackendInfo("b", false, kDemand * 10, &fakes[1]));
+  CodecConfig config = BrokerConfig();
+  uint8_t idr[] = {0, 0, 0, 1, 0x65, 0x88, 0x80};
+  auto codec = broker.CreateDecoder(config, idr, sizeof idr);
+  ASSERT_TRUE(codec);
+  ASSERT_EQ(broker.GetBackend(codec.get()), a);
+  now = now + 2;
+  const int64_t kFrames = 60;
+  std::vector<int64_t> stamps;
+  std::atomic<int64_t> output{0};
+  std::atomic<bool> stopped{false};
+  std::thread consumer([&]() {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (output < kFrames &&
+           std::chrono::steady_clock::now() < deadline) {
+      void *ptr = nullptr;
+      int64_t pts = kPtsUnknown;
+      if (codec->DequeueOutputBuffer(&ptr, &pts)) continue;
+      stamps.push_back(pts);
+      codec->ReleaseOutputBuffer(ptr);
+      output++;
+    }
+    stopped = true;
+  });
+  // every frame is a key frame, the decoder is moved at the next one
+  for (int64_t i = 0; i < kFrames; i++) {
+    // paced by the output, so the load is measured on the way
+    while (output + fakes[0].delay < i && !stopped) std::this_thread::yield();
+    EXPECT_EQ(codec->QueueInputBuffer(idr, sizeof idr, i), 0);
+  }
+  for (int i = 0; i < fakes[1].delay; i++) {
+    EXPECT_EQ(codec->QueueInputBuffer(nullptr, 0, kPtsUnknown), 0);
+  }
+  consumer.join();
+  // frames held by the old decoder come out first, and none is lost
+  ASSERT_EQ(stamps.size(), static_cast<size_t>(kFrames));
+  for (int64_t i = 0; i < kFrames; i++) EXPECT_EQ(stamps[i], i);
+  EXPECT_EQ(broker.GetBackend(codec.get()), b);
+  EXPECT_EQ(fakes[0].alive, 0);
+  EXPECT_EQ(fakes[0].dropped, 0);
+  EXPECT_GT(fakes[1].frames, 0);
+}
+
+TEST_F(IntelCodecTest, H264EncodeBrokered) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  CodecBroker broker;
+  // an absent adapter is skipped
+  BackendInfo absent{};
+  absent.name = "absent";
+  absent.encoder = [](const CodecConfig &) { return nullptr; };
+  int id = broker.AddBackend(absent);
+  broker.AddDefaultBackends();
+  auto codec = broker.CreateEncoder(par);
+  ASSERT_TRUE(codec);
+  EXPECT_NE(broker.GetBackend(codec.get()), id);
+  for (uint32_t i = 0; i < 4; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  auto stat = broker.GetBackendStat(broker.GetBackend(codec.get()));
+  EXPECT_EQ(stat.sessions, 1U);
+  EXPECT_GT(stat.pixelRate, 0);
+}
+
+TEST(CaptureWriter, ChunkOfManyParts) {
+  std::string capture;
+  CaptureWriter writer(
+      [&](const IoVec *iov, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+          capture.append(static_cast<const char *>(iov[i].base), iov[i].size);
+        }
+        return true;
+      },
+      false);
+  const char parts[6][4] = {"ab", "cde", "f", "", "gh", "ijk"};
+  IoVec iov[6];
+  for (int i = 0; i < 6; i++) iov[i] = IoVec{parts[i], strlen(parts[i])};
+  writer.Write(IXR_CAPTURE_SEI, 5, 7, iov, 6);
+  EXPECT_TRUE(writer.Good());
+  size_t pos = 0;
+  CaptureReader reader([&](void *dst, size_t size) {
+    size = std::min(size, capture.size() - pos);
+    memcpy(dst, &capture[pos], size);
+    pos += size;
+    return size;
+  });
+  CaptureChunk chunk{};
+  const uint8_t *payload = nullptr;
+  ASSERT_TRUE(reader.Next(&chunk, &payload));
+  EXPECT_EQ(chunk.tag, IXR_CAPTURE_SEI);
+  EXPECT_EQ(chunk.time, 5);
+  ASSERT_EQ(chunk.size, 11U);
+  EXPECT_EQ(std::string(reinterpret_cast<const char *>(payload), 11),
+            "abcdefghijk");
+}
+
+TEST_F(IntelCodecTest, H264EncodeCaptureReplay) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  std::string capture;
+  auto writer = std::make_shared<CaptureWriter>(
+      [&](const IoVec *iov, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+          capture.append(static_cast<const char *>(iov[i].base), iov[i].size);
+        }
+        return true;
+      },
+      true);
+  auto codec = CaptureEncoder(Encoder::Create(par.adapter), writer);
+  codec->Allocate(par);
+  for (uint32_t i = 0; i < 4; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    EXPECT_EQ(codec->QueueUserData(&i, sizeof i), 0);
+    EXPECT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  codec.reset();
+  EXPECT_TRUE(writer->Good());
+  // identical frames cost a few bytes
+  EXPECT_LT(capture.size(), 2 * sizeof sFrameNV12);
+  size_t pos = 0;
+  CaptureReader reader([&](void *dst, size_t size) {
+    size = std::min(size, capture.size() - pos);
+    memcpy(dst, &capture[pos], size);
+    pos += size;
+    return size;
+  });
+  Replayer replayer;
+  ReplayReport report;
+  ASSERT_EQ(replayer.Run(&reader, IXR_REPLAY_MAXIMUM, &report), 0);
+  EXPECT_EQ(report.frames, 4U);
+  EXPECT_EQ(report.outputs, 4U);
+  EXPECT_EQ(report.mismatch, 0U);
+  EXPECT_GT(report.bytes, 0U);
+  EXPECT_GE(report.latencyMax, report.latencyP50);
+}
+
+// A plane of texture, so SSE2 lanes and the scalar tail see other values
+static uint8_t Texture(uint32_t x, uint32_t y) {
+  return static_cast<uint8_t>((x * 7 + y * 13) % 200 + 20);
+}
+
+TEST(QualityMeter, OffsetByOne) {
+  // widths aren't multiples of 16, rows end in the scalar tail
+  const uint32_t w = 38, h = 30;
+  std::vector<uint8_t> ref(w * h * 3 / 2), dist(ref.size());
+  for (uint32_t y = 0; y < h * 3 / 2; y++) {
+    for (uint32_t x = 0; x < w; x++) {
+      ref[y * w + x] = Texture(x, y);
+      dist[y * w + x] = ref[y * w + x] + 1;
+    }
+  }
+  QualityMeter meter(1);
+  QualityScore score;
+  const uint32_t metrics = IXR_QUALITY_PSNR | IXR_QUALITY_SSIM;
+  ASSERT_EQ(meter.Compare(PackedSurface(ref.data(), w, h, IXR_COLOR_NV12),
+                          PackedSurface(dist.data(), w, h, IXR_COLOR_NV12),
+                          metrics, &score),
+            0);
+  // MSE of 1 is 10 * log10(255^2) dB
+  for (double db : score.psnr) EXPECT_NEAR(db, 48.13, 0.005);
+  EXPECT_NEAR(score.psnrAll, 48.13, 0.005);
+  // variances and covariance are equal, only the means of windows differ
+  const double c1 = (0.01 * 255) * (0.01 * 255);
+  double ssim = 0;
+  uint32_t windows = 0;
+  for (uint32_t wy = 0; wy + 8 <= h / 4 * 4; wy += 4) {
+    for (uint32_t wx = 0; wx + 8 <= w / 4 * 4; wx += 4, windows++) {
+      double mean = 0;
+      for (uint32_t y = wy; y < wy + 8; y++) {
+        for (uint32_t x = wx; x < wx + 8; x++) mean += ref[y * w + x];
+      }
+      mean /= 64;
+      ssim += (2 * mean * (mean + 1) + c1) /
+              (mean * mean + (mean + 1) * (mean + 1) + c1);
+    }
+  }
+  EXPECT_NEAR(score.ssim, ssim / windows, 1e-9);
+  EXPECT_LT(score.ssim, 1);
+  // B, G and R of ARGB, alpha isn't scored
+  const uint32_t aw = 37;
+  std::vector<uint8_t> argb(aw * h * 4), argb1(argb.size());
+  for (size_t i = 0; i < argb.size(); i++) {
+    argb[i] = Texture(static_cast<uint32_t>(i % (aw * 4)),
+                      static_cast<uint32_t>(i / (aw * 4)));
+    argb1[i] = i % 4 == 3 ? 0 : argb[i] + 1;
+  }
+  ASSERT_EQ(meter.Compare(PackedSurface(argb.data(), aw, h, IXR_COLOR_ARGB),
+                          PackedSurface(argb1.data(), aw, h, IXR_COLOR_ARGB),
+                          IXR_QUALITY_PSNR, &score),
+            0);
+  for (double db : score.psnr) EXPECT_NEAR(db, 48.13, 0.005);
+  EXPECT_NEAR(score.psnrAll, 48.13, 0.005);
+}
+
+TEST(QualityMeter, RefuseTenBit) {
+  const uint32_t w = 24, h = 16;
+  std::vector<uint8_t> frame(w * h * 4, 0x40);
+  // P010 samples are 16-bit, and chroma follows the luma rows
+  auto p010 = PackedSurface(frame.data(), w, h, IXR_COLOR_P010);
+  EXPECT_EQ(p010.pitch, w * 2);
+  EXPECT_EQ(p010.uv, frame.data() + w * 2 * h);
+  auto y410 = PackedSurface(frame.data(), w, h, IXR_COLOR_Y410);
+  EXPECT_EQ(y410.pitch, w * 4);
+  QualityMeter meter(1);
+  QualityScore score;
+  EXPECT_EQ(meter.Compare(p010, p010, IXR_QUALITY_PSNR, &score), -1);
+  EXPECT_EQ(meter.Compare(y410, y410, IXR_QUALITY_SSIM, &score), -1);
+  auto argb = PackedSurface(frame.data(), w, h, IXR_COLOR_ARGB);
+  ASSERT_EQ(meter.Compare(argb, argb, IXR_QUALITY_PSNR, &score), 0);
+  EXPECT_EQ(score.psnrAll, kPsnrMax);
+}
+
+TEST_F(IntelCodecTest, H264EncodeQualityLoopback) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  const uint32_t metrics =
+      IXR_QUALITY_PSNR | IXR_QUALITY_SSIM | IXR_QUALITY_MSSSIM;
+  QualityMeter meter;
+  QualityScore same;
+  auto view = PackedSurface(sFrameNV12, par.width, par.height, par.inputFormat);
+  ASSERT_EQ(meter.Compare(view, view, metrics, &same), 0);
+  EXPECT_EQ(same.psnrAll, kPsnrMax);
+  EXPECT_DOUBLE_EQ(same.ssim, 1.0);
+  EXPECT_DOUBLE_EQ(same.msssim, 1.0);
+
+  QualityLoopback loopback(par, metrics);
+  auto codec = Encoder::Create(par.adapter);
+  codec->Allocate(par);
+  for (int i = 0; i < 4; i++) {
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    ASSERT_EQ(codec->QueueInputBuffer(ptr), 0);
+    loopback.PushSource(ptr);
+    void *buf = nullptr;
+    uint32_t len = 0;
+    ASSERT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0);
+    EXPECT_GE(loopback.PushBitstream(buf, len), 0);
+    codec->ReleaseOutputBuffer(buf);
+  }
+  EXPECT_GE(loopback.Flush(), 0);
+  ASSERT_EQ(loopback.Scores().size(), 4U);
+  auto mean = loopback.Mean();
+  EXPECT_GT(mean.psnrAll, 25);
+  EXPECT_LT(mean.psnrAll, kPsnrMax);
+  EXPECT_GT(mean.ssim, 0.8);
+  EXPECT_GT(mean.msssim, 0.8);
+}
+
+TEST_F(IntelCodecTest, H264EncodeRecordStreams) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  // small blocks, so that frames span blocks
+  BitstreamRecorder recorder(BitstreamRecorder::kAlignment, 8, 2);
+  const std::string names[] = {::testing::TempDir() + "record0.264",
+                               ::testing::TempDir() + "record1.264"};
+  int streams[2];
+  std::unique_ptr<Encoder> codecs[2];
+  std::string expect[2];
+  for (int i = 0; i < 2; i++) {
+    streams[i] = recorder.Open(names[i].c_str());
+    ASSERT_GE(streams[i], 0);
+    codecs[i] = Encoder::Create(par.adapter);
+    codecs[i]->Allocate(par);
+  }
+  for (int f = 0; f < 4; f++) {
+    for (int i = 0; i < 2; i++) {
+      void *ptr = codecs[i]->DequeueInputBuffer();
+      memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+      ASSERT_EQ(codecs[i]->QueueInputBuffer(ptr), 0);
+      OutputDescriptor desc;
+      ASSERT_EQ(codecs[i]->DequeueOutputSegments(&desc), 0);
+      EXPECT_EQ(recorder.Write(streams[i], desc.segments, desc.count), 0);
+      for (uint32_t j = 0; j < desc.count; j++) {
+        expect[i].append(static_cast<const char *>(desc.segments[j].base),
+                         desc.segments[j].size);
+      }
+      // outputs are copied into the pool
+      codecs[i]->ReleaseOutputSegments(desc);
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ(recorder.Close(streams[i]), 0);
+    std::ifstream file(names[i], std::ios::binary);
+    std::string got((std::istreambuf_iterator<char>(file)),
+                    std::istreambuf_iterator<char>());
+    EXPECT_EQ(got, expect[i]);
+  }
+  EXPECT_EQ(recorder.Write(streams[0], "", 1), -1);
+  auto stats = recorder.GetStats();
+  EXPECT_EQ(stats.bytes, expect[0].size() + expect[1].size());
+  EXPECT_GT(stats.writes, 2U);
+  for (const auto &name : names) std::remove(name.c_str());
+}
+
+#ifdef IXR_CODEC_BUILD_MSDK
+static void SetEnv(const char *name, const char *value) {
+#if defined(_WIN32)
+  _putenv_s(name, value);
+#else
+  if (*value) {
+    setenv(name, value, 1);
+  } else {
+    unsetenv(name);
+  }
+#endif
+}
+#endif
+
+TEST_F(IntelCodecTest, H264EncodeSessionStartup) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_AVC;
+  par.inputFormat = ixr::IXR_COLOR_NV12;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+#ifdef IXR_CODEC_BUILD_MSDK
+  // start from an empty cache kept in a file
+  const std::string file = ::testing::TempDir() + "mfx_dispatcher.cache";
+  std::remove(file.c_str());
+  SetEnv("MFX_DISPATCHER_CACHE", file.c_str());
+  auto &cache = MFX::MFXDiscoveryCache::Instance();
+  cache.Reload();
+  const auto &stat = cache.GetStatistics();
+  const mfxU32 hits = stat.hits, misses = stat.misses;
+#endif
+  // the first session scans the libraries, the others load the cached one
+  double ms[3];
+  for (int i = 0; i < 3; i++) {
+#ifdef IXR_CODEC_BUILD_MSDK
+    // the last one loads the file, as a new process does
+    if (i == 2) cache.Reload();
+#endif
+    auto start = std::chrono::steady_clock::now();
+    auto codec = Encoder::Create(par.adapter);
+    codec->Allocate(par);
+    ms[i] = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+    void *ptr = codec->DequeueInputBuffer();
+    memcpy(ptr, sFrameNV12, sizeof sFrameNV12);
+    ASSERT_EQ(codec->QueueInputBuffer(ptr), 0);
+    void *buf = nullptr;
+    uint32_t size = 0;
+    ASSERT_EQ(codec->DequeueOutputBuffer(&buf, &size), 0);
+    EXPECT_GT(size, 0U);
+    codec->ReleaseOutputBuffer(buf);
+#ifdef IXR_CODEC_BUILD_MSDK
+    EXPECT_EQ(stat.misses, misses + 1);
+    EXPECT_EQ(stat.hits, hits + i);
+#endif
+  }
+#ifdef IXR_CODEC_BUILD_MSDK
+  SetEnv("MFX_DISPATCHER_CACHE", "");
+  cache.Reload();
+  std::remove(file.c_str());
+#endif
+  RecordProperty("first_session_ms", std::to_string(ms[0]));
+  RecordProperty("cached_session_ms", std::to_string((ms[1] + ms[2]) / 2));
+}
+
+// Encodes an image into 10 bytes a step of quality
+class FakeJpegEncoder : public Encoder {
+ public:
+  FakeJpegEncoder(int32_t quality, int *resets)
+      : quality_(quality), resets_(resets) {}
+
+  void *DequeueInputBuffer() override { return input_; }
+
+  int QueueInputBuffer(void *) override {
+    queued_ = true;
+    return 0;
+  }
+
+  int DequeueOutputBuffer(void **ptr, uint32_t *size) override {
+    if (!queued_) return -1;
+    queued_ = false;
+    output_.assign(static_cast<size_t>(quality_) * 10, 0xFF);
+    *ptr = output_.data();
+    *size = static_cast<uint32_t>(output_.size());
+    return 0;
+  }
+
+  int SetJpegQuality(int32_t quality) override {
+    quality_ = quality;
+    (*resets_)++;
+    return 0;
+  }
+
+ private:
+  int32_t quality_;
+  int *resets_;
+  bool queued_ = false;
+  uint8_t input_[64 * 64 * 3 / 2] = {};
+  std::vector<uint8_t> output_;
+};
+
+TEST(JpegBatchEncoder, ResetQualityOfSession) {
+  std::vector<uint8_t> frame(64 * 64 * 3 / 2, 128);
+  int resets = 0;
+  JpegBatchEncoder batch(CodecConfig{}, 1, [&resets](const CodecConfig &c) {
+    return std::unique_ptr<Encoder>(
+        new FakeJpegEncoder(c.advanced.jpegQuality, &resets));
+  });
+  // the highest quality of at most 555 bytes is 55
+  std::vector<JpegImage> images(
+      3, JpegImage{frame.data(), 64, 64, IXR_COLOR_NV12, 90, 555});
+  std::vector<JpegResult> results(images.size());
+  ASSERT_EQ(batch.Encode(images.data(), images.size(), results.data()), 0U);
+  for (auto &r : results) {
+    EXPECT_EQ(r.status, 0);
+    EXPECT_EQ(r.quality, 55);
+    EXPECT_EQ(r.size, 550U);
+  }
+  // probes of every search run on one session
+  EXPECT_EQ(batch.Allocations(), 1U);
+  EXPECT_GT(resets, 3);
+}
+
+TEST_F(IntelCodecTest, JpegEncodeBatch) {
+  auto par = GetConfig();
+  std::vector<uint8_t> small(64 * 64 * 3 / 2, 128);
+  std::vector<JpegImage> images;
+  for (int i = 0; i < 8; i++) {
+    JpegImage image{sFrameNV12, kWidth, kHeight, IXR_COLOR_NV12, 90, 0};
+    if (i % 2) image = JpegImage{small.data(), 64, 64, IXR_COLOR_NV12, 90, 0};
+    // the last two fit the size of the first one at a lower quality
+    if (i >= 6) image.targetSize = 1;
+    images.push_back(image);
+  }
+  JpegBatchEncoder batch(par);
+  std::vector<JpegResult> results(images.size());
+  ASSERT_EQ(batch.Encode(images.data(), images.size(), results.data()), 0U);
+  images[6].targetSize = images[7].targetSize = results[0].size * 3 / 4;
+  ASSERT_EQ(batch.Encode(images.data(), images.size(), results.data()), 0U);
+  size_t total = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    const uint8_t *jpeg = batch.Arena() + results[i].offset;
+    ASSERT_GT(results[i].size, 2U);
+    EXPECT_EQ(jpeg[0], 0xFF);
+    EXPECT_EQ(jpeg[1], 0xD8);
+    total += results[i].size;
+  }
+  EXPECT_EQ(total, batch.ArenaSize());
+  EXPECT_EQ(results[6].status, 0);
+  EXPECT_LE(results[6].size, images[6].targetSize);
+  EXPECT_LT(results[6].quality, 90);
+}
+
+TEST_F(IntelCodecTest, H265EncodeFromCpuP010) {
+  auto par = GetConfig();
+  par.codec = ixr::IXR_CODEC_HEVC;
+  par.inputFormat = ixr::IXR_COLOR_P010;
+  par.memoryType = ixr::IXR_MEM_INTERNAL_CPU;
+  Encoder::ConfigInfo info;
+  info.vid = par.adapter;
+  info.config = &par;
+  auto codec = ixr::Encoder::Create(info);
+  void *ptr = codec->DequeueInputBuffer();
+  EXPECT_EQ(CaptureFrameSize(par), sizeof sFrameNV12 * 2);
+  ASSERT_EQ(ixr::ConvertBitDepth(sFrameNV12, ixr::IXR_COLOR_NV12, 0, ptr,
+                                 ixr::IXR_COLOR_P010, 0, kWidth, kHeight),
+            0);
+  // 8-bit samples survive the round trip
+  std::vector<uint8_t> narrow(sizeof sFrameNV12);
+  ASSERT_EQ(ixr::ConvertBitDepth(ptr, ixr::IXR_COLOR_P010, 0, narrow.data(),
+                                 ixr::IXR_COLOR_NV12, 0, kWidth, kHeight),
+            0);
+  EXPECT_EQ(std::memcmp(narrow.data(), sFrameNV12, narrow.size()), 0);
+  EXPECT_EQ(codec->QueueInputBuffer(nullptr), 0) << "QueueInput Failed";
+  void *buf = nullptr;
+  uint32_t len = 0;
+  EXPECT_EQ(codec->DequeueOutputBuffer(&buf, &len), 0)
+      << "DequeueOutput Failed";
+  LogOutput("test_encode_p010_intel_cpu.265", buf, len);
+  codec->ReleaseOutputBuffer(buf);
+}
+
+TEST(Executor, NestedGroups) {
+  Executor executor(ExecutorConfig{2, IXR_AFFINITY_CORE, -1});
+  ASSERT_EQ(executor.Threads(), 2U);
+  std::atomic<uint32_t> sum(0);
+  {
+    TaskGroup group(IXR_TASK_BATCH, &executor);
+    for (uint32_t i = 0; i < 64; i++) {
+      group.Run([&executor, &sum]() {
+        // tasks of workers go to their own queues, and are stolen by others
+        TaskGroup inner(IXR_TASK_INTERACTIVE, &executor);
+        for (int k = 0; k < 4; k++) inner.Run([&sum]() { sum++; });
+      });
+    }
+    group.Wait();
+  }
+  EXPECT_EQ(sum, 256U);
+  EXPECT_EQ(executor.GetStat().executed, 64U + 256U);
+}
+
+TEST(Executor, WaitTakesNoLowerPriority) {
+  Executor executor(ExecutorConfig{2, IXR_AFFINITY_NONE, -1});
+  std::atomic<int> started(0);
+  std::atomic<bool> release(false), waiting(false), stolen(false);
+  const auto waiter = std::this_thread::get_id();
+  // both workers are busy, one with the task of the group
+  executor.Submit([&]() {
+    started++;
+    while (!release) std::this_thread::yield();
+  });
+  TaskGroup interactive(IXR_TASK_INTERACTIVE, &executor);
+  interactive.Run([&]() {
+    started++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  });
+  while (started < 2) std::this_thread::yield();
+  TaskGroup batch(IXR_TASK_BATCH, &executor);
+  batch.Run([&]() {
+    if (waiting && std::this_thread::get_id() == waiter) stolen = true;
+  });
+  waiting = true;
+  interactive.Wait();
+  waiting = false;
+  EXPECT_FALSE(stolen);
+  release = true;
+  batch.Wait();
+}
+
+TEST(Backpressure, Watermarks) {
+  BackpressureConfig config{};
+  config.strategy = IXR_OVERLOAD_DROP_OLDEST;
+  BackpressureController controller(config);
+  // overloaded at 4 frames in the encoder, calm at 2
+  controller.Reset(4, true);
+  int64_t now = 0;
+  for (int i = 0; i < 4; i++, now += 10) {
+    EXPECT_EQ(controller.Offer(now, false, false), IXR_FRAME_QUEUE);
+    controller.Queued(now);
+  }
+  EXPECT_EQ(controller.Offer(now, true, false), IXR_FRAME_HOLD);
+  EXPECT_EQ(controller.Offer(now, true, true), IXR_FRAME_HOLD);
+  controller.Completed(now);
+  EXPECT_TRUE(controller.Overloaded());
+  controller.Completed(now);
+  EXPECT_FALSE(controller.Overloaded());
+  auto stat = controller.GetStat();
+  EXPECT_EQ(stat.offered, 6U);
+  EXPECT_EQ(stat.queued, 4U);
+  EXPECT_EQ(stat.encoded, 2U);
+  EXPECT_EQ(stat.droppedOldest, 1U);
+  EXPECT_EQ(stat.overloads, 1U);
+  EXPECT_EQ(stat.depth, 2U);
+  EXPECT_EQ(stat.maxDepth, 4U);
+  EXPECT_EQ(stat.maxLatency, now);
+  // frames that can't be copied wait for a free buffer
+  controller.Reset(4, false);
+  EXPECT_EQ(controller.Offer(now, true, false), IXR_FRAME_STALL);
+  EXPECT_EQ(controller.GetStat().stalled, 1U);
+}
+
 TEST_F(IntelCodecTest, H264DecodeIntoCpuRGB4) {
   ixr::CodecConfig par{};
   par.codec = ixr::IXR_CODEC_AVC;
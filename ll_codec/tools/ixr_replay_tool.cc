@@ -0,0 +1,119 @@
+/********************************************************************
+Copyright 2026 Tang, Wenyi. All Rights Reserved.
+Description : Replay a codec capture and report the throughput
+Author      : Wenyi Tang
+Email       : wenyi.tang@intel.com
+Created     : Oct. 19th, 2026
+changelog
+********************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "ll_codec/codec/ixr_replay.h"
+
+using namespace ixr;
+
+namespace {
+void Usage() {
+  std::printf(
+      "usage: ixr_replay <capture> [--pacing max|recorded|realtime]\n"
+      "                  [--vendor recorded|intel|nvidia|software]\n"
+      "                  [--quality psnr,ssim,msssim]\n");
+}
+
+// run the recorded session on another backend
+CodecConfig Retarget(const CodecConfig &config, const std::string &vendor) {
+  CodecConfig c = config;
+  AdapterVendor vid = c.adapter;
+  if (vendor == "intel" || vendor == "software") vid = IXR_CODEC_VID_INTEL;
+  if (vendor == "nvidia") vid = IXR_CODEC_VID_NVIDIA;
+  if (vid != c.adapter) {
+    // the vendor specific configurations are meaningless to others
+    constexpr size_t kSize = std::max(
+        {sizeof(ConfigGPUSpecificIntel), sizeof(ConfigGPUSpecificNvidia),
+         sizeof(ConfigGPUSpecificAmd)});
+    std::memset(&c.intel, 0, kSize);
+    c.adapter = vid;
+  }
+  if (vendor == "software") c.intel.useSoftware = 1;
+  return c;
+}
+
+// comma separated names of metrics
+uint32_t Metrics(const std::string &names) {
+  uint32_t metrics = 0;
+  size_t begin = 0;
+  while (begin <= names.size()) {
+    size_t end = names.find(',', begin);
+    if (end == std::string::npos) end = names.size();
+    const std::string name = names.substr(begin, end - begin);
+    if (name == "psnr") metrics |= IXR_QUALITY_PSNR;
+    if (name == "ssim") metrics |= IXR_QUALITY_SSIM;
+    if (name == "msssim") metrics |= IXR_QUALITY_MSSSIM;
+    begin = end + 1;
+  }
+  return metrics;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    Usage();
+    return 1;
+  }
+  ReplayPacing pacing = IXR_REPLAY_MAXIMUM;
+  std::string vendor = "recorded";
+  uint32_t metrics = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    const std::string key = argv[i], value = argv[i + 1];
+    if (key == "--pacing" && value == "max") {
+      pacing = IXR_REPLAY_MAXIMUM;
+    } else if (key == "--pacing" && value == "recorded") {
+      pacing = IXR_REPLAY_RECORDED;
+    } else if (key == "--pacing" && value == "realtime") {
+      pacing = IXR_REPLAY_REALTIME;
+    } else if (key == "--vendor") {
+      vendor = value;
+    } else if (key == "--quality" && Metrics(value)) {
+      metrics = Metrics(value);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  CaptureReader reader(CaptureReader::FileSource(argv[1]));
+  Replayer replayer(
+      [&](const CodecConfig &config) {
+        auto c = Retarget(config, vendor);
+        auto codec = Encoder::Create(c.adapter);
+        if (codec) codec->Allocate(c);
+        return codec;
+      },
+      [&](CodecConfig &config, void *nalu, uint32_t size) {
+        auto c = Retarget(config, vendor);
+        auto codec = Decoder::Create(c.adapter);
+        if (codec) codec->Allocate(c, nalu, size);
+        return codec;
+      });
+  replayer.SetLoopback(metrics);
+  ReplayReport r;
+  const int ret = replayer.Run(&reader, pacing, &r);
+  std::printf("frames %llu, outputs %llu, bytes %llu, late %llu, "
+              "mismatch %llu\n",
+              (unsigned long long)r.frames, (unsigned long long)r.outputs,
+              (unsigned long long)r.bytes, (unsigned long long)r.late,
+              (unsigned long long)r.mismatch);
+  std::printf("%.3f s, %.2f fps\n", r.seconds, r.fps);
+  std::printf("latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+              r.latencyP50, r.latencyP90, r.latencyP99, r.latencyMax);
+  if (r.scored) {
+    std::printf("quality of %llu frames: psnr %.2f dB (y %.2f, u %.2f, "
+                "v %.2f), ssim %.4f, ms-ssim %.4f\n",
+                (unsigned long long)r.scored, r.quality.psnrAll,
+                r.quality.psnr[0], r.quality.psnr[1], r.quality.psnr[2],
+                r.quality.ssim, r.quality.msssim);
+  }
+  if (ret != 0) std::printf("replay failed\n");
+  return ret == 0 ? 0 : 2;
+}